@@ -0,0 +1,396 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "alpha_blend.h"
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+using namespace dcpomatic;
+
+
+#ifdef __SSE2__
+
+
+/** @return floor(v / 255) for each 16-bit lane, where each v is at most 255 * 255 */
+static inline __m128i
+divide_by_255 (__m128i v)
+{
+	return _mm_srli_epi16 (_mm_add_epi16(_mm_add_epi16(v, _mm_set1_epi16(1)), _mm_srli_epi16(v, 8)), 8);
+}
+
+
+/** Blend eight 8-bit samples held in 16-bit lanes */
+static inline __m128i
+blend_8_bit (__m128i target, __m128i overlay, __m128i alpha)
+{
+	auto const sum = _mm_add_epi16 (_mm_mullo_epi16(overlay, alpha), _mm_mullo_epi16(target, _mm_sub_epi16(_mm_set1_epi16(255), alpha)));
+	return divide_by_255 (sum);
+}
+
+
+/** @return floor(v / 255) for each 32-bit lane, where each v is at most 65535 * 255 */
+static inline __m128i
+divide_by_255_32 (__m128i v)
+{
+	/* This is either right or one too small */
+	auto const q = _mm_srli_epi32 (_mm_add_epi32(v, _mm_srli_epi32(v, 8)), 8);
+	auto const remainder = _mm_sub_epi32 (v, _mm_sub_epi32(_mm_slli_epi32(q, 8), q));
+	return _mm_sub_epi32 (q, _mm_cmpgt_epi32(remainder, _mm_set1_epi32(254)));
+}
+
+
+/** @return 32-bit lanes of low followed by those of high, packed into unsigned 16-bit lanes */
+static inline __m128i
+pack_32_to_16 (__m128i low, __m128i high)
+{
+	/* There is no unsigned 32-to-16-bit pack in SSE2, so offset into signed range and back */
+	auto const offset = _mm_set1_epi32 (32768);
+	return _mm_xor_si128 (
+		_mm_packs_epi32(_mm_sub_epi32(low, offset), _mm_sub_epi32(high, offset)),
+		_mm_set1_epi16(static_cast<int16_t>(0x8000))
+		);
+}
+
+
+/** Blend eight 16-bit samples */
+static inline __m128i
+blend_16_bit (__m128i target, __m128i overlay, __m128i alpha)
+{
+	auto const beta = _mm_sub_epi16 (_mm_set1_epi16(255), alpha);
+	auto const overlay_low = _mm_mullo_epi16 (overlay, alpha);
+	auto const overlay_high = _mm_mulhi_epu16 (overlay, alpha);
+	auto const target_low = _mm_mullo_epi16 (target, beta);
+	auto const target_high = _mm_mulhi_epu16 (target, beta);
+	auto const sum0 = _mm_add_epi32 (_mm_unpacklo_epi16(overlay_low, overlay_high), _mm_unpacklo_epi16(target_low, target_high));
+	auto const sum1 = _mm_add_epi32 (_mm_unpackhi_epi16(overlay_low, overlay_high), _mm_unpackhi_epi16(target_low, target_high));
+	return pack_32_to_16 (divide_by_255_32(sum0), divide_by_255_32(sum1));
+}
+
+
+/** Blend two 4-sample pixels held in 16-bit lanes.
+ *  @param target Target pixels; the 4th sample of each is a don't-care if the target has no alpha.
+ *  @param overlay Overlay pixels, with samples in the same order as target and alpha as the 4th.
+ */
+static inline __m128i
+blend_two_pixels (__m128i target, __m128i overlay)
+{
+	auto const alpha = _mm_shufflehi_epi16 (_mm_shufflelo_epi16(overlay, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	return blend_8_bit (target, overlay, alpha);
+}
+
+
+/** Swap the 1st and 3rd samples of two 4-sample pixels held in 16-bit lanes */
+static inline __m128i
+swap_red_blue (__m128i x)
+{
+	return _mm_shufflehi_epi16 (_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+
+/** Spread two 3-sample pixels in lanes 0-5 out to two 4-sample pixels, leaving
+ *  lanes 3 and 7 as don't-cares.
+ */
+static inline __m128i
+spread (__m128i x)
+{
+	return _mm_castpd_si128 (_mm_move_sd(_mm_castsi128_pd(_mm_slli_si128(x, 2)), _mm_castsi128_pd(x)));
+}
+
+
+/** The opposite of spread(), leaving lanes 6 and 7 as zero */
+static inline __m128i
+gather (__m128i x)
+{
+	auto const first = _mm_set_epi16 (0, 0, 0, 0, 0, -1, -1, -1);
+	auto const second = _mm_set_epi16 (0, 0, -1, -1, -1, 0, 0, 0);
+	return _mm_or_si128 (_mm_and_si128(x, first), _mm_and_si128(_mm_srli_si128(x, 2), second));
+}
+
+
+#endif
+
+
+/** Blend a row of an RGBA or BGRA overlay onto a row of a packed image.
+ *  @param target First pixel of the target.
+ *  @param format Target's pixel format.
+ *  @param overlay First pixel of the overlay.
+ *  @param overlay_bgra true if the overlay is BGRA, false if it is RGBA.
+ *  @param pixels Number of pixels to blend.
+ */
+void
+dcpomatic::alpha_blend_packed_row (uint8_t* target, PackedBlendTarget format, uint8_t const* overlay, bool overlay_bgra, int pixels)
+{
+	/* true if the overlay's red and blue must be swapped to match the target */
+	bool const swap = overlay_bgra ? format != PackedBlendTarget::BGRA : format == PackedBlendTarget::BGRA;
+	int x = 0;
+
+#ifdef __SSE2__
+	auto const zero = _mm_setzero_si128 ();
+	auto const low_bytes = _mm_set1_epi16 (0xff);
+
+	/* Four pixels at a time */
+	for (; x <= pixels - 4; x += 4) {
+		auto const o = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(overlay));
+		auto o0 = _mm_unpacklo_epi8 (o, zero);
+		auto o1 = _mm_unpackhi_epi8 (o, zero);
+		if (swap) {
+			o0 = swap_red_blue (o0);
+			o1 = swap_red_blue (o1);
+		}
+		overlay += 16;
+
+		switch (format) {
+		case PackedBlendTarget::BGRA:
+		case PackedBlendTarget::RGBA:
+		{
+			auto const t = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(target));
+			auto const r0 = blend_two_pixels (_mm_unpacklo_epi8(t, zero), o0);
+			auto const r1 = blend_two_pixels (_mm_unpackhi_epi8(t, zero), o1);
+			_mm_storeu_si128 (reinterpret_cast<__m128i*>(target), _mm_packus_epi16(r0, r1));
+			target += 16;
+			break;
+		}
+		case PackedBlendTarget::RGB24:
+		{
+			/* 12 bytes; t0 is r0 g0 b0 r1 g1 b1 r2 g2 and t1 is b2 r3 g3 b3 */
+			int32_t tail;
+			memcpy (&tail, target + 8, 4);
+			auto const t0 = _mm_unpacklo_epi8 (_mm_loadl_epi64(reinterpret_cast<__m128i const*>(target)), zero);
+			auto const t1 = _mm_unpacklo_epi8 (_mm_cvtsi32_si128(tail), zero);
+			/* r2 g2 b2 r3 g3 b3 */
+			auto const t2 = _mm_or_si128 (_mm_srli_si128(t0, 12), _mm_slli_si128(t1, 4));
+			auto const r0 = gather (blend_two_pixels(spread(t0), o0));
+			auto const r1 = gather (blend_two_pixels(spread(t2), o1));
+			auto const result = _mm_packus_epi16 (_mm_or_si128(r0, _mm_slli_si128(r1, 12)), _mm_srli_si128(r1, 4));
+			_mm_storel_epi64 (reinterpret_cast<__m128i*>(target), result);
+			tail = _mm_cvtsi128_si32 (_mm_srli_si128(result, 8));
+			memcpy (target + 8, &tail, 4);
+			target += 12;
+			break;
+		}
+		case PackedBlendTarget::RGB48LE:
+		{
+			/* 24 bytes; t0 is r0 g0 b0 r1 g1 b1 r2 g2 and t1 is b2 r3 g3 b3 */
+			auto const t0 = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(target));
+			auto const t1 = _mm_loadl_epi64 (reinterpret_cast<__m128i const*>(target + 16));
+			auto const t2 = _mm_or_si128 (_mm_srli_si128(t0, 12), _mm_slli_si128(t1, 4));
+			/* Blend the high bytes */
+			auto const r0 = gather (blend_two_pixels(spread(_mm_srli_epi16(t0, 8)), o0));
+			auto const r1 = gather (blend_two_pixels(spread(_mm_srli_epi16(t2, 8)), o1));
+			/* and put the low bytes back */
+			auto const result0 = _mm_or_si128 (_mm_slli_epi16(_mm_or_si128(r0, _mm_slli_si128(r1, 12)), 8), _mm_and_si128(t0, low_bytes));
+			auto const result1 = _mm_or_si128 (_mm_slli_epi16(_mm_srli_si128(r1, 4), 8), _mm_and_si128(t1, low_bytes));
+			_mm_storeu_si128 (reinterpret_cast<__m128i*>(target), result0);
+			_mm_storel_epi64 (reinterpret_cast<__m128i*>(target + 16), result1);
+			target += 24;
+			break;
+		}
+		}
+	}
+#endif
+
+	int const red = overlay_bgra ? 2 : 0;
+	int const blue = overlay_bgra ? 0 : 2;
+
+	for (; x < pixels; ++x) {
+		int const alpha = overlay[3];
+		switch (format) {
+		case PackedBlendTarget::RGB24:
+			target[0] = alpha_blend_sample<uint8_t>(target[0], overlay[red], alpha);
+			target[1] = alpha_blend_sample<uint8_t>(target[1], overlay[1], alpha);
+			target[2] = alpha_blend_sample<uint8_t>(target[2], overlay[blue], alpha);
+			target += 3;
+			break;
+		case PackedBlendTarget::BGRA:
+			target[0] = alpha_blend_sample<uint8_t>(target[0], overlay[blue], alpha);
+			target[1] = alpha_blend_sample<uint8_t>(target[1], overlay[1], alpha);
+			target[2] = alpha_blend_sample<uint8_t>(target[2], overlay[red], alpha);
+			target[3] = alpha_blend_sample<uint8_t>(target[3], overlay[3], alpha);
+			target += 4;
+			break;
+		case PackedBlendTarget::RGBA:
+			target[0] = alpha_blend_sample<uint8_t>(target[0], overlay[red], alpha);
+			target[1] = alpha_blend_sample<uint8_t>(target[1], overlay[1], alpha);
+			target[2] = alpha_blend_sample<uint8_t>(target[2], overlay[blue], alpha);
+			target[3] = alpha_blend_sample<uint8_t>(target[3], overlay[3], alpha);
+			target += 4;
+			break;
+		case PackedBlendTarget::RGB48LE:
+			target[1] = alpha_blend_sample<uint8_t>(target[1], overlay[red], alpha);
+			target[3] = alpha_blend_sample<uint8_t>(target[3], overlay[1], alpha);
+			target[5] = alpha_blend_sample<uint8_t>(target[5], overlay[blue], alpha);
+			target += 6;
+			break;
+		}
+		overlay += 4;
+	}
+}
+
+
+/** Copy the alpha channel out of a row of an RGBA or BGRA image */
+void
+dcpomatic::alpha_blend_extract_alpha (uint8_t const* overlay, int pixels, uint16_t* alpha)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	for (; x <= pixels - 8; x += 8) {
+		auto const a0 = _mm_srli_epi32 (_mm_loadu_si128(reinterpret_cast<__m128i const*>(overlay)), 24);
+		auto const a1 = _mm_srli_epi32 (_mm_loadu_si128(reinterpret_cast<__m128i const*>(overlay + 16)), 24);
+		_mm_storeu_si128 (reinterpret_cast<__m128i*>(alpha), _mm_packs_epi32(a0, a1));
+		overlay += 32;
+		alpha += 8;
+	}
+#endif
+
+	for (; x < pixels; ++x) {
+		*alpha++ = overlay[3];
+		overlay += 4;
+	}
+}
+
+
+/** Blend a row of one plane of an overlay onto the same plane of a target image,
+ *  using one alpha value for each sample.
+ */
+void
+dcpomatic::alpha_blend_planar_row (uint8_t* target, uint8_t const* overlay, uint16_t const* alpha, int samples)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	auto const zero = _mm_setzero_si128 ();
+	for (; x <= samples - 8; x += 8) {
+		auto const t = _mm_unpacklo_epi8 (_mm_loadl_epi64(reinterpret_cast<__m128i const*>(target)), zero);
+		auto const o = _mm_unpacklo_epi8 (_mm_loadl_epi64(reinterpret_cast<__m128i const*>(overlay)), zero);
+		auto const a = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(alpha));
+		auto const r = blend_8_bit (t, o, a);
+		_mm_storel_epi64 (reinterpret_cast<__m128i*>(target), _mm_packus_epi16(r, r));
+		target += 8;
+		overlay += 8;
+		alpha += 8;
+	}
+#endif
+
+	for (; x < samples; ++x) {
+		*target = alpha_blend_sample<uint8_t>(*target, *overlay++, *alpha++);
+		++target;
+	}
+}
+
+
+void
+dcpomatic::alpha_blend_planar_row (uint16_t* target, uint16_t const* overlay, uint16_t const* alpha, int samples)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	for (; x <= samples - 8; x += 8) {
+		auto const t = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(target));
+		auto const o = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(overlay));
+		auto const a = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(alpha));
+		_mm_storeu_si128 (reinterpret_cast<__m128i*>(target), blend_16_bit(t, o, a));
+		target += 8;
+		overlay += 8;
+		alpha += 8;
+	}
+#endif
+
+	for (; x < samples; ++x) {
+		*target = alpha_blend_sample<uint16_t>(*target, *overlay++, *alpha++);
+		++target;
+	}
+}
+
+
+/** Blend a row of a horizontally-subsampled plane of an overlay onto the same plane of
+ *  a target.  Each target sample covers two pixels, and is blended first with the
+ *  first pixel's overlay sample and alpha and then with the second's.
+ *  @param target Target samples.
+ *  @param overlay_even Overlay samples for the first pixel of each pair.
+ *  @param overlay_odd Overlay samples for the second pixel of each pair.
+ *  @param alpha Alpha for each pixel (i.e. two values for each target sample).
+ *  @param samples Number of target samples.
+ */
+void
+dcpomatic::alpha_blend_chroma_row (uint8_t* target, uint8_t const* overlay_even, uint8_t const* overlay_odd, uint16_t const* alpha, int samples)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	auto const zero = _mm_setzero_si128 ();
+	auto const low = _mm_set1_epi32 (0xffff);
+	for (; x <= samples - 8; x += 8) {
+		auto const a0 = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(alpha));
+		auto const a1 = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(alpha + 8));
+		auto const even = _mm_packs_epi32 (_mm_and_si128(a0, low), _mm_and_si128(a1, low));
+		auto const odd = _mm_packs_epi32 (_mm_srli_epi32(a0, 16), _mm_srli_epi32(a1, 16));
+		auto t = _mm_unpacklo_epi8 (_mm_loadl_epi64(reinterpret_cast<__m128i const*>(target)), zero);
+		t = blend_8_bit (t, _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(overlay_even)), zero), even);
+		t = blend_8_bit (t, _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(overlay_odd)), zero), odd);
+		_mm_storel_epi64 (reinterpret_cast<__m128i*>(target), _mm_packus_epi16(t, t));
+		target += 8;
+		overlay_even += 8;
+		overlay_odd += 8;
+		alpha += 16;
+	}
+#endif
+
+	for (; x < samples; ++x) {
+		auto const t = alpha_blend_sample<uint8_t>(*target, *overlay_even++, alpha[0]);
+		*target++ = alpha_blend_sample<uint8_t>(t, *overlay_odd++, alpha[1]);
+		alpha += 2;
+	}
+}
+
+
+void
+dcpomatic::alpha_blend_chroma_row (uint16_t* target, uint16_t const* overlay_even, uint16_t const* overlay_odd, uint16_t const* alpha, int samples)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	auto const low = _mm_set1_epi32 (0xffff);
+	for (; x <= samples - 8; x += 8) {
+		auto const a0 = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(alpha));
+		auto const a1 = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(alpha + 8));
+		auto const even = _mm_packs_epi32 (_mm_and_si128(a0, low), _mm_and_si128(a1, low));
+		auto const odd = _mm_packs_epi32 (_mm_srli_epi32(a0, 16), _mm_srli_epi32(a1, 16));
+		auto t = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(target));
+		t = blend_16_bit (t, _mm_loadu_si128(reinterpret_cast<__m128i const*>(overlay_even)), even);
+		t = blend_16_bit (t, _mm_loadu_si128(reinterpret_cast<__m128i const*>(overlay_odd)), odd);
+		_mm_storeu_si128 (reinterpret_cast<__m128i*>(target), t);
+		target += 8;
+		overlay_even += 8;
+		overlay_odd += 8;
+		alpha += 16;
+	}
+#endif
+
+	for (; x < samples; ++x) {
+		auto const t = alpha_blend_sample<uint16_t>(*target, *overlay_even++, alpha[0]);
+		*target++ = alpha_blend_sample<uint16_t>(t, *overlay_odd++, alpha[1]);
+		alpha += 2;
+	}
+}
@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  src/lib/alpha_blend.h
+ *  @brief Kernels to blend rows of an RGBA or BGRA overlay onto other images.
+ *
+ *  All of these compute (overlay * alpha + target * (255 - alpha)) / 255 for each
+ *  sample, rounding down, and use SSE2 where it is available.  The results are the
+ *  same with or without SSE2.
+ */
+
+
+#ifndef DCPOMATIC_ALPHA_BLEND_H
+#define DCPOMATIC_ALPHA_BLEND_H
+
+
+#include <stdint.h>
+
+
+namespace dcpomatic {
+
+
+/** Packed pixel formats that can be blended onto by alpha_blend_packed_row() */
+enum class PackedBlendTarget
+{
+	RGB24,
+	BGRA,
+	RGBA,
+	/** Only the high byte of each sample is blended */
+	RGB48LE
+};
+
+
+/** @return target with overlay blended on top of it */
+template <class T>
+T
+alpha_blend_sample (T target, T overlay, int alpha)
+{
+	return (overlay * alpha + target * (255 - alpha)) / 255;
+}
+
+
+extern void alpha_blend_packed_row (uint8_t* target, PackedBlendTarget format, uint8_t const* overlay, bool overlay_bgra, int pixels);
+extern void alpha_blend_extract_alpha (uint8_t const* overlay, int pixels, uint16_t* alpha);
+extern void alpha_blend_planar_row (uint8_t* target, uint8_t const* overlay, uint16_t const* alpha, int samples);
+extern void alpha_blend_planar_row (uint16_t* target, uint16_t const* overlay, uint16_t const* alpha, int samples);
+extern void alpha_blend_chroma_row (uint8_t* target, uint8_t const* overlay_even, uint8_t const* overlay_odd, uint16_t const* alpha, int samples);
+extern void alpha_blend_chroma_row (uint16_t* target, uint16_t const* overlay_even, uint16_t const* overlay_odd, uint16_t const* alpha, int samples);
+
+
+}
+
+
+#endif
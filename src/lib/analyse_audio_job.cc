@@ -21,6 +21,8 @@
 
 #include "analyse_audio_job.h"
 #include "audio_analysis.h"
+#include "audio_analysis_blocks.h"
+#include "audio_content.h"
 #include "compose.hpp"
 #include "dcpomatic_log.h"
 #include "film.h"
@@ -28,7 +30,9 @@
 #include "player.h"
 #include "playlist.h"
 #include "config.h"
+#include <boost/algorithm/string/predicate.hpp>
 #include <iostream>
+#include <set>
 
 #include "i18n.h"
 
@@ -83,32 +87,129 @@ AnalyseAudioJob::run ()
 {
 	LOG_DEBUG_AUDIO_ANALYSIS_NC("AnalyseAudioJob::run");
 
-	auto player = make_shared<Player>(_film, _playlist);
+	/* There's no point in making blocks for a single piece of content, as its analysis
+	   does not depend on its position anyway.
+	*/
+	if (_playlist->content().size() != 1 && can_assemble_audio_analysis(_film, _playlist)) {
+		assemble_audio_analysis(_film, _playlist, _analyser.start(), blocks()).write(_path);
+	} else {
+		analyse (_playlist, _analyser);
+		LOG_DEBUG_AUDIO_ANALYSIS_NC("Loop complete");
+		_analyser.finish ();
+		_analyser.get().write(_path);
+	}
+
+	LOG_DEBUG_AUDIO_ANALYSIS_NC("Job finished");
+	set_progress (1);
+	set_state (FINISHED_OK);
+}
+
+
+/** Run the audio from a playlist through an analyser */
+void
+AnalyseAudioJob::analyse (shared_ptr<const Playlist> playlist, AudioAnalyser& analyser)
+{
+	auto player = make_shared<Player>(_film, playlist);
 	player->set_ignore_video ();
 	player->set_ignore_text ();
 	player->set_fast ();
 	player->set_play_referenced ();
-	player->Audio.connect (bind(&AudioAnalyser::analyse, &_analyser, _1, _2));
+	player->Audio.connect (bind(&AudioAnalyser::analyse, &analyser, _1, _2));
 
 	bool has_any_audio = false;
-	for (auto c: _playlist->content()) {
+	for (auto c: playlist->content()) {
 		if (c->audio) {
 			has_any_audio = true;
 		}
 	}
 
 	if (has_any_audio) {
-		player->seek (_analyser.start(), true);
+		player->seek (analyser.start(), true);
 		while (!player->pass ()) {}
 	}
+}
 
-	LOG_DEBUG_AUDIO_ANALYSIS_NC("Loop complete");
 
-	_analyser.finish ();
-	auto analysis = _analyser.get();
-	analysis.write (_path);
+/** @return an analysis of each piece of content in _playlist which has audio, in
+ *  the order of Playlist::content(), re-using any which we already have.
+ */
+vector<AudioAnalysis>
+AnalyseAudioJob::blocks ()
+{
+	DCPTime total;
+	for (auto i: _playlist->content()) {
+		if (i->audio) {
+			total += i->length_after_trim(_film);
+		}
+	}
 
-	LOG_DEBUG_AUDIO_ANALYSIS_NC("Job finished");
-	set_progress (1);
-	set_state (FINISHED_OK);
+	vector<AudioAnalysis> blocks;
+	DCPTime done;
+
+	for (auto i: _playlist->content()) {
+		if (!i->audio) {
+			continue;
+		}
+
+		auto const path = _film->audio_analysis_block_path(i);
+		auto const length = i->length_after_trim(_film);
+
+		if (boost::filesystem::exists(path)) {
+			try {
+				AudioAnalysis block (path);
+				if (block.frames()) {
+					LOG_DEBUG_AUDIO_ANALYSIS("Using existing analysis of %1", i->path_summary());
+					blocks.push_back (block);
+					done += length;
+					continue;
+				}
+			} catch (...) {
+				/* Probably an old or broken file; make it again */
+			}
+		}
+
+		LOG_DEBUG_AUDIO_ANALYSIS("Analysing %1", i->path_summary());
+		auto playlist = make_shared<Playlist>();
+		playlist->add (_film, i);
+		AudioAnalyser analyser (
+			_film, playlist, false,
+			[this, done, length, total](float p) {
+				set_progress ((done.seconds() + length.seconds() * p) / total.seconds());
+			},
+			true
+			);
+		analyse (playlist, analyser);
+		analyser.finish ();
+		auto block = analyser.get ();
+		block.write (path);
+		blocks.push_back (block);
+		done += length;
+	}
+
+	remove_unused_blocks ();
+
+	return blocks;
+}
+
+
+/** Remove any block analyses which are not for the film's current content, as they will
+ *  be for content which has been removed or whose audio settings have since changed.
+ */
+void
+AnalyseAudioJob::remove_unused_blocks ()
+{
+	std::set<boost::filesystem::path> wanted;
+	for (auto i: _film->content()) {
+		if (i->audio) {
+			wanted.insert (_film->audio_analysis_block_path(i));
+		}
+	}
+
+	boost::system::error_code ec;
+	for (auto i: boost::filesystem::directory_iterator(_film->dir("analysis"), ec)) {
+		if (boost::starts_with(i.path().filename().string(), "block_") && wanted.find(i.path()) == wanted.end()) {
+			LOG_DEBUG_AUDIO_ANALYSIS("Removing unused analysis %1", i.path().string());
+			boost::filesystem::remove (i.path(), ec);
+		}
+	}
 }
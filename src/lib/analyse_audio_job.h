@@ -25,12 +25,14 @@
 
 
 #include "audio_analyser.h"
+#include "audio_analysis.h"
 #include "job.h"
 #include "audio_point.h"
 #include "types.h"
 #include "dcpomatic_time.h"
 #include <leqm_nrt.h>
 #include <boost/scoped_ptr.hpp>
+#include <vector>
 
 
 class AudioBuffers;
@@ -46,7 +48,9 @@ class Filter;
  *  broad peak and RMS levels.
  *
  *  After computing the peak and RMS levels the job will write a file
- *  to Film::audio_analysis_path.
+ *  to Film::audio_analysis_path.  Where possible an analysis of several
+ *  pieces of content is made from analyses of each one, which are kept
+ *  at Film::audio_analysis_block_path so that they can be used again.
  */
 class AnalyseAudioJob : public Job
 {
@@ -66,6 +70,10 @@ public:
 	}
 
 private:
+	void analyse (std::shared_ptr<const Playlist> playlist, AudioAnalyser& analyser);
+	std::vector<AudioAnalysis> blocks ();
+	void remove_unused_blocks ();
+
 	AudioAnalyser _analyser;
 
 	std::shared_ptr<const Playlist> _playlist;
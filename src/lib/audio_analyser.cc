@@ -24,12 +24,14 @@
 #include "audio_buffers.h"
 #include "audio_content.h"
 #include "audio_filter_graph.h"
+#include "audio_kernels.h"
 #include "audio_point.h"
 #include "config.h"
 #include "dcpomatic_log.h"
 #include "film.h"
 #include "filter.h"
 #include "playlist.h"
+#include "slice_pool.h"
 #include "types.h"
 #include <dcp/warnings.h>
 extern "C" {
@@ -45,18 +47,29 @@ LIBDCP_ENABLE_WARNINGS
 
 using std::make_shared;
 using std::max;
+using std::min;
 using std::shared_ptr;
 using std::vector;
 using namespace dcpomatic;
 
 
-static auto constexpr num_points = 1024;
+int constexpr AudioAnalyser::num_points;
+float constexpr AudioAnalyser::floor_level;
 
+/** Number of points to use for blocks; this is more than num_points so that an
+ *  analysis assembled from blocks has points which are about the right size.
+ */
+static auto constexpr block_points = 8192;
 
-AudioAnalyser::AudioAnalyser (shared_ptr<const Film> film, shared_ptr<const Playlist> playlist, bool from_zero, std::function<void (float)> set_progress)
+
+/** @param block true to make an analysis of a playlist containing one piece of content,
+ *  which can be used as part of an analysis of a bigger playlist.
+ */
+AudioAnalyser::AudioAnalyser (shared_ptr<const Film> film, shared_ptr<const Playlist> playlist, bool from_zero, std::function<void (float)> set_progress, bool block)
 	: _film (film)
 	, _playlist (playlist)
 	, _set_progress (set_progress)
+	, _block (block)
 #ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
 	, _ebur128 (new AudioFilterGraph(film->audio_frame_rate(), film->audio_channels()))
 #endif
@@ -89,7 +102,7 @@ AudioAnalyser::AudioAnalyser (shared_ptr<const Film> film, shared_ptr<const Play
 
 	int leqm_channels = film->audio_channels();
 	auto content = _playlist->content();
-	if (content.size() == 1 && content[0]->audio) {
+	if (!_block && content.size() == 1 && content[0]->audio) {
 		leqm_channels = content[0]->audio->mapping().mapped_output_channels().size();
 	}
 
@@ -121,7 +134,7 @@ AudioAnalyser::AudioAnalyser (shared_ptr<const Film> film, shared_ptr<const Play
 	DCPTime const length = _playlist->length (_film);
 
 	Frame const len = DCPTime (length - _start).frames_round (film->audio_frame_rate());
-	_samples_per_point = max (int64_t (1), len / num_points);
+	_samples_per_point = max (int64_t (1), len / (_block ? block_points : num_points));
 }
 
 
@@ -139,46 +152,37 @@ AudioAnalyser::analyse (shared_ptr<AudioBuffers> b, DCPTime time)
 	LOG_DEBUG_AUDIO_ANALYSIS("Received %1 frames at %2", b->frames(), to_string(time));
 	DCPOMATIC_ASSERT (time >= _start);
 
-#ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
-	if (Config::instance()->analyse_ebur128 ()) {
-		_ebur128->process (b);
-	}
-#endif
-
 	int const frames = b->frames ();
 	int const channels = b->channels ();
-	vector<double> interleaved(frames * channels);
-
-	for (int j = 0; j < channels; ++j) {
-		float const* data = b->data(j);
-		for (int i = 0; i < frames; ++i) {
-			float s = data[i];
-
-			interleaved[i * channels + j] = s;
+	_interleaved.resize (frames * channels);
 
-			float as = fabsf (s);
-			if (as < 10e-7) {
-				/* We may struggle to serialise and recover inf or -inf, so prevent such
-				   values by replacing with this (140dB down) */
-				s = as = 10e-7;
-			}
-			_current[j][AudioPoint::RMS] += pow (s, 2);
-			_current[j][AudioPoint::PEAK] = max (_current[j][AudioPoint::PEAK], as);
+#ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
+	bool const ebur128 = Config::instance()->analyse_ebur128 ();
+#endif
 
-			if (as > _sample_peak[j]) {
-				_sample_peak[j] = as;
-				_sample_peak_frame[j] = _done + i;
+	/* Leq(m), EBU R128 and the peak/RMS of each channel are independent of each other,
+	   so do them all at the same time.
+	*/
+	SlicePool::instance()->run(channels + 2, [&](int slice) {
+		if (slice == 0) {
+			auto out = _interleaved.data();
+			for (int j = 0; j < channels; ++j) {
+				float const* data = b->data(j);
+				for (int i = 0; i < frames; ++i) {
+					out[i * channels + j] = data[i];
+				}
 			}
-
-			if (((_done + i) % _samples_per_point) == 0) {
-				_current[j][AudioPoint::RMS] = sqrt (_current[j][AudioPoint::RMS] / _samples_per_point);
-				_analysis.add_point (j, _current[j]);
-				_current[j] = AudioPoint ();
+			_leqm->add(_interleaved);
+		} else if (slice == 1) {
+#ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
+			if (ebur128) {
+				_ebur128->process (b);
 			}
+#endif
+		} else {
+			analyse_channel (b->data(slice - 2), slice - 2, frames);
 		}
-	}
-
-	_leqm->add(interleaved);
+	});
 
 	_done += frames;
 
@@ -188,6 +192,48 @@ AudioAnalyser::analyse (shared_ptr<AudioBuffers> b, DCPTime time)
 }
 
 
+/** Add some samples of one channel to the peak/RMS points and the sample peak.
+ *  This only touches state belonging to the given channel, so it can be run for
+ *  different channels at the same time.
+ */
+void
+AudioAnalyser::analyse_channel (float const* data, int channel, int frames)
+{
+	auto& current = _current[channel];
+
+	int i = 0;
+	while (i < frames) {
+		/* Take everything up to and including the next sample which finishes a point */
+		Frame const to_end = (_samples_per_point - (_done + i) % _samples_per_point) % _samples_per_point;
+		int const n = static_cast<int>(min(static_cast<Frame>(frames - i), to_end + 1));
+
+		float peak;
+		double sum_of_squares;
+		audio_peak_and_power (data + i, n, floor_level, peak, sum_of_squares);
+		current[AudioPoint::RMS] += sum_of_squares;
+		current[AudioPoint::PEAK] = max (current[AudioPoint::PEAK], peak);
+
+		if (peak > _sample_peak[channel]) {
+			/* Find the first sample at this level */
+			int j = 0;
+			while (j < n - 1 && max(fabsf(data[i + j]), floor_level) != peak) {
+				++j;
+			}
+			_sample_peak[channel] = peak;
+			_sample_peak_frame[channel] = _done + i + j;
+		}
+
+		if (n == to_end + 1) {
+			current[AudioPoint::RMS] = sqrt (current[AudioPoint::RMS] / _samples_per_point);
+			_analysis.add_point (channel, current);
+			current = AudioPoint ();
+		}
+
+		i += n;
+	}
+}
+
+
 void
 AudioAnalyser::finish ()
 {
@@ -224,4 +270,18 @@ AudioAnalyser::finish ()
 	_analysis.set_samples_per_point (_samples_per_point);
 	_analysis.set_sample_rate (_film->audio_frame_rate ());
 	_analysis.set_leqm (_leqm->leq_m());
+
+	if (_block) {
+		/* Add whatever is left over, since assemble_audio_analysis() needs to know
+		   about all the samples.  Like the other points this is divided by
+		   _samples_per_point however many samples it has.
+		*/
+		if (_done > 0 && ((_done - 1) % _samples_per_point) != 0) {
+			for (int i = 0; i < _film->audio_channels(); ++i) {
+				_current[i][AudioPoint::RMS] = sqrt (_current[i][AudioPoint::RMS] / _samples_per_point);
+				_analysis.add_point (i, _current[i]);
+			}
+		}
+		_analysis.set_frames (_done);
+	}
 }
@@ -39,7 +39,13 @@ class Playlist;
 class AudioAnalyser
 {
 public:
-	AudioAnalyser (std::shared_ptr<const Film> film, std::shared_ptr<const Playlist> playlist, bool from_zero, std::function<void (float)> set_progress);
+	AudioAnalyser (
+		std::shared_ptr<const Film> film,
+		std::shared_ptr<const Playlist> playlist,
+		bool from_zero,
+		std::function<void (float)> set_progress,
+		bool block = false
+		);
 	~AudioAnalyser ();
 
 	AudioAnalyser (AudioAnalyser const&) = delete;
@@ -57,13 +63,26 @@ public:
 		return _analysis;
 	}
 
+	/** Number of points in an analysis of a whole playlist */
+	static int constexpr num_points = 1024;
+	/** Level that we use for any sample which is quieter than it; we may struggle to
+	 *  serialise and recover inf or -inf, so we avoid them by using this (120dB down).
+	 */
+	static float constexpr floor_level = 10e-7f;
+
 private:
+	void analyse_channel (float const* data, int channel, int frames);
+
 	std::shared_ptr<const Film> _film;
 	std::shared_ptr<const Playlist> _playlist;
 
 	std::function<void (float)> _set_progress;
 
 	dcpomatic::DCPTime _start;
+	/** true if we are making an analysis of one piece of content which can be used
+	 *  as part of a bigger analysis (see assemble_audio_analysis())
+	 */
+	bool _block;
 #ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
 	std::shared_ptr<AudioFilterGraph> _ebur128;
 #endif
@@ -75,6 +94,10 @@ private:
 	std::vector<float> _sample_peak;
 	std::vector<Frame> _sample_peak_frame;
 	std::vector<AudioPoint> _current;
+	/** buffer for the interleaved samples that we give to _leqm, kept so that
+	 *  we don't allocate a new one for each call to analyse()
+	 */
+	std::vector<double> _interleaved;
 
 	AudioAnalysis _analysis;
 };
@@ -24,6 +24,7 @@
 #include "util.h"
 #include "playlist.h"
 #include "audio_content.h"
+#include <dcp/file.h>
 #include <dcp/raw_convert.h>
 #include <dcp/warnings.h>
 LIBDCP_DISABLE_WARNINGS
@@ -33,6 +34,7 @@ LIBDCP_ENABLE_WARNINGS
 #include <stdint.h>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <inttypes.h>
 
@@ -54,7 +56,55 @@ using dcp::raw_convert;
 using namespace dcpomatic;
 
 
-int const AudioAnalysis::_current_state_version = 3;
+/* An analysis file is
+ *
+ *   8 bytes:  "DCPOMAA\0"
+ *   uint32:   version (_current_state_version)
+ *   uint32:   length of the metadata
+ *   metadata: XML with everything apart from the points, padded with zeros to a multiple of 4 bytes
+ *   for each channel, its peak values as float32s followed by its RMS values as float32s
+ *
+ * with all numbers little-endian.  Reading and writing the points as XML was slow,
+ * especially for long films with many channels.
+ */
+int const AudioAnalysis::_current_state_version = 4;
+static char const magic[] = "DCPOMAA";
+static int constexpr header_size = 16;
+
+
+static void
+put_uint32 (vector<uint8_t>& data, uint32_t value)
+{
+	for (int i = 0; i < 4; ++i) {
+		data.push_back ((value >> (i * 8)) & 0xff);
+	}
+}
+
+
+static uint32_t
+get_uint32 (uint8_t const* data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+
+static void
+put_float (vector<uint8_t>& data, float value)
+{
+	uint32_t bits;
+	memcpy (&bits, &value, 4);
+	put_uint32 (data, bits);
+}
+
+
+static float
+get_float (uint8_t const* data)
+{
+	auto const bits = get_uint32 (data);
+	float value;
+	memcpy (&value, &bits, 4);
+	return value;
+}
 
 
 AudioAnalysis::AudioAnalysis (int channels)
@@ -65,22 +115,54 @@ AudioAnalysis::AudioAnalysis (int channels)
 
 AudioAnalysis::AudioAnalysis (boost::filesystem::path filename)
 {
-	cxml::Document f ("AudioAnalysis");
-	f.read_file (filename);
+	auto const size = boost::filesystem::file_size (filename);
+	dcp::File file (filename, "rb");
+	if (!file) {
+		throw FileError ("Could not open audio analysis file for reading", filename);
+	}
 
-	if (f.optional_number_child<int>("Version").get_value_or(1) < _current_state_version) {
-		/* Too old.  Throw an exception so that this analysis is re-run. */
+	/* Throw OldFormatError if this isn't an analysis that we can read, so that it is re-made */
+	if (size < header_size) {
 		throw OldFormatError ("Audio analysis file is too old");
 	}
 
-	for (auto i: f.node_children("Channel")) {
-		vector<AudioPoint> channel;
+	uint8_t header[header_size];
+	file.checked_read (header, header_size);
+	if (memcmp(header, magic, sizeof(magic)) != 0 || get_uint32(header + 8) < static_cast<uint32_t>(_current_state_version)) {
+		throw OldFormatError ("Audio analysis file is too old");
+	}
 
-		for (auto j: i->node_children("Point")) {
-			channel.push_back (AudioPoint(j));
+	uint64_t const metadata_length = get_uint32(header + 12);
+	uint64_t offset = header_size + ((metadata_length + 3) & ~3);
+	if (offset > size) {
+		throw OldFormatError ("Audio analysis file is truncated");
+	}
+
+	vector<uint8_t> data (offset - header_size);
+	file.checked_read (data.data(), data.size());
+
+	cxml::Document f ("AudioAnalysis");
+	f.read_string (string(reinterpret_cast<char const*>(data.data()), metadata_length));
+
+	/* Read the points a column at a time, so that we only need space for one column of
+	   raw data as well as the points themselves.
+	*/
+	for (auto i: f.node_children("Channel")) {
+		size_t const points = i->number_attribute<int>("Points");
+		if (offset + points * 8 > size) {
+			throw OldFormatError ("Audio analysis file is truncated");
 		}
 
-		_data.push_back (channel);
+		data.resize (points * 4);
+		_data.push_back (vector<AudioPoint>(points));
+		auto& channel = _data.back();
+		for (auto type: { AudioPoint::PEAK, AudioPoint::RMS }) {
+			file.checked_read (data.data(), data.size());
+			for (size_t j = 0; j < points; ++j) {
+				channel[j][type] = get_float (data.data() + j * 4);
+			}
+		}
+		offset += points * 8;
 	}
 
 	for (auto i: f.node_children ("SamplePeak")) {
@@ -103,6 +185,7 @@ AudioAnalysis::AudioAnalysis (boost::filesystem::path filename)
 	_sample_rate = f.number_child<int64_t>("SampleRate");
 
 	_leqm = f.optional_number_child<double>("Leqm");
+	_frames = f.optional_number_child<Frame>("Frames");
 }
 
 
@@ -140,16 +223,11 @@ AudioAnalysis::points (int c) const
 void
 AudioAnalysis::write (boost::filesystem::path filename)
 {
-	auto doc = make_shared<xmlpp::Document>();
-	xmlpp::Element* root = doc->create_root_node ("AudioAnalysis");
-
-	root->add_child("Version")->add_child_text(raw_convert<string>(_current_state_version));
+	xmlpp::Document doc;
+	auto root = doc.create_root_node ("AudioAnalysis");
 
 	for (auto& i: _data) {
-		auto channel = root->add_child ("Channel");
-		for (auto& j: i) {
-			j.as_xml (channel->add_child ("Point"));
-		}
+		root->add_child("Channel")->set_attribute("Points", raw_convert<string>(i.size()));
 	}
 
 	for (size_t i = 0; i < _sample_peak.size(); ++i) {
@@ -181,7 +259,38 @@ AudioAnalysis::write (boost::filesystem::path filename)
 		root->add_child("Leqm")->add_child_text(raw_convert<string>(*_leqm));
 	}
 
-	doc->write_to_file_formatted (filename.string ());
+	if (_frames) {
+		root->add_child("Frames")->add_child_text(raw_convert<string>(*_frames));
+	}
+
+	auto const metadata = doc.write_to_string ("UTF-8");
+
+	vector<uint8_t> data;
+	data.reserve (header_size + metadata.bytes() + 3);
+	data.insert (data.end(), magic, magic + sizeof(magic));
+	put_uint32 (data, _current_state_version);
+	put_uint32 (data, metadata.bytes());
+	data.insert (data.end(), metadata.c_str(), metadata.c_str() + metadata.bytes());
+	data.resize ((data.size() + 3) & ~3);
+
+	dcp::File file (filename, "wb");
+	if (!file) {
+		throw FileError ("Could not open audio analysis file for writing", filename);
+	}
+	file.checked_write (data.data(), data.size());
+
+	/* Write the points a column at a time, as we read them */
+	for (auto& i: _data) {
+		for (auto type: { AudioPoint::PEAK, AudioPoint::RMS }) {
+			data.clear ();
+			for (auto& j: i) {
+				put_float (data, j[type]);
+			}
+			file.checked_write (data.data(), data.size());
+		}
+	}
+
+	file.close ();
 }
 
 
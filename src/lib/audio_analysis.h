@@ -25,6 +25,7 @@
 
 #include "dcpomatic_time.h"
 #include "audio_point.h"
+#include "types.h"
 #include <libcxml/cxml.h>
 #include <boost/optional.hpp>
 #include <boost/filesystem.hpp>
@@ -129,6 +130,17 @@ public:
 		return _leqm;
 	}
 
+	void set_frames (Frame frames) {
+		_frames = frames;
+	}
+
+	/** @return number of frames that were analysed, if this analysis
+	 *  was made to be part of a bigger one.
+	 */
+	boost::optional<Frame> frames () const {
+		return _frames;
+	}
+
 	void write (boost::filesystem::path);
 
 	float gain_correction (std::shared_ptr<const Playlist> playlist);
@@ -147,6 +159,7 @@ private:
 	boost::optional<double> _analysis_gain;
 	int64_t _samples_per_point = 0;
 	int _sample_rate = 0;
+	boost::optional<Frame> _frames;
 
 	static int const _current_state_version;
 };
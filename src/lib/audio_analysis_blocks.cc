@@ -0,0 +1,208 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  src/lib/audio_analysis_blocks.cc
+ *  @brief Functions to make an analysis of a playlist from analyses of each piece of its content.
+ *
+ *  Each piece of content is analysed on its own, using an AudioAnalyser in block mode, and the
+ *  result is stored at Film::audio_analysis_block_path.  As that path does not depend on where
+ *  the content is, an analysis of the whole playlist can then be made by combining the blocks,
+ *  so moving or adding content only means that new or changed content needs to be decoded.
+ */
+
+
+#include "audio_analyser.h"
+#include "audio_analysis_blocks.h"
+#include "audio_content.h"
+#include "config.h"
+#include "dcpomatic_assert.h"
+#include "film.h"
+#include "playlist.h"
+#include <algorithm>
+#include <cmath>
+
+
+using std::max;
+using std::min;
+using std::shared_ptr;
+using std::vector;
+using namespace dcpomatic;
+
+
+/** @return true if an analysis of a playlist can be made with assemble_audio_analysis() */
+bool
+can_assemble_audio_analysis (shared_ptr<const Film> film, shared_ptr<const Playlist> playlist)
+{
+#ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
+	/* We can't work out integrated loudness or loudness range from those of the blocks */
+	if (Config::instance()->analyse_ebur128()) {
+		return false;
+	}
+#endif
+
+	/* The audio processor may mix channels together */
+	if (film->audio_processor()) {
+		return false;
+	}
+
+	/* Each block only tells us about one piece of content so we can't combine
+	   them if any content's audio is mixed with another's.
+	*/
+	vector<DCPTimePeriod> periods;
+	for (auto i: playlist->content()) {
+		if (i->audio) {
+			periods.push_back (DCPTimePeriod(i->position(), i->end(film)));
+		}
+	}
+
+	std::sort (periods.begin(), periods.end());
+	for (size_t i = 1; i < periods.size(); ++i) {
+		if (periods[i].from < periods[i - 1].to) {
+			return false;
+		}
+	}
+
+	return !periods.empty();
+}
+
+
+/** Make an analysis of a playlist from analyses of each piece of its content.  The points
+ *  will be close to, but not necessarily exactly the same as, those that AudioAnalyser
+ *  would find, since the edges of the blocks' points do not line up with those of the
+ *  analysis' points.  Sample peaks are exact, and Leq(m) is very close.
+ *
+ *  @param start Time to start the analysis from, as in AudioAnalyser::start().
+ *  @param blocks Blocks made by AudioAnalyser with block = true, one for each piece of
+ *  content with audio in the playlist, in the same order as Playlist::content().
+ */
+AudioAnalysis
+assemble_audio_analysis (shared_ptr<const Film> film, shared_ptr<const Playlist> playlist, DCPTime start, vector<AudioAnalysis> const& blocks)
+{
+	int const channels = film->audio_channels();
+	int const rate = film->audio_frame_rate();
+
+	/* These are the same as AudioAnalyser would use */
+	Frame const length = DCPTime(playlist->length(film) - start).frames_round(rate);
+	Frame const samples_per_point = max(int64_t(1), length / AudioAnalyser::num_points);
+
+	/* AudioAnalyser makes point 0 from frame 0 and then point p from
+	   frames (p - 1) * samples_per_point + 1 to p * samples_per_point.
+	*/
+	int const points = length > 0 ? (length - 1) / samples_per_point + 1 : 0;
+	auto point = [samples_per_point](Frame frame) {
+		return frame == 0 ? 0 : (frame - 1) / samples_per_point + 1;
+	};
+	auto point_first = [samples_per_point](Frame p) {
+		return p == 0 ? 0 : (p - 1) * samples_per_point + 1;
+	};
+	auto point_last = [samples_per_point](Frame p) {
+		return p * samples_per_point;
+	};
+
+	vector<vector<double>> sum_of_squares (channels, vector<double>(points));
+	vector<vector<float>> peak (channels, vector<float>(points, AudioAnalyser::floor_level));
+	/* number of frames in each point which are covered by some block */
+	vector<Frame> covered (points);
+	vector<float> sample_peak (channels, length > 0 ? AudioAnalyser::floor_level : 0);
+	vector<Frame> sample_peak_frame (channels);
+	double leqm_power = 0;
+	bool have_leqm = true;
+
+	size_t n = 0;
+	for (auto content: playlist->content()) {
+		if (!content->audio) {
+			continue;
+		}
+
+		DCPOMATIC_ASSERT (n < blocks.size());
+		auto const& block = blocks[n++];
+		DCPOMATIC_ASSERT (block.frames());
+		DCPOMATIC_ASSERT (block.channels() == channels);
+
+		Frame const offset = DCPTime(content->position() - start).frames_round(rate);
+		Frame const frames = *block.frames();
+		Frame const block_samples_per_point = block.samples_per_point();
+
+		for (int c = 0; c < channels; ++c) {
+			for (int p = 0; p < block.points(c); ++p) {
+				Frame const first = offset + (p == 0 ? 0 : (p - 1) * block_samples_per_point + 1);
+				Frame const last = offset + (p == 0 ? 0 : min(p * block_samples_per_point, frames - 1));
+				auto bp = block.get_point(c, p);
+				double const block_sum_of_squares = pow(bp[AudioPoint::RMS], 2) * block_samples_per_point;
+				/* Share the block point's power between the points that it overlaps, and
+				   give its peak to all of them.
+				*/
+				for (auto q = point(first); q <= min(point(last), Frame(points - 1)); ++q) {
+					Frame const overlap = min(last, point_last(q)) - max(first, point_first(q)) + 1;
+					sum_of_squares[c][q] += block_sum_of_squares * overlap / (last - first + 1);
+					peak[c][q] = max(peak[c][q], bp[AudioPoint::PEAK]);
+					if (c == 0) {
+						covered[q] += overlap;
+					}
+				}
+			}
+		}
+
+		auto const block_sample_peak = block.sample_peak();
+		for (int c = 0; c < channels; ++c) {
+			auto const& sp = block_sample_peak[c];
+			Frame const frame = offset + sp.time.frames_round(rate);
+			if (sp.peak > sample_peak[c] || (sp.peak == sample_peak[c] && frame < sample_peak_frame[c])) {
+				sample_peak[c] = sp.peak;
+				sample_peak_frame[c] = frame;
+			}
+		}
+
+		/* Leq(m) is a level of the mean power, so we can combine them weighted by length */
+		if (block.leqm()) {
+			leqm_power += frames * pow(10, *block.leqm() / 10);
+		} else {
+			have_leqm = false;
+		}
+	}
+
+	AudioAnalysis analysis (channels);
+
+	for (int c = 0; c < channels; ++c) {
+		for (int q = 0; q < points; ++q) {
+			/* Anything not covered by a block is silence */
+			Frame const silence = max(Frame(0), (q == 0 ? 1 : samples_per_point) - covered[q]);
+			AudioPoint ap;
+			ap[AudioPoint::PEAK] = peak[c][q];
+			ap[AudioPoint::RMS] = sqrt((sum_of_squares[c][q] + silence * pow(AudioAnalyser::floor_level, 2)) / samples_per_point);
+			analysis.add_point (c, ap);
+		}
+	}
+
+	vector<AudioAnalysis::PeakTime> peak_times;
+	for (int c = 0; c < channels; ++c) {
+		peak_times.push_back (AudioAnalysis::PeakTime(sample_peak[c], DCPTime::from_frames(sample_peak_frame[c], rate)));
+	}
+	analysis.set_sample_peak (peak_times);
+
+	analysis.set_samples_per_point (samples_per_point);
+	analysis.set_sample_rate (rate);
+	if (have_leqm && leqm_power > 0 && length > 0) {
+		analysis.set_leqm (10 * log10(leqm_power / length));
+	}
+
+	return analysis;
+}
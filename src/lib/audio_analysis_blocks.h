@@ -0,0 +1,50 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  src/lib/audio_analysis_blocks.h
+ *  @brief Functions to make an analysis of a playlist from analyses of each piece of its content.
+ */
+
+
+#ifndef DCPOMATIC_AUDIO_ANALYSIS_BLOCKS_H
+#define DCPOMATIC_AUDIO_ANALYSIS_BLOCKS_H
+
+
+#include "audio_analysis.h"
+#include "dcpomatic_time.h"
+#include <memory>
+#include <vector>
+
+
+class Film;
+class Playlist;
+
+
+extern bool can_assemble_audio_analysis (std::shared_ptr<const Film> film, std::shared_ptr<const Playlist> playlist);
+extern AudioAnalysis assemble_audio_analysis (
+	std::shared_ptr<const Film> film,
+	std::shared_ptr<const Playlist> playlist,
+	dcpomatic::DCPTime start,
+	std::vector<AudioAnalysis> const& blocks
+	);
+
+
+#endif
@@ -0,0 +1,183 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "audio_buffer_pool.h"
+#include "dcpomatic_assert.h"
+#include <boost/align/aligned_alloc.hpp>
+#include <new>
+
+
+using std::make_pair;
+using std::pair;
+using std::vector;
+
+
+size_t constexpr AudioBufferPool::alignment;
+
+
+/** Smallest block that we will hand out, in bytes */
+static size_t constexpr minimum_block = 1024;
+
+
+/** @return A block of at least `bytes' bytes, aligned to AudioBufferPool::alignment, and the actual size of the block */
+pair<void*, size_t>
+AudioBufferPool::get (size_t bytes)
+{
+	size_t size = minimum_block;
+	while (size < bytes) {
+		size *= 2;
+	}
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+
+		auto i = _entries.find (size);
+		if (i != _entries.end() && !i->second.free.empty()) {
+			auto& entry = i->second;
+			auto block = entry.free.back ();
+			entry.free.pop_back ();
+			entry.last_used = ++_clock;
+			_resident -= size;
+			++_hits;
+			return make_pair(block, size);
+		}
+
+		++_misses;
+	}
+
+	auto block = boost::alignment::aligned_alloc (alignment, size);
+	if (!block) {
+		throw std::bad_alloc ();
+	}
+	return make_pair(block, size);
+}
+
+
+/** Give the pool a block which is no longer required.  The pool takes ownership of it,
+ *  and will free it if it does not keep it.
+ *  @param block Block that was returned by get().
+ *  @param bytes Size of the block, as returned by get().
+ */
+void
+AudioBufferPool::put (void* block, size_t bytes)
+{
+	vector<void*> to_free;
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+
+		if (bytes > _maximum_resident) {
+			to_free.push_back (block);
+		} else {
+			while (_resident + bytes > _maximum_resident) {
+				evict_unlocked (to_free);
+			}
+
+			auto& entry = _entries[bytes];
+			entry.free.push_back (block);
+			entry.last_used = ++_clock;
+			_resident += bytes;
+		}
+	}
+
+	for (auto i: to_free) {
+		boost::alignment::aligned_free (i);
+	}
+}
+
+
+/** Remove one block from the least-recently-used entry which has any.
+ *  _mutex must be held, and _resident must be greater than 0.
+ */
+void
+AudioBufferPool::evict_unlocked (vector<void*>& to_free)
+{
+	auto oldest = _entries.end();
+	for (auto i = _entries.begin(); i != _entries.end(); ++i) {
+		if (!i->second.free.empty() && (oldest == _entries.end() || i->second.last_used < oldest->second.last_used)) {
+			oldest = i;
+		}
+	}
+
+	DCPOMATIC_ASSERT (oldest != _entries.end());
+
+	to_free.push_back (oldest->second.free.back());
+	oldest->second.free.pop_back ();
+	_resident -= oldest->first;
+
+	if (oldest->second.free.empty()) {
+		_entries.erase (oldest);
+	}
+}
+
+
+/** Set the maximum total size of the blocks that we will hold, in bytes */
+void
+AudioBufferPool::set_maximum_resident (size_t bytes)
+{
+	vector<void*> to_free;
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_maximum_resident = bytes;
+		while (_resident > _maximum_resident) {
+			evict_unlocked (to_free);
+		}
+	}
+
+	for (auto i: to_free) {
+		boost::alignment::aligned_free (i);
+	}
+}
+
+
+/** Free all the blocks that we are holding */
+void
+AudioBufferPool::clear ()
+{
+	vector<void*> to_free;
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		for (auto& i: _entries) {
+			for (auto j: i.second.free) {
+				to_free.push_back (j);
+			}
+		}
+		_entries.clear ();
+		_resident = 0;
+	}
+
+	for (auto i: to_free) {
+		boost::alignment::aligned_free (i);
+	}
+}
+
+
+AudioBufferPool*
+AudioBufferPool::instance ()
+{
+	/* AudioBuffers can be made and destroyed on any thread, and at any time up to the end of
+	   the program, so this must be created in a thread-safe way and never destroyed.
+	*/
+	static auto pool = new AudioBufferPool ();
+	return pool;
+}
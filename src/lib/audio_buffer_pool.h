@@ -0,0 +1,115 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCPOMATIC_AUDIO_BUFFER_POOL_H
+#define DCPOMATIC_AUDIO_BUFFER_POOL_H
+
+
+/** @file  src/lib/audio_buffer_pool.h
+ *  @brief AudioBufferPool class.
+ */
+
+
+#include <boost/thread/mutex.hpp>
+#include <stdint.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+
+/** @class AudioBufferPool
+ *  @brief A store of memory blocks for AudioBuffers which have been finished with, so that they can be re-used.
+ *
+ *  Blocks are 32-byte aligned and come in power-of-two sizes, so that a block freed by one
+ *  AudioBuffers can be used by the next one that needs a similar amount of space.  The
+ *  blocks that the pool holds are limited to a maximum total size; when that is reached,
+ *  blocks of the least-recently-used size are freed.
+ *
+ *  All methods can be called from any thread.
+ */
+class AudioBufferPool
+{
+public:
+	AudioBufferPool (AudioBufferPool const&) = delete;
+	AudioBufferPool& operator= (AudioBufferPool const&) = delete;
+
+	/** Alignment of the blocks that get() returns, in bytes */
+	static size_t constexpr alignment = 32;
+
+	std::pair<void*, size_t> get (size_t bytes);
+	void put (void* block, size_t bytes);
+
+	void set_maximum_resident (size_t bytes);
+
+	size_t maximum_resident () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _maximum_resident;
+	}
+
+	void clear ();
+
+	/** @return number of times that get() has returned a block that was put() */
+	int hits () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _hits;
+	}
+
+	/** @return number of times that get() had to allocate a new block */
+	int misses () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _misses;
+	}
+
+	/** @return total size of the blocks that we are holding, in bytes */
+	size_t resident () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _resident;
+	}
+
+	static AudioBufferPool* instance ();
+
+private:
+	AudioBufferPool () {}
+
+	struct Entry
+	{
+		/** blocks that are ready to be re-used */
+		std::vector<void*> free;
+		/** value of _clock when this entry was last used */
+		uint64_t last_used = 0;
+	};
+
+	void evict_unlocked (std::vector<void*>& to_free);
+
+	/** mutex to protect everything below */
+	mutable boost::mutex _mutex;
+	/** Entries indexed by block size in bytes */
+	std::map<size_t, Entry> _entries;
+	size_t _resident = 0;
+	size_t _maximum_resident = 64 * 1024 * 1024;
+	int _hits = 0;
+	int _misses = 0;
+	/** counter used to find the least-recently-used entry */
+	uint64_t _clock = 0;
+};
+
+
+#endif
@@ -19,17 +19,26 @@
 */
 
 
+#include "audio_buffer_pool.h"
 #include "audio_buffers.h"
+#include "audio_kernels.h"
 #include "dcpomatic_assert.h"
 #include "maths_util.h"
-#include "scope_guard.h"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <cmath>
 
 
+using std::max;
+using std::min;
 using std::shared_ptr;
 using std::make_shared;
+using namespace dcpomatic;
+
+
+/** Number of floats that make up AudioBufferPool::alignment bytes */
+static int constexpr floats_per_alignment = AudioBufferPool::alignment / sizeof(float);
 
 
 /** Construct a silent AudioBuffers */
@@ -63,6 +72,14 @@ AudioBuffers::AudioBuffers (std::shared_ptr<const AudioBuffers> other, int frame
 }
 
 
+AudioBuffers::~AudioBuffers ()
+{
+	if (_block) {
+		AudioBufferPool::instance()->put (_block, _block_size);
+	}
+}
+
+
 AudioBuffers &
 AudioBuffers::operator= (AudioBuffers const & other)
 {
@@ -77,18 +94,56 @@ AudioBuffers::operator= (AudioBuffers const & other)
 }
 
 
+/** Set up these buffers to hold some number of channels and frames.  Any existing data
+ *  in channels and frames that are kept is preserved, and anything new is silent.
+ */
 void
 AudioBuffers::allocate (int channels, int frames)
 {
 	DCPOMATIC_ASSERT (frames >= 0);
 	DCPOMATIC_ASSERT (channels > 0);
 
-	ScopeGuard sg = [this]() { update_data_pointers(); };
+	if (channels == _channels && frames <= _stride) {
+		/* We already have enough space */
+		for (int channel = 0; channel < channels; ++channel) {
+			std::fill (_data_pointers[channel] + _frames, _data_pointers[channel] + max(frames, _frames), 0.0f);
+		}
+		_frames = frames;
+		return;
+	}
+
+	auto round_up = [](size_t n, size_t to) {
+		return (n + to - 1) / to * to;
+	};
+
+	/* The channel pointers go at the start of the block, followed by the channels */
+	auto const header = round_up (channels * sizeof(float*), AudioBufferPool::alignment);
+	auto const minimum_stride = round_up (frames, floats_per_alignment);
+	auto block = AudioBufferPool::instance()->get(header + channels * minimum_stride * sizeof(float));
+	/* Use all of the block that we got, so that we can grow later without asking for another */
+	int const stride = ((block.second - header) / sizeof(float) / channels) / floats_per_alignment * floats_per_alignment;
+	DCPOMATIC_ASSERT (stride >= frames);
 
-	_data.resize(channels);
+	auto pointers = reinterpret_cast<float**>(block.first);
 	for (int channel = 0; channel < channels; ++channel) {
-		_data[channel].resize(frames);
+		pointers[channel] = reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(block.first) + header) + channel * stride;
+		auto const keep = channel < _channels ? min(frames, _frames) : 0;
+		if (keep) {
+			memcpy (pointers[channel], _data_pointers[channel], keep * sizeof(float));
+		}
+		std::fill (pointers[channel] + keep, pointers[channel] + frames, 0.0f);
+	}
+
+	if (_block) {
+		AudioBufferPool::instance()->put (_block, _block_size);
 	}
+
+	_channels = channels;
+	_frames = frames;
+	_stride = stride;
+	_block = block.first;
+	_block_size = block.second;
+	_data_pointers = pointers;
 }
 
 
@@ -99,7 +154,7 @@ float*
 AudioBuffers::data (int channel)
 {
 	DCPOMATIC_ASSERT (channel >= 0 && channel < channels());
-	return _data[channel].data();
+	return _data_pointers[channel];
 }
 
 
@@ -110,7 +165,7 @@ float const*
 AudioBuffers::data (int channel) const
 {
 	DCPOMATIC_ASSERT (channel >= 0 && channel < channels());
-	return _data[channel].data();
+	return _data_pointers[channel];
 }
 
 
@@ -118,7 +173,7 @@ AudioBuffers::data (int channel) const
 void
 AudioBuffers::set_frames (int frames)
 {
-	allocate(_data.size(), frames);
+	allocate(_channels, frames);
 }
 
 
@@ -227,11 +282,10 @@ AudioBuffers::accumulate_channel (AudioBuffers const * from, int from_channel, i
 	DCPOMATIC_ASSERT (from->frames() == N);
 	DCPOMATIC_ASSERT (to_channel <= channels());
 
-	auto s = from->data (from_channel);
-	auto d = data(to_channel);
-
-	for (int i = 0; i < N; ++i) {
-		*d++ += (*s++) * gain;
+	if (gain == 1) {
+		audio_accumulate (data(to_channel), from->data(from_channel), N);
+	} else {
+		audio_accumulate (data(to_channel), from->data(from_channel), gain, N);
 	}
 }
 
@@ -249,11 +303,8 @@ AudioBuffers::accumulate_frames (AudioBuffers const * from, int frames, int read
 	DCPOMATIC_ASSERT (read_offset >= 0);
 	DCPOMATIC_ASSERT (write_offset >= 0);
 
-	auto from_data = from->data ();
 	for (int i = 0; i < channels(); ++i) {
-		for (int j = 0; j < frames; ++j) {
-			_data[i][j + write_offset] += from_data[i][j + read_offset];
-		}
+		audio_accumulate (data(i) + write_offset, from->data(i) + read_offset, frames);
 	}
 }
 
@@ -265,9 +316,7 @@ AudioBuffers::apply_gain (float dB)
 	auto const linear = db_to_linear (dB);
 
 	for (int i = 0; i < channels(); ++i) {
-		for (int j = 0; j < frames(); ++j) {
-			_data[i][j] *= linear;
-		}
+		audio_apply_gain (data(i), linear, frames());
 	}
 }
 
@@ -325,13 +374,3 @@ AudioBuffers::trim_start (int frames_to_trim)
 	set_frames (frames() - frames_to_trim);
 }
 
-
-void
-AudioBuffers::update_data_pointers ()
-{
-        _data_pointers.resize (channels());
-        for (int i = 0; i < channels(); ++i) {
-                _data_pointers[i] = _data[i].data();
-        }
-}
-
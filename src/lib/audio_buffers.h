@@ -34,6 +34,11 @@
 
 /** @class AudioBuffers
  *  @brief A class to hold multi-channel audio data in float format.
+ *
+ *  The channels are held one after the other in a single block of memory from
+ *  AudioBufferPool, with each channel starting on a 32-byte boundary.  The block
+ *  is usually bigger than it needs to be, so the buffers can often grow without
+ *  a new one.
  */
 class AudioBuffers
 {
@@ -43,24 +48,26 @@ public:
 	explicit AudioBuffers (std::shared_ptr<const AudioBuffers>);
 	AudioBuffers (std::shared_ptr<const AudioBuffers> other, int frames_to_copy, int read_offset);
 
+	~AudioBuffers ();
+
 	AudioBuffers & operator= (AudioBuffers const &);
 
 	std::shared_ptr<AudioBuffers> clone () const;
 	std::shared_ptr<AudioBuffers> channel (int) const;
 
 	float* const* data () const {
-		return _data_pointers.data();
+		return _data_pointers;
 	}
 
 	float const* data (int) const;
 	float* data (int);
 
 	int channels () const {
-		return _data.size();
+		return _channels;
 	}
 
 	int frames () const {
-		return _data[0].size();
+		return _frames;
 	}
 
 	void set_frames (int f);
@@ -81,12 +88,17 @@ public:
 
 private:
 	void allocate (int channels, int frames);
-	void update_data_pointers ();
 
-	/** Audio data (so that, e.g. _data[2][6] is channel 2, sample 6) */
-	std::vector<std::vector<float>> _data;
-	/** Pointers to the data of each vector in _data */
-	std::vector<float*> _data_pointers;
+	int _channels = 0;
+	int _frames = 0;
+	/** Number of floats between the start of one channel and the start of the next */
+	int _stride = 0;
+	/** Block of memory from AudioBufferPool, holding _data_pointers followed by the data */
+	void* _block = nullptr;
+	/** Size of _block in bytes */
+	size_t _block_size = 0;
+	/** Pointers to the start of each channel's data (so that, e.g. _data_pointers[2][6] is channel 2, sample 6) */
+	float** _data_pointers = nullptr;
 };
 
 
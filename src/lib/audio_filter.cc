@@ -27,15 +27,18 @@
 
 
 using std::make_shared;
+using std::max;
 using std::min;
 using std::shared_ptr;
 
 
+int constexpr AudioFilter::fft_threshold;
+
+
 std::vector<float>
 AudioFilter::sinc_blackman (float cutoff, bool invert) const
 {
-	auto ir = std::vector<float>();
-	ir.reserve(_M + 1);
+	auto ir = std::vector<float>(_M + 1);
 
 	/* Impulse response */
 
@@ -82,8 +85,30 @@ AudioFilter::run (shared_ptr<const AudioBuffers> in)
 	if (!_tail) {
 		_tail.reset (new AudioBuffers (in->channels(), _M + 1));
 		_tail->make_silent ();
+		if (_M + 1 >= fft_threshold && _fft_size == 0) {
+			setup_fft ();
+		}
+	}
+
+	if (_fft_size) {
+		run_fft (in.get(), out.get());
+	} else {
+		run_direct (in.get(), out.get());
 	}
 
+	int const amount = min (in->frames(), _tail->frames());
+	if (amount < _tail->frames ()) {
+		_tail->move (_tail->frames() - amount, amount, 0);
+	}
+	_tail->copy_from (in.get(), amount, in->frames() - amount, _tail->frames () - amount);
+
+	return out;
+}
+
+
+void
+AudioFilter::run_direct (AudioBuffers const* in, AudioBuffers* out) const
+{
 	int const channels = in->channels ();
 	int const frames = in->frames ();
 
@@ -104,14 +129,149 @@ AudioFilter::run (shared_ptr<const AudioBuffers> in)
 			out_p[j] = s;
 		}
 	}
+}
 
-	int const amount = min (in->frames(), _tail->frames());
-	if (amount < _tail->frames ()) {
-		_tail->move (_tail->frames() - amount, amount, 0);
+
+/** Set up for FFT convolution; must be called after _ir is filled in */
+void
+AudioFilter::setup_fft ()
+{
+	/* Each transform gives us _fft_size - _M frames of output, so a size of about
+	   four times the kernel length keeps the overhead of the overlap small.
+	*/
+	_fft_size = 256;
+	while (_fft_size < (_M + 1) * 4) {
+		_fft_size *= 2;
 	}
-	_tail->copy_from (in.get(), amount, in->frames() - amount, _tail->frames () - amount);
 
-	return out;
+	_cos.resize (_fft_size / 2);
+	_sin.resize (_fft_size / 2);
+	for (int i = 0; i < _fft_size / 2; ++i) {
+		_cos[i] = cos (2 * M_PI * i / _fft_size);
+		_sin[i] = sin (2 * M_PI * i / _fft_size);
+	}
+
+	int bits = 0;
+	while ((1 << bits) < _fft_size) {
+		++bits;
+	}
+	_bit_reverse.resize (_fft_size);
+	for (int i = 0; i < _fft_size; ++i) {
+		int r = 0;
+		for (int j = 0; j < bits; ++j) {
+			if (i & (1 << j)) {
+				r |= 1 << (bits - 1 - j);
+			}
+		}
+		_bit_reverse[i] = r;
+	}
+
+	_real.assign (_fft_size, 0);
+	_imag.assign (_fft_size, 0);
+	for (int i = 0; i <= _M; ++i) {
+		_real[i] = _ir[i];
+	}
+	fft (false);
+	_kernel_real = _real;
+	_kernel_imag = _imag;
+}
+
+
+/** In-place radix-2 FFT of _real and _imag.  The inverse is not scaled. */
+void
+AudioFilter::fft (bool inverse)
+{
+	int const N = _fft_size;
+	auto re = _real.data();
+	auto im = _imag.data();
+
+	for (int i = 0; i < N; ++i) {
+		int const j = _bit_reverse[i];
+		if (i < j) {
+			std::swap (re[i], re[j]);
+			std::swap (im[i], im[j]);
+		}
+	}
+
+	double const sign = inverse ? 1 : -1;
+	for (int length = 2; length <= N; length *= 2) {
+		int const half = length / 2;
+		int const step = N / length;
+		for (int i = 0; i < N; i += length) {
+			for (int j = 0; j < half; ++j) {
+				double const wr = _cos[j * step];
+				double const wi = sign * _sin[j * step];
+				int const a = i + j;
+				int const b = a + half;
+				double const vr = re[b] * wr - im[b] * wi;
+				double const vi = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - vr;
+				im[b] = im[a] - vi;
+				re[a] += vr;
+				im[a] += vi;
+			}
+		}
+	}
+}
+
+
+/** Overlap-save convolution.  As the kernel is real we can filter two channels with each
+ *  transform, one in the real part and one in the imaginary.
+ */
+void
+AudioFilter::run_fft (AudioBuffers const* in, AudioBuffers* out)
+{
+	int const channels = in->channels ();
+	int const frames = in->frames ();
+	/* Number of new frames of output that each transform gives us */
+	int const block = _fft_size - _M;
+	double const scale = 1.0 / _fft_size;
+
+	for (int first = 0; first < channels; first += 2) {
+		int const pair = min (2, channels - first);
+		for (int start = 0; start < frames; start += block) {
+			int const todo = min (block, frames - start);
+
+			/* The _M frames before start, followed by the input from start */
+			for (int c = 0; c < 2; ++c) {
+				auto target = c == 0 ? _real.data() : _imag.data();
+				if (c >= pair) {
+					std::fill (target, target + _fft_size, 0.0);
+					continue;
+				}
+				auto tail_p = _tail->data (first + c);
+				auto in_p = in->data (first + c);
+				int const from_tail = max (0, _M - start);
+				for (int i = 0; i < from_tail; ++i) {
+					target[i] = tail_p[_tail->frames() - from_tail + i];
+				}
+				for (int i = from_tail; i < _M + todo; ++i) {
+					target[i] = in_p[start - _M + i];
+				}
+				std::fill (target + _M + todo, target + _fft_size, 0.0);
+			}
+
+			fft (false);
+
+			for (int i = 0; i < _fft_size; ++i) {
+				double const r = _real[i] * _kernel_real[i] - _imag[i] * _kernel_imag[i];
+				double const m = _real[i] * _kernel_imag[i] + _imag[i] * _kernel_real[i];
+				_real[i] = r;
+				_imag[i] = m;
+			}
+
+			fft (true);
+
+			/* The first _M outputs are wrapped round from the end, so they are no use */
+			for (int c = 0; c < pair; ++c) {
+				auto source = c == 0 ? _real.data() : _imag.data();
+				auto out_p = out->data(first + c) + start;
+				for (int i = 0; i < todo; ++i) {
+					out_p[i] = source[_M + i] * scale;
+				}
+			}
+		}
+	}
 }
 
 
@@ -142,7 +302,7 @@ BandPassAudioFilter::BandPassAudioFilter (float transition_bandwidth, float lowe
 	auto lpf = sinc_blackman (lower, false);
 	auto hpf = sinc_blackman (higher, true);
 
-	_ir.reserve (_M + 1);
+	_ir.resize (_M + 1);
 	for (int i = 0; i <= _M; ++i) {
 		_ir[i] = lpf[i] + hpf[i];
 	}
@@ -31,7 +31,11 @@ struct audio_filter_impulse_input_test;
 
 
 /** An audio filter which can take AudioBuffers and apply some filtering operation,
- *  returning filtered samples
+ *  returning filtered samples.
+ *
+ *  Short kernels are convolved directly.  Kernels with at least fft_threshold taps
+ *  are done by overlap-save FFT convolution, which gives the same results to within
+ *  floating-point rounding.
  */
 class AudioFilter
 {
@@ -50,15 +54,39 @@ public:
 
 	void flush ();
 
+	/** Smallest number of taps for which we use FFT convolution */
+	static int constexpr fft_threshold = 64;
+
 protected:
 	friend struct audio_filter_impulse_kernel_test;
 	friend struct audio_filter_impulse_input_test;
+	friend struct audio_filter_fft_test;
 
 	std::vector<float> sinc_blackman (float cutoff, bool invert) const;
 
 	std::vector<float> _ir;
 	int _M;
+	/** The last _M + 1 frames of input that we have seen */
 	std::shared_ptr<AudioBuffers> _tail;
+
+private:
+	void setup_fft ();
+	void run_direct (AudioBuffers const* in, AudioBuffers* out) const;
+	void run_fft (AudioBuffers const* in, AudioBuffers* out);
+	void fft (bool inverse);
+
+	/** FFT size, or 0 if we are convolving directly */
+	int _fft_size = 0;
+	/** Transform of _ir, padded to _fft_size */
+	std::vector<double> _kernel_real;
+	std::vector<double> _kernel_imag;
+	/** cos and sin of 2 * pi * i / _fft_size for i up to _fft_size / 2 */
+	std::vector<double> _cos;
+	std::vector<double> _sin;
+	std::vector<int> _bit_reverse;
+	/** Buffers for the data being transformed */
+	std::vector<double> _real;
+	std::vector<double> _imag;
 };
 
 
@@ -0,0 +1,175 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "audio_kernels.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <algorithm>
+#include <cmath>
+
+
+/* Loads and stores here are unaligned, as callers may start part-way through an AudioBuffers channel */
+
+
+void
+dcpomatic::audio_apply_gain (float* data, float gain, int samples)
+{
+	int i = 0;
+#ifdef __SSE2__
+	auto const g = _mm_set1_ps (gain);
+	for (; i + 8 <= samples; i += 8) {
+		_mm_storeu_ps (data + i, _mm_mul_ps(_mm_loadu_ps(data + i), g));
+		_mm_storeu_ps (data + i + 4, _mm_mul_ps(_mm_loadu_ps(data + i + 4), g));
+	}
+#endif
+	for (; i < samples; ++i) {
+		data[i] *= gain;
+	}
+}
+
+
+void
+dcpomatic::audio_accumulate (float* target, float const* source, int samples)
+{
+	int i = 0;
+#ifdef __SSE2__
+	for (; i + 8 <= samples; i += 8) {
+		_mm_storeu_ps (target + i, _mm_add_ps(_mm_loadu_ps(target + i), _mm_loadu_ps(source + i)));
+		_mm_storeu_ps (target + i + 4, _mm_add_ps(_mm_loadu_ps(target + i + 4), _mm_loadu_ps(source + i + 4)));
+	}
+#endif
+	for (; i < samples; ++i) {
+		target[i] += source[i];
+	}
+}
+
+
+void
+dcpomatic::audio_accumulate (float* target, float const* source, float gain, int samples)
+{
+	int i = 0;
+#ifdef __SSE2__
+	auto const g = _mm_set1_ps (gain);
+	for (; i + 8 <= samples; i += 8) {
+		_mm_storeu_ps (target + i, _mm_add_ps(_mm_loadu_ps(target + i), _mm_mul_ps(_mm_loadu_ps(source + i), g)));
+		_mm_storeu_ps (target + i + 4, _mm_add_ps(_mm_loadu_ps(target + i + 4), _mm_mul_ps(_mm_loadu_ps(source + i + 4), g)));
+	}
+#endif
+	for (; i < samples; ++i) {
+		target[i] += source[i] * gain;
+	}
+}
+
+
+void
+dcpomatic::audio_convert (int16_t const* in, float* out, int samples)
+{
+	/* Multiplying by a power of 2 is exact, so this is the same as dividing by 1 << 15 */
+	float const scale = 1.0f / (1 << 15);
+	int i = 0;
+#ifdef __SSE2__
+	auto const s = _mm_set1_ps (scale);
+	for (; i + 8 <= samples; i += 8) {
+		auto const x = _mm_loadu_si128 (reinterpret_cast<__m128i const*>(in + i));
+		/* Sign-extend to 32 bits by putting each sample in the top half of a lane and shifting down */
+		auto const low = _mm_srai_epi32 (_mm_unpacklo_epi16(x, x), 16);
+		auto const high = _mm_srai_epi32 (_mm_unpackhi_epi16(x, x), 16);
+		_mm_storeu_ps (out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), s));
+		_mm_storeu_ps (out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), s));
+	}
+#endif
+	for (; i < samples; ++i) {
+		out[i] = static_cast<float>(in[i]) * scale;
+	}
+}
+
+
+void
+dcpomatic::audio_convert (int32_t const* in, float* out, int samples)
+{
+	float const scale = 1.0f / 2147483648.0f;
+	int i = 0;
+#ifdef __SSE2__
+	auto const s = _mm_set1_ps (scale);
+	for (; i + 8 <= samples; i += 8) {
+		auto const a = _mm_cvtepi32_ps (_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)));
+		auto const b = _mm_cvtepi32_ps (_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i + 4)));
+		_mm_storeu_ps (out + i, _mm_mul_ps(a, s));
+		_mm_storeu_ps (out + i + 4, _mm_mul_ps(b, s));
+	}
+#endif
+	for (; i < samples; ++i) {
+		out[i] = static_cast<float>(in[i]) * scale;
+	}
+}
+
+
+void
+dcpomatic::audio_peak_and_power (float const* data, int samples, float floor, float& peak, double& sum_of_squares)
+{
+	/* The square of a float is exact as a double, and the squares are summed in four
+	   lanes which are added together in a fixed order, so that the result does not
+	   depend on whether we have SSE2.
+	*/
+	float max_abs = floor;
+	double lanes[4] = { 0, 0, 0, 0 };
+	int i = 0;
+#ifdef __SSE2__
+	auto const abs_mask = _mm_castsi128_ps (_mm_set1_epi32(0x7fffffff));
+	auto const f = _mm_set1_ps (floor);
+	auto peaks = f;
+	auto low = _mm_setzero_pd ();
+	auto high = _mm_setzero_pd ();
+	for (; i + 4 <= samples; i += 4) {
+		auto const x = _mm_max_ps (_mm_and_ps(_mm_loadu_ps(data + i), abs_mask), f);
+		peaks = _mm_max_ps (peaks, x);
+		auto const x_low = _mm_cvtps_pd (x);
+		auto const x_high = _mm_cvtps_pd (_mm_movehl_ps(x, x));
+		low = _mm_add_pd (low, _mm_mul_pd(x_low, x_low));
+		high = _mm_add_pd (high, _mm_mul_pd(x_high, x_high));
+	}
+	float p[4];
+	_mm_storeu_ps (p, peaks);
+	for (auto j: p) {
+		max_abs = std::max (max_abs, j);
+	}
+	_mm_storeu_pd (lanes, low);
+	_mm_storeu_pd (lanes + 2, high);
+#else
+	for (; i + 4 <= samples; i += 4) {
+		for (int j = 0; j < 4; ++j) {
+			double const x = std::max (std::fabs(data[i + j]), floor);
+			max_abs = std::max (max_abs, static_cast<float>(x));
+			lanes[j] += x * x;
+		}
+	}
+#endif
+	double sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	for (; i < samples; ++i) {
+		auto const x = std::max (std::fabs(data[i]), floor);
+		max_abs = std::max (max_abs, x);
+		sum += static_cast<double>(x) * x;
+	}
+
+	peak = max_abs;
+	sum_of_squares = sum;
+}
@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  src/lib/audio_kernels.h
+ *  @brief Kernels to apply gain to, mix, convert and measure runs of audio samples.
+ *
+ *  These use SSE2 where it is available.  The results are the same with or without SSE2.
+ */
+
+
+#ifndef DCPOMATIC_AUDIO_KERNELS_H
+#define DCPOMATIC_AUDIO_KERNELS_H
+
+
+#include <stdint.h>
+
+
+namespace dcpomatic {
+
+
+/** Multiply `samples' samples in data by gain */
+extern void audio_apply_gain (float* data, float gain, int samples);
+/** Add `samples' samples from source to those in target */
+extern void audio_accumulate (float* target, float const* source, int samples);
+/** Add `samples' samples from source, multiplied by gain, to those in target */
+extern void audio_accumulate (float* target, float const* source, float gain, int samples);
+/** Convert `samples' signed 16-bit samples to floats in the range [-1, 1) */
+extern void audio_convert (int16_t const* in, float* out, int samples);
+/** Convert `samples' signed 32-bit samples to floats in the range [-1, 1] */
+extern void audio_convert (int32_t const* in, float* out, int samples);
+/** Find the largest absolute value, and the sum of the squares, of `samples' samples,
+ *  treating any sample whose absolute value is less than floor as if it were floor.
+ */
+extern void audio_peak_and_power (float const* data, int samples, float floor, float& peak, double& sum_of_squares);
+
+
+}
+
+
+#endif
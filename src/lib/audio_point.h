@@ -23,14 +23,6 @@
 #define DCPOMATIC_AUDIO_POINT_H
 
 
-#include <libcxml/cxml.h>
-
-
-namespace xmlpp {
-	class Element;
-}
-
-
 class AudioPoint
 {
 public:
@@ -41,12 +33,9 @@ public:
 	};
 
 	AudioPoint ();
-	explicit AudioPoint (cxml::ConstNodePtr node);
 	AudioPoint (AudioPoint const &);
 	AudioPoint& operator= (AudioPoint const &);
 
-	void as_xml (xmlpp::Element *) const;
-
 	inline float& operator[] (int t) {
 		return _data[t];
 	}
@@ -20,90 +20,143 @@
 
 
 #include "audio_ring_buffers.h"
+#include "compose.hpp"
 #include "dcpomatic_assert.h"
 #include "exceptions.h"
+#include <algorithm>
 #include <iostream>
 
 
 using std::min;
 using std::cout;
-using std::make_pair;
-using std::pair;
-using std::list;
 using std::shared_ptr;
 using boost::optional;
 using namespace dcpomatic;
 
 
-AudioRingBuffers::AudioRingBuffers ()
+AudioRingBuffers::AudioRingBuffers (Frame capacity)
+	: _capacity (capacity)
+	, _read (0)
+	, _write (0)
+	, _base_position (0)
+	, _base_time (0)
+	, _frame_rate (48000)
 {
-
+	DCPOMATIC_ASSERT (_capacity > 0);
 }
 
 
-/** @param frame_rate Frame rate in use; this is only used to check timing consistency of the incoming data */
+/** @param frame_rate Frame rate of the data */
 void
 AudioRingBuffers::put (shared_ptr<const AudioBuffers> data, DCPTime time, int frame_rate)
 {
-	boost::mutex::scoped_lock lm (_mutex);
+	if (_data.empty()) {
+		_channels = data->channels();
+		_data.resize (_capacity * _channels);
+	}
+
+	DCPOMATIC_ASSERT (data->channels() == _channels);
+
+	auto const write = _write.load (std::memory_order_relaxed);
+	auto const frames = data->frames();
+
+	if (write - _read.load(std::memory_order_acquire) + frames > _capacity) {
+		throw ProgrammingError (__FILE__, __LINE__, String::compose("Audio ring buffers overflowed (%1 frames held, %2 more offered)", size(), frames));
+	}
 
-	if (!_buffers.empty()) {
-		DCPOMATIC_ASSERT (_buffers.front().first->channels() == data->channels());
-		DCPTime const end = (_buffers.back().second + DCPTime::from_frames(_buffers.back().first->frames(), frame_rate));
-		if (labs(end.get() - time.get()) > 1) {
-			cout << "bad put " << to_string(_buffers.back().second) << " " << _buffers.back().first->frames() << " " << to_string(time) << "\n";
+	if (_next_put) {
+		if (labs(_next_put->get() - time.get()) > 1) {
+			cout << "bad put " << to_string(*_next_put) << " " << to_string(time) << "\n";
 		}
-		DCPOMATIC_ASSERT (labs(end.get() - time.get()) < 2);
+		DCPOMATIC_ASSERT (labs(_next_put->get() - time.get()) < 2);
+	} else {
+		/* get() only looks at these when there is data after write, and that data is only
+		   made visible by the store to _write below.
+		*/
+		_base_position.store (write, std::memory_order_relaxed);
+		_base_time.store (time.get(), std::memory_order_relaxed);
+		_frame_rate.store (frame_rate, std::memory_order_relaxed);
+	}
+	_next_put = time + DCPTime::from_frames(frames, frame_rate);
+
+	auto const channels = _channels;
+	Frame done = 0;
+	while (done < frames) {
+		/* Copy up to the end of _data, then wrap round */
+		auto const start = (write + done) % _capacity;
+		auto const to_do = min (frames - done, _capacity - start);
+		auto out = _data.data() + start * channels;
+		for (int c = 0; c < channels; ++c) {
+			auto in = data->data(c) + done;
+			auto o = out + c;
+			for (Frame i = 0; i < to_do; ++i) {
+				*o = in[i];
+				o += channels;
+			}
+		}
+		done += to_do;
 	}
 
-	_buffers.push_back(make_pair(data, time));
+	_write.store (write + frames, std::memory_order_release);
 }
 
 
-/** @return time of the returned data; if it's not set this indicates an underrun */
+DCPTime
+AudioRingBuffers::time_of (Frame position) const
+{
+	return DCPTime(_base_time.load(std::memory_order_relaxed))
+		+ DCPTime::from_frames(position - _base_position.load(std::memory_order_relaxed), _frame_rate.load(std::memory_order_relaxed));
+}
+
+
+/** Copy some audio out, writing silence for anything that is not available.
+ *  @param out Buffer to write `frames' frames of `channels' interleaved channels to.
+ *  @param channels Number of channels to write; any which are not in the ring are silent
+ *  and any extra ones in the ring are ignored.
+ *  @return time of the returned data; if it's not set this indicates an underrun.
+ */
 optional<DCPTime>
 AudioRingBuffers::get (float* out, int channels, int frames)
 {
-	boost::mutex::scoped_lock lm (_mutex);
+	auto const read = _read.load (std::memory_order_acquire);
+	auto const available = min (static_cast<Frame>(frames), _write.load(std::memory_order_acquire) - read);
 
 	optional<DCPTime> time;
-
-	while (frames > 0) {
-		if (_buffers.empty ()) {
-			for (int i = 0; i < frames; ++i) {
-				for (int j = 0; j < channels; ++j) {
-					*out++ = 0;
+	int done = 0;
+
+	if (available > 0) {
+		auto const ring_channels = _channels;
+		auto const copy_channels = min (ring_channels, channels);
+		auto o = out;
+		while (done < available) {
+			auto const start = (read + done) % _capacity;
+			auto const to_do = static_cast<int>(min(available - done, _capacity - start));
+			auto in = _data.data() + start * ring_channels;
+			for (int i = 0; i < to_do; ++i) {
+				for (int c = 0; c < copy_channels; ++c) {
+					*o++ = in[c];
 				}
+				for (int c = copy_channels; c < channels; ++c) {
+					*o++ = 0;
+				}
+				in += ring_channels;
 			}
-			cout << "audio underrun; missing " << frames << "!\n";
-			return time;
-		}
-
-		auto front = _buffers.front ();
-		if (!time) {
-			time = front.second + DCPTime::from_frames(_used_in_head, 48000);
+			done += to_do;
 		}
 
-		int const to_do = min (frames, front.first->frames() - _used_in_head);
-		float* const* p = front.first->data();
-		int const c = min (front.first->channels(), channels);
-		for (int i = 0; i < to_do; ++i) {
-			for (int j = 0; j < c; ++j) {
-				*out++ = p[j][i + _used_in_head];
-			}
-			for (int j = c; j < channels; ++j) {
-				*out++ = 0;
-			}
-		}
-		_used_in_head += to_do;
-		frames -= to_do;
+		time = time_of (read);
 
-		if (_used_in_head == front.first->frames()) {
-			_buffers.pop_front ();
-			_used_in_head = 0;
+		auto expected = read;
+		if (!_read.compare_exchange_strong(expected, read + available, std::memory_order_acq_rel)) {
+			/* clear() was called while we were copying, so what we have is not wanted (and
+			   may have been overwritten by a put() since).
+			*/
+			time = optional<DCPTime>();
+			done = 0;
 		}
 	}
 
+	std::fill (out + done * channels, out + frames * channels, 0.0f);
 	return time;
 }
 
@@ -111,30 +164,26 @@ AudioRingBuffers::get (float* out, int channels, int frames)
 optional<DCPTime>
 AudioRingBuffers::peek () const
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	if (_buffers.empty()) {
+	auto const read = _read.load (std::memory_order_acquire);
+	if (_write.load(std::memory_order_acquire) == read) {
 		return {};
 	}
-	return _buffers.front().second;
+	return time_of (read);
 }
 
 
 void
 AudioRingBuffers::clear ()
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	_buffers.clear ();
-	_used_in_head = 0;
+	/* If get() is running now its compare-and-swap of _read will fail and it will discard what it read */
+	_read.store (_write.load(std::memory_order_acquire), std::memory_order_release);
+	_next_put = optional<DCPTime>();
 }
 
 
 Frame
 AudioRingBuffers::size () const
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	Frame s = 0;
-	for (auto const& i: _buffers) {
-		s += i.first->frames();
-	}
-	return s - _used_in_head;
+	auto const read = _read.load (std::memory_order_acquire);
+	return _write.load(std::memory_order_acquire) - read;
 }
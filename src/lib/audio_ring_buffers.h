@@ -26,17 +26,26 @@
 #include "audio_buffers.h"
 #include "types.h"
 #include "dcpomatic_time.h"
-#include <boost/thread.hpp>
-#include <list>
-
-
+#include <boost/optional.hpp>
+#include <atomic>
+#include <vector>
+
+
+/** @class AudioRingBuffers
+ *  @brief A fixed-size ring of interleaved audio, written by one thread and read by another.
+ *
+ *  get() takes no locks and allocates nothing, so it can be called from a real-time
+ *  audio callback.  put() must only be called by one thread at a time and get() by one
+ *  (other) thread at a time.  clear() can be called from any thread, but not at the same
+ *  time as put(); if it happens during a get() that get() will return silence.
+ */
 class AudioRingBuffers
 {
 public:
-	AudioRingBuffers ();
+	explicit AudioRingBuffers (Frame capacity = 48000 * 8);
 
-	AudioRingBuffers (AudioBuffers const&) = delete;
-	AudioRingBuffers& operator= (AudioBuffers const&) = delete;
+	AudioRingBuffers (AudioRingBuffers const&) = delete;
+	AudioRingBuffers& operator= (AudioRingBuffers const&) = delete;
 
 	void put (std::shared_ptr<const AudioBuffers> data, dcpomatic::DCPTime time, int frame_rate);
 	boost::optional<dcpomatic::DCPTime> get (float* out, int channels, int frames);
@@ -46,10 +55,29 @@ public:
 	/** @return number of frames currently available */
 	Frame size () const;
 
+	/** @return maximum number of frames that can be held */
+	Frame capacity () const {
+		return _capacity;
+	}
+
 private:
-	mutable boost::mutex _mutex;
-	std::list<std::pair<std::shared_ptr<const AudioBuffers>, dcpomatic::DCPTime>> _buffers;
-	int _used_in_head = 0;
+	dcpomatic::DCPTime time_of (Frame position) const;
+
+	Frame const _capacity;
+	/** Interleaved samples; this is allocated by the first put(), when we know how many channels there are */
+	std::vector<float> _data;
+	int _channels = 0;
+	/** Total number of frames ever read from the ring; only get() and clear() change this */
+	std::atomic<Frame> _read;
+	/** Total number of frames ever written to the ring; only put() changes this */
+	std::atomic<Frame> _write;
+	/** _write position of the first put() since the ring was created or cleared */
+	std::atomic<Frame> _base_position;
+	/** Time of the audio at _base_position */
+	std::atomic<dcpomatic::DCPTime::Type> _base_time;
+	std::atomic<int> _frame_rate;
+	/** Time that we expect the next put() to start at, if there has been one since the last clear() */
+	boost::optional<dcpomatic::DCPTime> _next_put;
 };
 
 
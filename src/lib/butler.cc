@@ -28,6 +28,7 @@
 #include "player.h"
 #include "util.h"
 #include "video_content.h"
+#include <cmath>
 
 
 using std::cout;
@@ -53,6 +54,8 @@ using namespace boost::placeholders;
 #define MINIMUM_AUDIO_READAHEAD (48000 * MINIMUM_VIDEO_READAHEAD / 24)
 /** Maximum audio readahead in frames; should never be exceeded (by much) unless there are bugs in Player */
 #define MAXIMUM_AUDIO_READAHEAD (48000 * MAXIMUM_VIDEO_READAHEAD / 24)
+/** Maximum extra DCP decode reduction to use when we are struggling to keep up */
+#define MAXIMUM_EXTRA_DECODE_REDUCTION 3
 
 
 /** @param pixel_format Pixel format functor that will be used when calling ::image on PlayerVideos coming out of this
@@ -73,7 +76,8 @@ Butler::Butler (
 	)
 	: _film (film)
 	, _player (player)
-	, _prepare_work (new boost::asio::io_service::work(_prepare_service))
+	, _video (MAXIMUM_VIDEO_READAHEAD * 10)
+	, _audio (MAXIMUM_AUDIO_READAHEAD * 10)
 	, _pending_seek_accurate (false)
 	, _suspended (0)
 	, _finished (false)
@@ -87,6 +91,10 @@ Butler::Butler (
 	, _alignment (alignment)
 	, _fast (fast)
 	, _prepare_only_proxy (prepare_only_proxy)
+	, _adaptive_decode_reduction (false)
+	, _decode_reduction (MAXIMUM_EXTRA_DECODE_REDUCTION)
+	, _prepare_threads (std::max(1U, boost::thread::hardware_concurrency()) * 2)
+	, _real_time_audio (false)
 {
 	_player_video_connection = _player->Video.connect (bind (&Butler::video, this, _1, _2));
 	_player_audio_connection = _player->Audio.connect (bind (&Butler::audio, this, _1, _2, _3));
@@ -100,14 +108,10 @@ Butler::Butler (
 	pthread_setname_np (_thread.native_handle(), "butler");
 #endif
 
-	/* Create some threads to do work on the PlayerVideos we are creating; at present this is used to
-	   multi-thread JPEG2000 decoding.
-	*/
-
-	LOG_TIMING("start-prepare-threads %1", boost::thread::hardware_concurrency() * 2);
+	LOG_TIMING("start-prepare-threads %1", _prepare_threads);
 
-	for (size_t i = 0; i < boost::thread::hardware_concurrency() * 2; ++i) {
-		_prepare_pool.create_thread (bind (&boost::asio::io_service::run, &_prepare_service));
+	for (int i = 0; i < _prepare_threads; ++i) {
+		_prepare_pool.create_thread (bind(&Butler::prepare_thread, this));
 	}
 }
 
@@ -121,9 +125,16 @@ Butler::~Butler ()
 		_stop_thread = true;
 	}
 
-	_prepare_work.reset ();
+	{
+		boost::mutex::scoped_lock lm (_prepare_mutex);
+		_prepare_stop = true;
+		_prepare_condition.notify_all ();
+	}
 	_prepare_pool.join_all ();
-	_prepare_service.stop ();
+
+	if (_prepare_skipped) {
+		LOG_GENERAL ("Butler skipped preparation of %1 frames which were needed before they could be done", _prepare_skipped);
+	}
 
 	_thread.interrupt ();
 	try {
@@ -135,7 +146,7 @@ Butler::~Butler ()
 bool
 Butler::should_run () const
 {
-	if (_video.size() >= MAXIMUM_VIDEO_READAHEAD * 10) {
+	if (_video.size() >= _video.capacity()) {
 		/* This is way too big */
 		optional<DCPTime> pos = _audio.peek();
 		if (pos) {
@@ -147,18 +158,6 @@ Butler::should_run () const
 		}
 	}
 
-	if (_audio.size() >= MAXIMUM_AUDIO_READAHEAD * 10) {
-		/* This is way too big */
-		auto pos = _audio.peek();
-		if (pos) {
-			throw ProgrammingError
-				(__FILE__, __LINE__, String::compose ("Butler audio buffers reached %1 frames at %2 (video is %3)", _audio.size(), pos->get(), _video.size()));
-		} else {
-			throw ProgrammingError
-				(__FILE__, __LINE__, String::compose ("Butler audio buffers reached %1 frames (video is %3)", _audio.size(), _video.size()));
-		}
-	}
-
 	if (_video.size() >= MAXIMUM_VIDEO_READAHEAD * 2) {
 		LOG_WARNING ("Butler video buffers reached %1 frames (audio is %2)", _video.size(), _audio.size());
 	}
@@ -191,9 +190,17 @@ try
 	while (true) {
 		boost::mutex::scoped_lock lm (_mutex);
 
-		/* Wait until we have something to do */
+		/* Wait until we have something to do.  get_audio() does not wake us when it is
+		   called from a real-time thread, so while that is happening look every so often
+		   in case it has drained _audio.  Once it stops we wait to be woken as usual; anything
+		   else that wakes us (such as get_video()) will start us looking again if it restarts.
+		*/
 		while (!should_run() && !_pending_seek_position) {
-			_summon.wait (lm);
+			if (_real_time_audio.exchange(false)) {
+				_summon.timed_wait (lm, boost::posix_time::milliseconds(50));
+			} else {
+				_summon.wait (lm);
+			}
 		}
 
 		/* Do any seek that has been requested */
@@ -277,6 +284,14 @@ Butler::get_video (Behaviour behaviour, Error* e)
 
 	auto const r = _video.get ();
 	_summon.notify_all ();
+
+	{
+		/* Move the prepare threads' window on */
+		boost::mutex::scoped_lock plm (_prepare_mutex);
+		_prepare_head = r.second;
+		_prepare_condition.notify_all ();
+	}
+
 	return r;
 }
 
@@ -313,20 +328,141 @@ Butler::seek_unlocked (DCPTime position, bool accurate)
 	_audio.clear ();
 	_closed_caption.clear ();
 
+	{
+		boost::mutex::scoped_lock lm (_prepare_mutex);
+		_prepare_queue.clear ();
+		_prepare_head = boost::none;
+	}
+
 	_summon.notify_all ();
 }
 
 
+/** Caller must hold a lock on _prepare_mutex.
+ *  @return Number of frames after the one most recently returned by get_video() that the
+ *  prepare threads should work on.  This is enough that every frame which will be needed
+ *  in the time it takes to prepare one has been started, with a margin; preparing further
+ *  ahead than that uses memory and, if we get behind, time on frames which will never be
+ *  shown.
+ */
+int
+Butler::prepare_window (int frame_rate) const
+{
+	if (!_prepare_time) {
+		return MAXIMUM_VIDEO_READAHEAD;
+	}
+
+	int const needed = std::ceil (*_prepare_time * frame_rate * 2);
+	return std::max (MINIMUM_VIDEO_READAHEAD, std::min(MAXIMUM_VIDEO_READAHEAD, needed));
+}
+
+
+/** Tell our controller about a frame that has just been prepared, and pass on any
+ *  change that it then decides to make to the player's DCP decode reduction.
+ *  @param taken Time taken to prepare the frame, in seconds.
+ *  @param now Current time, in seconds.
+ */
+void
+Butler::adapt_decode_reduction (double taken, double now)
+{
+	auto film = _film.lock ();
+	if (!film) {
+		return;
+	}
+
+	_decode_reduction.add_decode (taken);
+
+	/* We have _prepare_threads working at once, but they will only get as far ahead
+	   of our consumer as prepare_window() allows.  Each frame must be ready in the
+	   time that those frames take to play.  taken is a wall-clock time so it already
+	   includes any time that the threads spend sharing the available cores.
+	*/
+	auto const rate = film->video_frame_rate ();
+	int window = 0;
+	{
+		boost::mutex::scoped_lock lm (_prepare_mutex);
+		window = prepare_window (rate);
+	}
+	auto const eyes = film->three_d() ? 2 : 1;
+	auto const in_flight = std::min (_prepare_threads, window * eyes);
+	auto const frames_per_second = rate * eyes;
+	auto const budget = in_flight / static_cast<double>(frames_per_second);
+
+	auto const reduction = _decode_reduction.update (now, budget);
+	if (reduction) {
+		LOG_DEBUG_PLAYER ("Butler setting extra DCP decode reduction to %1", *reduction);
+		_player->set_dcp_decode_extra_reduction (*reduction);
+	}
+}
+
+
+/** Thread to prepare videos that Player has given us, strictly in presentation order and
+ *  only within prepare_window() of the last frame which was returned by get_video().  Frames
+ *  which get_video() returns before we have started on them are skipped; whoever took them
+ *  will do the work themselves, if they need it done at all.
+ */
 void
-Butler::prepare (weak_ptr<PlayerVideo> weak_video)
+Butler::prepare_thread ()
 try
 {
-	auto video = weak_video.lock ();
-	/* If the weak_ptr cannot be locked the video obviously no longer requires any work */
-	if (video) {
+	start_of_thread ("Butler-prepare");
+
+	while (true) {
+		shared_ptr<PlayerVideo> video;
+		{
+			boost::mutex::scoped_lock lm (_prepare_mutex);
+			while (true) {
+				if (_prepare_stop) {
+					return;
+				}
+
+				while (!_prepare_queue.empty() && _prepare_head && _prepare_queue.front().second < *_prepare_head) {
+					_prepare_queue.pop_front ();
+					++_prepare_skipped;
+				}
+
+				if (!_prepare_queue.empty()) {
+					auto const& front = _prepare_queue.front();
+					auto const film = _film.lock ();
+					auto limit = DCPTime::max ();
+					if (film && _prepare_head) {
+						auto const rate = film->video_frame_rate ();
+						limit = *_prepare_head + DCPTime::from_frames(prepare_window(rate), rate);
+					}
+					if (front.second <= limit) {
+						video = front.first.lock ();
+						_prepare_queue.pop_front ();
+						if (video) {
+							break;
+						}
+						/* This video no longer requires any work */
+						continue;
+					}
+				}
+
+				_prepare_condition.wait (lm);
+			}
+		}
+
+		struct timeval start;
+		gettimeofday (&start, 0);
+
 		LOG_TIMING("start-prepare in %1", thread_id());
 		video->prepare (_pixel_format, _video_range, _alignment, _fast, _prepare_only_proxy);
 		LOG_TIMING("finish-prepare in %1", thread_id());
+
+		struct timeval end;
+		gettimeofday (&end, 0);
+		auto const taken = seconds(end) - seconds(start);
+
+		{
+			boost::mutex::scoped_lock lm (_prepare_mutex);
+			_prepare_time = _prepare_time ? (*_prepare_time * 0.9 + taken * 0.1) : taken;
+		}
+
+		if (_adaptive_decode_reduction) {
+			adapt_decode_reduction (taken, seconds(end));
+		}
 	}
 }
 catch (std::exception& e)
@@ -335,12 +471,14 @@ catch (std::exception& e)
 	boost::mutex::scoped_lock lm (_mutex);
 	_died = true;
 	_died_message = e.what ();
+	_arrived.notify_all ();
 }
 catch (...)
 {
 	store_current ();
 	boost::mutex::scoped_lock lm (_mutex);
 	_died = true;
+	_arrived.notify_all ();
 }
 
 
@@ -354,7 +492,11 @@ Butler::video (shared_ptr<PlayerVideo> video, DCPTime time)
 		return;
 	}
 
-	_prepare_service.post (bind(&Butler::prepare, this, weak_ptr<PlayerVideo>(video)));
+	{
+		boost::mutex::scoped_lock plm (_prepare_mutex);
+		_prepare_queue.push_back (make_pair(weak_ptr<PlayerVideo>(video), time));
+		_prepare_condition.notify_one ();
+	}
 
 	_video.put (video, time);
 }
@@ -376,15 +518,22 @@ Butler::audio (shared_ptr<AudioBuffers> audio, DCPTime time, int frame_rate)
 /** Try to get `frames' frames of audio and copy it into `out'.
  *  @param behaviour BLOCKING if we should block until audio is available.  If behaviour is NON_BLOCKING
  *  and no audio is immediately available the buffer will be filled with silence and boost::none
- *  will be returned.
+ *  will be returned.  With NON_BLOCKING this takes no locks and allocates no memory, so it can be
+ *  called from a real-time audio callback.
  *  @return time of this audio, or unset if blocking was false and no data was available.
  */
 optional<DCPTime>
 Butler::get_audio (Behaviour behaviour, float* out, Frame frames)
 {
+	if (behaviour == Behaviour::NON_BLOCKING) {
+		/* The butler thread will notice that we have taken some audio next time it looks */
+		_real_time_audio.store (true, std::memory_order_relaxed);
+		return _audio.get (out, _audio_channels, frames);
+	}
+
 	boost::mutex::scoped_lock lm (_mutex);
 
-	while (behaviour == Behaviour::BLOCKING && !_finished && !_died && _audio.size() < frames) {
+	while (!_finished && !_died && _audio.size() < frames) {
 		_arrived.wait (lm);
 	}
 
@@ -394,6 +543,30 @@ Butler::get_audio (Behaviour behaviour, float* out, Frame frames)
 }
 
 
+/** @param adaptive true to reduce the resolution that DCP pictures are decoded at (on top of
+ *  any reduction which suits the size of our output) when frames are taking too long to prepare,
+ *  or are being dropped by our consumer, and to put it back up again when there is time.
+ */
+void
+Butler::set_adaptive_decode_reduction (bool adaptive)
+{
+	_adaptive_decode_reduction = adaptive;
+	/* Either we are not adapting, or we are starting again from our controller's initial state */
+	_decode_reduction.reset ();
+	_player->set_dcp_decode_extra_reduction (0);
+}
+
+
+/** Called by our consumer to tell us that it dropped a frame because it was not ready in time */
+void
+Butler::video_dropped ()
+{
+	if (_adaptive_decode_reduction) {
+		_decode_reduction.add_dropped ();
+	}
+}
+
+
 void
 Butler::disable_audio ()
 {
@@ -406,6 +579,7 @@ pair<size_t, string>
 Butler::memory_used () const
 {
 	/* XXX: should also look at _audio.memory_used() */
+	boost::mutex::scoped_lock lm (_mutex);
 	return _video.memory_used();
 }
 
@@ -417,6 +591,7 @@ Butler::player_change (ChangeType type, int property)
 		if (type == ChangeType::DONE) {
 			auto film = _film.lock();
 			if (film) {
+				boost::mutex::scoped_lock lm (_mutex);
 				_video.reset_metadata (film, _player->video_container_size());
 			}
 		}
@@ -22,13 +22,15 @@
 #include "audio_mapping.h"
 #include "audio_ring_buffers.h"
 #include "change_signaller.h"
+#include "decode_reduction_controller.h"
 #include "exception_store.h"
 #include "text_ring_buffers.h"
 #include "video_ring_buffers.h"
-#include <boost/asio.hpp>
 #include <boost/signals2.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
+#include <atomic>
+#include <deque>
 
 
 class Player;
@@ -82,6 +84,8 @@ public:
 	boost::optional<TextRingBuffers::Data> get_closed_caption ();
 
 	void disable_audio ();
+	void set_adaptive_decode_reduction (bool adaptive);
+	void video_dropped ();
 
 	std::pair<size_t, std::string> memory_used () const;
 
@@ -91,7 +95,9 @@ private:
 	void audio (std::shared_ptr<AudioBuffers> audio, dcpomatic::DCPTime time, int frame_rate);
 	void text (PlayerText pt, TextType type, boost::optional<DCPTextTrack> track, dcpomatic::DCPTimePeriod period);
 	bool should_run () const;
-	void prepare (std::weak_ptr<PlayerVideo> video);
+	void prepare_thread ();
+	int prepare_window (int frame_rate) const;
+	void adapt_decode_reduction (double taken, double now);
 	void player_change (ChangeType type, int property);
 	void seek_unlocked (dcpomatic::DCPTime position, bool accurate);
 
@@ -103,12 +109,28 @@ private:
 	AudioRingBuffers _audio;
 	TextRingBuffers _closed_caption;
 
+	/** Threads to do work on the PlayerVideos we are creating; at present this is used to
+	 *  multi-thread JPEG2000 decoding.
+	 */
 	boost::thread_group _prepare_pool;
-	boost::asio::io_service _prepare_service;
-	std::shared_ptr<boost::asio::io_service::work> _prepare_work;
-
-	/** mutex to protect _pending_seek_position, _pending_seek_accurate, _finished, _died, _stop_thread */
-	boost::mutex _mutex;
+	/** mutex to protect _prepare_queue, _prepare_head, _prepare_time and _prepare_stop */
+	mutable boost::mutex _prepare_mutex;
+	/** condition to wake the prepare threads */
+	boost::condition _prepare_condition;
+	/** Videos which are waiting to be prepared, in presentation order */
+	std::deque<std::pair<std::weak_ptr<PlayerVideo>, dcpomatic::DCPTime>> _prepare_queue;
+	/** Time of the last video returned by get_video() since the last seek, if there is one */
+	boost::optional<dcpomatic::DCPTime> _prepare_head;
+	/** Recent average time taken to prepare one video, in seconds */
+	boost::optional<double> _prepare_time;
+	/** Number of videos which were returned by get_video() before we got round to preparing them */
+	int _prepare_skipped = 0;
+	bool _prepare_stop = false;
+
+	/** mutex to protect _pending_seek_position, _pending_seek_accurate, _finished, _died, _stop_thread,
+	 *  and to serialise everything that writes to _video and _audio (apart from NON_BLOCKING get_audio())
+	 */
+	mutable boost::mutex _mutex;
 	boost::condition _summon;
 	boost::condition _arrived;
 	boost::optional<dcpomatic::DCPTime> _pending_seek_position;
@@ -137,6 +159,19 @@ private:
 	 */
 	bool _prepare_only_proxy = false;
 
+	/** true to change the player's extra DCP decode reduction according to how well
+	 *  we and our consumer are keeping up.
+	 */
+	std::atomic<bool> _adaptive_decode_reduction;
+	DecodeReductionController _decode_reduction;
+	/** number of threads in _prepare_pool */
+	int const _prepare_threads;
+
+	/** set by get_audio() when it is called with NON_BLOCKING (which does not wake our thread),
+	 *  and cleared by our thread when it looks
+	 */
+	std::atomic<bool> _real_time_audio;
+
 	/** If we are waiting to be refilled following a seek, this is the time we were
 	    seeking to.
 	*/
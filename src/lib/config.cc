@@ -88,10 +88,12 @@ Config::set_defaults ()
 {
 	_master_encoding_threads = max (2U, boost::thread::hardware_concurrency ());
 	_server_encoding_threads = max (2U, boost::thread::hardware_concurrency ());
+	_parallel_reels = 1;
 	_server_port_base = 6192;
 	_use_any_servers = true;
 	_servers.clear ();
 	_only_servers_encode = false;
+	_compress_frames_for_servers = true;
 	_tms_protocol = FileTransferProtocol::SCP;
 	_tms_ip = "";
 	_tms_path = ".";
@@ -163,6 +165,8 @@ Config::set_defaults ()
 	   use about 240Mb with 72 encoding threads.
 	*/
 	_frames_in_memory_multiplier = 3;
+	_j2k_cache_directory = boost::none;
+	_j2k_cache_size = 20;
 	_decode_reduction = optional<int>();
 	_default_notify = false;
 	for (int i = 0; i < NOTIFICATION_COUNT; ++i) {
@@ -283,6 +287,8 @@ try
 		_server_encoding_threads = f.number_child<int>("ServerEncodingThreads");
 	}
 
+	_parallel_reels = f.optional_number_child<int>("ParallelReels").get_value_or(1);
+
 	_default_directory = f.optional_string_child ("DefaultDirectory");
 	if (_default_directory && _default_directory->empty ()) {
 		/* We used to store an empty value for this to mean "none set" */
@@ -307,6 +313,7 @@ try
 	}
 
 	_only_servers_encode = f.optional_bool_child ("OnlyServersEncode").get_value_or (false);
+	_compress_frames_for_servers = f.optional_bool_child("CompressFramesForServers").get_value_or(true);
 	_tms_protocol = static_cast<FileTransferProtocol>(f.optional_number_child<int>("TMSProtocol").get_value_or(static_cast<int>(FileTransferProtocol::SCP)));
 	_tms_ip = f.string_child ("TMSIP");
 	_tms_path = f.string_child ("TMSPath");
@@ -525,6 +532,8 @@ try
 		}
 	}
 	_frames_in_memory_multiplier = f.optional_number_child<int>("FramesInMemoryMultiplier").get_value_or(3);
+	_j2k_cache_directory = f.optional_string_child("J2KCacheDirectory");
+	_j2k_cache_size = f.optional_number_child<int>("J2KCacheSize").get_value_or(20);
 	_decode_reduction = f.optional_number_child<int>("DecodeReduction");
 	_default_notify = f.optional_bool_child("DefaultNotify").get_value_or(false);
 
@@ -648,6 +657,10 @@ Config::write_config () const
 	root->add_child("MasterEncodingThreads")->add_child_text (raw_convert<string> (_master_encoding_threads));
 	/* [XML] ServerEncodingThreads Number of encoding threads to use when running as server. */
 	root->add_child("ServerEncodingThreads")->add_child_text (raw_convert<string> (_server_encoding_threads));
+	if (_parallel_reels != 1) {
+		/* [XML:opt] ParallelReels Number of reels to decode at the same time when making a DCP; 1 if not present. */
+		root->add_child("ParallelReels")->add_child_text (raw_convert<string>(_parallel_reels));
+	}
 	if (_default_directory) {
 		/* [XML:opt] DefaultDirectory Default directory when creating a new film in the GUI. */
 		root->add_child("DefaultDirectory")->add_child_text (_default_directory->string ());
@@ -671,6 +684,10 @@ Config::write_config () const
 	   is done by the encoding servers.  0 to set the master to do some encoding as well as coordinating the job.
 	*/
 	root->add_child("OnlyServersEncode")->add_child_text (_only_servers_encode ? "1" : "0");
+	/* [XML] CompressFramesForServers 1 to losslessly compress decoded frames before sending them to encoding servers
+	   which can accept them, using some CPU on the master to save network bandwidth; 0 to always send them raw.
+	*/
+	root->add_child("CompressFramesForServers")->add_child_text (_compress_frames_for_servers ? "1" : "0");
 	/* [XML] TMSProtocol Protocol to use to copy files to a TMS; 0 to use SCP, 1 for FTP. */
 	root->add_child("TMSProtocol")->add_child_text (raw_convert<string> (static_cast<int> (_tms_protocol)));
 	/* [XML] TMSIP IP address of TMS. */
@@ -925,6 +942,13 @@ Config::write_config () const
 	*/
 	root->add_child("FramesInMemoryMultiplier")->add_child_text(raw_convert<string>(_frames_in_memory_multiplier));
 
+	if (_j2k_cache_directory) {
+		/* [XML] J2KCacheDirectory Directory in which to keep encoded JPEG2000 frames so that later encodes can re-use them. */
+		root->add_child("J2KCacheDirectory")->add_child_text(_j2k_cache_directory->string());
+		/* [XML] J2KCacheSize Maximum size of the data in J2KCacheDirectory, in GB. */
+		root->add_child("J2KCacheSize")->add_child_text(raw_convert<string>(_j2k_cache_size));
+	}
+
 	/* [XML] DecodeReduction power of 2 to reduce DCP images by before decoding in the player. */
 	if (_decode_reduction) {
 		root->add_child("DecodeReduction")->add_child_text(raw_convert<string>(_decode_reduction.get()));
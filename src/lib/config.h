@@ -68,6 +68,13 @@ public:
 		return _server_encoding_threads;
 	}
 
+	/** @return number of reels which should be decoded at the same time (each by its own player)
+	 *  when making a DCP.
+	 */
+	int parallel_reels () const {
+		return _parallel_reels;
+	}
+
 	boost::optional<boost::filesystem::path> default_directory () const {
 		return _default_directory;
 	}
@@ -125,6 +132,11 @@ public:
 		return _only_servers_encode;
 	}
 
+	/** @return true to losslessly compress raw frames before sending them to servers which can accept them */
+	bool compress_frames_for_servers () const {
+		return _compress_frames_for_servers;
+	}
+
 	FileTransferProtocol tms_protocol () const {
 		return _tms_protocol;
 	}
@@ -462,6 +474,15 @@ public:
 		return _frames_in_memory_multiplier;
 	}
 
+	boost::optional<boost::filesystem::path> j2k_cache_directory () const {
+		return _j2k_cache_directory;
+	}
+
+	/** @return maximum size of the J2K cache in GB */
+	int j2k_cache_size () const {
+		return _j2k_cache_size;
+	}
+
 	boost::optional<int> decode_reduction () const {
 		return _decode_reduction;
 	}
@@ -591,6 +612,10 @@ public:
 		maybe_set (_server_encoding_threads, n);
 	}
 
+	void set_parallel_reels (int n) {
+		maybe_set (_parallel_reels, n);
+	}
+
 	void set_default_directory (boost::filesystem::path d) {
 		if (_default_directory && *_default_directory == d) {
 			return;
@@ -608,6 +633,10 @@ public:
 		maybe_set (_only_servers_encode, o);
 	}
 
+	void set_compress_frames_for_servers (bool c) {
+		maybe_set (_compress_frames_for_servers, c);
+	}
+
 	void set_tms_protocol (FileTransferProtocol p) {
 		maybe_set (_tms_protocol, p);
 	}
@@ -926,6 +955,22 @@ public:
 		maybe_set (_frames_in_memory_multiplier, m);
 	}
 
+	void set_j2k_cache_directory (boost::filesystem::path d) {
+		maybe_set (_j2k_cache_directory, d);
+	}
+
+	void unset_j2k_cache_directory () {
+		if (!_j2k_cache_directory) {
+			return;
+		}
+		_j2k_cache_directory = boost::none;
+		changed ();
+	}
+
+	void set_j2k_cache_size (int s) {
+		maybe_set (_j2k_cache_size, s);
+	}
+
 	void set_decode_reduction (boost::optional<int> r) {
 		maybe_set (_decode_reduction, r);
 	}
@@ -1195,6 +1240,8 @@ private:
 	int _master_encoding_threads;
 	/** number of threads which a server should use for J2K encoding on the local machine */
 	int _server_encoding_threads;
+	/** number of reels to decode at the same time when making a DCP */
+	int _parallel_reels;
 	/** default directory to put new films in */
 	boost::optional<boost::filesystem::path> _default_directory;
 	/** base port number to use for J2K encoding servers;
@@ -1206,6 +1253,7 @@ private:
 	/** J2K encoding servers that should definitely be used */
 	std::vector<std::string> _servers;
 	bool _only_servers_encode;
+	bool _compress_frames_for_servers;
 	FileTransferProtocol _tms_protocol;
 	/** The IP address of a TMS that we can copy DCPs to */
 	std::string _tms_ip;
@@ -1304,6 +1352,12 @@ private:
 	boost::optional<KDMWriteType> _last_kdm_write_type;
 	boost::optional<DKDMWriteType> _last_dkdm_write_type;
 	int _frames_in_memory_multiplier;
+	/** Directory to keep encoded JPEG2000 frames in so that they can be re-used by later encodes,
+	 *  or none to not do that.
+	 */
+	boost::optional<boost::filesystem::path> _j2k_cache_directory;
+	/** Maximum size of the data in _j2k_cache_directory in GB */
+	int _j2k_cache_size;
 	boost::optional<int> _decode_reduction;
 	bool _default_notify;
 	bool _notification[NOTIFICATION_COUNT];
@@ -51,6 +51,8 @@
 #include <dcp/stereo_picture_asset_reader.h>
 #include <dcp/stereo_picture_frame.h>
 #include <dcp/subtitle_image.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include "i18n.h"
@@ -68,6 +70,10 @@ using boost::optional;
 using namespace dcpomatic;
 
 
+/** Length of audio in seconds to emit from each pass() when we are not emitting anything else */
+static double constexpr audio_only_pass_length = 1;
+
+
 DCPDecoder::DCPDecoder (shared_ptr<const Film> film, shared_ptr<const DCPContent> content, bool fast, bool tolerant, shared_ptr<DCPDecoder> old)
 	: Decoder (film)
 	, _dcp_content (content)
@@ -158,12 +164,28 @@ DCPDecoder::pass ()
 	auto picture_asset = (*_reel)->main_picture()->asset();
 	DCPOMATIC_ASSERT (picture_asset);
 
+	bool const use_video = video && !video->ignore();
+	bool const use_text = std::any_of(text.begin(), text.end(), [](shared_ptr<TextDecoder> t) { return !t->ignore(); });
+
+	/* Number of frames to do in this pass.  If nobody wants anything but audio we need
+	   not read any pictures, and we can do a lot of audio at once.
+	*/
+	int frames_this_pass = 1;
+	if (!use_video && !use_text && !_atmos_reader) {
+		frames_this_pass = std::max(
+			static_cast<int64_t>(1),
+			std::min(static_cast<int64_t>(ceil(vfr * audio_only_pass_length)), (*_reel)->main_picture()->duration() - frame)
+			);
+	}
+
 	/* We must emit texts first as when we emit the video for this frame
 	   it will expect already to have the texts.
 	*/
-	pass_texts (_next, picture_asset->size());
+	if (use_text) {
+		pass_texts (_next, picture_asset->size());
+	}
 
-	if ((_mono_reader || _stereo_reader) && (_decode_referenced || !_dcp_content->reference_video())) {
+	if (use_video && (_mono_reader || _stereo_reader) && (_decode_referenced || !_dcp_content->reference_video())) {
 		auto const entry_point = (*_reel)->main_picture()->entry_point().get_value_or(0);
 		if (_mono_reader) {
 			video->emit (
@@ -172,7 +194,8 @@ DCPDecoder::pass ()
 					_mono_reader->get_frame (entry_point + frame),
 					picture_asset->size(),
 					AV_PIX_FMT_XYZ12LE,
-					_forced_reduction
+					_forced_reduction,
+					_extra_reduction
 					),
 				_offset + frame
 				);
@@ -184,7 +207,8 @@ DCPDecoder::pass ()
 					picture_asset->size(),
 					dcp::Eye::LEFT,
 					AV_PIX_FMT_XYZ12LE,
-					_forced_reduction
+					_forced_reduction,
+					_extra_reduction
 					),
 				_offset + frame
 				);
@@ -196,7 +220,8 @@ DCPDecoder::pass ()
 					picture_asset->size(),
 					dcp::Eye::RIGHT,
 					AV_PIX_FMT_XYZ12LE,
-					_forced_reduction
+					_forced_reduction,
+					_extra_reduction
 					),
 				_offset + frame
 				);
@@ -205,17 +230,29 @@ DCPDecoder::pass ()
 
 	if (_sound_reader && (_decode_referenced || !_dcp_content->reference_audio())) {
 		auto const entry_point = (*_reel)->main_sound()->entry_point().get_value_or(0);
-		auto sf = _sound_reader->get_frame (entry_point + frame);
-		auto from = sf->data ();
-
 		int const channels = _dcp_content->audio->stream()->channels ();
-		int const frames = sf->size() / (3 * channels);
-		auto data = make_shared<AudioBuffers>(channels, frames);
-		auto data_data = data->data();
-		for (int i = 0; i < frames; ++i) {
-			for (int j = 0; j < channels; ++j) {
-				data_data[j][i] = static_cast<int> ((from[0] << 8) | (from[1] << 16) | (from[2] << 24)) / static_cast<float> (INT_MAX - 256);
-				from += 3;
+		shared_ptr<AudioBuffers> data;
+
+		for (int f = 0; f < frames_this_pass; ++f) {
+			auto sf = _sound_reader->get_frame (entry_point + frame + f);
+			auto from = sf->data ();
+
+			int const frames = sf->size() / (3 * channels);
+			int offset = 0;
+			if (data) {
+				offset = data->frames();
+				data->set_frames (offset + frames);
+			} else {
+				data = make_shared<AudioBuffers>(channels, frames * frames_this_pass);
+				data->set_frames (frames);
+			}
+
+			auto data_data = data->data();
+			for (int i = offset; i < offset + frames; ++i) {
+				for (int j = 0; j < channels; ++j) {
+					data_data[j][i] = static_cast<int> ((from[0] << 8) | (from[1] << 16) | (from[2] << 24)) / static_cast<float> (INT_MAX - 256);
+					from += 3;
+				}
 			}
 		}
 
@@ -228,7 +265,7 @@ DCPDecoder::pass ()
 		atmos->emit (film(), _atmos_reader->get_frame(entry_point + frame), _offset + frame, *_atmos_metadata);
 	}
 
-	_next += ContentTime::from_frames (1, vfr);
+	_next += ContentTime::from_frames (frames_this_pass, vfr);
 
 	if ((*_reel)->main_picture ()) {
 		if (_next.frames_round (vfr) >= (*_reel)->main_picture()->duration()) {
@@ -478,6 +515,17 @@ DCPDecoder::set_forced_reduction (optional<int> reduction)
 }
 
 
+/** Set a reduction to apply to decoded pictures on top of the one that would
+ *  be chosen to suit the size that they are being decoded for.  This has no
+ *  effect if a forced reduction has been set.
+ */
+void
+DCPDecoder::set_extra_reduction (int reduction)
+{
+	_extra_reduction = reduction;
+}
+
+
 string
 DCPDecoder::calculate_lazy_digest (shared_ptr<const DCPContent> c) const
 {
@@ -58,6 +58,7 @@ public:
 
 	void set_decode_referenced (bool r);
 	void set_forced_reduction (boost::optional<int> reduction);
+	void set_extra_reduction (int reduction);
 
 	bool pass () override;
 	void seek (dcpomatic::ContentTime t, bool accurate) override;
@@ -106,6 +107,7 @@ private:
 
 	bool _decode_referenced = false;
 	boost::optional<int> _forced_reduction;
+	int _extra_reduction = 0;
 
 	std::string _lazy_digest;
 };
@@ -33,11 +33,16 @@
 #include "player.h"
 #include "job.h"
 #include "writer.h"
+#include "config.h"
+#include "util.h"
 #include "compose.hpp"
 #include "referenced_reel_asset.h"
 #include "text_content.h"
 #include "player_video.h"
 #include <boost/signals2.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <exception>
 #include <iostream>
 
 #include "i18n.h"
@@ -118,17 +123,141 @@ DCPEncoder::go ()
 		_writer->write (fonts);
 	}
 
-	while (!_player->pass ()) {}
-
+	/* Give the writer any referenced assets now so that it can be hashing them while we encode */
 	for (auto i: _player->get_reel_assets()) {
 		_writer->write (i);
 	}
 
+	auto const reels = _film->reels ();
+	int const parallel = std::min (static_cast<int>(reels.size()), Config::instance()->parallel_reels());
+	if (parallel > 1) {
+		encode_reels_in_parallel (reels, parallel);
+	} else {
+		while (!_player->pass ()) {}
+	}
+
 	_finishing = true;
 	_j2k_encoder->end ();
 	_writer->finish (_film->dir(_film->dcp_name()));
 }
 
+/** Decode the video for each reel with its own Player, so that decoding, scaling and
+ *  subtitle burning for different reels happen on different threads.  The Writer writes
+ *  each reel's frames independently, so none of them needs to wait for earlier reels.
+ *  Meanwhile _player gives us the audio, text and Atmos for the whole film, in order.
+ *  @param reels Periods of the reels in the DCP.
+ *  @param threads Number of reels to decode at once.
+ */
+void
+DCPEncoder::encode_reels_in_parallel (vector<DCPTimePeriod> reels, int threads)
+{
+	_parallel_reels = true;
+	_player->set_ignore_video ();
+
+	std::atomic<int> next_reel (0);
+	std::atomic<bool> stop (false);
+	boost::mutex mutex;
+	boost::condition condition;
+	int finished = 0;
+	std::exception_ptr error;
+
+	auto run = [&]() {
+		start_of_thread ("DCPEncoder-reel");
+		try {
+			while (!stop) {
+				int const reel = next_reel++;
+				if (reel >= static_cast<int>(reels.size())) {
+					break;
+				}
+				encode_reel_video (reels[reel], stop);
+			}
+		} catch (boost::thread_interrupted) {
+			/* We are being cancelled */
+		} catch (...) {
+			boost::mutex::scoped_lock lm (mutex);
+			if (!error) {
+				error = std::current_exception ();
+			}
+			stop = true;
+		}
+
+		boost::mutex::scoped_lock lm (mutex);
+		++finished;
+		condition.notify_all ();
+	};
+
+	boost::thread_group pool;
+	for (int i = 0; i < threads; ++i) {
+		pool.create_thread (run);
+	}
+
+	try {
+		while (!_player->pass ()) {}
+
+		auto job = _job.lock ();
+		DCPOMATIC_ASSERT (job);
+
+		boost::mutex::scoped_lock lm (mutex);
+		while (finished < threads) {
+			lm.unlock ();
+			job->set_progress (video_progress());
+			lm.lock ();
+			condition.timed_wait (lm, boost::posix_time::seconds(1));
+		}
+	} catch (...) {
+		stop = true;
+		pool.interrupt_all ();
+		pool.join_all ();
+		throw;
+	}
+
+	pool.join_all ();
+
+	if (error) {
+		std::rethrow_exception (error);
+	}
+}
+
+
+/** Pass the video for one reel to the J2KEncoder, using a new Player.
+ *  @param stop Flag which will be set if we should give up early.
+ */
+void
+DCPEncoder::encode_reel_video (DCPTimePeriod reel, std::atomic<bool>& stop)
+{
+	auto player = make_shared<Player>(_film, Image::Alignment::PADDED);
+	player->set_ignore_audio ();
+	player->seek (reel.from, true);
+
+	bool done = false;
+	boost::signals2::scoped_connection connection = player->Video.connect (
+		[this, reel, &done](shared_ptr<PlayerVideo> data, DCPTime time) {
+			if (time >= reel.to) {
+				/* This is the next reel's job */
+				done = true;
+				return;
+			}
+			_j2k_encoder->encode (data, time);
+		});
+
+	while (!done && !stop && !player->pass ()) {}
+}
+
+
+/** @return Progress, as a fraction, judged by the number of video frames that have been
+ *  given to the J2KEncoder.
+ */
+float
+DCPEncoder::video_progress () const
+{
+	auto const length = _film->length().frames_round(_film->video_frame_rate());
+	if (length == 0) {
+		return 0;
+	}
+	return std::min (1.0f, static_cast<float>(_j2k_encoder->video_frames_enqueued()) / length);
+}
+
+
 void
 DCPEncoder::video (shared_ptr<PlayerVideo> data, DCPTime time)
 {
@@ -142,7 +271,12 @@ DCPEncoder::audio (shared_ptr<AudioBuffers> data, DCPTime time)
 
 	auto job = _job.lock ();
 	DCPOMATIC_ASSERT (job);
-	job->set_progress (float(time.get()) / _film->length().get());
+	if (_parallel_reels) {
+		/* Audio will get to the end long before the video does */
+		job->set_progress (video_progress());
+	} else {
+		job->set_progress (float(time.get()) / _film->length().get());
+	}
 }
 
 void
@@ -24,6 +24,7 @@
 #include "dcp_text_track.h"
 #include "encoder.h"
 #include <dcp/atmos_frame.h>
+#include <atomic>
 
 class Film;
 class J2KEncoder;
@@ -52,6 +53,10 @@ public:
 
 private:
 
+	void encode_reels_in_parallel (std::vector<dcpomatic::DCPTimePeriod> reels, int threads);
+	void encode_reel_video (dcpomatic::DCPTimePeriod reel, std::atomic<bool>& stop);
+	float video_progress () const;
+
 	void video (std::shared_ptr<PlayerVideo>, dcpomatic::DCPTime);
 	void audio (std::shared_ptr<AudioBuffers>, dcpomatic::DCPTime);
 	void text (PlayerText, TextType, boost::optional<DCPTextTrack>, dcpomatic::DCPTimePeriod);
@@ -61,6 +66,10 @@ private:
 	std::shared_ptr<J2KEncoder> _j2k_encoder;
 	bool _finishing;
 	bool _non_burnt_subtitles;
+	/** true if the video for each reel is being decoded by its own Player, and _player
+	 *  is only being used for audio, text and Atmos.
+	 */
+	bool _parallel_reels = false;
 
 	boost::signals2::scoped_connection _player_video_connection;
 	boost::signals2::scoped_connection _player_audio_connection;
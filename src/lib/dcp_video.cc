@@ -36,23 +36,27 @@
 #include "dcp_video.h"
 #include "dcpomatic_log.h"
 #include "dcpomatic_socket.h"
+#include "digester.h"
+#include "encode_server_connection.h"
 #include "encode_server_description.h"
 #include "exceptions.h"
 #include "image.h"
 #include "log.h"
 #include "player_video.h"
+#include "rgb_to_xyz.h"
 #include "rng.h"
 #include <libcxml/cxml.h>
 #include <dcp/raw_convert.h>
 #include <dcp/openjpeg_image.h>
 #include <dcp/rgb_xyz.h>
 #include <dcp/j2k_transcode.h>
+#include <dcp/version.h>
 #include <dcp/warnings.h>
 LIBDCP_DISABLE_WARNINGS
 #include <libxml++/libxml++.h>
 LIBDCP_ENABLE_WARNINGS
-#include <boost/asio.hpp>
 #include <boost/thread.hpp>
+#include <openjpeg.h>
 #include <stdint.h>
 #include <iomanip>
 #include <iostream>
@@ -64,6 +68,7 @@ using std::cout;
 using std::make_shared;
 using std::shared_ptr;
 using std::string;
+using boost::optional;
 using dcp::ArrayData;
 using dcp::raw_convert;
 #if BOOST_VERSION >= 106100
@@ -71,6 +76,15 @@ using namespace boost::placeholders;
 #endif
 
 
+std::atomic<int> DCPVideo::_small_frames (0);
+
+
+/** Smallest J2K frame that we will write; smaller frames have noise added and are encoded again.
+ *  This was empirically derived by a user: see #1902.
+ */
+static int constexpr minimum_size = 16384;
+
+
 #define DCI_COEFFICENT (48.0 / 52.37)
 
 
@@ -107,7 +121,7 @@ DCPVideo::convert_to_xyz (shared_ptr<const PlayerVideo> frame, dcp::NoteHandler
 
 	auto image = frame->image (bind(&PlayerVideo::keep_xyz_or_rgb, _1), VideoRange::FULL, false);
 	if (frame->colour_conversion()) {
-		xyz = dcp::rgb_to_xyz (
+		xyz = dcpomatic::rgb_to_xyz (
 			image->data()[0],
 			image->size(),
 			image->stride()[0],
@@ -121,7 +135,11 @@ DCPVideo::convert_to_xyz (shared_ptr<const PlayerVideo> frame, dcp::NoteHandler
 	return xyz;
 }
 
-/** J2K-encode this frame on the local host.
+/** J2K-encode this frame on the local host.  If the result is too small we add noise and
+ *  encode again, as many times as it takes; the first noisy attempt is usually enough.
+ *  Converting to XYZ happens once for the first encode and once more for a frame that needs
+ *  noise.  This is per call, so a frame which is encoded more than once (for example
+ *  speculatively by another thread) is converted again each time.
  *  @return Encoded data.
  */
 ArrayData
@@ -130,13 +148,13 @@ DCPVideo::encode_locally () const
 	auto const comment = Config::instance()->dcp_j2k_comment();
 
 	ArrayData enc = {};
-	/* This was empirically derived by a user: see #1902 */
-	int const minimum_size = 16384;
 	LOG_GENERAL ("Using minimum frame size %1", minimum_size);
 
 	auto xyz = convert_to_xyz (_frame, boost::bind(&Log::dcp_log, dcpomatic_log.get(), _1, _2));
+	/* Copy of the XYZ image before anything was done to it, made only if we need it */
+	shared_ptr<dcp::OpenJPEGImage> pristine;
 	int noise_amount = 2;
-	int pixel_skip = 16;
+	optional<int> pixel_skip;
 	while (true) {
 		enc = dcp::compress_j2k (
 			xyz,
@@ -152,14 +170,35 @@ DCPVideo::encode_locally () const
 			break;
 		}
 
-		LOG_GENERAL (N_("Frame %1 encoded size was small (%2); adding noise at level %3 with pixel skip %4"), _index, enc.size(), noise_amount, pixel_skip);
-
 		/* The JPEG2000 is too low-bitrate for some decoders <cough>DSS200</cough> so add some noise
-		 * and try again.  This is slow but hopefully won't happen too often.  We have to do
-		 * convert_to_xyz() again because compress_j2k() corrupts its xyz parameter.
+		 * and try again.  This is slow but hopefully won't happen too often.  compress_j2k() corrupts
+		 * its xyz parameter, so we convert once more to get an untouched copy and then start each
+		 * attempt from a copy of that.
 		 */
 
-		xyz = convert_to_xyz (_frame, boost::bind(&Log::dcp_log, dcpomatic_log.get(), _1, _2));
+		if (!pristine) {
+			++_small_frames;
+			pristine = convert_to_xyz (_frame, boost::bind(&Log::dcp_log, dcpomatic_log.get(), _1, _2));
+		}
+
+		if (!pixel_skip) {
+			/* Guess how much noise we need from how far short we fell, so that the next
+			   attempt is usually the last: the smaller the frame, the more pixels we add
+			   noise to.
+			*/
+			pixel_skip = std::max(1, std::min(16, static_cast<int>(8 * enc.size() / minimum_size)));
+		} else if (*pixel_skip > 1) {
+			pixel_skip = std::max(1, *pixel_skip / 2);
+		} else {
+			++noise_amount;
+		}
+
+		/* Something's gone badly wrong if this much noise doesn't help */
+		DCPOMATIC_ASSERT (noise_amount < 16);
+
+		LOG_GENERAL (N_("Frame %1 encoded size was small (%2); adding noise at level %3 with pixel skip %4"), _index, enc.size(), noise_amount, *pixel_skip);
+
+		xyz = make_shared<dcp::OpenJPEGImage>(*pristine);
 		auto size = xyz->size ();
 		auto pixels = size.width * size.height;
 		dcpomatic::RNG rng(42);
@@ -168,17 +207,9 @@ DCPVideo::encode_locally () const
 			auto e = xyz->data(c) + pixels;
 			while (p < e) {
 				*p = std::min(4095, std::max(0, *p + (rng.get() % noise_amount)));
-				p += pixel_skip;
+				p += *pixel_skip;
 			}
 		}
-
-		if (pixel_skip > 1) {
-			--pixel_skip;
-		} else {
-			++noise_amount;
-		}
-		/* Something's gone badly wrong if this much noise doesn't help */
-		DCPOMATIC_ASSERT (noise_amount < 16);
 	}
 
 	switch (_frame->eyes()) {
@@ -198,6 +229,35 @@ DCPVideo::encode_locally () const
 	return enc;
 }
 
+
+/** @return A digest of everything that affects the J2K data that encode_locally() or
+ *  encode_remotely() would return, so that it can be used to find a cached copy.
+ */
+string
+DCPVideo::digest () const
+{
+	if (!_digest) {
+		Digester digester;
+		/* Change this if the encoding changes in a way that makes old encodes unsuitable */
+		digester.add (string("dcp-video-1"));
+		_frame->add_digest (digester);
+		digester.add (_frame->eyes() == Eyes::LEFT || _frame->eyes() == Eyes::RIGHT);
+		digester.add (_frames_per_second);
+		digester.add (_j2k_bandwidth);
+		digester.add (static_cast<int>(_resolution));
+		digester.add (Config::instance()->dcp_j2k_comment());
+		digester.add (minimum_size);
+		/* The same settings can give different J2K from a different encoder */
+		digester.add (string(dcp::version));
+		digester.add (string(dcp::git_commit));
+		digester.add (string(opj_version()));
+		_digest = digester.get ();
+	}
+
+	return *_digest;
+}
+
+
 /** Send this frame to a remote server for J2K encoding, then read the result.
  *  @param serv Server to send to.
  *  @param timeout timeout in seconds.
@@ -206,62 +266,44 @@ DCPVideo::encode_locally () const
 ArrayData
 DCPVideo::encode_remotely (EncodeServerDescription serv, int timeout) const
 {
-	boost::asio::io_service io_service;
-	boost::asio::ip::tcp::resolver resolver (io_service);
-	boost::asio::ip::tcp::resolver::query query (serv.host_name(), raw_convert<string> (ENCODE_FRAME_PORT));
-	boost::asio::ip::tcp::resolver::iterator endpoint_iterator = resolver.resolve (query);
-
-	auto socket = make_shared<Socket>(timeout);
+	EncodeServerConnection connection (serv, timeout);
+	connection.send (*this);
+	return connection.collect().second;
+}
 
-	socket->connect (*endpoint_iterator);
 
+/** Write the metadata and image data for this frame to a socket, followed by a digest.
+ *  @param compress true to losslessly compress raw image data where possible; only do this
+ *  if the server has said that it can decompress it.
+ */
+void
+DCPVideo::write_to_socket (shared_ptr<Socket> socket, bool compress) const
+{
 	/* Collect all XML metadata */
 	xmlpp::Document doc;
 	auto root = doc.create_root_node ("EncodingRequest");
 	root->add_child("Version")->add_child_text (raw_convert<string> (SERVER_LINK_VERSION));
-	add_metadata (root);
-
-	LOG_DEBUG_ENCODE (N_("Sending frame %1 to remote"), _index);
+	add_metadata (root, compress);
 
-	{
-		Socket::WriteDigestScope ds (socket);
-
-		/* Send XML metadata */
-		auto xml = doc.write_to_string ("UTF-8");
-		socket->write (xml.length() + 1);
-		socket->write ((uint8_t *) xml.c_str(), xml.bytes() + 1);
-
-		/* Send binary data */
-		LOG_TIMING("start-remote-send thread=%1", thread_id ());
-		_frame->write_to_socket (socket);
-	}
-
-	/* Read the response (JPEG2000-encoded data); this blocks until the data
-	   is ready and sent back.
-	*/
-	Socket::ReadDigestScope ds (socket);
-	LOG_TIMING("start-remote-encode thread=%1", thread_id ());
-	ArrayData e (socket->read_uint32 ());
-	LOG_TIMING("start-remote-receive thread=%1", thread_id ());
-	socket->read (e.data(), e.size());
-	LOG_TIMING("finish-remote-receive thread=%1", thread_id ());
-	if (!ds.check()) {
-		throw NetworkError ("Checksums do not match");
-	}
+	Socket::WriteDigestScope ds (socket);
 
-	LOG_DEBUG_ENCODE (N_("Finished remotely-encoded frame %1"), _index);
+	/* Send XML metadata */
+	auto xml = doc.write_to_string ("UTF-8");
+	socket->write (xml.length() + 1);
+	socket->write ((uint8_t *) xml.c_str(), xml.bytes() + 1);
 
-	return e;
+	/* Send binary data */
+	_frame->write_to_socket (socket, compress);
 }
 
 void
-DCPVideo::add_metadata (xmlpp::Element* el) const
+DCPVideo::add_metadata (xmlpp::Element* el, bool compress) const
 {
 	el->add_child("Index")->add_child_text (raw_convert<string> (_index));
 	el->add_child("FramesPerSecond")->add_child_text (raw_convert<string> (_frames_per_second));
 	el->add_child("J2KBandwidth")->add_child_text (raw_convert<string> (_j2k_bandwidth));
 	el->add_child("Resolution")->add_child_text (raw_convert<string> (int (_resolution)));
-	_frame->add_metadata (el);
+	_frame->add_metadata (el, compress);
 }
 
 Eyes
@@ -22,6 +22,8 @@
 #include "encode_server_description.h"
 #include <libcxml/cxml.h>
 #include <dcp/array_data.h>
+#include <boost/optional.hpp>
+#include <atomic>
 
 /** @file  src/dcp_video_frame.h
  *  @brief A single frame of video destined for a DCP.
@@ -29,6 +31,7 @@
 
 class Log;
 class PlayerVideo;
+class Socket;
 
 /** @class DCPVideo
  *  @brief A single frame of video destined for a DCP.
@@ -50,6 +53,7 @@ public:
 
 	dcp::ArrayData encode_locally () const;
 	dcp::ArrayData encode_remotely (EncodeServerDescription, int timeout = 30) const;
+	void write_to_socket (std::shared_ptr<Socket> socket, bool compress) const;
 
 	int index () const {
 		return _index;
@@ -59,15 +63,28 @@ public:
 
 	bool same (std::shared_ptr<const DCPVideo> other) const;
 
+	std::string digest () const;
+
 	static std::shared_ptr<dcp::OpenJPEGImage> convert_to_xyz (std::shared_ptr<const PlayerVideo> frame, dcp::NoteHandler note);
 
+	/** @return number of frames encoded by this process which came out too small,
+	 *  so that they had to be encoded again with some noise added.
+	 */
+	static int small_frames () {
+		return _small_frames;
+	}
+
 private:
 
-	void add_metadata (xmlpp::Element *) const;
+	void add_metadata (xmlpp::Element *, bool compress) const;
 
 	std::shared_ptr<const PlayerVideo> _frame;
 	int _index;			 ///< frame index within the DCP's intrinsic duration
 	int _frames_per_second;		 ///< Frames per second that we will use for the DCP
 	int _j2k_bandwidth;		 ///< J2K bandwidth to use
 	Resolution _resolution;          ///< Resolution (2K or 4K)
+	/** digest() result, if it has been calculated */
+	mutable boost::optional<std::string> _digest;
+
+	static std::atomic<int> _small_frames;
 };
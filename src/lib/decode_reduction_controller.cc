@@ -0,0 +1,148 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "decode_reduction_controller.h"
+
+
+using boost::optional;
+
+
+/** Length of each period that we look at, in seconds */
+static double constexpr period = 1;
+/** Number of dropped frames in a period which make us reduce further */
+static int constexpr too_many_dropped = 2;
+/** Fraction of the budget which, if decodes take longer, makes us reduce further */
+static double constexpr overloaded = 0.9;
+/** Fraction of the budget that decodes at the next level up must fit into for us to go back up */
+static double constexpr headroom = 0.6;
+/** Number of periods with enough headroom that we need to see before going back up */
+static int constexpr good_periods_needed = 3;
+
+
+/** @param maximum Maximum extra reduction to use */
+DecodeReductionController::DecodeReductionController (int maximum)
+	: _maximum (maximum)
+{
+
+}
+
+
+/** Note that a frame has been decoded.
+ *  @param seconds Time that the decode took.
+ */
+void
+DecodeReductionController::add_decode (double seconds)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_decode_time += seconds;
+	++_decodes;
+}
+
+
+/** Note that a frame was dropped because it was not ready in time */
+void
+DecodeReductionController::add_dropped ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	++_dropped;
+}
+
+
+/** Call this often; it will do nothing until a period has passed since the last time
+ *  it made a decision.
+ *  @param now Current time in seconds.
+ *  @param budget Time in seconds that one decode can take if we are to keep up.
+ *  @return New extra reduction, if it should change.
+ */
+optional<int>
+DecodeReductionController::update (double now, double budget)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (!_period_start) {
+		_period_start = now;
+		return {};
+	}
+
+	if ((now - *_period_start) < period) {
+		return {};
+	}
+
+	auto const decodes = _decodes;
+	auto const dropped = _dropped;
+	auto const mean = decodes ? (_decode_time / decodes) : 0;
+
+	_period_start = now;
+	_decode_time = 0;
+	_decodes = 0;
+	_dropped = 0;
+
+	if (_settling) {
+		_settling = false;
+		return {};
+	}
+
+	if (decodes == 0 && dropped == 0) {
+		/* Nothing is happening (we are probably stopped) */
+		return {};
+	}
+
+	if (dropped >= too_many_dropped || mean > budget * overloaded) {
+		_good_periods = 0;
+		if (_reduction < _maximum) {
+			++_reduction;
+			_settling = true;
+			return _reduction;
+		}
+		return {};
+	}
+
+	/* Decoding at the next level up will take about 4 times as long, as it has twice the
+	   width and twice the height.
+	*/
+	if (_reduction > 0 && dropped == 0 && (mean * 4) < (budget * headroom)) {
+		if (++_good_periods >= good_periods_needed) {
+			--_reduction;
+			_good_periods = 0;
+			_settling = true;
+			return _reduction;
+		}
+	} else {
+		_good_periods = 0;
+	}
+
+	return {};
+}
+
+
+/** Forget everything that we have been told, and go back to no extra reduction */
+void
+DecodeReductionController::reset ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_reduction = 0;
+	_period_start = boost::none;
+	_decode_time = 0;
+	_decodes = 0;
+	_dropped = 0;
+	_good_periods = 0;
+	_settling = false;
+}
@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCPOMATIC_DECODE_REDUCTION_CONTROLLER_H
+#define DCPOMATIC_DECODE_REDUCTION_CONTROLLER_H
+
+
+/** @file  src/lib/decode_reduction_controller.h
+ *  @brief DecodeReductionController class.
+ */
+
+
+#include <boost/optional.hpp>
+#include <boost/thread/mutex.hpp>
+
+
+/** @class DecodeReductionController
+ *  @brief Decide how much extra JPEG2000 decode reduction to use during playback.
+ *
+ *  We are told how long each frame takes to decode and when frames are dropped.
+ *  Once every period update() looks at what happened: if frames were dropped, or
+ *  decoding is using up nearly all of the time available, we reduce by another
+ *  level.  If several periods in a row show that decoding at the next level up would
+ *  (at about 4 times the cost) still fit comfortably we go back up.  We wait a period
+ *  after each change so that we are not misled by frames decoded before it.
+ *
+ *  All methods can be called from any thread.
+ */
+class DecodeReductionController
+{
+public:
+	explicit DecodeReductionController (int maximum);
+
+	void add_decode (double seconds);
+	void add_dropped ();
+
+	boost::optional<int> update (double now, double budget);
+	void reset ();
+
+	/** @return current extra reduction */
+	int reduction () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _reduction;
+	}
+
+private:
+	mutable boost::mutex _mutex;
+	int _maximum;
+	int _reduction = 0;
+	/** start time of the current period, or empty if update() has not been called yet */
+	boost::optional<double> _period_start;
+	/** total time taken by decodes in the current period */
+	double _decode_time = 0;
+	/** number of decodes in the current period */
+	int _decodes = 0;
+	/** number of frames dropped in the current period */
+	int _dropped = 0;
+	/** number of consecutive periods which suggest that we could reduce less */
+	int _good_periods = 0;
+	/** true to ignore the next period because _reduction has just changed */
+	bool _settling = false;
+};
+
+
+#endif
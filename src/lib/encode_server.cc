@@ -26,9 +26,11 @@
 
 
 #include "encode_server.h"
+#include "encode_server_connection.h"
 #include "util.h"
 #include "dcpomatic_socket.h"
 #include "image.h"
+#include "image_compression.h"
 #include "dcp_video.h"
 #include "config.h"
 #include "cross.h"
@@ -37,6 +39,7 @@
 #include "log.h"
 #include "dcpomatic_log.h"
 #include "encoded_log_entry.h"
+#include "exceptions.h"
 #include "version.h"
 #include <dcp/raw_convert.h>
 #include <dcp/warnings.h>
@@ -49,6 +52,7 @@ LIBDCP_ENABLE_WARNINGS
 #ifdef HAVE_VALGRIND_H
 #include <valgrind/memcheck.h>
 #endif
+#include <cmath>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -95,12 +99,27 @@ EncodeServer::~EncodeServer ()
 		_terminate = true;
 		_empty_condition.notify_all ();
 		_full_condition.notify_all ();
+		_done_condition.notify_all ();
 	}
 
 	try {
 		_worker_threads.join_all ();
 	} catch (...) {}
 
+	list<shared_ptr<Link>> links;
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		links = _links;
+		_links.clear ();
+	}
+
+	/* Link threads will finish when their clients disconnect, or when their sockets time out */
+	for (auto i: links) {
+		try {
+			i->thread.join ();
+		} catch (...) {}
+	}
+
 	{
 		boost::mutex::scoped_lock lm (_broadcast.mutex);
 		if (_broadcast.socket) {
@@ -117,12 +136,30 @@ EncodeServer::~EncodeServer ()
 }
 
 
-/** @param after_read Filled in with gettimeofday() after reading the input from the network.
- *  @param after_encode Filled in with gettimeofday() after encoding the image.
+/** Read a frame from a link and add it to the queue for encoding.  If the queue is full
+ *  we wait for the worker threads to make some space before reading anything, so that
+ *  the client is held up by its socket rather than us buffering any number of frames.
+ *  @return false if we are terminating.
  */
-int
-EncodeServer::process (shared_ptr<Socket> socket, struct timeval& after_read, struct timeval& after_encode)
+bool
+EncodeServer::receive_frame (shared_ptr<Link> link)
 {
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		while (static_cast<int>(_queue.size()) >= maximum_queue_size() && !_terminate) {
+			_full_condition.wait (lm);
+		}
+		if (_terminate) {
+			return false;
+		}
+	}
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+
+	auto socket = link->socket;
+	auto const serial = socket->read_uint32 ();
+
 	Socket::ReadDigestScope ds (socket);
 
 	auto length = socket->read_uint32 ();
@@ -138,7 +175,7 @@ EncodeServer::process (shared_ptr<Socket> socket, struct timeval& after_read, st
 	if (xml->number_child<int> ("Version") != SERVER_LINK_VERSION) {
 		cerr << "Mismatched server/client versions\n";
 		LOG_ERROR_NC ("Mismatched server/client versions");
-		return -1;
+		throw NetworkError ("Mismatched server/client versions");
 	}
 
 	auto pvf = make_shared<PlayerVideo>(xml, socket);
@@ -147,25 +184,92 @@ EncodeServer::process (shared_ptr<Socket> socket, struct timeval& after_read, st
 		throw NetworkError ("Checksums do not match");
 	}
 
-	DCPVideo dcp_video_frame (pvf, xml);
-
+	struct timeval after_read;
 	gettimeofday (&after_read, 0);
 
-	auto encoded = dcp_video_frame.encode_locally ();
+	boost::mutex::scoped_lock lm (_mutex);
+	_waker.nudge ();
+	_queue.push_back ({link, serial, make_shared<DCPVideo>(pvf, xml), seconds(after_read) - seconds(start)});
+	_empty_condition.notify_all ();
+	return true;
+}
 
-	gettimeofday (&after_encode, 0);
 
+/** Wait for one of a link's frames to be encoded, then send it back to the client.
+ *  @return true if a frame was sent, false if we are terminating or an encode failed.
+ */
+bool
+EncodeServer::send_encoded (shared_ptr<Link> link, string ip)
+{
+	boost::mutex::scoped_lock lock (_mutex);
+	while (link->done.empty() && !link->failed && !_terminate) {
+		_done_condition.wait (lock);
+	}
+
+	if (link->failed || _terminate) {
+		return false;
+	}
+
+	auto done = link->done.front ();
+	link->done.pop_front ();
+	lock.unlock ();
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+
+	auto socket = link->socket;
 	try {
+		socket->write (done.serial);
+		socket->write (static_cast<uint32_t>(std::lround(done.encode * 1e6)));
 		Socket::WriteDigestScope ds (socket);
-		socket->write (encoded.size());
-		socket->write (encoded.data(), encoded.size());
+		socket->write (done.encoded.size());
+		socket->write (done.encoded.data(), done.encoded.size());
 	} catch (std::exception& e) {
-		cerr << "Send failed; frame " << dcp_video_frame.index() << "\n";
-		LOG_ERROR ("Send failed; frame %1", dcp_video_frame.index());
+		cerr << "Send failed; frame " << done.index << "\n";
+		LOG_ERROR ("Send failed; frame %1", done.index);
 		throw;
 	}
 
-	return dcp_video_frame.index ();
+	struct timeval end;
+	gettimeofday (&end, 0);
+
+	auto e = make_shared<EncodedLogEntry>(done.index, ip, done.receive, done.encode, seconds(end) - seconds(start));
+
+	if (_verbose) {
+		cout << e->get() << "\n";
+	}
+
+	dcpomatic_log->log (e);
+	return true;
+}
+
+
+void
+EncodeServer::link_thread (shared_ptr<Link> link)
+{
+	try {
+		auto ip = link->socket->socket().remote_endpoint().address().to_string();
+		bool running = true;
+		while (running) {
+			switch (static_cast<EncodeServerMessage>(link->socket->read_uint32())) {
+			case EncodeServerMessage::FRAME:
+				running = receive_frame (link);
+				break;
+			case EncodeServerMessage::COLLECT:
+				running = send_encoded (link, ip);
+				break;
+			default:
+				running = false;
+				break;
+			}
+		}
+	} catch (std::exception& e) {
+		cerr << "Error: " << e.what() << "\n";
+		LOG_ERROR ("Error: %1", e.what());
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	link->finished = true;
 }
 
 
@@ -182,54 +286,35 @@ EncodeServer::worker_thread ()
 			return;
 		}
 
-		auto socket = _queue.front ();
+		auto request = _queue.front ();
 		_queue.pop_front ();
+		_full_condition.notify_all ();
 
 		lock.unlock ();
 
-		int frame = -1;
-		string ip;
-
 		struct timeval start;
-		struct timeval after_read;
-		struct timeval after_encode;
-		struct timeval end;
-
 		gettimeofday (&start, 0);
 
+		optional<ArrayData> encoded;
 		try {
-			frame = process (socket, after_read, after_encode);
-			ip = socket->socket().remote_endpoint().address().to_string();
+			encoded = request.frame->encode_locally ();
 		} catch (std::exception& e) {
 			cerr << "Error: " << e.what() << "\n";
 			LOG_ERROR ("Error: %1", e.what());
 		}
 
+		struct timeval end;
 		gettimeofday (&end, 0);
 
-		socket.reset ();
-
 		lock.lock ();
 
-		if (frame >= 0) {
-			struct timeval end;
-			gettimeofday (&end, 0);
-
-			auto e = make_shared<EncodedLogEntry>(
-				frame, ip,
-				seconds(after_read) - seconds(start),
-				seconds(after_encode) - seconds(after_read),
-				seconds(end) - seconds(after_encode)
-				);
-
-			if (_verbose) {
-				cout << e->get() << "\n";
-			}
-
-			dcpomatic_log->log (e);
+		if (encoded) {
+			request.link->done.push_back ({request.serial, *encoded, request.frame->index(), request.receive, seconds(end) - seconds(start)});
+		} else {
+			request.link->failed = true;
 		}
 
-		_full_condition.notify_all ();
+		_done_condition.notify_all ();
 	}
 }
 
@@ -296,6 +381,9 @@ EncodeServer::broadcast_received ()
 		auto root = doc.create_root_node ("ServerAvailable");
 		root->add_child("Threads")->add_child_text (raw_convert<string> (_worker_threads.size ()));
 		root->add_child("Version")->add_child_text (raw_convert<string> (SERVER_LINK_VERSION));
+		if (can_decompress_images_losslessly()) {
+			root->add_child("Compression")->add_child_text ("FFV1");
+		}
 		auto xml = doc.write_to_string ("UTF-8");
 
 		if (_verbose) {
@@ -338,11 +426,21 @@ EncodeServer::handle (shared_ptr<Socket> socket)
 
 	_waker.nudge ();
 
-	/* Wait until the queue has gone down a bit */
-	while (_queue.size() >= _worker_threads.size() * 2 && !_terminate) {
-		_full_condition.wait (lock);
+	/* Tidy up after clients that have gone away */
+	auto i = _links.begin ();
+	while (i != _links.end()) {
+		if ((*i)->finished) {
+			(*i)->thread.join ();
+			i = _links.erase (i);
+		} else {
+			++i;
+		}
 	}
 
-	_queue.push_back (socket);
-	_empty_condition.notify_all ();
+	auto link = make_shared<Link>(socket);
+	link->thread = thread (bind(&EncodeServer::link_thread, this, link));
+#ifdef DCPOMATIC_LINUX
+	pthread_setname_np (link->thread.native_handle(), "encode-server-link");
+#endif
+	_links.push_back (link);
 }
@@ -31,12 +31,14 @@
 #include "cross.h"
 #include "exception_store.h"
 #include "server.h"
+#include <dcp/array_data.h>
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
 #include <string>
 
 
+class DCPVideo;
 class Log;
 class Socket;
 
@@ -44,6 +46,10 @@ class Socket;
 /** @class EncodeServer
  *  @brief A class to run a server which can accept requests to perform JPEG2000
  *  encoding work.
+ *
+ *  Each client connection is handled by its own thread, which reads frames and
+ *  passes them to a pool of worker threads for encoding.  Clients can send several
+ *  frames before collecting the results; see EncodeServerConnection.
  */
 class EncodeServer : public Server, public ExceptionStore
 {
@@ -54,16 +60,69 @@ public:
 	void run () override;
 
 private:
+	/** A connection from a client, over which frames arrive to be encoded */
+	struct Link
+	{
+		explicit Link (std::shared_ptr<Socket> socket_)
+			: socket (socket_)
+		{}
+
+		std::shared_ptr<Socket> socket;
+		boost::thread thread;
+
+		struct Done
+		{
+			uint32_t serial;
+			dcp::ArrayData encoded;
+			int index;
+			/** time taken to receive the frame, in seconds */
+			double receive;
+			/** time taken to encode the frame, in seconds */
+			double encode;
+		};
+
+		/** Frames which have been encoded but not yet collected by the client */
+		std::list<Done> done;
+		/** true if encoding of one of this link's frames failed */
+		bool failed = false;
+		/** true if the thread has finished and can be joined */
+		bool finished = false;
+	};
+
+	/** A frame waiting to be encoded by one of the worker threads */
+	struct Request
+	{
+		std::shared_ptr<Link> link;
+		uint32_t serial;
+		std::shared_ptr<DCPVideo> frame;
+		double receive;
+	};
+
+	/** @return number of frames that can be waiting for a worker thread before we
+	 *  stop reading new ones; this is enough to keep the workers busy while frames
+	 *  are being received.
+	 */
+	int maximum_queue_size () const {
+		return _num_threads * 2;
+	}
+
 	void handle (std::shared_ptr<Socket>) override;
 	void worker_thread ();
-	int process (std::shared_ptr<Socket> socket, struct timeval &, struct timeval &);
+	void link_thread (std::shared_ptr<Link> link);
+	bool receive_frame (std::shared_ptr<Link> link);
+	bool send_encoded (std::shared_ptr<Link> link, std::string ip);
 	void broadcast_thread ();
 	void broadcast_received ();
 
 	boost::thread_group _worker_threads;
-	std::list<std::shared_ptr<Socket>> _queue;
-	boost::condition _full_condition;
+	std::list<std::shared_ptr<Link>> _links;
+	std::list<Request> _queue;
+	/** condition to wake link threads when a frame has been encoded */
+	boost::condition _done_condition;
+	/** condition to wake worker threads when there is something in the queue */
 	boost::condition _empty_condition;
+	/** condition to wake link threads when there is space in the queue */
+	boost::condition _full_condition;
 	bool _verbose;
 	int _num_threads;
 	Waker _waker;
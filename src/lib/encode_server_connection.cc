@@ -0,0 +1,143 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "compose.hpp"
+#include "config.h"
+#include "cross.h"
+#include "dcpomatic_assert.h"
+#include "dcpomatic_log.h"
+#include "dcpomatic_socket.h"
+#include "encode_server_connection.h"
+#include "exceptions.h"
+#include "util.h"
+#include <dcp/raw_convert.h>
+#include <boost/asio.hpp>
+
+#include "i18n.h"
+
+
+using std::make_pair;
+using std::make_shared;
+using std::pair;
+using std::string;
+using std::vector;
+using dcp::ArrayData;
+using dcp::raw_convert;
+
+
+/** Open a connection to an encode server.
+ *  @param server Server to connect to.
+ *  @param timeout Timeout in seconds for each network operation.
+ */
+EncodeServerConnection::EncodeServerConnection (EncodeServerDescription server, int timeout)
+	: _server (server)
+	, _compress (server.accepts_compressed_images() && Config::instance()->compress_frames_for_servers())
+{
+	boost::asio::io_service io_service;
+	boost::asio::ip::tcp::resolver resolver (io_service);
+	boost::asio::ip::tcp::resolver::query query (server.host_name(), raw_convert<string>(ENCODE_FRAME_PORT));
+	auto endpoint_iterator = resolver.resolve (query);
+
+	_socket = make_shared<Socket>(timeout);
+	_socket->connect (*endpoint_iterator);
+
+	LOG_GENERAL ("Opened connection to encode server %1 (%2)", server.host_name(), _compress ? "compressed" : "raw");
+}
+
+
+EncodeServerConnection::~EncodeServerConnection ()
+{
+	try {
+		_socket->write (static_cast<uint32_t>(EncodeServerMessage::END));
+	} catch (...) {
+		/* The server will notice that we have gone away soon enough */
+	}
+}
+
+
+/** Send a frame to the server for encoding.  This returns as soon as the frame
+ *  has been sent; use collect() to get the encoded data.
+ */
+void
+EncodeServerConnection::send (DCPVideo const& frame)
+{
+	auto const serial = _next_serial++;
+
+	LOG_DEBUG_ENCODE (N_("Sending frame %1 to remote as %2"), frame.index(), serial);
+
+	_socket->write (static_cast<uint32_t>(EncodeServerMessage::FRAME));
+	_socket->write (serial);
+	LOG_TIMING("start-remote-send thread=%1", thread_id ());
+	frame.write_to_socket (_socket, _compress);
+
+	_in_flight.emplace (serial, frame);
+}
+
+
+/** Wait for the server to finish encoding one of the frames that we have sent,
+ *  and read the result.
+ *  @return Frame that was encoded, and its J2K data.
+ */
+pair<DCPVideo, ArrayData>
+EncodeServerConnection::collect ()
+{
+	DCPOMATIC_ASSERT (!_in_flight.empty());
+
+	_socket->write (static_cast<uint32_t>(EncodeServerMessage::COLLECT));
+
+	LOG_TIMING("start-remote-encode thread=%1", thread_id ());
+	auto const serial = _socket->read_uint32 ();
+	auto frame = _in_flight.find (serial);
+	if (frame == _in_flight.end()) {
+		throw NetworkError (String::compose("Server returned unexpected frame %1", serial));
+	}
+
+	auto const encode_time = _socket->read_uint32 ();
+
+	Socket::ReadDigestScope ds (_socket);
+	ArrayData encoded (_socket->read_uint32());
+	LOG_TIMING("start-remote-receive thread=%1", thread_id ());
+	_socket->read (encoded.data(), encoded.size());
+	LOG_TIMING("finish-remote-receive thread=%1", thread_id ());
+	if (!ds.check()) {
+		throw NetworkError ("Checksums do not match");
+	}
+
+	LOG_DEBUG_ENCODE (N_("Finished remotely-encoded frame %1"), frame->second.index());
+
+	_last_encode_time = encode_time / 1e6;
+
+	auto result = make_pair (frame->second, encoded);
+	_in_flight.erase (frame);
+	return result;
+}
+
+
+/** @return frames that have been sent but not yet collected */
+vector<DCPVideo>
+EncodeServerConnection::in_flight_frames () const
+{
+	vector<DCPVideo> frames;
+	for (auto const& i: _in_flight) {
+		frames.push_back (i.second);
+	}
+	return frames;
+}
@@ -0,0 +1,118 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCPOMATIC_ENCODE_SERVER_CONNECTION_H
+#define DCPOMATIC_ENCODE_SERVER_CONNECTION_H
+
+
+/** @file  src/lib/encode_server_connection.h
+ *  @brief EncodeServerConnection class.
+ */
+
+
+#include "dcp_video.h"
+#include "encode_server_description.h"
+#include <dcp/array_data.h>
+#include <boost/optional.hpp>
+#include <map>
+#include <memory>
+#include <vector>
+
+
+class Socket;
+
+
+/** Messages that a client sends to an encode server over a connection.
+ *  Each message is sent as a uint32 which may be followed by some data.
+ */
+enum class EncodeServerMessage
+{
+	/** A frame to encode: followed by a uint32 serial number and then the
+	 *  frame's XML and image data (with a digest).
+	 */
+	FRAME = 1,
+	/** A request for the next frame that the server has finished encoding; the
+	 *  server replies with the frame's serial number, the time it spent encoding
+	 *  the frame (as a uint32 number of microseconds) and then its J2K data (with a digest).
+	 */
+	COLLECT = 2,
+	/** The client has finished with the connection */
+	END = 3
+};
+
+
+/** @class EncodeServerConnection
+ *  @brief A persistent connection to an encode server.
+ *
+ *  Several frames can be sent over the connection before any are collected,
+ *  so that the server can be encoding some frames while others are being
+ *  sent or received.  The protocol is strictly half-duplex: the server only
+ *  sends data in reply to a COLLECT message.
+ */
+class EncodeServerConnection
+{
+public:
+	EncodeServerConnection (EncodeServerDescription server, int timeout = 30);
+	~EncodeServerConnection ();
+
+	EncodeServerConnection (EncodeServerConnection const&) = delete;
+	EncodeServerConnection& operator= (EncodeServerConnection const&) = delete;
+
+	void send (DCPVideo const& frame);
+	std::pair<DCPVideo, dcp::ArrayData> collect ();
+
+	/** @return number of frames that have been sent but not yet collected */
+	int in_flight () const {
+		return _in_flight.size();
+	}
+
+	std::vector<DCPVideo> in_flight_frames () const;
+
+	/** @return the largest number of frames that it is worth having in flight at once */
+	int maximum_window () const {
+		return _server.threads() * 2;
+	}
+
+	/** @return time in seconds that the server spent encoding the most recently
+	 *  collected frame, if anything has been collected yet.  This does not include
+	 *  any time that the frame spent waiting to be sent, encoded or collected.
+	 */
+	boost::optional<double> last_encode_time () const {
+		return _last_encode_time;
+	}
+
+	EncodeServerDescription server () const {
+		return _server;
+	}
+
+private:
+	EncodeServerDescription _server;
+	/** true to losslessly compress raw images that we send */
+	bool _compress;
+	std::shared_ptr<Socket> _socket;
+	uint32_t _next_serial = 0;
+	/** Frames that have been sent but not yet collected, indexed by serial number */
+	std::map<uint32_t, DCPVideo> _in_flight;
+	boost::optional<double> _last_encode_time;
+};
+
+
+#endif
@@ -40,11 +40,13 @@ public:
 	/** @param h Server host name or IP address in string form.
 	 *  @param t Number of threads to use on the server.
 	 *  @param l Server link version number of the server.
+	 *  @param c true if the server can decompress losslessly-compressed images.
 	 */
-	EncodeServerDescription (std::string h, int t, int l)
+	EncodeServerDescription (std::string h, int t, int l, bool c = false)
 		: _host_name (h)
 		, _threads (t)
 		, _link_version (l)
+		, _accepts_compressed_images (c)
 		, _last_seen (boost::posix_time::second_clock::local_time())
 	{}
 
@@ -60,6 +62,11 @@ public:
 		return _threads;
 	}
 
+	/** @return true if the server can decompress losslessly-compressed images */
+	bool accepts_compressed_images () const {
+		return _accepts_compressed_images;
+	}
+
 	bool current_link_version () const {
 		return _link_version == SERVER_LINK_VERSION;
 	}
@@ -87,6 +94,7 @@ private:
 	int _threads;
 	/** server link (i.e. protocol) version number */
 	int _link_version;
+	bool _accepts_compressed_images = false;
 	boost::posix_time::ptime _last_seen;
 };
 
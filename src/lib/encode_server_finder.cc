@@ -243,7 +243,12 @@ EncodeServerFinder::handle_accept (boost::system::error_code ec)
 		if (i != _servers.end()) {
 			i->set_seen();
 		} else {
-			EncodeServerDescription sd (ip, xml->number_child<int>("Threads"), xml->optional_number_child<int>("Version").get_value_or(0));
+			EncodeServerDescription sd (
+				ip,
+				xml->number_child<int>("Threads"),
+				xml->optional_number_child<int>("Version").get_value_or(0),
+				xml->optional_string_child("Compression").get_value_or("") == "FFV1"
+				);
 			_servers.push_back (sd);
 			changed = true;
 		}
@@ -0,0 +1,107 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "encode_statistics.h"
+#include <algorithm>
+#include <cmath>
+
+
+using boost::optional;
+
+
+EncodeStatistics::EncodeStatistics ()
+	: _history (16)
+{
+
+}
+
+
+/** Record that a frame has been encoded.
+ *  @param latency Time taken to encode the frame, in seconds, not counting any time that
+ *  it spent waiting for its turn.
+ */
+void
+EncodeStatistics::frame_done (double latency)
+{
+	_history.event ();
+
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (!_latency) {
+		_latency = latency;
+	} else {
+		_latency = *_latency * 0.9 + latency * 0.1;
+	}
+
+	/* Let the minimum drift upwards so that we notice if things get slower */
+	if (!_minimum_latency) {
+		_minimum_latency = latency;
+	} else {
+		_minimum_latency = std::min (latency, *_minimum_latency * 1.01);
+	}
+}
+
+
+/** @return frames per second, if known */
+optional<float>
+EncodeStatistics::rate () const
+{
+	return _history.rate ();
+}
+
+
+/** @return average latency in seconds, if known */
+optional<double>
+EncodeStatistics::latency () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _latency;
+}
+
+
+optional<double>
+EncodeStatistics::minimum_latency () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _minimum_latency;
+}
+
+
+/** @param maximum Largest window to return.
+ *  @return Number of frames that should be in flight at once.
+ *
+ *  From Little's law, keeping something busy needs (rate * latency) frames in flight,
+ *  where latency is the time taken by a frame which does not have to queue.  We add one
+ *  so that the window grows while the rate is limited by the window rather than by the
+ *  encoder, and stops growing when the encoder is saturated.
+ */
+int
+EncodeStatistics::window (int maximum) const
+{
+	auto const r = rate ();
+	auto const l = minimum_latency ();
+	if (!r || !l) {
+		/* We don't know anything yet, so start half-way */
+		return std::max (1, maximum / 2);
+	}
+
+	return std::max (1, std::min(static_cast<int>(std::ceil(*r * *l)) + 1, maximum));
+}
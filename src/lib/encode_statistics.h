@@ -0,0 +1,66 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCPOMATIC_ENCODE_STATISTICS_H
+#define DCPOMATIC_ENCODE_STATISTICS_H
+
+
+/** @file  src/lib/encode_statistics.h
+ *  @brief EncodeStatistics class.
+ */
+
+
+#include "event_history.h"
+#include <boost/optional.hpp>
+#include <boost/thread/mutex.hpp>
+
+
+/** @class EncodeStatistics
+ *  @brief Measurements of how quickly something (the local machine or a remote server)
+ *  is encoding frames.
+ */
+class EncodeStatistics
+{
+public:
+	EncodeStatistics ();
+
+	void frame_done (double latency);
+
+	boost::optional<float> rate () const;
+	boost::optional<double> latency () const;
+	boost::optional<double> minimum_latency () const;
+
+	int window (int maximum) const;
+
+private:
+	mutable boost::mutex _mutex;
+	/** history of completed frames, to estimate frames per second */
+	EventHistory _history;
+	/** exponentially-weighted moving average of the time taken to encode a frame, in seconds */
+	boost::optional<double> _latency;
+	/** smallest recent latency, in seconds; this is roughly the time taken
+	 *  by a frame which does not have to wait behind others.
+	 */
+	boost::optional<double> _minimum_latency;
+};
+
+
+#endif
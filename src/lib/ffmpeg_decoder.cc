@@ -27,6 +27,7 @@
 #include "audio_buffers.h"
 #include "audio_content.h"
 #include "audio_decoder.h"
+#include "audio_kernels.h"
 #include "compose.hpp"
 #include "dcpomatic_log.h"
 #include "exceptions.h"
@@ -174,9 +175,51 @@ FFmpegDecoder::flush ()
 }
 
 
+/** Tell the demuxer not to read packets from streams that we are not going to decode,
+ *  so that (for example) we do not read all the video when we are only analysing audio.
+ *  Our parts can be told to ignore things at any time, so this checks to see if anything
+ *  has changed since the last call.
+ */
+void
+FFmpegDecoder::discard_unused_streams ()
+{
+	bool const use_video = video && !video->ignore();
+	bool const use_audio = audio && !audio->ignore();
+	bool const use_text = !text.empty() && !only_text()->ignore();
+
+	int const set_for = (use_video ? 1 : 0) | (use_audio ? 2 : 0) | (use_text ? 4 : 0);
+	if (_discard_set_for && *_discard_set_for == set_for) {
+		return;
+	}
+
+	auto const audio_streams = _ffmpeg_content->ffmpeg_audio_streams();
+	auto const subtitle_stream = _ffmpeg_content->subtitle_stream();
+
+	for (uint32_t i = 0; i < _format_context->nb_streams; ++i) {
+		bool used = false;
+		if (_video_stream && static_cast<int>(i) == *_video_stream) {
+			used = use_video;
+		} else if (subtitle_stream && subtitle_stream->uses_index(_format_context, i)) {
+			used = use_text;
+		} else {
+			for (auto j: audio_streams) {
+				if (j->uses_index(_format_context, i)) {
+					used = use_audio;
+				}
+			}
+		}
+		_format_context->streams[i]->discard = used ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+	}
+
+	_discard_set_for = set_for;
+}
+
+
 bool
 FFmpegDecoder::pass ()
 {
+	discard_unused_streams ();
+
 	auto packet = av_packet_alloc();
 	DCPOMATIC_ASSERT (packet);
 
@@ -269,9 +312,7 @@ FFmpegDecoder::deinterleave_audio (AVFrame* frame)
 	{
 		auto p = reinterpret_cast<int16_t **> (frame->data);
 		for (int i = 0; i < channels; ++i) {
-			for (int j = 0; j < frames; ++j) {
-				data[i][j] = static_cast<float>(p[i][j]) / (1 << 15);
-			}
+			audio_convert (p[i], data[i], frames);
 		}
 	}
 	break;
@@ -297,9 +338,7 @@ FFmpegDecoder::deinterleave_audio (AVFrame* frame)
 	{
 		auto p = reinterpret_cast<int32_t **> (frame->data);
 		for (int i = 0; i < channels; ++i) {
-			for (int j = 0; j < frames; ++j) {
-				data[i][j] = static_cast<float>(p[i][j]) / 2147483648;
-			}
+			audio_convert (p[i], data[i], frames);
 		}
 	}
 	break;
@@ -375,16 +414,22 @@ FFmpegDecoder::seek (ContentTime time, bool accurate)
 
 	optional<int> stream;
 
-	if (_video_stream) {
+	/* Seek on the video stream unless we aren't using it, in which case its packets
+	   are being discarded (see discard_unused_streams()).
+	*/
+	if (_video_stream && video && !video->ignore()) {
 		stream = _video_stream;
-	} else {
-		DCPOMATIC_ASSERT (_ffmpeg_content->audio);
+	} else if (_ffmpeg_content->audio) {
 		auto s = dynamic_pointer_cast<FFmpegAudioStream>(_ffmpeg_content->audio->stream());
 		if (s) {
 			stream = s->index (_format_context);
 		}
 	}
 
+	if (!stream) {
+		stream = _video_stream;
+	}
+
 	DCPOMATIC_ASSERT (stream);
 
 	auto u = time - _pts_offset;
@@ -58,6 +58,7 @@ private:
 	friend struct ::ffmpeg_pts_offset_test;
 
 	bool flush ();
+	void discard_unused_streams ();
 
 	static std::shared_ptr<AudioBuffers> deinterleave_audio (AVFrame* frame);
 
@@ -89,4 +90,9 @@ private:
 	std::shared_ptr<Image> _black_image;
 
 	std::map<std::shared_ptr<FFmpegAudioStream>, boost::optional<dcpomatic::ContentTime>> _next_time;
+
+	/** Which of video, audio and text we were using when discard_unused_streams() last set
+	 *  up the streams' discard flags, as bits 0, 1 and 2.
+	 */
+	boost::optional<int> _discard_set_for;
 };
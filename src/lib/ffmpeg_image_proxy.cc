@@ -23,6 +23,7 @@
 #include "cross.h"
 #include "dcpomatic_assert.h"
 #include "dcpomatic_socket.h"
+#include "digester.h"
 #include "exceptions.h"
 #include "ffmpeg_image_proxy.h"
 #include "image.h"
@@ -220,13 +221,13 @@ FFmpegImageProxy::image (Image::Alignment alignment, optional<dcp::Size>) const
 
 
 void
-FFmpegImageProxy::add_metadata (xmlpp::Node* node) const
+FFmpegImageProxy::add_metadata (xmlpp::Node* node, bool) const
 {
 	node->add_child("Type")->add_child_text (N_("FFmpeg"));
 }
 
 void
-FFmpegImageProxy::write_to_socket (shared_ptr<Socket> socket) const
+FFmpegImageProxy::write_to_socket (shared_ptr<Socket> socket, bool) const
 {
 	socket->write (_data.size());
 	socket->write (_data.data(), _data.size());
@@ -243,6 +244,14 @@ FFmpegImageProxy::same (shared_ptr<const ImageProxy> other) const
 	return _data == mp->_data;
 }
 
+void
+FFmpegImageProxy::add_digest (Digester& digester) const
+{
+	digester.add (string("ffmpeg"));
+	digester.add (_data.data(), _data.size());
+}
+
+
 size_t
 FFmpegImageProxy::memory_used () const
 {
@@ -0,0 +1,183 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "exceptions.h"
+#include "file_digest.h"
+#include "scope_guard.h"
+#include <dcp/file.h>
+#include <openssl/evp.h>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <cerrno>
+#include <deque>
+#include <exception>
+#include <vector>
+
+
+using std::deque;
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+
+
+/** Calculate the digest of a file in the form that is used in PKLs (base64-encoded SHA1),
+ *  giving the same result as dcp::make_digest().  The file is read by a second thread into
+ *  a few large buffers while this one hashes, so that reading and hashing overlap.
+ *  SHA1 cannot be split into independent pieces, so this is as much parallelism as we can get
+ *  for one file.
+ *
+ *  @param progress Function to call with progress as a fraction, or empty.  It may throw
+ *  (e.g. boost::thread_interrupted) to abandon the calculation.
+ */
+string
+dcpomatic::file_digest (boost::filesystem::path file, std::function<void (float)> progress)
+{
+	int const block_size = 4 * 1024 * 1024;
+	int const blocks = 4;
+
+	auto const total = boost::filesystem::file_size (file);
+
+	dcp::File f (file, "rb");
+	if (!f) {
+		throw OpenFileError (file, errno, OpenFileError::READ);
+	}
+
+	vector<vector<uint8_t>> buffers (blocks, vector<uint8_t>(block_size));
+
+	boost::mutex mutex;
+	boost::condition condition;
+	/* Indices of buffers that the reader can fill */
+	deque<int> empty;
+	for (int i = 0; i < blocks; ++i) {
+		empty.push_back (i);
+	}
+	/* Indices of buffers that have been read, with the number of bytes in each */
+	deque<pair<int, size_t>> full;
+	/* true when the reader has stopped, for whatever reason */
+	bool finished = false;
+	/* true to ask the reader to stop early */
+	bool stop = false;
+	std::exception_ptr error;
+
+	auto reader = [&]() {
+		try {
+			while (true) {
+				int index;
+				{
+					boost::mutex::scoped_lock lm (mutex);
+					while (empty.empty() && !stop) {
+						condition.wait (lm);
+					}
+					if (stop) {
+						break;
+					}
+					index = empty.front ();
+					empty.pop_front ();
+				}
+
+				auto const read = f.read (buffers[index].data(), 1, block_size);
+
+				boost::mutex::scoped_lock lm (mutex);
+				if (read == 0) {
+					break;
+				}
+				full.push_back (make_pair(index, read));
+				condition.notify_all ();
+			}
+		} catch (...) {
+			boost::mutex::scoped_lock lm (mutex);
+			error = std::current_exception ();
+		}
+
+		boost::mutex::scoped_lock lm (mutex);
+		finished = true;
+		condition.notify_all ();
+	};
+
+	boost::thread thread (reader);
+
+	ScopeGuard sg = [&]() {
+		boost::this_thread::disable_interruption dis;
+		{
+			boost::mutex::scoped_lock lm (mutex);
+			stop = true;
+			condition.notify_all ();
+		}
+		thread.join ();
+	};
+
+	auto context = EVP_MD_CTX_create ();
+	if (!context) {
+		throw std::bad_alloc ();
+	}
+	ScopeGuard context_guard = [context]() {
+		EVP_MD_CTX_destroy (context);
+	};
+
+	EVP_DigestInit_ex (context, EVP_sha1(), nullptr);
+
+	uintmax_t done = 0;
+	while (true) {
+		pair<int, size_t> block;
+		{
+			boost::mutex::scoped_lock lm (mutex);
+			while (full.empty() && !finished) {
+				condition.wait (lm);
+			}
+			if (full.empty()) {
+				break;
+			}
+			block = full.front ();
+			full.pop_front ();
+		}
+
+		EVP_DigestUpdate (context, buffers[block.first].data(), block.second);
+		done += block.second;
+
+		{
+			boost::mutex::scoped_lock lm (mutex);
+			empty.push_back (block.first);
+			condition.notify_all ();
+		}
+
+		if (progress && total > 0) {
+			progress (static_cast<float>(done) / total);
+		}
+	}
+
+	if (error) {
+		std::rethrow_exception (error);
+	}
+
+	if (done != total) {
+		throw ReadFileError (file);
+	}
+
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_length = 0;
+	EVP_DigestFinal_ex (context, digest, &digest_length);
+
+	/* base64 needs 4 characters for every 3 bytes, plus a terminator */
+	char base64[EVP_MAX_MD_SIZE * 2];
+	EVP_EncodeBlock (reinterpret_cast<unsigned char*>(base64), digest, digest_length);
+	return base64;
+}
@@ -345,6 +345,35 @@ Film::audio_analysis_path (shared_ptr<const Playlist> playlist) const
 }
 
 
+/** @return path of a piece of content's audio analysis which can be used as part
+ *  of a bigger analysis.  This depends on the things which change the content's
+ *  contribution to the DCP's audio, but not on where the content is in the playlist.
+ */
+boost::filesystem::path
+Film::audio_analysis_block_path (shared_ptr<const Content> content) const
+{
+	DCPOMATIC_ASSERT (content->audio);
+
+	auto p = dir ("analysis");
+
+	Digester digester;
+	digester.add (content->digest());
+	digester.add (content->audio->mapping().digest());
+	digester.add (content->audio->gain());
+	digester.add (content->audio->delay());
+	digester.add (content->audio->fade_in().get());
+	digester.add (content->audio->fade_out().get());
+	digester.add (content->trim_start().get());
+	digester.add (content->trim_end().get());
+	digester.add (video_frame_rate());
+	digester.add (audio_frame_rate());
+	digester.add (audio_channels());
+
+	p /= "block_" + digester.get();
+	return p;
+}
+
+
 boost::filesystem::path
 Film::subtitle_analysis_path (shared_ptr<const Content> content) const
 {
@@ -1234,31 +1263,13 @@ Film::set_isdcf_date_today ()
 }
 
 
+/** @return path of the scratch file that the Writer uses to hold encoded frames
+ *  which it cannot yet write.
+ */
 boost::filesystem::path
-Film::j2c_path (int reel, Frame frame, Eyes eyes, bool tmp) const
+Film::spill_path () const
 {
-	boost::filesystem::path p;
-	p /= "j2c";
-	p /= video_identifier ();
-
-	char buffer[256];
-	snprintf(buffer, sizeof(buffer), "%08d_%08" PRId64, reel, frame);
-	string s (buffer);
-
-	if (eyes == Eyes::LEFT) {
-		s += ".L";
-	} else if (eyes == Eyes::RIGHT) {
-		s += ".R";
-	}
-
-	s += ".j2c";
-
-	if (tmp) {
-		s += ".tmp";
-	}
-
-	p /= s;
-	return file (p);
+	return file (boost::filesystem::path("j2c") / "spill");
 }
 
 static
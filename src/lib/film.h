@@ -106,11 +106,12 @@ public:
 	Film& operator= (Film const&) = delete;
 
 	std::shared_ptr<InfoFileHandle> info_file_handle (dcpomatic::DCPTimePeriod period, bool read) const;
-	boost::filesystem::path j2c_path (int, Frame, Eyes, bool) const;
+	boost::filesystem::path spill_path () const;
 	boost::filesystem::path internal_video_asset_dir () const;
 	boost::filesystem::path internal_video_asset_filename (dcpomatic::DCPTimePeriod p) const;
 
 	boost::filesystem::path audio_analysis_path (std::shared_ptr<const Playlist>) const;
+	boost::filesystem::path audio_analysis_block_path (std::shared_ptr<const Content>) const;
 	boost::filesystem::path subtitle_analysis_path (std::shared_ptr<const Content>) const;
 
 	void send_dcp_to_tms ();
@@ -24,14 +24,18 @@
  */
 
 
+#include "alpha_blend.h"
 #include "compose.hpp"
 #include "dcpomatic_assert.h"
 #include "dcpomatic_socket.h"
+#include "digester.h"
 #include "exceptions.h"
 #include "image.h"
+#include "image_pool.h"
 #include "maths_util.h"
 #include "memory_util.h"
 #include "rect.h"
+#include "slice_pool.h"
 #include "timer.h"
 #include <dcp/rgb_xyz.h>
 #include <dcp/transfer_function.h>
@@ -47,6 +51,7 @@ LIBDCP_ENABLE_WARNINGS
 #if HAVE_VALGRIND_MEMCHECK_H
 #include <valgrind/memcheck.h>
 #endif
+#include <boost/thread/tss.hpp>
 #include <iostream>
 
 
@@ -62,7 +67,13 @@ using std::min;
 using std::runtime_error;
 using std::shared_ptr;
 using std::string;
+using std::vector;
 using dcp::Size;
+using dcpomatic::alpha_blend_chroma_row;
+using dcpomatic::alpha_blend_extract_alpha;
+using dcpomatic::alpha_blend_packed_row;
+using dcpomatic::alpha_blend_planar_row;
+using dcpomatic::alpha_blend_sample;
 
 
 /** The memory alignment, in bytes, used for each row of an image if Alignment::PADDED is requested */
@@ -77,6 +88,11 @@ static uint16_t const ten_bit_uv =	(1 << 9) - 1;
 /* U/V black value for 16-bit colour */
 static uint16_t const sixteen_bit_uv =	(1 << 15) - 1;
 
+/** Number of scaler contexts to keep for each thread */
+static int constexpr scale_contexts_per_thread = 4;
+/** Smallest number of lines that we will give to each slice when scaling in slices */
+static int constexpr minimum_slice_height = 32;
+
 
 int
 Image::vertical_factor (int n) const
@@ -159,6 +175,125 @@ round_height_for_subsampling (int p, AVPixFmtDescriptor const * desc)
 }
 
 
+/** Everything that goes into setting up a SwsContext */
+struct ScaleParameters
+{
+	dcp::Size in_size;
+	AVPixelFormat in_format;
+	dcp::Size out_size;
+	AVPixelFormat out_format;
+	int flags;
+	dcp::YUVToRGB yuv_to_rgb;
+	/** 0 for video range, 1 for full range */
+	int in_range;
+	int out_range;
+
+	bool operator== (ScaleParameters const& other) const {
+		return in_size == other.in_size && in_format == other.in_format &&
+			out_size == other.out_size && out_format == other.out_format &&
+			flags == other.flags && yuv_to_rgb == other.yuv_to_rgb &&
+			in_range == other.in_range && out_range == other.out_range;
+	}
+};
+
+
+/** Some SwsContexts that have been used by one thread, most-recently-used first */
+class ScaleContexts
+{
+public:
+	ScaleContexts () {}
+
+	ScaleContexts (ScaleContexts const&) = delete;
+	ScaleContexts& operator= (ScaleContexts const&) = delete;
+
+	~ScaleContexts ()
+	{
+		for (auto const& i: _contexts) {
+			sws_freeContext (i.second);
+		}
+	}
+
+	SwsContext* get (ScaleParameters const& parameters);
+
+private:
+	std::list<std::pair<ScaleParameters, SwsContext*>> _contexts;
+};
+
+
+SwsContext*
+ScaleContexts::get (ScaleParameters const& parameters)
+{
+	for (auto i = _contexts.begin(); i != _contexts.end(); ++i) {
+		if (i->first == parameters) {
+			_contexts.splice (_contexts.begin(), _contexts, i);
+			return _contexts.front().second;
+		}
+	}
+
+	auto context = sws_getContext (
+		parameters.in_size.width, parameters.in_size.height, parameters.in_format,
+		parameters.out_size.width, parameters.out_size.height, parameters.out_format,
+		parameters.flags, 0, 0, 0
+		);
+
+	if (!context) {
+		throw runtime_error (N_("Could not allocate SwsContext"));
+	}
+
+	DCPOMATIC_ASSERT (parameters.yuv_to_rgb < dcp::YUVToRGB::COUNT);
+	int const lut[static_cast<int>(dcp::YUVToRGB::COUNT)] = {
+		SWS_CS_ITU601,
+		SWS_CS_ITU709
+	};
+
+	/* The 3rd parameter here is:
+	   0 -> source range MPEG (i.e. "video", 16-235)
+	   1 -> source range JPEG (i.e. "full", 0-255)
+	   And the 5th:
+	   0 -> destination range MPEG (i.e. "video", 16-235)
+	   1 -> destination range JPEG (i.e. "full", 0-255)
+
+	   But remember: sws_setColorspaceDetails ignores these
+	   parameters unless the both source and destination images
+	   are isYUV or isGray.  (If either is not, it uses video range).
+	*/
+	sws_setColorspaceDetails (
+		context,
+		sws_getCoefficients (lut[static_cast<int>(parameters.yuv_to_rgb)]), parameters.in_range,
+		sws_getCoefficients (lut[static_cast<int>(parameters.yuv_to_rgb)]), parameters.out_range,
+		0, 1 << 16, 1 << 16
+		);
+
+	_contexts.push_front (std::make_pair(parameters, context));
+	if (static_cast<int>(_contexts.size()) > scale_contexts_per_thread) {
+		sws_freeContext (_contexts.back().second);
+		_contexts.pop_back ();
+	}
+
+	return context;
+}
+
+
+/** Scaler contexts for each thread; a SwsContext can only be used by one thread at a time,
+ *  and we will typically want the same few contexts for every frame that a thread handles.
+ */
+static boost::thread_specific_ptr<ScaleContexts> scale_contexts;
+
+
+/** @return A SwsContext for some parameters; it belongs to the calling thread and
+ *  must not be freed.
+ */
+static SwsContext*
+scale_context (ScaleParameters const& parameters)
+{
+	if (!scale_contexts.get()) {
+		scale_contexts.reset (new ScaleContexts());
+	}
+
+	return scale_contexts->get (parameters);
+}
+
+
 /** Crop this image, scale it to `inter_size' and then place it in a black frame of `out_size'.
  *  @param crop Amount to crop by.
  *  @param inter_size Size to scale the cropped image to.
@@ -170,6 +305,9 @@ round_height_for_subsampling (int p, AVPixFmtDescriptor const * desc)
  *  @param out_video_range Video range to use for the output image.
  *  @param fast Try to be fast at the possible expense of quality; at present this means using
  *  fast bilinear rather than bicubic scaling.
+ *  @param slices Number of horizontal slices to split the scale into, to be done in parallel.  Each
+ *  slice is scaled separately, so lines at the slice boundaries may be very slightly different
+ *  to those from a single scale; this is intended for previews.
  */
 shared_ptr<Image>
 Image::crop_scale_window (
@@ -181,7 +319,8 @@ Image::crop_scale_window (
 	AVPixelFormat out_format,
 	VideoRange out_video_range,
 	Alignment out_alignment,
-	bool fast
+	bool fast,
+	int slices
 	) const
 {
 	/* Empirical testing suggests that sws_scale() will crash if
@@ -193,7 +332,6 @@ Image::crop_scale_window (
 	DCPOMATIC_ASSERT (out_size.height >= inter_size.height);
 
 	auto out = make_shared<Image>(out_format, out_size, out_alignment);
-	out->make_black ();
 
 	auto in_desc = av_pix_fmt_desc_get (_pixel_format);
 	if (!in_desc) {
@@ -224,48 +362,6 @@ Image::crop_scale_window (
 	/* Size of the image after any crop */
 	auto const cropped_size = corrected_crop.apply (size());
 
-	/* Scale context for a scale from cropped_size to inter_size */
-	auto scale_context = sws_getContext (
-			cropped_size.width, cropped_size.height, pixel_format(),
-			inter_size.width, inter_size.height, out_format,
-			fast ? SWS_FAST_BILINEAR : SWS_BICUBIC, 0, 0, 0
-		);
-
-	if (!scale_context) {
-		throw runtime_error (N_("Could not allocate SwsContext"));
-	}
-
-	DCPOMATIC_ASSERT (yuv_to_rgb < dcp::YUVToRGB::COUNT);
-	int const lut[static_cast<int>(dcp::YUVToRGB::COUNT)] = {
-		SWS_CS_ITU601,
-		SWS_CS_ITU709
-	};
-
-	/* The 3rd parameter here is:
-	   0 -> source range MPEG (i.e. "video", 16-235)
-	   1 -> source range JPEG (i.e. "full", 0-255)
-	   And the 5th:
-	   0 -> destination range MPEG (i.e. "video", 16-235)
-	   1 -> destination range JPEG (i.e. "full", 0-255)
-
-	   But remember: sws_setColorspaceDetails ignores these
-	   parameters unless the both source and destination images
-	   are isYUV or isGray.  (If either is not, it uses video range).
-	*/
-	sws_setColorspaceDetails (
-		scale_context,
-		sws_getCoefficients (lut[static_cast<int>(yuv_to_rgb)]), video_range == VideoRange::VIDEO ? 0 : 1,
-		sws_getCoefficients (lut[static_cast<int>(yuv_to_rgb)]), out_video_range == VideoRange::VIDEO ? 0 : 1,
-		0, 1 << 16, 1 << 16
-		);
-
-	/* Prepare input data pointers with crop */
-	uint8_t* scale_in_data[planes()];
-	for (int c = 0; c < planes(); ++c) {
-		int const x = lrintf(bytes_per_pixel(c) * corrected_crop.left);
-		scale_in_data[c] = data()[c] + x + stride()[c] * (corrected_crop.top / vertical_factor(c));
-	}
-
 	auto out_desc = av_pix_fmt_desc_get (out_format);
 	if (!out_desc) {
 		throw PixelFormatError ("crop_scale_window()", out_format);
@@ -277,20 +373,76 @@ Image::crop_scale_window (
 		round_height_for_subsampling((out_size.height - inter_size.height) / 2, out_desc)
 		);
 
-	uint8_t* scale_out_data[out->planes()];
-	for (int c = 0; c < out->planes(); ++c) {
-		int const x = lrintf(out->bytes_per_pixel(c) * corner.x);
-		scale_out_data[c] = out->data()[c] + x + out->stride()[c] * (corner.y / out->vertical_factor(c));
-	}
+	/* Blacken the parts of the output that the scaled image will not cover; this is done before
+	   scaling so that, where subsampled chroma samples are shared between the image and the
+	   border, the scaler has the last word.
+	*/
+	out->make_outside_black (corner, inter_size);
+
+	ScaleParameters parameters;
+	parameters.in_format = pixel_format();
+	parameters.out_format = out_format;
+	parameters.flags = fast ? SWS_FAST_BILINEAR : SWS_BICUBIC;
+	parameters.yuv_to_rgb = yuv_to_rgb;
+	parameters.in_range = video_range == VideoRange::VIDEO ? 0 : 1;
+	parameters.out_range = out_video_range == VideoRange::VIDEO ? 0 : 1;
+
+	/* Scale in_height lines of the cropped image, starting in_y lines down, into out_height
+	   lines of the output, starting out_y lines down from the corner.
+	*/
+	auto scale = [&](int in_y, int in_height, int out_y, int out_height) {
+		auto slice_parameters = parameters;
+		slice_parameters.in_size = dcp::Size(cropped_size.width, in_height);
+		slice_parameters.out_size = dcp::Size(inter_size.width, out_height);
+		auto scale_context = ::scale_context (slice_parameters);
+
+		/* Prepare input data pointers with crop */
+		uint8_t* scale_in_data[4] = { nullptr, nullptr, nullptr, nullptr };
+		for (int c = 0; c < planes(); ++c) {
+			int const x = lrintf(bytes_per_pixel(c) * corrected_crop.left);
+			scale_in_data[c] = data()[c] + x + stride()[c] * ((corrected_crop.top + in_y) / vertical_factor(c));
+		}
 
-	sws_scale (
-		scale_context,
-		scale_in_data, stride(),
-		0, cropped_size.height,
-		scale_out_data, out->stride()
-		);
+		uint8_t* scale_out_data[4] = { nullptr, nullptr, nullptr, nullptr };
+		for (int c = 0; c < out->planes(); ++c) {
+			int const x = lrintf(out->bytes_per_pixel(c) * corner.x);
+			scale_out_data[c] = out->data()[c] + x + out->stride()[c] * ((corner.y + out_y) / out->vertical_factor(c));
+		}
+
+		sws_scale (
+			scale_context,
+			scale_in_data, stride(),
+			0, in_height,
+			scale_out_data, out->stride()
+			);
+	};
+
+	slices = min(slices, min(cropped_size.height, inter_size.height) / minimum_slice_height);
+
+	if (slices <= 1) {
+		scale (0, cropped_size.height, 0, inter_size.height);
+	} else {
+		/* Slice boundaries must be on whole lines of any subsampled planes */
+		int const in_step = 1 << in_desc->log2_chroma_h;
+		int const out_step = 1 << out_desc->log2_chroma_h;
 
-	sws_freeContext (scale_context);
+		auto out_boundary = [&](int slice) {
+			return slice == slices ? inter_size.height : (inter_size.height * slice / slices) / out_step * out_step;
+		};
+
+		auto in_boundary = [&](int slice) {
+			if (slice == slices) {
+				return cropped_size.height;
+			}
+			return static_cast<int>(lrint(static_cast<double>(out_boundary(slice)) * cropped_size.height / inter_size.height)) / in_step * in_step;
+		};
+
+		SlicePool::instance()->run(slices, [&](int slice) {
+			auto const in_y = in_boundary (slice);
+			auto const out_y = out_boundary (slice);
+			scale (in_y, in_boundary(slice + 1) - in_y, out_y, out_boundary(slice + 1) - out_y);
+		});
+	}
 
 	if (corrected_crop != Crop() && cropped_size == inter_size) {
 		/* We are cropping without any scaling or pixel format conversion, so FFmpeg may have left some
@@ -336,35 +488,20 @@ Image::scale (dcp::Size out_size, dcp::YUVToRGB yuv_to_rgb, AVPixelFormat out_fo
 	DCPOMATIC_ASSERT (alignment() == Alignment::PADDED);
 
 	auto scaled = make_shared<Image>(out_format, out_size, out_alignment);
-	auto scale_context = sws_getContext (
-		size().width, size().height, pixel_format(),
-		out_size.width, out_size.height, out_format,
-		(fast ? SWS_FAST_BILINEAR : SWS_BICUBIC) | SWS_ACCURATE_RND, 0, 0, 0
-		);
 
-	DCPOMATIC_ASSERT (yuv_to_rgb < dcp::YUVToRGB::COUNT);
-	int const lut[static_cast<int>(dcp::YUVToRGB::COUNT)] = {
-		SWS_CS_ITU601,
-		SWS_CS_ITU709
-	};
-
-	/* The 3rd parameter here is:
-	   0 -> source range MPEG (i.e. "video", 16-235)
-	   1 -> source range JPEG (i.e. "full", 0-255)
-	   And the 5th:
-	   0 -> destination range MPEG (i.e. "video", 16-235)
-	   1 -> destination range JPEG (i.e. "full", 0-255)
-
-	   But remember: sws_setColorspaceDetails ignores these
-	   parameters unless the corresponding image isYUV or isGray.
-	   (If it's neither, it uses video range).
+	/* sws_setColorspaceDetails ignores the ranges unless the corresponding image
+	   isYUV or isGray (if it's neither, it uses video range).
 	*/
-	sws_setColorspaceDetails (
-		scale_context,
-		sws_getCoefficients (lut[static_cast<int>(yuv_to_rgb)]), 0,
-		sws_getCoefficients (lut[static_cast<int>(yuv_to_rgb)]), 0,
-		0, 1 << 16, 1 << 16
-		);
+	ScaleParameters parameters;
+	parameters.in_size = size();
+	parameters.in_format = pixel_format();
+	parameters.out_size = out_size;
+	parameters.out_format = out_format;
+	parameters.flags = (fast ? SWS_FAST_BILINEAR : SWS_BICUBIC) | SWS_ACCURATE_RND;
+	parameters.yuv_to_rgb = yuv_to_rgb;
+	parameters.in_range = 0;
+	parameters.out_range = 0;
+	auto scale_context = ::scale_context (parameters);
 
 	sws_scale (
 		scale_context,
@@ -373,8 +510,6 @@ Image::scale (dcp::Size out_size, dcp::YUVToRGB yuv_to_rgb, AVPixelFormat out_fo
 		scaled->data(), scaled->stride()
 		);
 
-	sws_freeContext (scale_context);
-
 	return scaled;
 }
 
@@ -412,12 +547,35 @@ Image::swap_16 (uint16_t v)
 void
 Image::make_part_black (int const start, int const width)
 {
+	make_part_black (start, width, 0, size().height);
+}
+
+
+/** Make a rectangle of this image black.  Only some pixel formats are supported.
+ *  @param start x position of the left of the rectangle.
+ *  @param width Width of the rectangle.
+ *  @param top y position of the top of the rectangle.
+ *  @param height Height of the rectangle.
+ */
+void
+Image::make_part_black (int const start, int const width, int const top, int const height)
+{
+	/* Range of lines to blacken in plane i, making sure that we cover any subsampled lines which
+	   are only partly in the rectangle.
+	*/
+	auto first_line = [&](int i) {
+		return top / vertical_factor(i);
+	};
+
+	auto last_line = [&](int i) {
+		return min(sample_size(i).height, (top + height + vertical_factor(i) - 1) / vertical_factor(i));
+	};
+
 	auto y_part = [&]() {
 		int const bpp = bytes_per_pixel(0);
-		int const h = sample_size(0).height;
 		int const s = stride()[0];
-		auto p = data()[0];
-		for (int y = 0; y < h; ++y) {
+		auto p = data()[0] + top * s;
+		for (int y = 0; y < height; ++y) {
 			memset (p + start * bpp, 0, width * bpp);
 			p += s;
 		}
@@ -433,24 +591,14 @@ Image::make_part_black (int const start, int const width)
 	case AV_PIX_FMT_RGB48LE:
 	case AV_PIX_FMT_RGB48BE:
 	case AV_PIX_FMT_XYZ12LE:
-	{
-		int const h = sample_size(0).height;
-		int const bpp = bytes_per_pixel(0);
-		int const s = stride()[0];
-		uint8_t* p = data()[0];
-		for (int y = 0; y < h; y++) {
-			memset (p + start * bpp, 0, width * bpp);
-			p += s;
-		}
+		y_part ();
 		break;
-	}
 	case AV_PIX_FMT_YUV420P:
 	{
 		y_part ();
 		for (int i = 1; i < 3; ++i) {
-			auto p = data()[i];
-			int const h = sample_size(i).height;
-			for (int y = 0; y < h; ++y) {
+			auto p = data()[i] + first_line(i) * stride()[i];
+			for (int y = first_line(i); y < last_line(i); ++y) {
 				for (int x = start / 2; x < (start + width) / 2; ++x) {
 					p[x] = eight_bit_uv;
 				}
@@ -463,9 +611,8 @@ Image::make_part_black (int const start, int const width)
 	{
 		y_part ();
 		for (int i = 1; i < 3; ++i) {
-			auto p = reinterpret_cast<int16_t*>(data()[i]);
-			int const h = sample_size(i).height;
-			for (int y = 0; y < h; ++y) {
+			auto p = reinterpret_cast<int16_t*>(data()[i] + first_line(i) * stride()[i]);
+			for (int y = first_line(i); y < last_line(i); ++y) {
 				for (int x = start / 2; x < (start + width) / 2; ++x) {
 					p[x] = ten_bit_uv;
 				}
@@ -480,6 +627,50 @@ Image::make_part_black (int const start, int const width)
 }
 
 
+/** Make black the parts of this image which are outside a rectangle.
+ *  @param corner Top-left corner of the rectangle.
+ *  @param inner Size of the rectangle.
+ */
+void
+Image::make_outside_black (Position<int> corner, dcp::Size inner)
+{
+	switch (_pixel_format) {
+	case AV_PIX_FMT_RGB24:
+	case AV_PIX_FMT_ARGB:
+	case AV_PIX_FMT_RGBA:
+	case AV_PIX_FMT_ABGR:
+	case AV_PIX_FMT_BGRA:
+	case AV_PIX_FMT_RGB555LE:
+	case AV_PIX_FMT_RGB48LE:
+	case AV_PIX_FMT_RGB48BE:
+	case AV_PIX_FMT_XYZ12LE:
+	case AV_PIX_FMT_YUV420P:
+	case AV_PIX_FMT_YUV422P10LE:
+		break;
+	default:
+		/* make_part_black() can't do this format, so do the whole thing */
+		make_black ();
+		return;
+	}
+
+	auto const right = corner.x + inner.width;
+	auto const bottom = corner.y + inner.height;
+
+	if (corner.y > 0) {
+		make_part_black (0, size().width, 0, corner.y);
+	}
+	if (bottom < size().height) {
+		make_part_black (0, size().width, bottom, size().height - bottom);
+	}
+	if (corner.x > 0) {
+		make_part_black (0, corner.x, corner.y, inner.height);
+	}
+	if (right < size().width) {
+		make_part_black (right, size().width - right, corner.y, inner.height);
+	}
+}
+
+
 void
 Image::make_black ()
 {
@@ -607,247 +798,242 @@ Image::make_transparent ()
 }
 
 
-void
-Image::alpha_blend (shared_ptr<const Image> other, Position<int> position)
+/** @return The smallest part of area which contains all the pixels of image that are not
+ *  completely transparent, or nothing if they all are.
+ *  @param image RGBA or BGRA image.
+ */
+static boost::optional<dcpomatic::Rect<int>>
+non_transparent_area (Image const& image, dcpomatic::Rect<int> area)
 {
-	/* We're blending RGBA or BGRA images */
-	DCPOMATIC_ASSERT (other->pixel_format() == AV_PIX_FMT_BGRA || other->pixel_format() == AV_PIX_FMT_RGBA);
-	int const blue = other->pixel_format() == AV_PIX_FMT_BGRA ? 0 : 2;
-	int const red = other->pixel_format() == AV_PIX_FMT_BGRA ? 2 : 0;
+	int left = area.x + area.width;
+	int right = area.x;
+	int top = area.y + area.height;
+	int bottom = area.y;
+
+	for (int y = area.y; y < area.y + area.height; ++y) {
+		auto p = image.data()[0] + y * image.stride()[0] + 3;
+		int first = area.x;
+		while (first < area.x + area.width && p[first * 4] == 0) {
+			++first;
+		}
+		if (first == area.x + area.width) {
+			continue;
+		}
 
-	int const other_bpp = 4;
+		/* Only look as far as the right-hand edge that we already have */
+		int last = area.x + area.width - 1;
+		while (last > first && last >= right && p[last * 4] == 0) {
+			--last;
+		}
 
-	int start_tx = position.x;
-	int start_ox = 0;
+		left = min (left, first);
+		right = max (right, last + 1);
+		top = min (top, y);
+		bottom = y + 1;
+	}
 
-	if (start_tx < 0) {
-		start_ox = -start_tx;
-		start_tx = 0;
+	if (left >= right) {
+		return {};
 	}
 
-	int start_ty = position.y;
-	int start_oy = 0;
+	return dcpomatic::Rect<int>(left, top, right - left, bottom - top);
+}
+
 
-	if (start_ty < 0) {
-		start_oy = -start_ty;
-		start_ty = 0;
+/** Blend an RGBA or BGRA overlay onto a YUV image whose chroma is subsampled horizontally.
+ *  Each chroma sample of the target is blended with the overlay once for each of
+ *  the pixels that it covers.
+ *  @param T Type of each sample of target (uint8_t or uint16_t).
+ *  @param area Part of overlay to blend.
+ *  @param position Position of overlay's top-left corner in target.
+ */
+template <class T>
+static void
+alpha_blend_yuv (Image* target, shared_ptr<const Image> overlay, dcpomatic::Rect<int> area, Position<int> position)
+{
+	auto const vertical_shift = av_pix_fmt_desc_get(target->pixel_format())->log2_chroma_h;
+
+	/* Convert only the part of the overlay that we need, starting on even co-ordinates
+	   so that its chroma samples are the same as they would be in a conversion of the
+	   whole thing.
+	*/
+	auto const crop_x = area.x & ~1;
+	auto const crop_y = area.y & ~1;
+	auto cropped = overlay;
+	if (crop_x != 0 || crop_y != 0 || area.width != overlay->size().width || area.height != overlay->size().height) {
+		auto copy = make_shared<Image>(overlay->pixel_format(), dcp::Size(area.x + area.width - crop_x, area.y + area.height - crop_y), Image::Alignment::COMPACT);
+		for (int y = 0; y < copy->size().height; ++y) {
+			memcpy (
+				copy->data()[0] + y * copy->stride()[0],
+				overlay->data()[0] + (y + crop_y) * overlay->stride()[0] + crop_x * 4,
+				copy->size().width * 4
+			       );
+		}
+		cropped = copy;
 	}
 
-	switch (_pixel_format) {
-	case AV_PIX_FMT_RGB24:
-	{
-		/* Going onto RGB24.  First byte is red, second green, third blue */
-		int const this_bpp = 3;
-		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
-			uint8_t* tp = data()[0] + ty * stride()[0] + start_tx * this_bpp;
-			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-				tp[0] = op[red] * alpha + tp[0] * (1 - alpha);
-				tp[1] = op[1] * alpha + tp[1] * (1 - alpha);
-				tp[2] = op[blue] * alpha + tp[2] * (1 - alpha);
-
-				tp += this_bpp;
-				op += other_bpp;
+	auto yuv = cropped->convert_pixel_format (dcp::YUVToRGB::REC709, target->pixel_format(), Image::Alignment::COMPACT, false);
+
+	int const start_tx = area.x + position.x;
+	int const end_tx = start_tx + area.width;
+	/* Pixel tx of the target is on top of pixel tx - offset of yuv */
+	int const offset = position.x + crop_x;
+
+	/* Chroma samples in [first_pair, end_pair) of the target cover two pixels that are both blended */
+	int const first_pair = (start_tx + 1) / 2;
+	int const end_pair = end_tx / 2;
+
+	vector<uint16_t> alpha (area.width);
+
+	for (int oy = area.y; oy < area.y + area.height; ++oy) {
+		int const ty = oy + position.y;
+		int const yuv_y = oy - crop_y;
+
+		alpha_blend_extract_alpha (overlay->data()[0] + oy * overlay->stride()[0] + area.x * 4, area.width, alpha.data());
+
+		auto const tY = reinterpret_cast<T*>(target->data()[0] + ty * target->stride()[0]);
+		auto const oY = reinterpret_cast<T const*>(yuv->data()[0] + yuv_y * yuv->stride()[0]);
+		alpha_blend_planar_row (tY + start_tx, oY + start_tx - offset, alpha.data(), area.width);
+
+		for (int c = 1; c < 3; ++c) {
+			auto const tC = reinterpret_cast<T*>(target->data()[c] + (ty >> vertical_shift) * target->stride()[c]);
+			auto const oC = reinterpret_cast<T const*>(yuv->data()[c] + (yuv_y >> vertical_shift) * yuv->stride()[c]);
+			auto overlay_chroma = [oC, offset](int tx) {
+				return oC[(tx - offset) / 2];
+			};
+
+			if (start_tx % 2) {
+				/* The first chroma sample only covers one pixel that we are blending */
+				tC[start_tx / 2] = alpha_blend_sample<T>(tC[start_tx / 2], overlay_chroma(start_tx), alpha[0]);
+			}
+
+			if (end_pair > first_pair) {
+				alpha_blend_chroma_row (
+					tC + first_pair,
+					oC + (first_pair * 2 - offset) / 2,
+					oC + (first_pair * 2 + 1 - offset) / 2,
+					alpha.data() + first_pair * 2 - start_tx,
+					end_pair - first_pair
+					);
+			}
+
+			if (end_tx % 2 && end_tx - 1 >= first_pair * 2) {
+				/* So does the last */
+				tC[end_tx / 2] = alpha_blend_sample<T>(tC[end_tx / 2], overlay_chroma(end_tx - 1), alpha[area.width - 1]);
 			}
 		}
-		break;
 	}
-	case AV_PIX_FMT_BGRA:
-	{
-		int const this_bpp = 4;
-		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
-			uint8_t* tp = data()[0] + ty * stride()[0] + start_tx * this_bpp;
-			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-				tp[0] = op[blue] * alpha + tp[0] * (1 - alpha);
-				tp[1] = op[1] * alpha + tp[1] * (1 - alpha);
-				tp[2] = op[red] * alpha + tp[2] * (1 - alpha);
-				tp[3] = op[3] * alpha + tp[3] * (1 - alpha);
-
-				tp += this_bpp;
-				op += other_bpp;
-			}
+}
+
+
+void
+Image::alpha_blend (shared_ptr<const Image> other, Position<int> position)
+{
+	/* We're blending RGBA or BGRA images */
+	DCPOMATIC_ASSERT (other->pixel_format() == AV_PIX_FMT_BGRA || other->pixel_format() == AV_PIX_FMT_RGBA);
+	bool const other_bgra = other->pixel_format() == AV_PIX_FMT_BGRA;
+
+	/* Find the part of other which is on top of us and not completely transparent */
+	auto const on_top = dcpomatic::Rect<int>(0, 0, other->size().width, other->size().height).intersection(
+		dcpomatic::Rect<int>(-position.x, -position.y, size().width, size().height)
+		);
+	if (!on_top) {
+		return;
+	}
+
+	auto const area = non_transparent_area (*other, *on_top);
+	if (!area) {
+		return;
+	}
+
+	int const start_ox = area->x;
+	int const start_oy = area->y;
+	int const end_ox = area->x + area->width;
+	int const end_oy = area->y + area->height;
+	int const start_tx = start_ox + position.x;
+
+	auto blend_packed = [&](dcpomatic::PackedBlendTarget format, int this_bpp) {
+		for (int oy = start_oy; oy < end_oy; ++oy) {
+			alpha_blend_packed_row (
+				data()[0] + (oy + position.y) * stride()[0] + start_tx * this_bpp,
+				format,
+				other->data()[0] + oy * other->stride()[0] + start_ox * 4,
+				other_bgra,
+				area->width
+				);
 		}
+	};
+
+	switch (_pixel_format) {
+	case AV_PIX_FMT_RGB24:
+		blend_packed (dcpomatic::PackedBlendTarget::RGB24, 3);
+		break;
+	case AV_PIX_FMT_BGRA:
+		blend_packed (dcpomatic::PackedBlendTarget::BGRA, 4);
 		break;
-	}
 	case AV_PIX_FMT_RGBA:
-	{
-		int const this_bpp = 4;
-		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
-			uint8_t* tp = data()[0] + ty * stride()[0] + start_tx * this_bpp;
-			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-				tp[0] = op[red] * alpha + tp[0] * (1 - alpha);
-				tp[1] = op[1] * alpha + tp[1] * (1 - alpha);
-				tp[2] = op[blue] * alpha + tp[2] * (1 - alpha);
-				tp[3] = op[3] * alpha + tp[3] * (1 - alpha);
-
-				tp += this_bpp;
-				op += other_bpp;
-			}
-		}
+		blend_packed (dcpomatic::PackedBlendTarget::RGBA, 4);
 		break;
-	}
 	case AV_PIX_FMT_RGB48LE:
-	{
-		int const this_bpp = 6;
-		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
-			uint8_t* tp = data()[0] + ty * stride()[0] + start_tx * this_bpp;
-			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-				/* Blend high bytes */
-				tp[1] = op[red] * alpha + tp[1] * (1 - alpha);
-				tp[3] = op[1] * alpha + tp[3] * (1 - alpha);
-				tp[5] = op[blue] * alpha + tp[5] * (1 - alpha);
-
-				tp += this_bpp;
-				op += other_bpp;
-			}
-		}
+		blend_packed (dcpomatic::PackedBlendTarget::RGB48LE, 6);
 		break;
-	}
 	case AV_PIX_FMT_XYZ12LE:
 	{
+		int const blue = other_bgra ? 0 : 2;
+		int const red = other_bgra ? 2 : 0;
 		auto conv = dcp::ColourConversion::srgb_to_xyz();
 		double fast_matrix[9];
 		dcp::combined_rgb_to_xyz (conv, fast_matrix);
 		auto lut_in = conv.in()->lut(0, 1, 8, false);
 		auto lut_out = conv.out()->lut(0, 1, 16, true);
-		int const this_bpp = 6;
-		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
-			uint16_t* tp = reinterpret_cast<uint16_t*> (data()[0] + ty * stride()[0] + start_tx * this_bpp);
-			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-
-				/* Convert sRGB to XYZ; op is BGRA.  First, input gamma LUT */
-				double const r = lut_in[op[red]];
-				double const g = lut_in[op[1]];
-				double const b = lut_in[op[blue]];
-
-				/* RGB to XYZ, including Bradford transform and DCI companding */
-				double const x = max (0.0, min (65535.0, r * fast_matrix[0] + g * fast_matrix[1] + b * fast_matrix[2]));
-				double const y = max (0.0, min (65535.0, r * fast_matrix[3] + g * fast_matrix[4] + b * fast_matrix[5]));
-				double const z = max (0.0, min (65535.0, r * fast_matrix[6] + g * fast_matrix[7] + b * fast_matrix[8]));
-
-				/* Out gamma LUT and blend */
-				tp[0] = lrint(lut_out[lrint(x)] * 65535) * alpha + tp[0] * (1 - alpha);
-				tp[1] = lrint(lut_out[lrint(y)] * 65535) * alpha + tp[1] * (1 - alpha);
-				tp[2] = lrint(lut_out[lrint(z)] * 65535) * alpha + tp[2] * (1 - alpha);
-
-				tp += this_bpp / 2;
-				op += other_bpp;
+
+		/* Subtitles are mostly made of a few colours, so remember the last conversion */
+		int last_rgb = -1;
+		uint16_t xyz[3] = { 0, 0, 0 };
+
+		for (int oy = start_oy; oy < end_oy; ++oy) {
+			uint16_t* tp = reinterpret_cast<uint16_t*> (data()[0] + (oy + position.y) * stride()[0] + start_tx * 6);
+			uint8_t* op = other->data()[0] + oy * other->stride()[0] + start_ox * 4;
+			for (int ox = start_ox; ox < end_ox; ++ox) {
+				int const alpha = op[3];
+				if (alpha) {
+					int const rgb = (op[red] << 16) | (op[1] << 8) | op[blue];
+					if (rgb != last_rgb) {
+						/* Convert sRGB to XYZ; op is BGRA.  First, input gamma LUT */
+						double const r = lut_in[op[red]];
+						double const g = lut_in[op[1]];
+						double const b = lut_in[op[blue]];
+
+						/* RGB to XYZ, including Bradford transform and DCI companding */
+						double const x = max (0.0, min (65535.0, r * fast_matrix[0] + g * fast_matrix[1] + b * fast_matrix[2]));
+						double const y = max (0.0, min (65535.0, r * fast_matrix[3] + g * fast_matrix[4] + b * fast_matrix[5]));
+						double const z = max (0.0, min (65535.0, r * fast_matrix[6] + g * fast_matrix[7] + b * fast_matrix[8]));
+
+						/* Out gamma LUT */
+						xyz[0] = lrint(lut_out[lrint(x)] * 65535);
+						xyz[1] = lrint(lut_out[lrint(y)] * 65535);
+						xyz[2] = lrint(lut_out[lrint(z)] * 65535);
+						last_rgb = rgb;
+					}
+
+					for (int c = 0; c < 3; ++c) {
+						tp[c] = alpha_blend_sample<uint16_t>(tp[c], xyz[c], alpha);
+					}
+				}
+
+				tp += 3;
+				op += 4;
 			}
 		}
 		break;
 	}
 	case AV_PIX_FMT_YUV420P:
-	{
-		auto yuv = other->convert_pixel_format (dcp::YUVToRGB::REC709, _pixel_format, Alignment::COMPACT, false);
-		dcp::Size const ts = size();
-		dcp::Size const os = yuv->size();
-		for (int ty = start_ty, oy = start_oy; ty < ts.height && oy < os.height; ++ty, ++oy) {
-			int const hty = ty / 2;
-			int const hoy = oy / 2;
-			uint8_t* tY = data()[0] + (ty * stride()[0]) + start_tx;
-			uint8_t* tU = data()[1] + (hty * stride()[1]) + start_tx / 2;
-			uint8_t* tV = data()[2] + (hty * stride()[2]) + start_tx / 2;
-			uint8_t* oY = yuv->data()[0] + (oy * yuv->stride()[0]) + start_ox;
-			uint8_t* oU = yuv->data()[1] + (hoy * yuv->stride()[1]) + start_ox / 2;
-			uint8_t* oV = yuv->data()[2] + (hoy * yuv->stride()[2]) + start_ox / 2;
-			uint8_t* alpha = other->data()[0] + (oy * other->stride()[0]) + start_ox * 4;
-			for (int tx = start_tx, ox = start_ox; tx < ts.width && ox < os.width; ++tx, ++ox) {
-				float const a = float(alpha[3]) / 255;
-				*tY = *oY * a + *tY * (1 - a);
-				*tU = *oU * a + *tU * (1 - a);
-				*tV = *oV * a + *tV * (1 - a);
-				++tY;
-				++oY;
-				if (tx % 2) {
-					++tU;
-					++tV;
-				}
-				if (ox % 2) {
-					++oU;
-					++oV;
-				}
-				alpha += 4;
-			}
-		}
+		alpha_blend_yuv<uint8_t> (this, other, *area, position);
 		break;
-	}
 	case AV_PIX_FMT_YUV420P10:
-	{
-		auto yuv = other->convert_pixel_format (dcp::YUVToRGB::REC709, _pixel_format, Alignment::COMPACT, false);
-		dcp::Size const ts = size();
-		dcp::Size const os = yuv->size();
-		for (int ty = start_ty, oy = start_oy; ty < ts.height && oy < os.height; ++ty, ++oy) {
-			int const hty = ty / 2;
-			int const hoy = oy / 2;
-			uint16_t* tY = ((uint16_t *) (data()[0] + (ty * stride()[0]))) + start_tx;
-			uint16_t* tU = ((uint16_t *) (data()[1] + (hty * stride()[1]))) + start_tx / 2;
-			uint16_t* tV = ((uint16_t *) (data()[2] + (hty * stride()[2]))) + start_tx / 2;
-			uint16_t* oY = ((uint16_t *) (yuv->data()[0] + (oy * yuv->stride()[0]))) + start_ox;
-			uint16_t* oU = ((uint16_t *) (yuv->data()[1] + (hoy * yuv->stride()[1]))) + start_ox / 2;
-			uint16_t* oV = ((uint16_t *) (yuv->data()[2] + (hoy * yuv->stride()[2]))) + start_ox / 2;
-			uint8_t* alpha = other->data()[0] + (oy * other->stride()[0]) + start_ox * 4;
-			for (int tx = start_tx, ox = start_ox; tx < ts.width && ox < os.width; ++tx, ++ox) {
-				float const a = float(alpha[3]) / 255;
-				*tY = *oY * a + *tY * (1 - a);
-				*tU = *oU * a + *tU * (1 - a);
-				*tV = *oV * a + *tV * (1 - a);
-				++tY;
-				++oY;
-				if (tx % 2) {
-					++tU;
-					++tV;
-				}
-				if (ox % 2) {
-					++oU;
-					++oV;
-				}
-				alpha += 4;
-			}
-		}
-		break;
-	}
 	case AV_PIX_FMT_YUV422P10LE:
-	{
-		auto yuv = other->convert_pixel_format (dcp::YUVToRGB::REC709, _pixel_format, Alignment::COMPACT, false);
-		dcp::Size const ts = size();
-		dcp::Size const os = yuv->size();
-		for (int ty = start_ty, oy = start_oy; ty < ts.height && oy < os.height; ++ty, ++oy) {
-			uint16_t* tY = ((uint16_t *) (data()[0] + (ty * stride()[0]))) + start_tx;
-			uint16_t* tU = ((uint16_t *) (data()[1] + (ty * stride()[1]))) + start_tx / 2;
-			uint16_t* tV = ((uint16_t *) (data()[2] + (ty * stride()[2]))) + start_tx / 2;
-			uint16_t* oY = ((uint16_t *) (yuv->data()[0] + (oy * yuv->stride()[0]))) + start_ox;
-			uint16_t* oU = ((uint16_t *) (yuv->data()[1] + (oy * yuv->stride()[1]))) + start_ox / 2;
-			uint16_t* oV = ((uint16_t *) (yuv->data()[2] + (oy * yuv->stride()[2]))) + start_ox / 2;
-			uint8_t* alpha = other->data()[0] + (oy * other->stride()[0]) + start_ox * 4;
-			for (int tx = start_tx, ox = start_ox; tx < ts.width && ox < os.width; ++tx, ++ox) {
-				float const a = float(alpha[3]) / 255;
-				*tY = *oY * a + *tY * (1 - a);
-				*tU = *oU * a + *tU * (1 - a);
-				*tV = *oV * a + *tV * (1 - a);
-				++tY;
-				++oY;
-				if (tx % 2) {
-					++tU;
-					++tV;
-				}
-				if (ox % 2) {
-					++oU;
-					++oV;
-				}
-				alpha += 4;
-			}
-		}
+		alpha_blend_yuv<uint16_t> (this, other, *area, position);
 		break;
-	}
 	default:
 		throw PixelFormatError ("alpha_blend()", _pixel_format);
 	}
@@ -964,14 +1150,11 @@ Image::Image (AVPixelFormat p, dcp::Size s, Alignment alignment)
 void
 Image::allocate ()
 {
-	_data = (uint8_t **) wrapped_av_malloc (4 * sizeof (uint8_t *));
-	_data[0] = _data[1] = _data[2] = _data[3] = 0;
-
-	_line_size = (int *) wrapped_av_malloc (4 * sizeof (int));
-	_line_size[0] = _line_size[1] = _line_size[2] = _line_size[3] = 0;
-
-	_stride = (int *) wrapped_av_malloc (4 * sizeof (int));
-	_stride[0] = _stride[1] = _stride[2] = _stride[3] = 0;
+	for (int i = 0; i < 4; ++i) {
+		_data[i] = nullptr;
+		_line_size[i] = 0;
+		_stride[i] = 0;
+	}
 
 	auto stride_round_up = [](int stride, int t) {
 		int const a = stride + (t - 1);
@@ -981,7 +1164,18 @@ Image::allocate ()
 	for (int i = 0; i < planes(); ++i) {
 		_line_size[i] = ceil (_size.width * bytes_per_pixel(i));
 		_stride[i] = stride_round_up (_line_size[i], _alignment == Alignment::PADDED ? ALIGNMENT : 1);
+	}
+
+	/* Re-use buffers from an image that has already been destroyed, if we can */
+	auto pooled = ImagePool::instance()->get(_pixel_format, _size, _alignment);
+	if (pooled) {
+		for (int i = 0; i < 4; ++i) {
+			_data[i] = (*pooled)[i];
+		}
+		return;
+	}
 
+	for (int i = 0; i < planes(); ++i) {
 		/* The assembler function ff_rgb24ToY_avx (in libswscale/x86/input.asm)
 		   uses a 16-byte fetch to read three bytes (R/G/B) of image data.
 		   Hence on the last pixel of the last line it reads over the end of
@@ -1019,17 +1213,25 @@ Image::allocate ()
 		   |XXXwrittenXXX|<------line-size------------->|XXXwrittenXXXXXXwrittenXXX
 		                                                               ^^^^ out of bounds
 		*/
-		_data[i] = (uint8_t *) wrapped_av_malloc (_stride[i] * (sample_size(i).height + 1) + ALIGNMENT);
+		_data[i] = (uint8_t *) wrapped_av_malloc (allocation_size(i));
 #if HAVE_VALGRIND_MEMCHECK_H
 		/* The data between the end of the line size and the stride is undefined but processed by
 		   libswscale, causing lots of valgrind errors.  Mark it all defined to quell these errors.
 		*/
-		VALGRIND_MAKE_MEM_DEFINED (_data[i], _stride[i] * (sample_size(i).height + 1) + ALIGNMENT);
+		VALGRIND_MAKE_MEM_DEFINED (_data[i], allocation_size(i));
 #endif
 	}
 }
 
 
+/** @return Number of bytes that allocate() allocates for a plane; see the comment there for the reasons */
+size_t
+Image::allocation_size (int plane) const
+{
+	return _stride[plane] * (sample_size(plane).height + 1) + ALIGNMENT;
+}
+
+
 Image::Image (Image const & other)
 	: std::enable_shared_from_this<Image>(other)
 	, _size (other._size)
@@ -1126,13 +1328,14 @@ Image::swap (Image & other)
 
 Image::~Image ()
 {
-	for (int i = 0; i < planes(); ++i) {
-		av_free (_data[i]);
+	ImagePool::Planes planes = {{ nullptr, nullptr, nullptr, nullptr }};
+	size_t bytes = 0;
+	for (int i = 0; i < this->planes(); ++i) {
+		planes[i] = _data[i];
+		bytes += allocation_size (i);
 	}
 
-	av_free (_data);
-	av_free (_line_size);
-	av_free (_stride);
+	ImagePool::instance()->put (_pixel_format, _size, _alignment, planes, bytes);
 }
 
 
@@ -1271,8 +1474,10 @@ Image::fade (float f)
 	}
 
 	case AV_PIX_FMT_RGB24:
+	case AV_PIX_FMT_BGRA:
+	case AV_PIX_FMT_RGBA:
 	{
-		/* 8-bit */
+		/* 8-bit; where there is alpha it is faded too, so that the image fades to transparent */
 		uint8_t* p = data()[0];
 		int const lines = sample_size(0).height;
 		for (int y = 0; y < lines; ++y) {
@@ -1370,6 +1575,25 @@ Image::memory_used () const
 }
 
 
+/** Add our pixel format, size and image data (but not any padding) to a digest */
+void
+Image::add_digest (Digester& digester) const
+{
+	digester.add (static_cast<int>(_pixel_format));
+	digester.add (_size.width);
+	digester.add (_size.height);
+
+	for (int c = 0; c < planes(); ++c) {
+		uint8_t* p = data()[c];
+		int const lines = sample_size(c).height;
+		for (int y = 0; y < lines; ++y) {
+			digester.add (p, line_size()[c]);
+			p += stride()[c];
+		}
+	}
+}
+
+
 void
 Image::video_range_to_full_range ()
 {
@@ -35,6 +35,7 @@ extern "C" {
 #include <dcp/colour_conversion.h>
 
 struct AVFrame;
+class Digester;
 class Socket;
 
 class Image : public std::enable_shared_from_this<Image>
@@ -77,7 +78,8 @@ public:
 		AVPixelFormat out_format,
 		VideoRange out_video_range,
 		Alignment alignment,
-		bool fast
+		bool fast,
+		int slices = 1
 		) const;
 
 	void make_black ();
@@ -95,6 +97,8 @@ public:
 
 	size_t memory_used () const;
 
+	void add_digest (Digester& digester) const;
+
 	static std::shared_ptr<const Image> ensure_alignment (std::shared_ptr<const Image> image, Alignment alignment);
 
 private:
@@ -102,17 +106,20 @@ private:
 	friend struct make_part_black_test;
 
 	void allocate ();
+	size_t allocation_size (int plane) const;
 	void swap (Image &);
 	void make_part_black (int x, int w);
+	void make_part_black (int x, int w, int y, int h);
+	void make_outside_black (Position<int> corner, dcp::Size inner);
 	void yuv_16_black (uint16_t, bool);
 	static uint16_t swap_16 (uint16_t);
 	void video_range_to_full_range ();
 
 	dcp::Size _size;
 	AVPixelFormat _pixel_format; ///< FFmpeg's way of describing the pixel format of this Image
-	uint8_t** _data; ///< array of pointers to components
-	int* _line_size; ///< array of sizes of the data in each line, in bytes (without any alignment padding bytes)
-	int* _stride; ///< array of strides for each line, in bytes (including any alignment padding bytes)
+	uint8_t* _data[4]; ///< array of pointers to components
+	int _line_size[4]; ///< array of sizes of the data in each line, in bytes (without any alignment padding bytes)
+	int _stride[4]; ///< array of strides for each line, in bytes (including any alignment padding bytes)
 	Alignment _alignment;
 };
 
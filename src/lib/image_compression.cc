@@ -0,0 +1,246 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "dcpomatic_assert.h"
+#include "dcpomatic_socket.h"
+#include "exceptions.h"
+#include "ffmpeg_wrapper.h"
+#include "image.h"
+#include "image_compression.h"
+#include "scope_guard.h"
+#include <dcp/warnings.h>
+LIBDCP_DISABLE_WARNINGS
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+LIBDCP_ENABLE_WARNINGS
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstring>
+
+#include "i18n.h"
+
+
+using std::make_shared;
+using std::shared_ptr;
+
+
+/** Number of slices to split each frame into when compressing; this must be one that FFV1 accepts */
+static int constexpr compression_slices = 16;
+/** Smallest width and height of image that is worth splitting into slices; smaller images
+ *  (such as most subtitles) are quick to compress, and FFV1 will not make very small slices.
+ */
+static int constexpr minimum_sliced_size = 256;
+
+
+/** @return true if images in the given format can be compressed by compress_image_losslessly() */
+bool
+can_compress_image_losslessly (AVPixelFormat format)
+{
+	auto codec = avcodec_find_encoder (AV_CODEC_ID_FFV1);
+	if (!codec || !codec->pix_fmts) {
+		return false;
+	}
+
+	for (auto p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; ++p) {
+		if (*p == format) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/** @return true if images compressed by compress_image_losslessly() can be decompressed here */
+bool
+can_decompress_images_losslessly ()
+{
+	return avcodec_find_decoder(AV_CODEC_ID_FFV1) != nullptr;
+}
+
+
+/** Compress an image as a single FFV1 frame.  The image's pixel format must be one
+ *  for which can_compress_image_losslessly() returns true.
+ */
+dcp::ArrayData
+compress_image_losslessly (shared_ptr<const Image> image)
+{
+	auto codec = avcodec_find_encoder (AV_CODEC_ID_FFV1);
+	if (!codec) {
+		throw EncodeError (N_("avcodec_find_encoder"), N_("compress_image_losslessly"));
+	}
+
+	auto context = avcodec_alloc_context3 (codec);
+	if (!context) {
+		throw std::bad_alloc ();
+	}
+
+	ScopeGuard sg = [&context]() { avcodec_free_context(&context); };
+
+	context->width = image->size().width;
+	context->height = image->size().height;
+	context->pix_fmt = image->pixel_format();
+	context->time_base = (AVRational) { 1, 24 };
+	if (image->size().width >= minimum_sliced_size && image->size().height >= minimum_sliced_size) {
+		/* Use FFV1 version 3 so that the frame is split into slices which are encoded in parallel;
+		   otherwise a 4K frame takes long enough that compressing it could cost more time than
+		   it saves on the network.
+		*/
+		context->level = 3;
+		context->slices = compression_slices;
+		context->thread_type = FF_THREAD_SLICE;
+		context->thread_count = std::min(compression_slices, std::max(1, static_cast<int>(boost::thread::hardware_concurrency())));
+	}
+
+	int r = avcodec_open2 (context, codec, nullptr);
+	if (r < 0) {
+		throw EncodeError (N_("avcodec_open2"), N_("compress_image_losslessly"), r);
+	}
+
+	auto frame = av_frame_alloc ();
+	if (!frame) {
+		throw std::bad_alloc ();
+	}
+
+	ScopeGuard fsg = [&frame]() { av_frame_free(&frame); };
+
+	for (int i = 0; i < image->planes(); ++i) {
+		frame->data[i] = image->data()[i];
+		frame->linesize[i] = image->stride()[i];
+	}
+
+	frame->width = image->size().width;
+	frame->height = image->size().height;
+	frame->format = image->pixel_format();
+	frame->pts = 0;
+
+	r = avcodec_send_frame (context, frame);
+	if (r < 0) {
+		throw EncodeError (N_("avcodec_send_frame"), N_("compress_image_losslessly"), r);
+	}
+
+	/* Flush so that we get our single packet back */
+	r = avcodec_send_frame (context, nullptr);
+	if (r < 0) {
+		throw EncodeError (N_("avcodec_send_frame"), N_("compress_image_losslessly"), r);
+	}
+
+	ffmpeg::Packet packet;
+	r = avcodec_receive_packet (context, packet.get());
+	if (r < 0) {
+		throw EncodeError (N_("avcodec_receive_packet"), N_("compress_image_losslessly"), r);
+	}
+
+	return dcp::ArrayData (packet->data, packet->size);
+}
+
+
+/** Decompress an image which was compressed by compress_image_losslessly() */
+shared_ptr<Image>
+decompress_image_losslessly (dcp::Data const& data, AVPixelFormat format, dcp::Size size, Image::Alignment alignment)
+{
+	auto codec = avcodec_find_decoder (AV_CODEC_ID_FFV1);
+	if (!codec) {
+		throw DecodeError (N_("avcodec_find_decoder"), N_("decompress_image_losslessly"));
+	}
+
+	auto context = avcodec_alloc_context3 (codec);
+	if (!context) {
+		throw std::bad_alloc ();
+	}
+
+	ScopeGuard sg = [&context]() { avcodec_free_context(&context); };
+
+	context->width = size.width;
+	context->height = size.height;
+	context->pix_fmt = format;
+
+	int r = avcodec_open2 (context, codec, nullptr);
+	if (r < 0) {
+		throw DecodeError (N_("avcodec_open2"), N_("decompress_image_losslessly"), r);
+	}
+
+	/* The decoder needs some padding after the end of the data */
+	dcp::ArrayData padded (data.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+	memcpy (padded.data(), data.data(), data.size());
+	memset (padded.data() + data.size(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+	ffmpeg::Packet packet;
+	packet->data = padded.data();
+	packet->size = data.size();
+
+	r = avcodec_send_packet (context, packet.get());
+	if (r < 0) {
+		throw DecodeError (N_("avcodec_send_packet"), N_("decompress_image_losslessly"), r);
+	}
+
+	auto frame = av_frame_alloc ();
+	if (!frame) {
+		throw std::bad_alloc ();
+	}
+
+	ScopeGuard fsg = [&frame]() { av_frame_free(&frame); };
+
+	r = avcodec_receive_frame (context, frame);
+	if (r < 0) {
+		throw DecodeError (N_("avcodec_receive_frame"), N_("decompress_image_losslessly"), r);
+	}
+
+	if (frame->width != size.width || frame->height != size.height || frame->format != format) {
+		throw DecodeError (N_("Unexpected frame from FFV1 decoder"));
+	}
+
+	return make_shared<Image>(frame, alignment);
+}
+
+
+/** Write an image to a socket, optionally compressing it first.
+ *  @param compress true to compress; the image's format must be one for which can_compress_image_losslessly() returns true.
+ */
+void
+write_image_to_socket (shared_ptr<const Image> image, bool compress, shared_ptr<Socket> socket)
+{
+	if (compress) {
+		auto compressed = compress_image_losslessly (image);
+		socket->write (compressed.size());
+		socket->write (compressed.data(), compressed.size());
+	} else {
+		image->write_to_socket (socket);
+	}
+}
+
+
+/** Read an image that was written by write_image_to_socket() */
+shared_ptr<Image>
+read_image_from_socket (AVPixelFormat format, dcp::Size size, bool compressed, shared_ptr<Socket> socket)
+{
+	if (compressed) {
+		dcp::ArrayData data (socket->read_uint32());
+		socket->read (data.data(), data.size());
+		return decompress_image_losslessly (data, format, size, Image::Alignment::PADDED);
+	}
+
+	auto image = make_shared<Image>(format, size, Image::Alignment::PADDED);
+	image->read_from_socket (socket);
+	return image;
+}
@@ -0,0 +1,51 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  src/lib/image_compression.h
+ *  @brief Lossless compression of Images (using FFV1) so that they can be sent
+ *  to encoding servers without saturating the network.
+ */
+
+
+#ifndef DCPOMATIC_IMAGE_COMPRESSION_H
+#define DCPOMATIC_IMAGE_COMPRESSION_H
+
+
+#include "image.h"
+#include <dcp/array_data.h>
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+#include <memory>
+
+
+class Socket;
+
+
+extern bool can_compress_image_losslessly (AVPixelFormat format);
+extern bool can_decompress_images_losslessly ();
+extern dcp::ArrayData compress_image_losslessly (std::shared_ptr<const Image> image);
+extern std::shared_ptr<Image> decompress_image_losslessly (dcp::Data const& data, AVPixelFormat format, dcp::Size size, Image::Alignment alignment);
+extern void write_image_to_socket (std::shared_ptr<const Image> image, bool compress, std::shared_ptr<Socket> socket);
+extern std::shared_ptr<Image> read_image_from_socket (AVPixelFormat format, dcp::Size size, bool compressed, std::shared_ptr<Socket> socket);
+
+
+#endif
@@ -0,0 +1,196 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "dcpomatic_assert.h"
+#include "image_pool.h"
+#include <dcp/warnings.h>
+LIBDCP_DISABLE_WARNINGS
+extern "C" {
+#include <libavutil/mem.h>
+}
+LIBDCP_ENABLE_WARNINGS
+
+
+using std::vector;
+using boost::optional;
+
+
+static void
+free_planes (ImagePool::Planes const& planes)
+{
+	for (auto i: planes) {
+		av_free (i);
+	}
+}
+
+
+bool
+ImagePool::Key::operator< (Key const& other) const
+{
+	if (format != other.format) {
+		return format < other.format;
+	}
+
+	if (size.width != other.size.width) {
+		return size.width < other.size.width;
+	}
+
+	if (size.height != other.size.height) {
+		return size.height < other.size.height;
+	}
+
+	return alignment < other.alignment;
+}
+
+
+/** @return Buffers that were put() with the same format, size and alignment, or nothing if there are none */
+optional<ImagePool::Planes>
+ImagePool::get (AVPixelFormat format, dcp::Size size, Image::Alignment alignment)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	auto i = _entries.find (Key(format, size, alignment));
+	if (i == _entries.end() || i->second.free.empty()) {
+		++_misses;
+		return {};
+	}
+
+	auto& entry = i->second;
+	auto planes = entry.free.back ();
+	entry.free.pop_back ();
+	entry.last_used = ++_clock;
+	_resident -= entry.bytes;
+	++_hits;
+	return planes;
+}
+
+
+/** Give the pool some buffers from an image which is no longer required.  The pool
+ *  takes ownership of them, and will free them with av_free() if it does not keep them.
+ *  @param planes Buffers, with unused entries set to nullptr.
+ *  @param bytes Total size of the buffers in bytes.
+ */
+void
+ImagePool::put (AVPixelFormat format, dcp::Size size, Image::Alignment alignment, Planes planes, size_t bytes)
+{
+	vector<Planes> to_free;
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+
+		if (bytes > _maximum_resident) {
+			to_free.push_back (planes);
+		} else {
+			while (_resident + bytes > _maximum_resident) {
+				evict_unlocked (to_free);
+			}
+
+			auto& entry = _entries[Key(format, size, alignment)];
+			entry.free.push_back (planes);
+			entry.bytes = bytes;
+			entry.last_used = ++_clock;
+			_resident += bytes;
+		}
+	}
+
+	for (auto const& i: to_free) {
+		free_planes (i);
+	}
+}
+
+
+/** Remove one set of buffers from the least-recently-used entry which has any.
+ *  _mutex must be held, and _resident must be greater than 0.
+ */
+void
+ImagePool::evict_unlocked (vector<Planes>& to_free)
+{
+	auto oldest = _entries.end();
+	for (auto i = _entries.begin(); i != _entries.end(); ++i) {
+		if (!i->second.free.empty() && (oldest == _entries.end() || i->second.last_used < oldest->second.last_used)) {
+			oldest = i;
+		}
+	}
+
+	DCPOMATIC_ASSERT (oldest != _entries.end());
+
+	to_free.push_back (oldest->second.free.back());
+	oldest->second.free.pop_back ();
+	_resident -= oldest->second.bytes;
+
+	if (oldest->second.free.empty()) {
+		_entries.erase (oldest);
+	}
+}
+
+
+/** Set the maximum total size of the buffers that we will hold, in bytes */
+void
+ImagePool::set_maximum_resident (size_t bytes)
+{
+	vector<Planes> to_free;
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_maximum_resident = bytes;
+		while (_resident > _maximum_resident) {
+			evict_unlocked (to_free);
+		}
+	}
+
+	for (auto const& i: to_free) {
+		free_planes (i);
+	}
+}
+
+
+/** Free all the buffers that we are holding */
+void
+ImagePool::clear ()
+{
+	vector<Planes> to_free;
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		for (auto& i: _entries) {
+			for (auto const& j: i.second.free) {
+				to_free.push_back (j);
+			}
+		}
+		_entries.clear ();
+		_resident = 0;
+	}
+
+	for (auto const& i: to_free) {
+		free_planes (i);
+	}
+}
+
+
+ImagePool*
+ImagePool::instance ()
+{
+	/* Images can be made and destroyed on any thread, and at any time up to the end of the
+	   program, so this must be created in a thread-safe way and never destroyed.
+	*/
+	static auto pool = new ImagePool ();
+	return pool;
+}
@@ -0,0 +1,133 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCPOMATIC_IMAGE_POOL_H
+#define DCPOMATIC_IMAGE_POOL_H
+
+
+/** @file  src/lib/image_pool.h
+ *  @brief ImagePool class.
+ */
+
+
+#include "image.h"
+#include <boost/optional.hpp>
+#include <boost/thread/mutex.hpp>
+#include <array>
+#include <map>
+#include <vector>
+
+
+/** @class ImagePool
+ *  @brief A store of image data buffers which have been finished with, so that they can be re-used.
+ *
+ *  When an Image is destroyed its plane buffers are given to the pool, and a new Image with
+ *  the same pixel format, size and alignment will take them instead of allocating its own.
+ *  This saves a lot of allocation and page-faulting of large buffers when we are making
+ *  a new image of each size for every frame.  The buffers that the pool holds are limited
+ *  to a maximum total size; when that is reached, buffers for the least-recently-used
+ *  kinds of image are freed.
+ *
+ *  All methods can be called from any thread.
+ */
+class ImagePool
+{
+public:
+	ImagePool (ImagePool const&) = delete;
+	ImagePool& operator= (ImagePool const&) = delete;
+
+	typedef std::array<uint8_t*, 4> Planes;
+
+	boost::optional<Planes> get (AVPixelFormat format, dcp::Size size, Image::Alignment alignment);
+	void put (AVPixelFormat format, dcp::Size size, Image::Alignment alignment, Planes planes, size_t bytes);
+
+	void set_maximum_resident (size_t bytes);
+
+	size_t maximum_resident () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _maximum_resident;
+	}
+
+	void clear ();
+
+	/** @return number of times that get() has returned some buffers */
+	int hits () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _hits;
+	}
+
+	/** @return number of times that get() had nothing to return */
+	int misses () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _misses;
+	}
+
+	/** @return total size of the buffers that we are holding, in bytes */
+	size_t resident () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _resident;
+	}
+
+	static ImagePool* instance ();
+
+private:
+	ImagePool () {}
+
+	struct Key
+	{
+		Key (AVPixelFormat format_, dcp::Size size_, Image::Alignment alignment_)
+			: format (format_)
+			, size (size_)
+			, alignment (alignment_)
+		{}
+
+		AVPixelFormat format;
+		dcp::Size size;
+		Image::Alignment alignment;
+
+		bool operator< (Key const& other) const;
+	};
+
+	struct Entry
+	{
+		/** buffers that are ready to be re-used */
+		std::vector<Planes> free;
+		/** size of each set of buffers, in bytes */
+		size_t bytes = 0;
+		/** value of _clock when this entry was last used */
+		uint64_t last_used = 0;
+	};
+
+	void evict_unlocked (std::vector<Planes>& to_free);
+
+	/** mutex to protect everything below */
+	mutable boost::mutex _mutex;
+	std::map<Key, Entry> _entries;
+	size_t _resident = 0;
+	size_t _maximum_resident = 256 * 1024 * 1024;
+	int _hits = 0;
+	int _misses = 0;
+	/** counter used to find the least-recently-used entry */
+	uint64_t _clock = 0;
+};
+
+
+#endif
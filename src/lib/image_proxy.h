@@ -37,6 +37,7 @@ extern "C" {
 #include <boost/utility.hpp>
 
 
+class Digester;
 class Image;
 class Socket;
 
@@ -101,10 +102,15 @@ public:
 		boost::optional<dcp::Size> size = boost::optional<dcp::Size> ()
 		) const = 0;
 
-	virtual void add_metadata (xmlpp::Node *) const = 0;
-	virtual void write_to_socket (std::shared_ptr<Socket>) const = 0;
+	/** @param compress true to losslessly compress raw image data where possible;
+	 *  this must be the same as is passed to write_to_socket().
+	 */
+	virtual void add_metadata (xmlpp::Node *, bool compress) const = 0;
+	virtual void write_to_socket (std::shared_ptr<Socket>, bool compress) const = 0;
 	/** @return true if our image is definitely the same as another, false if it is probably not */
 	virtual bool same (std::shared_ptr<const ImageProxy>) const = 0;
+	/** Add something to a digest which will be the same for any two proxies whose images are the same */
+	virtual void add_digest (Digester& digester) const = 0;
 	/** Do any useful work that would speed up a subsequent call to ::image().
 	 *  This method may be called in a different thread to image().
 	 *  @return log2 of any scaling down that will be applied to the image.
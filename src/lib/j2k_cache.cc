@@ -0,0 +1,187 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "dcpomatic_log.h"
+#include "j2k_cache.h"
+#include <algorithm>
+#include <ctime>
+#include <tuple>
+#include <vector>
+
+
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::tuple;
+using std::vector;
+
+
+/** Set up a cache, reading the details of anything that is already in the directory.
+ *  @param directory Directory to keep frames in; it will be created if it does not exist.
+ *  @param maximum_size Maximum total size of the frames, in bytes.
+ */
+J2KCache::J2KCache (boost::filesystem::path directory, uint64_t maximum_size)
+	: _directory (directory)
+	, _maximum_size (maximum_size)
+{
+	boost::filesystem::create_directories (_directory);
+
+	/* Modification time, digest, size */
+	vector<tuple<time_t, string, uint64_t>> found;
+
+	for (auto i: boost::filesystem::recursive_directory_iterator(_directory)) {
+		if (!boost::filesystem::is_regular_file(i.path())) {
+			continue;
+		}
+
+		boost::system::error_code ec;
+		if (i.path().extension() == ".tmp") {
+			/* Left over from a write that did not finish */
+			boost::filesystem::remove (i.path(), ec);
+			continue;
+		}
+
+		auto const size = boost::filesystem::file_size (i.path(), ec);
+		if (ec) {
+			continue;
+		}
+		auto const time = boost::filesystem::last_write_time (i.path(), ec);
+		if (ec) {
+			continue;
+		}
+		found.push_back (std::make_tuple(time, i.path().filename().string(), size));
+	}
+
+	std::sort (found.begin(), found.end());
+
+	boost::mutex::scoped_lock lm (_mutex);
+
+	for (auto const& i: found) {
+		_lru.push_back (std::get<1>(i));
+		_entries[std::get<1>(i)] = { std::get<2>(i), std::prev(_lru.end()) };
+		_size += std::get<2>(i);
+	}
+
+	evict ();
+}
+
+
+boost::filesystem::path
+J2KCache::path (string digest) const
+{
+	/* Split the files up into some sub-directories so that no one directory gets too big */
+	return _directory / digest.substr(0, 2) / digest;
+}
+
+
+/** @param digest Digest of the frame that is wanted.
+ *  @return The frame's J2K data, or nullptr if we do not have it.
+ */
+shared_ptr<dcp::ArrayData>
+J2KCache::get (string digest)
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		auto i = _entries.find (digest);
+		if (i == _entries.end()) {
+			return {};
+		}
+		/* Mark this as the most recently used */
+		_lru.splice (_lru.end(), _lru, i->second.position);
+	}
+
+	auto const p = path (digest);
+
+	try {
+		auto data = make_shared<dcp::ArrayData>(p);
+		boost::system::error_code ec;
+		boost::filesystem::last_write_time (p, time(nullptr), ec);
+		return data;
+	} catch (std::exception& e) {
+		/* Someone else has probably removed it */
+		LOG_WARNING ("Could not read %1 from J2K cache (%2)", p.string(), e.what());
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	auto i = _entries.find (digest);
+	if (i != _entries.end()) {
+		_size -= i->second.size;
+		_lru.erase (i->second.position);
+		_entries.erase (i);
+	}
+
+	return {};
+}
+
+
+/** Add a frame to the cache, removing older frames if the cache has become too big.
+ *  @param digest Digest of the frame (from DCPVideo::digest()).
+ *  @param data J2K data.
+ */
+void
+J2KCache::put (string digest, dcp::Data const& data)
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		if (_entries.find(digest) != _entries.end()) {
+			return;
+		}
+	}
+
+	auto const p = path (digest);
+	boost::filesystem::create_directories (p.parent_path());
+
+	/* Write to a temporary file and then rename it so that nobody can see a half-written frame */
+	auto tmp = p;
+	tmp += "." + boost::filesystem::unique_path().string() + ".tmp";
+	data.write (tmp);
+	boost::filesystem::rename (tmp, p);
+
+	boost::mutex::scoped_lock lm (_mutex);
+	if (_entries.find(digest) != _entries.end()) {
+		/* Someone else put the same frame in while we were writing it */
+		return;
+	}
+
+	_lru.push_back (digest);
+	_entries[digest] = { static_cast<uint64_t>(data.size()), std::prev(_lru.end()) };
+	_size += data.size();
+
+	evict ();
+}
+
+
+/** Remove least-recently-used frames until we are under our maximum size.
+ *  Caller must hold a lock on _mutex.
+ */
+void
+J2KCache::evict ()
+{
+	while (_size > _maximum_size && !_lru.empty()) {
+		auto const digest = _lru.front ();
+		auto i = _entries.find (digest);
+		boost::system::error_code ec;
+		boost::filesystem::remove (path(digest), ec);
+		_size -= i->second.size;
+		_entries.erase (i);
+		_lru.pop_front ();
+	}
+}
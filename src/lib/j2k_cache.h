@@ -0,0 +1,88 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCPOMATIC_J2K_CACHE_H
+#define DCPOMATIC_J2K_CACHE_H
+
+
+/** @file  src/lib/j2k_cache.h
+ *  @brief J2KCache class.
+ */
+
+
+#include <dcp/array_data.h>
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+
+/** @class J2KCache
+ *  @brief A directory of encoded JPEG2000 frames, each named after the digest of whatever
+ *  it was made from (see DCPVideo::digest()).
+ *
+ *  The cache is kept under a maximum size by deleting the least-recently-used frames.
+ *  Files are touched when they are used, so that the order survives between runs.
+ *  All methods may be called from any thread.
+ */
+class J2KCache
+{
+public:
+	J2KCache (boost::filesystem::path directory, uint64_t maximum_size);
+
+	J2KCache (J2KCache const&) = delete;
+	J2KCache& operator= (J2KCache const&) = delete;
+
+	std::shared_ptr<dcp::ArrayData> get (std::string digest);
+	void put (std::string digest, dcp::Data const& data);
+
+	/** @return total size of the frames in the cache, in bytes */
+	uint64_t size () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _size;
+	}
+
+private:
+	boost::filesystem::path path (std::string digest) const;
+	void evict ();
+
+	struct Entry
+	{
+		uint64_t size;
+		/** position in _lru */
+		std::list<std::string>::iterator position;
+	};
+
+	boost::filesystem::path _directory;
+	uint64_t _maximum_size;
+
+	/** mutex for _size, _lru and _entries */
+	mutable boost::mutex _mutex;
+	uint64_t _size = 0;
+	/** digests of the frames that we have, least recently used first */
+	std::list<std::string> _lru;
+	std::map<std::string, Entry> _entries;
+};
+
+
+#endif
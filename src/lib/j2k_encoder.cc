@@ -29,9 +29,11 @@
 #include "cross.h"
 #include "dcp_video.h"
 #include "dcpomatic_log.h"
+#include "encode_server_connection.h"
 #include "encode_server_description.h"
 #include "encode_server_finder.h"
 #include "film.h"
+#include "j2k_cache.h"
 #include "j2k_encoder.h"
 #include "log.h"
 #include "player.h"
@@ -39,6 +41,7 @@
 #include "util.h"
 #include "writer.h"
 #include <libcxml/cxml.h>
+#include <cmath>
 #include <iostream>
 
 #include "i18n.h"
@@ -47,22 +50,41 @@
 using std::cout;
 using std::exception;
 using std::list;
+using std::make_pair;
 using std::make_shared;
 using std::shared_ptr;
+using std::vector;
 using std::weak_ptr;
 using boost::optional;
 using dcp::Data;
 using namespace dcpomatic;
 
 
+/** Number of seconds that a remote encoder thread will keep an idle connection open
+ *  before closing it.  This must be less than the timeout on the server's socket (30s),
+ *  otherwise the server might close the connection first.
+ */
+static int constexpr remote_idle_timeout = 10;
+
+
 /** @param film Film that we are encoding.
  *  @param writer Writer that we are using.
  */
 J2KEncoder::J2KEncoder (shared_ptr<const Film> film, shared_ptr<Writer> writer)
 	: _film (film)
 	, _history (200)
+	, _small_frames_at_start (DCPVideo::small_frames())
 	, _writer (writer)
+	, _video_frames_enqueued (0)
 {
+	if (auto dir = Config::instance()->j2k_cache_directory()) {
+		try {
+			_cache = make_shared<J2KCache>(*dir, static_cast<uint64_t>(Config::instance()->j2k_cache_size()) * 1000000000);
+		} catch (std::exception& e) {
+			LOG_ERROR (N_("Could not open J2K cache in %1 (%2)"), dir->string(), e.what());
+		}
+	}
+
 	servers_list_changed ();
 }
 
@@ -101,30 +123,43 @@ J2KEncoder::call_servers_list_changed (weak_ptr<J2KEncoder> encoder)
 void
 J2KEncoder::end ()
 {
-	boost::mutex::scoped_lock lock (_queue_mutex);
-
 	LOG_GENERAL (N_("Clearing queue of %1"), _queue.size ());
 
-	/* Keep waking workers until the queue is empty */
-	while (!_queue.empty ()) {
-		rethrow ();
-		_empty_condition.notify_all ();
-		_full_condition.wait (lock);
+	{
+		boost::mutex::scoped_lock lm (_in_flight_mutex);
+		_ending = true;
 	}
 
-	lock.unlock ();
+	auto in_flight = [this]() {
+		boost::mutex::scoped_lock lm (_in_flight_mutex);
+		return _in_flight.size();
+	};
+
+	/* Wait for the workers to empty the queue and for the servers to send back everything
+	   that they have been given.  Idle workers may speculatively encode some of the frames
+	   that are still on servers while we wait.
+	*/
+	{
+		boost::mutex::scoped_lock lock (_full_mutex);
+		while (_queue.size() > 0 || in_flight() > 0) {
+			rethrow ();
+			_full_condition.wait (lock);
+		}
+	}
 
 	LOG_GENERAL_NC (N_("Terminating encoder threads"));
 
+	list<DCPVideo> left_over;
 	{
 		boost::mutex::scoped_lock lm (_threads_mutex);
 		terminate_threads ();
+		left_over = _queue.take_all ();
 	}
 
 	/* Something might have been thrown during terminate_threads */
 	rethrow ();
 
-	LOG_GENERAL (N_("Mopping up %1"), _queue.size());
+	LOG_GENERAL (N_("Mopping up %1"), left_over.size());
 
 	/* The following sequence of events can occur in the above code:
 	     1. a remote worker takes the last image off the queue
@@ -135,7 +170,7 @@ J2KEncoder::end ()
 	     So just mop up anything left in the queue here.
 	*/
 
-	for (auto const& i: _queue) {
+	for (auto const& i: left_over) {
 		LOG_GENERAL(N_("Encode left-over frame %1"), i.index());
 		try {
 			_writer->write (
@@ -148,6 +183,8 @@ J2KEncoder::end ()
 			LOG_ERROR (N_("Local encode failed (%1)"), e.what ());
 		}
 	}
+
+	LOG_GENERAL (N_("%1 frames were encoded locally with noise added to make them big enough"), DCPVideo::small_frames() - _small_frames_at_start);
 }
 
 
@@ -161,15 +198,14 @@ J2KEncoder::current_encoding_rate () const
 }
 
 
-/** @return Number of video frames that have been queued for encoding */
+/** @return Number of video frames that have been queued for encoding.  When reels are
+ *  being encoded in parallel this counts frames from all of them, so it says how much
+ *  of the whole job has been done rather than how far through the film we are.
+ */
 int
 J2KEncoder::video_frames_enqueued () const
 {
-	if (!_last_player_video_time) {
-		return 0;
-	}
-
-	return _last_player_video_time->frames_floor (_film->video_frame_rate ());
+	return _video_frames_enqueued;
 }
 
 
@@ -181,8 +217,186 @@ J2KEncoder::frame_done ()
 }
 
 
+/** Should be called when a frame has been taken off the queue, or when something
+ *  else happens that the thread in encode() or end() might need to know about.
+ */
+void
+J2KEncoder::frame_taken ()
+{
+	boost::mutex::scoped_lock lm (_full_mutex);
+	_full_condition.notify_all ();
+}
+
+
+/** Should be called by a remote worker when it is about to send a frame (which it took from the queue) */
+void
+J2KEncoder::add_in_flight (DCPVideo const& frame, int worker)
+{
+	struct timeval now;
+	gettimeofday (&now, 0);
+
+	boost::mutex::scoped_lock lm (_in_flight_mutex);
+	auto const key = make_pair (frame.index(), frame.eyes());
+	_in_flight.erase (key);
+	_in_flight.emplace (key, InFlight(frame, seconds(now), worker));
+}
+
+
+/** Should be called when a worker has received the encoded data for a frame that was in flight.
+ *  @return true if the data should be written, false if another worker got there first.
+ */
+bool
+J2KEncoder::finish_in_flight (DCPVideo const& frame)
+{
+	{
+		boost::mutex::scoped_lock lm (_in_flight_mutex);
+		auto i = _in_flight.find (make_pair(frame.index(), frame.eyes()));
+		if (i == _in_flight.end()) {
+			return false;
+		}
+		_in_flight.erase (i);
+	}
+
+	/* end() might be waiting for this */
+	frame_taken ();
+	return true;
+}
+
+
+/** Should be called when a remote worker has lost a frame that it sent (or was about to send)
+ *  because something went wrong.
+ *  @return true if the frame should be put back onto the queue.
+ */
+bool
+J2KEncoder::lose_in_flight (DCPVideo const& frame, int worker)
+{
+	boost::mutex::scoped_lock lm (_in_flight_mutex);
+	auto i = _in_flight.find (make_pair(frame.index(), frame.eyes()));
+	if (i == _in_flight.end()) {
+		/* It has already been written */
+		return false;
+	}
+
+	auto& f = i->second;
+	if (f.worker == worker) {
+		if (f.speculator) {
+			/* Someone else is already encoding it, so they can take responsibility for it */
+			f.worker = *f.speculator;
+			f.speculator = boost::none;
+			return false;
+		}
+		_in_flight.erase (i);
+		return true;
+	}
+
+	if (f.speculator && *f.speculator == worker) {
+		/* We lost our speculative copy; the original is still in flight */
+		f.speculator = boost::none;
+	}
+
+	return false;
+}
+
+
+/** Find a frame for an idle worker to encode speculatively at the end of the job.
+ *  @param worker Worker that is asking.
+ *  @param latency Time that the worker usually takes to encode a frame, in seconds, if known.
+ *  @return The frame which has been in flight the longest, if we have reached the end of the
+ *  job and it has been in flight for longer than the worker would take to encode it.
+ */
+optional<DCPVideo>
+J2KEncoder::speculate (int worker, optional<double> latency)
+{
+	if (!latency) {
+		return {};
+	}
+
+	struct timeval now;
+	gettimeofday (&now, 0);
+	auto const t = seconds (now);
+
+	boost::mutex::scoped_lock lm (_in_flight_mutex);
+	if (!_ending) {
+		return {};
+	}
+
+	InFlight* oldest = nullptr;
+	for (auto& i: _in_flight) {
+		auto& f = i.second;
+		if (f.worker == worker || f.speculator || (t - f.sent) < *latency) {
+			continue;
+		}
+		if (!oldest || f.sent < oldest->sent) {
+			oldest = &f;
+		}
+	}
+
+	if (!oldest) {
+		return {};
+	}
+
+	LOG_GENERAL (N_("Speculatively encoding frame %1 which has been in flight for %2s"), oldest->frame.index(), t - oldest->sent);
+	oldest->speculator = worker;
+	return oldest->frame;
+}
+
+
+/** @return J2K data for a frame from our cache, or nullptr if it is not there */
+shared_ptr<dcp::ArrayData>
+J2KEncoder::get_from_cache (DCPVideo const& frame)
+{
+	if (!_cache) {
+		return {};
+	}
+
+	auto data = _cache->get (frame.digest());
+	if (data) {
+		LOG_DEBUG_ENCODE (N_("Frame %1 found in J2K cache"), frame.index());
+	}
+	return data;
+}
+
+
+void
+J2KEncoder::add_to_cache (DCPVideo const& frame, dcp::Data const& data)
+{
+	if (!_cache) {
+		return;
+	}
+
+	try {
+		_cache->put (frame.digest(), data);
+	} catch (std::exception& e) {
+		/* It doesn't matter much if this fails */
+		LOG_WARNING (N_("Could not add frame %1 to J2K cache (%2)"), frame.index(), e.what());
+	}
+}
+
+
+/** @param slots Number of frames that can be encoded at once.
+ *  @return Number of frames that we should allow to wait in the queue.
+ */
+int
+J2KEncoder::queue_depth (int slots) const
+{
+	auto const rate = _history.rate ();
+	if (!rate) {
+		/* We don't know how fast we're going yet */
+		return slots * 2 + 1;
+	}
+
+	/* Enough frames to keep every slot busy, plus enough to keep the slots going
+	   through the longest recent gap between frames arriving from the player.
+	*/
+	int const cover = std::ceil (*rate * _producer_stall);
+	return std::min (slots + 1 + cover, slots * 4 + 1);
+}
+
+
 /** Called to request encoding of the next video frame in the DCP.  This is called in order,
- *  so each time the supplied frame is the one after the previous one.
+ *  so each time the supplied frame is the one after the previous one; or, if several
+ *  threads are each passing in a different part of the DCP, it is called in order by
+ *  each thread.
  *  pv represents one video frame, and could be empty if there is nothing to encode
  *  for this DCP frame.
  *
@@ -192,23 +406,36 @@ J2KEncoder::frame_done ()
 void
 J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 {
+	boost::mutex::scoped_lock encode_lock (_encode_mutex);
+
 	_waker.nudge ();
 
-	size_t threads = 0;
+	struct timeval now;
+	gettimeofday (&now, 0);
+	if (_last_encode_return) {
+		_producer_stall = std::max (seconds(now) - *_last_encode_return, _producer_stall * 0.95);
+	}
+
+	int threads = 0;
 	{
 		boost::mutex::scoped_lock lm (_threads_mutex);
-		threads = _threads->size();
+		threads = _slots;
 	}
 
-	boost::mutex::scoped_lock queue_lock (_queue_mutex);
+	auto const depth = queue_depth (threads);
 
-	/* Wait until the queue has gone down a bit.  Allow one thing in the queue even
-	   when there are no threads.
-	*/
-	while (_queue.size() >= (threads * 2) + 1) {
-		LOG_TIMING ("decoder-sleep queue=%1 threads=%2", _queue.size(), threads);
-		_full_condition.wait (queue_lock);
-		LOG_TIMING ("decoder-wake queue=%1 threads=%2", _queue.size(), threads);
+	{
+		boost::mutex::scoped_lock lm (_full_mutex);
+		/* Wait until the queue has gone down a bit.  Allow one thing in the queue even
+		   when there are no threads.
+		*/
+		while (_queue.size() >= depth) {
+			/* Give up if one of our threads has died */
+			rethrow ();
+			LOG_TIMING ("decoder-sleep queue=%1 threads=%2 depth=%3", _queue.size(), threads, depth);
+			_full_condition.wait (lm);
+			LOG_TIMING ("decoder-wake queue=%1 threads=%2 depth=%3", _queue.size(), threads, depth);
+		}
 	}
 
 	_writer->rethrow ();
@@ -220,6 +447,13 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 
 	auto const position = time.frames_floor(_film->video_frame_rate());
 
+	shared_ptr<PlayerVideo> previous;
+	auto last = _last_player_video.find (make_pair(position - 1, pv->eyes()));
+	if (last != _last_player_video.end()) {
+		previous = last->second;
+		_last_player_video.erase (last);
+	}
+
 	if (_writer->can_fake_write (position)) {
 		/* We can fake-write this frame */
 		LOG_DEBUG_ENCODE("Frame @ %1 FAKE", to_string(time));
@@ -230,29 +464,31 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 		/* This frame already has J2K data, so just write it */
 		_writer->write (pv->j2k(), position, pv->eyes ());
 		frame_done ();
-	} else if (_last_player_video[static_cast<int>(pv->eyes())] && _writer->can_repeat(position) && pv->same (_last_player_video[static_cast<int>(pv->eyes())])) {
+	} else if (previous && _writer->can_repeat(position) && pv->same(previous)) {
 		LOG_DEBUG_ENCODE("Frame @ %1 REPEAT", to_string(time));
 		_writer->repeat (position, pv->eyes ());
 	} else {
 		LOG_DEBUG_ENCODE("Frame @ %1 ENCODE", to_string(time));
 		/* Queue this new frame for encoding */
 		LOG_TIMING ("add-frame-to-queue queue=%1", _queue.size ());
-		_queue.push_back (DCPVideo(
+		/* This will wake up a waiting thread, if there is one */
+		boost::mutex::scoped_lock lm (_threads_mutex);
+		_queue.push (DCPVideo(
 				pv,
 				position,
 				_film->video_frame_rate(),
 				_film->j2k_bandwidth(),
 				_film->resolution()
 				));
+	}
 
-		/* The queue might not be empty any more, so notify anything which is
-		   waiting on that.
-		*/
-		_empty_condition.notify_all ();
+	_last_player_video[make_pair(position, pv->eyes())] = pv;
+	if (pv->eyes() != Eyes::RIGHT) {
+		++_video_frames_enqueued;
 	}
 
-	_last_player_video[static_cast<int>(pv->eyes())] = pv;
-	_last_player_video_time = time;
+	gettimeofday (&now, 0);
+	_last_encode_return = seconds (now);
 }
 
 
@@ -280,112 +516,229 @@ J2KEncoder::terminate_threads ()
 
 
 void
-J2KEncoder::encoder_thread (optional<EncodeServerDescription> server)
+J2KEncoder::local_encoder_thread (int worker)
 try
 {
 	start_of_thread ("J2KEncoder");
 
-	if (server) {
-		LOG_TIMING ("start-encoder-thread thread=%1 server=%2", thread_id (), server->host_name ());
-	} else {
-		LOG_TIMING ("start-encoder-thread thread=%1 server=localhost", thread_id ());
-	}
-
-	/* Number of seconds that we currently wait between attempts
-	   to connect to the server; not relevant for localhost
-	   encodings.
-	*/
-	int remote_backoff = 0;
+	LOG_TIMING ("start-encoder-thread thread=%1 server=localhost", thread_id ());
 
 	while (true) {
 
 		LOG_TIMING ("encoder-sleep thread=%1", thread_id ());
-		boost::mutex::scoped_lock lock (_queue_mutex);
-		while (_queue.empty ()) {
-			_empty_condition.wait (lock);
-		}
-
+		auto vf = _queue.pop (worker, boost::posix_time::seconds(1));
 		LOG_TIMING ("encoder-wake thread=%1 queue=%2", thread_id(), _queue.size());
-		auto vf = _queue.front ();
 
-		/* We're about to commit to either encoding this frame or putting it back onto the queue,
-		   so we must not be interrupted until one or other of these things have happened.  This
-		   block has thread interruption disabled.
+		bool speculative = false;
+		if (!vf) {
+			vf = speculate (worker, _local_statistics.latency());
+			if (!vf) {
+				continue;
+			}
+			speculative = true;
+		}
+
+		/* We have taken this frame off the queue, so we must not be interrupted until it
+		   has been encoded.  This block has thread interruption disabled.
 		*/
 		{
 			boost::this_thread::disable_interruption dis;
 
-			LOG_TIMING ("encoder-pop thread=%1 frame=%2 eyes=%3", thread_id(), vf.index(), static_cast<int>(vf.eyes()));
-			_queue.pop_front ();
+			LOG_TIMING ("encoder-pop thread=%1 frame=%2 eyes=%3", thread_id(), vf->index(), static_cast<int>(vf->eyes()));
 
-			lock.unlock ();
+			/* The queue might not be full any more, so notify anything that is waiting on that */
+			frame_taken ();
 
-			shared_ptr<Data> encoded;
+			shared_ptr<Data> encoded = get_from_cache (*vf);
 
-			/* We need to encode this input */
-			if (server) {
+			if (!encoded) {
 				try {
-					encoded = make_shared<dcp::ArrayData>(vf.encode_remotely(server.get()));
+					struct timeval start;
+					gettimeofday (&start, 0);
+					LOG_TIMING ("start-local-encode thread=%1 frame=%2", thread_id(), vf->index());
+					encoded = make_shared<dcp::ArrayData>(vf->encode_locally());
+					LOG_TIMING ("finish-local-encode thread=%1 frame=%2", thread_id(), vf->index());
+					struct timeval finish;
+					gettimeofday (&finish, 0);
+					_local_statistics.frame_done (seconds(finish) - seconds(start));
+					add_to_cache (*vf, *encoded);
+				} catch (std::exception& e) {
+					/* This is very bad, so don't cope with it, just pass it on */
+					LOG_ERROR (N_("Local encode failed (%1)"), e.what ());
+					throw;
+				}
+			}
 
-					if (remote_backoff > 0) {
-						LOG_GENERAL ("%1 was lost, but now she is found; removing backoff", server->host_name ());
-					}
+			if (!speculative || finish_in_flight(*vf)) {
+				_writer->write (encoded, vf->index(), vf->eyes());
+				frame_done ();
+			}
+		}
+	}
+}
+catch (boost::thread_interrupted& e) {
+	/* Ignore these and just stop the thread */
+	frame_taken ();
+}
+catch (...)
+{
+	store_current ();
+	/* Wake anything waiting on _full_condition so it can see the exception */
+	frame_taken ();
+}
 
-					/* This job succeeded, so remove any backoff */
-					remote_backoff = 0;
 
-				} catch (std::exception& e) {
-					if (remote_backoff < 60) {
-						/* back off more */
-						remote_backoff += 10;
+/** Thread to send frames to a remote server.  We keep a connection open to the server
+ *  until it has been idle for remote_idle_timeout seconds, and try to keep enough frames in
+ *  flight on it that the server is encoding some frames while we send and receive others.
+ *  How many that is depends on how quickly the server has been returning frames.  The
+ *  connection is closed when the thread is terminated by end().
+ */
+void
+J2KEncoder::remote_encoder_thread (int worker, EncodeServerDescription server)
+try
+{
+	start_of_thread ("J2KEncoder");
+
+	LOG_TIMING ("start-encoder-thread thread=%1 server=%2", thread_id (), server.host_name ());
+
+	/* Number of seconds that we currently wait between attempts
+	   to connect to the server.
+	*/
+	int remote_backoff = 0;
+
+	shared_ptr<EncodeServerConnection> connection;
+	EncodeStatistics statistics;
+	/* Number of seconds that we have been waiting for something to do */
+	int idle = 0;
+
+	while (true) {
+
+		optional<DCPVideo> vf;
+		bool speculative = false;
+		if (!connection || connection->in_flight() == 0) {
+			/* Nothing is in flight so we can wait (and be interrupted) here */
+			LOG_TIMING ("encoder-sleep thread=%1", thread_id ());
+			vf = _queue.pop (worker, boost::posix_time::seconds(1));
+			LOG_TIMING ("encoder-wake thread=%1 queue=%2", thread_id(), _queue.size());
+			if (!vf) {
+				vf = speculate (worker, statistics.latency());
+				if (!vf) {
+					/* Keep the connection while the player is just slower than the server,
+					   but close it before the server gives up on it.
+					*/
+					if (connection && ++idle >= remote_idle_timeout) {
+						LOG_DEBUG_ENCODE (N_("Closing idle connection to %1"), server.host_name());
+						connection.reset ();
 					}
-					LOG_ERROR (
-						N_("Remote encode of %1 on %2 failed (%3); thread sleeping for %4s"),
-						vf.index(), server->host_name(), e.what(), remote_backoff
-						);
+					continue;
 				}
+				speculative = true;
+			}
+			idle = 0;
+		} else if (connection->in_flight() < statistics.window(connection->maximum_window())) {
+			vf = _queue.try_pop (worker);
+		}
 
-			} else {
-				try {
-					LOG_TIMING ("start-local-encode thread=%1 frame=%2", thread_id(), vf.index());
-					encoded = make_shared<dcp::ArrayData>(vf.encode_locally());
-					LOG_TIMING ("finish-local-encode thread=%1 frame=%2", thread_id(), vf.index());
-				} catch (std::exception& e) {
-					/* This is very bad, so don't cope with it, just pass it on */
-					LOG_ERROR (N_("Local encode failed (%1)"), e.what ());
-					throw;
+		/* From here we are responsible for vf and any frames that are in flight on our connection,
+		   so we must not be interrupted until they are either written or put back onto the queue.
+		*/
+		{
+			boost::this_thread::disable_interruption dis;
+
+			if (vf) {
+				LOG_TIMING ("encoder-pop thread=%1 frame=%2 eyes=%3", thread_id(), vf->index(), static_cast<int>(vf->eyes()));
+				frame_taken ();
+				if (!speculative) {
+					if (auto cached = get_from_cache(*vf)) {
+						_writer->write (cached, vf->index(), vf->eyes());
+						frame_done ();
+						continue;
+					}
+					add_in_flight (*vf, worker);
 				}
 			}
 
-			if (encoded) {
-				_writer->write (encoded, vf.index(), vf.eyes());
-				frame_done ();
-			} else {
-				lock.lock ();
-				LOG_GENERAL (N_("[%1] J2KEncoder thread pushes frame %2 back onto queue after failure"), thread_id(), vf.index());
-				_queue.push_front (vf);
-				lock.unlock ();
+			bool sent = false;
+			try {
+				if (!connection) {
+					connection = make_shared<EncodeServerConnection>(server);
+				}
+
+				if (vf) {
+					connection->send (*vf);
+					sent = true;
+				}
+
+				if (!vf || connection->in_flight() >= statistics.window(connection->maximum_window())) {
+					auto encoded = connection->collect ();
+					/* Use the server's own idea of how long the encode took, as the time
+					   between sending and collecting includes time spent waiting behind the
+					   other frames in our window, which would make the window grow further.
+					*/
+					if (auto encode_time = connection->last_encode_time()) {
+						statistics.frame_done (*encode_time);
+					}
+					if (finish_in_flight(encoded.first)) {
+						_writer->write (make_shared<dcp::ArrayData>(encoded.second), encoded.first.index(), encoded.first.eyes());
+						frame_done ();
+						add_to_cache (encoded.first, encoded.second);
+					} else {
+						LOG_DEBUG_ENCODE (N_("Discarding frame %1 from %2 as another worker finished it first"), encoded.first.index(), server.host_name());
+					}
+				}
+
+				if (remote_backoff > 0) {
+					LOG_GENERAL ("%1 was lost, but now she is found; removing backoff", server.host_name ());
+				}
+
+				/* This job succeeded, so remove any backoff */
+				remote_backoff = 0;
+
+			} catch (std::exception& e) {
+				if (remote_backoff < 60) {
+					/* back off more */
+					remote_backoff += 10;
+				}
+				LOG_ERROR (
+					N_("Remote encode on %1 failed (%2); thread sleeping for %3s"),
+					server.host_name(), e.what(), remote_backoff
+					);
+
+				vector<DCPVideo> lost;
+				if (connection) {
+					lost = connection->in_flight_frames ();
+				}
+				if (vf && !sent) {
+					lost.push_back (*vf);
+				}
+				connection.reset ();
+
+				/* Give the frames to other workers if we can, since we are about to go to sleep */
+				for (auto i = lost.rbegin(); i != lost.rend(); ++i) {
+					if (lose_in_flight(*i, worker)) {
+						LOG_GENERAL (N_("[%1] J2KEncoder thread pushes frame %2 back onto queue after failure"), thread_id(), i->index());
+						_queue.push_front (*i, worker);
+					}
+				}
+				frame_taken ();
 			}
 		}
 
 		if (remote_backoff > 0) {
 			boost::this_thread::sleep (boost::posix_time::seconds (remote_backoff));
 		}
-
-		/* The queue might not be full any more, so notify anything that is waiting on that */
-		lock.lock ();
-		_full_condition.notify_all ();
 	}
 }
 catch (boost::thread_interrupted& e) {
 	/* Ignore these and just stop the thread */
-	_full_condition.notify_all ();
+	frame_taken ();
 }
 catch (...)
 {
 	store_current ();
 	/* Wake anything waiting on _full_condition so it can see the exception */
-	_full_condition.notify_all ();
+	frame_taken ();
 }
 
 
@@ -396,30 +749,41 @@ J2KEncoder::servers_list_changed ()
 
 	terminate_threads ();
 	_threads = make_shared<boost::thread_group>();
+	_slots = 0;
 
 	/* XXX: could re-use threads */
 
-	if (!Config::instance()->only_servers_encode ()) {
-		for (int i = 0; i < Config::instance()->master_encoding_threads (); ++i) {
+	int const local = Config::instance()->only_servers_encode() ? 0 : Config::instance()->master_encoding_threads();
+
+	vector<EncodeServerDescription> servers;
+	for (auto i: EncodeServerFinder::instance()->servers()) {
+		if (i.current_link_version()) {
+			servers.push_back (i);
+		}
+	}
+
+	/* Each thread gets its own part of the queue; anything already queued is shared out between them */
+	_queue.set_workers (local + static_cast<int>(servers.size()));
+
+	int worker = 0;
+
+	for (int i = 0; i < local; ++i) {
 #ifdef DCPOMATIC_LINUX
-			auto t = _threads->create_thread(boost::bind(&J2KEncoder::encoder_thread, this, optional<EncodeServerDescription>()));
-			pthread_setname_np (t->native_handle(), "encode-worker");
+		auto t = _threads->create_thread(boost::bind(&J2KEncoder::local_encoder_thread, this, worker));
+		pthread_setname_np (t->native_handle(), "encode-worker");
 #else
-			_threads->create_thread(boost::bind(&J2KEncoder::encoder_thread, this, optional<EncodeServerDescription>()));
+		_threads->create_thread(boost::bind(&J2KEncoder::local_encoder_thread, this, worker));
 #endif
-		}
+		++worker;
+		++_slots;
 	}
 
-	for (auto i: EncodeServerFinder::instance()->servers()) {
-		if (!i.current_link_version()) {
-			continue;
-		}
-
-		LOG_GENERAL (N_("Adding %1 worker threads for remote %2"), i.threads(), i.host_name ());
-		for (int j = 0; j < i.threads(); ++j) {
-			_threads->create_thread(boost::bind(&J2KEncoder::encoder_thread, this, i));
-		}
+	for (auto i: servers) {
+		LOG_GENERAL (N_("Adding worker thread for remote %1 with %2 threads"), i.host_name(), i.threads());
+		_threads->create_thread(boost::bind(&J2KEncoder::remote_encoder_thread, this, worker, i));
+		++worker;
+		_slots += i.threads();
 	}
 
-	_writer->set_encoder_threads (_threads->size());
+	_writer->set_encoder_threads (_slots);
 }
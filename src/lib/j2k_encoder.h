@@ -31,19 +31,23 @@
 #include "util.h"
 #include "cross.h"
 #include "event_history.h"
+#include "dcp_video.h"
+#include "encode_statistics.h"
 #include "exception_store.h"
+#include "work_stealing_queue.h"
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
 #include <boost/thread.hpp>
 #include <boost/optional.hpp>
 #include <boost/signals2.hpp>
-#include <list>
 #include <stdint.h>
+#include <atomic>
+#include <map>
 
 
 class Film;
 class EncodeServerDescription;
-class DCPVideo;
+class J2KCache;
 class Writer;
 class Job;
 class PlayerVideo;
@@ -53,7 +57,12 @@ class PlayerVideo;
  *  @brief Class to manage encoding to J2K.
  *
  *  This class keeps a queue of frames to be encoded and distributes
- *  the work around threads and encoding servers.
+ *  the work around threads and encoding servers.  Each server is given
+ *  as many frames at a time as its measured speed suggests that it can
+ *  handle, and once the queue has run dry at the end of the encode any
+ *  worker which becomes idle can speculatively re-encode a frame that
+ *  is taking a long time on some server; whichever copy finishes first
+ *  is written.
  */
 class J2KEncoder : public ExceptionStore, public std::enable_shared_from_this<J2KEncoder>
 {
@@ -67,7 +76,9 @@ public:
 	/** Called to indicate that a processing run is about to begin */
 	void begin ();
 
-	/** Called to pass a bit of video to be encoded as the next DCP frame */
+	/** Called to pass a bit of video to be encoded as the next DCP frame, or as the next
+	 *  frame of one of several runs of frames being passed in from different threads.
+	 */
 	void encode (std::shared_ptr<PlayerVideo> pv, dcpomatic::DCPTime time);
 
 	/** Called when a processing run has finished */
@@ -83,8 +94,19 @@ private:
 	static void call_servers_list_changed (std::weak_ptr<J2KEncoder> encoder);
 
 	void frame_done ();
+	void frame_taken ();
+	int queue_depth (int slots) const;
 
-	void encoder_thread (boost::optional<EncodeServerDescription>);
+	void add_in_flight (DCPVideo const& frame, int worker);
+	bool finish_in_flight (DCPVideo const& frame);
+	bool lose_in_flight (DCPVideo const& frame, int worker);
+	boost::optional<DCPVideo> speculate (int worker, boost::optional<double> latency);
+
+	std::shared_ptr<dcp::ArrayData> get_from_cache (DCPVideo const& frame);
+	void add_to_cache (DCPVideo const& frame, dcp::Data const& data);
+
+	void local_encoder_thread (int worker);
+	void remote_encoder_thread (int worker, EncodeServerDescription server);
 	void terminate_threads ();
 
 	/** Film that we are encoding */
@@ -94,19 +116,69 @@ private:
 
 	boost::mutex _threads_mutex;
 	std::shared_ptr<boost::thread_group> _threads;
-
-	mutable boost::mutex _queue_mutex;
-	std::list<DCPVideo> _queue;
-	/** condition to manage thread wakeups when we have nothing to do */
-	boost::condition _empty_condition;
-	/** condition to manage thread wakeups when we have too much to do */
+	/** Number of frames that can be encoded at once by our local threads and remote servers */
+	int _slots = 0;
+
+	WorkStealingQueue<DCPVideo> _queue;
+	/** mutex for _full_condition */
+	boost::mutex _full_mutex;
+	/** condition to wake the thread calling encode() or end() when frames have been
+	 *  taken from the queue, or when an encoder thread has thrown an exception.
+	 */
 	boost::condition _full_condition;
 
+	/** Time that the last call to encode() returned (from gettimeofday) */
+	boost::optional<double> _last_encode_return;
+	/** Recent longest time between encode() returning and being called again,
+	 *  decaying slowly; used to decide how deep the queue should be.
+	 */
+	double _producer_stall = 0;
+
+	struct InFlight
+	{
+		InFlight (DCPVideo frame_, double sent_, int worker_)
+			: frame (frame_)
+			, sent (sent_)
+			, worker (worker_)
+		{}
+
+		DCPVideo frame;
+		/** time that the frame was sent (from gettimeofday) */
+		double sent;
+		/** worker which is responsible for the frame */
+		int worker;
+		/** worker which is speculatively encoding another copy of the frame, if any */
+		boost::optional<int> speculator;
+	};
+
+	/** mutex for _in_flight and _ending */
+	mutable boost::mutex _in_flight_mutex;
+	/** Frames which have been sent to remote servers and not yet written, indexed by
+	 *  index and eyes.
+	 */
+	std::map<std::pair<int, Eyes>, InFlight> _in_flight;
+	/** true if end() has been called, so idle workers may speculate */
+	bool _ending = false;
+	/** Measurements of our local encoding threads */
+	EncodeStatistics _local_statistics;
+	/** Value of DCPVideo::small_frames() when we were created */
+	int _small_frames_at_start;
+
+	/** Cache of previously-encoded frames, or nullptr */
+	std::shared_ptr<J2KCache> _cache;
+
 	std::shared_ptr<Writer> _writer;
 	Waker _waker;
 
-	std::shared_ptr<PlayerVideo> _last_player_video[static_cast<int>(Eyes::COUNT)];
-	boost::optional<dcpomatic::DCPTime> _last_player_video_time;
+	/** mutex to serialise calls to encode() */
+	boost::mutex _encode_mutex;
+	/** The PlayerVideo most recently given to encode(), indexed by its frame index and eyes,
+	 *  so that we can spot when the next frame is a repeat.  If encode() is being called
+	 *  from several threads there is one of these for the latest frame from each thread.
+	 */
+	std::map<std::pair<Frame, Eyes>, std::shared_ptr<PlayerVideo>> _last_player_video;
+	/** number of video frames that have been given to encode() */
+	std::atomic<int> _video_frames_enqueued;
 
 	boost::signals2::scoped_connection _server_found_connection;
 };
@@ -21,6 +21,7 @@
 
 #include "dcpomatic_assert.h"
 #include "dcpomatic_socket.h"
+#include "digester.h"
 #include "image.h"
 #include "j2k_image_proxy.h"
 #include <dcp/colour_conversion.h>
@@ -36,6 +37,9 @@ LIBDCP_DISABLE_WARNINGS
 #include <libxml++/libxml++.h>
 LIBDCP_ENABLE_WARNINGS
 #include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "i18n.h"
 
@@ -44,6 +48,7 @@ using std::cout;
 using std::dynamic_pointer_cast;
 using std::make_shared;
 using std::max;
+using std::min;
 using std::shared_ptr;
 using std::string;
 using boost::optional;
@@ -51,6 +56,74 @@ using dcp::ArrayData;
 using dcp::raw_convert;
 
 
+/** Largest reduction that we will ask for; 2K DCP pictures have 5 wavelet decomposition
+ *  levels and OpenJPEG will not reduce by more than that.
+ */
+static int constexpr maximum_reduction = 5;
+
+
+void
+dcpomatic::pack_row (int const* in_0, int const* in_1, int const* in_2, uint16_t* out, int width, int shift)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	/* Shifting each 32-bit sample 16 further than we need to and then arithmetic-shifting
+	   it back down leaves the bottom 16 bits of the shifted sample, sign-extended, which
+	   _mm_packs_epi32 can then pack without saturating.
+	*/
+	auto const up = _mm_cvtsi32_si128 (shift + 16);
+	auto const zero = _mm_setzero_si128 ();
+
+	auto load = [&x, up](int const* in) {
+		auto a = _mm_loadu_si128 (reinterpret_cast<__m128i const *>(in + x));
+		auto b = _mm_loadu_si128 (reinterpret_cast<__m128i const *>(in + x + 4));
+		a = _mm_srai_epi32 (_mm_sll_epi32(a, up), 16);
+		b = _mm_srai_epi32 (_mm_sll_epi32(b, up), 16);
+		return _mm_packs_epi32 (a, b);
+	};
+
+	/* Masks for the first three 16-bit samples, and for the next three */
+	auto const first = _mm_set_epi16 (0, 0, 0, 0, 0, -1, -1, -1);
+	auto const second = _mm_set_epi16 (0, 0, -1, -1, -1, 0, 0, 0);
+
+	/* Take two pixels, each as three samples and a zero, and return them as six samples */
+	auto squash = [first, second](__m128i p) {
+		return _mm_or_si128 (_mm_and_si128(p, first), _mm_and_si128(_mm_srli_si128(p, 2), second));
+	};
+
+	for (; (x + 8) <= width; x += 8) {
+		auto const c0 = load (in_0);
+		auto const c1 = load (in_1);
+		auto const c2 = load (in_2);
+
+		auto const c01_lo = _mm_unpacklo_epi16 (c0, c1);
+		auto const c01_hi = _mm_unpackhi_epi16 (c0, c1);
+		auto const c2_lo = _mm_unpacklo_epi16 (c2, zero);
+		auto const c2_hi = _mm_unpackhi_epi16 (c2, zero);
+
+		/* Pixels 0 and 1, 2 and 3, and so on */
+		auto const p01 = squash (_mm_unpacklo_epi32(c01_lo, c2_lo));
+		auto const p23 = squash (_mm_unpackhi_epi32(c01_lo, c2_lo));
+		auto const p45 = squash (_mm_unpacklo_epi32(c01_hi, c2_hi));
+		auto const p67 = squash (_mm_unpackhi_epi32(c01_hi, c2_hi));
+
+		auto o = reinterpret_cast<__m128i*>(out + x * 3);
+		_mm_storeu_si128 (o, _mm_or_si128(p01, _mm_slli_si128(p23, 12)));
+		_mm_storeu_si128 (o + 1, _mm_or_si128(_mm_srli_si128(p23, 4), _mm_slli_si128(p45, 8)));
+		_mm_storeu_si128 (o + 2, _mm_or_si128(_mm_srli_si128(p45, 8), _mm_slli_si128(p67, 4)));
+	}
+#endif
+
+	auto q = out + x * 3;
+	for (; x < width; ++x) {
+		*q++ = in_0[x] << shift;
+		*q++ = in_1[x] << shift;
+		*q++ = in_2[x] << shift;
+	}
+}
+
+
 /** Construct a J2KImageProxy from a JPEG2000 file */
 J2KImageProxy::J2KImageProxy (boost::filesystem::path path, dcp::Size size, AVPixelFormat pixel_format)
 	: _data (new dcp::ArrayData(path))
@@ -67,12 +140,14 @@ J2KImageProxy::J2KImageProxy (
 	shared_ptr<const dcp::MonoPictureFrame> frame,
 	dcp::Size size,
 	AVPixelFormat pixel_format,
-	optional<int> forced_reduction
+	optional<int> forced_reduction,
+	int extra_reduction
 	)
 	: _data (frame)
 	, _size (size)
 	, _pixel_format (pixel_format)
 	, _forced_reduction (forced_reduction)
+	, _extra_reduction (extra_reduction)
 	, _error (false)
 {
 	/* ::image assumes 16bpp */
@@ -85,13 +160,15 @@ J2KImageProxy::J2KImageProxy (
 	dcp::Size size,
 	dcp::Eye eye,
 	AVPixelFormat pixel_format,
-	optional<int> forced_reduction
+	optional<int> forced_reduction,
+	int extra_reduction
 	)
 	: _data (eye == dcp::Eye::LEFT ? frame->left() : frame->right())
 	, _size (size)
 	, _eye (eye)
 	, _pixel_format (pixel_format)
 	, _forced_reduction (forced_reduction)
+	, _extra_reduction (extra_reduction)
 	, _error (false)
 {
 	/* ::image assumes 16bpp */
@@ -138,6 +215,12 @@ J2KImageProxy::prepare (Image::Alignment alignment, optional<dcp::Size> target_s
 
 		--reduce;
 		reduce = max (0, reduce);
+		/* Extra reduction is a way to keep up with playback; without a target size
+		   someone wants the picture at full resolution.
+		*/
+		if (target_size) {
+			reduce = min (reduce + _extra_reduction, maximum_reduction);
+		}
 	}
 
 	try {
@@ -153,18 +236,15 @@ J2KImageProxy::prepare (Image::Alignment alignment, optional<dcp::Size> target_s
 
 		int const width = decompressed->size().width;
 
-		int p = 0;
-		int* decomp_0 = decompressed->data (0);
-		int* decomp_1 = decompressed->data (1);
-		int* decomp_2 = decompressed->data (2);
 		for (int y = 0; y < decompressed->size().height; ++y) {
-			auto q = reinterpret_cast<uint16_t *>(_image->data()[0] + y * _image->stride()[0]);
-			for (int x = 0; x < width; ++x) {
-				*q++ = decomp_0[p] << shift;
-				*q++ = decomp_1[p] << shift;
-				*q++ = decomp_2[p] << shift;
-				++p;
-			}
+			dcpomatic::pack_row (
+				decompressed->data(0) + y * width,
+				decompressed->data(1) + y * width,
+				decompressed->data(2) + y * width,
+				reinterpret_cast<uint16_t *>(_image->data()[0] + y * _image->stride()[0]),
+				width,
+				shift
+				);
 		}
 	} catch (dcp::J2KDecompressionError& e) {
 		_image = make_shared<Image>(_pixel_format, _size, alignment);
@@ -192,7 +272,7 @@ J2KImageProxy::image (Image::Alignment alignment, optional<dcp::Size> target_siz
 
 
 void
-J2KImageProxy::add_metadata (xmlpp::Node* node) const
+J2KImageProxy::add_metadata (xmlpp::Node* node, bool) const
 {
 	node->add_child("Type")->add_child_text(N_("J2K"));
 	node->add_child("Width")->add_child_text(raw_convert<string>(_size.width));
@@ -205,7 +285,7 @@ J2KImageProxy::add_metadata (xmlpp::Node* node) const
 
 
 void
-J2KImageProxy::write_to_socket (shared_ptr<Socket> socket) const
+J2KImageProxy::write_to_socket (shared_ptr<Socket> socket, bool) const
 {
 	socket->write (_data->data(), _data->size());
 }
@@ -223,6 +303,16 @@ J2KImageProxy::same (shared_ptr<const ImageProxy> other) const
 }
 
 
+void
+J2KImageProxy::add_digest (Digester& digester) const
+{
+	digester.add (string("j2k"));
+	digester.add (_data->data(), _data->size());
+	digester.add (static_cast<int>(_pixel_format));
+	digester.add (_eye ? static_cast<int>(*_eye) : -1);
+}
+
+
 J2KImageProxy::J2KImageProxy (ArrayData data, dcp::Size size, AVPixelFormat pixel_format)
 	: _data (new ArrayData(data))
 	, _size (size)
@@ -40,7 +40,8 @@ public:
 		std::shared_ptr<const dcp::MonoPictureFrame> frame,
 		dcp::Size,
 		AVPixelFormat pixel_format,
-		boost::optional<int> forced_reduction
+		boost::optional<int> forced_reduction,
+		int extra_reduction = 0
 		);
 
 	J2KImageProxy (
@@ -48,7 +49,8 @@ public:
 		dcp::Size,
 		dcp::Eye,
 		AVPixelFormat pixel_format,
-		boost::optional<int> forced_reduction
+		boost::optional<int> forced_reduction,
+		int extra_reduction = 0
 		);
 
 	J2KImageProxy (std::shared_ptr<cxml::Node> xml, std::shared_ptr<Socket> socket);
@@ -61,10 +63,11 @@ public:
 		boost::optional<dcp::Size> size = boost::optional<dcp::Size> ()
 		) const override;
 
-	void add_metadata (xmlpp::Node *) const override;
-	void write_to_socket (std::shared_ptr<Socket> override) const override;
+	void add_metadata (xmlpp::Node *, bool) const override;
+	void write_to_socket (std::shared_ptr<Socket> override, bool) const override;
 	/** @return true if our image is definitely the same as another, false if it is probably not */
 	bool same (std::shared_ptr<const ImageProxy>) const override;
+	void add_digest (Digester& digester) const override;
 	int prepare (Image::Alignment alignment, boost::optional<dcp::Size> = boost::optional<dcp::Size>()) const override;
 
 	std::shared_ptr<const dcp::Data> j2k () const {
@@ -91,6 +94,22 @@ private:
 	AVPixelFormat _pixel_format;
 	mutable boost::mutex _mutex;
 	boost::optional<int> _forced_reduction;
+	/** reduction to apply on top of the one chosen to suit the target size, if
+	 *  _forced_reduction is not set and there is a target size; used to decode more cheaply when we are struggling
+	 *  to keep up.
+	 */
+	int _extra_reduction = 0;
 	/** true if an error occurred while decoding the JPEG2000 data, false if not */
 	mutable bool _error;
 };
+
+
+namespace dcpomatic {
+
+/** Interleave one row of three planes of decoded samples into 16-bit samples,
+ *  shifting each one left as we go.  This uses SSE2 where it is available, with
+ *  the same results as without.
+ */
+extern void pack_row (int const* in_0, int const* in_1, int const* in_2, uint16_t* out, int width, int shift);
+
+}
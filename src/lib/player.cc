@@ -88,6 +88,10 @@ using namespace boost::placeholders;
 using namespace dcpomatic;
 
 
+/** Length of silence in seconds to emit from each pass() when we are not emitting any video */
+static double constexpr audio_only_silence_length = 1;
+
+
 int const PlayerProperty::VIDEO_CONTAINER_SIZE = 700;
 int const PlayerProperty::PLAYLIST = 701;
 int const PlayerProperty::FILM_CONTAINER = 702;
@@ -212,6 +216,7 @@ Player::setup_pieces_unlocked ()
 			dcp->set_decode_referenced (_play_referenced);
 			if (_play_referenced) {
 				dcp->set_forced_reduction (_dcp_decode_reduction);
+				dcp->set_extra_reduction (_dcp_decode_extra_reduction);
 			}
 		}
 
@@ -736,8 +741,10 @@ Player::pass ()
 			DCPOMATIC_ASSERT (error < too_much_error);
 			period.from = *_next_audio_time;
 		}
-		if (period.duration() > one_video_frame()) {
-			period.to = period.from + one_video_frame();
+		/* If there's no video to keep in step with we can do much more silence at once */
+		auto const maximum = _ignore_video ? DCPTime::from_seconds(audio_only_silence_length) : one_video_frame();
+		if (period.duration() > maximum) {
+			period.to = period.from + maximum;
 		}
 		fill_audio (period);
 		_silent.set_position (period.to);
@@ -1416,6 +1423,37 @@ Player::set_dcp_decode_reduction (optional<int> reduction)
 }
 
 
+/** Set a reduction to apply to DCP pictures on top of the one that would be chosen
+ *  to suit the size that we are making images at (this has no effect if a reduction
+ *  has been set with set_dcp_decode_reduction()).  Unlike set_dcp_decode_reduction()
+ *  this only affects pictures that are decoded from now on, so it does not cause a
+ *  Change and can be called often (from any thread) to adapt to how quickly we are
+ *  being asked to decode.
+ */
+void
+Player::set_dcp_decode_extra_reduction (int reduction)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (reduction == _dcp_decode_extra_reduction) {
+		return;
+	}
+
+	_dcp_decode_extra_reduction = reduction;
+
+	if (!_play_referenced) {
+		return;
+	}
+
+	for (auto i: _pieces) {
+		auto dcp = dynamic_pointer_cast<DCPDecoder>(i->decoder);
+		if (dcp) {
+			dcp->set_extra_reduction (reduction);
+		}
+	}
+}
+
+
 optional<DCPTime>
 Player::content_time_to_dcp (shared_ptr<const Content> content, ContentTime t)
 {
@@ -99,6 +99,7 @@ public:
 	void set_fast ();
 	void set_play_referenced ();
 	void set_dcp_decode_reduction (boost::optional<int> reduction);
+	void set_dcp_decode_extra_reduction (int reduction);
 
 	boost::optional<dcpomatic::DCPTime> content_time_to_dcp (std::shared_ptr<const Content> content, dcpomatic::ContentTime t);
 	boost::optional<dcpomatic::ContentTime> dcp_to_content_time (std::shared_ptr<const Content> content, dcpomatic::DCPTime t);
@@ -202,6 +203,10 @@ private:
 	boost::optional<dcpomatic::DCPTime> _next_audio_time;
 
 	boost::optional<int> _dcp_decode_reduction;
+	/** reduction to apply to DCP pictures on top of the one chosen to suit the output size,
+	 *  if _dcp_decode_reduction is not set.
+	 */
+	int _dcp_decode_extra_reduction = 0;
 
 	typedef std::map<std::weak_ptr<Piece>, std::shared_ptr<PlayerVideo>, std::owner_less<std::weak_ptr<Piece>>> LastVideoMap;
 	LastVideoMap _last_video;
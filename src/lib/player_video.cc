@@ -20,8 +20,10 @@
 
 
 #include "content.h"
+#include "digester.h"
 #include "film.h"
 #include "image.h"
+#include "image_compression.h"
 #include "image_proxy.h"
 #include "j2k_image_proxy.h"
 #include "player.h"
@@ -97,12 +99,13 @@ PlayerVideo::PlayerVideo (shared_ptr<cxml::Node> node, shared_ptr<Socket> socket
 
 	if (node->optional_number_child<int>("SubtitleX")) {
 
-		auto image = make_shared<Image> (
-			AV_PIX_FMT_BGRA, dcp::Size(node->number_child<int>("SubtitleWidth"), node->number_child<int>("SubtitleHeight")), Image::Alignment::PADDED
+		auto image = read_image_from_socket (
+			AV_PIX_FMT_BGRA,
+			dcp::Size(node->number_child<int>("SubtitleWidth"), node->number_child<int>("SubtitleHeight")),
+			node->optional_string_child("SubtitleCompression").get_value_or("") == "FFV1",
+			socket
 			);
 
-		image->read_from_socket (socket);
-
 		_text = PositionImage (image, Position<int>(node->number_child<int>("SubtitleX"), node->number_child<int>("SubtitleY")));
 	}
 }
@@ -116,13 +119,13 @@ PlayerVideo::set_text (PositionImage image)
 
 
 shared_ptr<Image>
-PlayerVideo::image (function<AVPixelFormat (AVPixelFormat)> pixel_format, VideoRange video_range, bool fast) const
+PlayerVideo::image (function<AVPixelFormat (AVPixelFormat)> pixel_format, VideoRange video_range, bool fast, int slices) const
 {
 	/* XXX: this assumes that image() and prepare() are only ever called with the same parameters (except crop, inter size, out size, fade) */
 
 	boost::mutex::scoped_lock lm (_mutex);
 	if (!_image || _crop != _image_crop || _inter_size != _image_inter_size || _out_size != _image_out_size || _fade != _image_fade) {
-		make_image (pixel_format, video_range, fast);
+		make_image (pixel_format, video_range, fast, slices);
 	}
 	return _image;
 }
@@ -140,9 +143,11 @@ PlayerVideo::raw_image () const
  *  it is passed the pixel format of the input image from the ImageProxy, and should return the desired
  *  output pixel format.  Two functions force and keep_xyz_or_rgb are provided for use here.
  *  @param fast true to be fast at the expense of quality.
+ *  @param slices Number of slices to split the crop/scale into so that it can be done in parallel;
+ *  see Image::crop_scale_window.
  */
 void
-PlayerVideo::make_image (function<AVPixelFormat (AVPixelFormat)> pixel_format, VideoRange video_range, bool fast) const
+PlayerVideo::make_image (function<AVPixelFormat (AVPixelFormat)> pixel_format, VideoRange video_range, bool fast, int slices) const
 {
 	_image_crop = _crop;
 	_image_inter_size = _inter_size;
@@ -185,7 +190,7 @@ PlayerVideo::make_image (function<AVPixelFormat (AVPixelFormat)> pixel_format, V
 	}
 
 	_image = prox.image->crop_scale_window (
-		total_crop, _inter_size, _out_size, yuv_to_rgb, _video_range, pixel_format (prox.image->pixel_format()), video_range, Image::Alignment::COMPACT, fast
+		total_crop, _inter_size, _out_size, yuv_to_rgb, _video_range, pixel_format (prox.image->pixel_format()), video_range, Image::Alignment::COMPACT, fast, slices
 		);
 
 	if (_text) {
@@ -199,13 +204,13 @@ PlayerVideo::make_image (function<AVPixelFormat (AVPixelFormat)> pixel_format, V
 
 
 void
-PlayerVideo::add_metadata (xmlpp::Node* node) const
+PlayerVideo::add_metadata (xmlpp::Node* node, bool compress) const
 {
 	_crop.as_xml (node);
 	if (_fade) {
 		node->add_child("Fade")->add_child_text (raw_convert<string> (_fade.get ()));
 	}
-	_in->add_metadata (node->add_child ("In"));
+	_in->add_metadata (node->add_child ("In"), compress);
 	node->add_child("InterWidth")->add_child_text (raw_convert<string> (_inter_size.width));
 	node->add_child("InterHeight")->add_child_text (raw_convert<string> (_inter_size.height));
 	node->add_child("OutWidth")->add_child_text (raw_convert<string> (_out_size.width));
@@ -222,16 +227,19 @@ PlayerVideo::add_metadata (xmlpp::Node* node) const
 		node->add_child ("SubtitleHeight")->add_child_text (raw_convert<string> (_text->image->size().height));
 		node->add_child ("SubtitleX")->add_child_text (raw_convert<string> (_text->position.x));
 		node->add_child ("SubtitleY")->add_child_text (raw_convert<string> (_text->position.y));
+		if (compress && can_compress_image_losslessly(_text->image->pixel_format())) {
+			node->add_child ("SubtitleCompression")->add_child_text ("FFV1");
+		}
 	}
 }
 
 
 void
-PlayerVideo::write_to_socket (shared_ptr<Socket> socket) const
+PlayerVideo::write_to_socket (shared_ptr<Socket> socket, bool compress) const
 {
-	_in->write_to_socket (socket);
+	_in->write_to_socket (socket, compress);
 	if (_text) {
-		_text->image->write_to_socket (socket);
+		write_image_to_socket (_text->image, compress && can_compress_image_losslessly(_text->image->pixel_format()), socket);
 	}
 }
 
@@ -297,6 +305,35 @@ PlayerVideo::same (shared_ptr<const PlayerVideo> other) const
 }
 
 
+/** Add everything which affects the image that we will make to a digest, so that two PlayerVideos
+ *  with the same digest will give the same image.
+ */
+void
+PlayerVideo::add_digest (Digester& digester) const
+{
+	_in->add_digest (digester);
+	digester.add (_crop.left);
+	digester.add (_crop.right);
+	digester.add (_crop.top);
+	digester.add (_crop.bottom);
+	digester.add (_fade.get_value_or(-1));
+	digester.add (_inter_size.width);
+	digester.add (_inter_size.height);
+	digester.add (_out_size.width);
+	digester.add (_out_size.height);
+	digester.add (static_cast<int>(_part));
+	digester.add (_colour_conversion ? _colour_conversion->identifier() : string("none"));
+	digester.add (static_cast<int>(_video_range));
+	if (_text && _text->image) {
+		digester.add (_text->position.x);
+		digester.add (_text->position.y);
+		_text->image->add_digest (digester);
+	} else {
+		digester.add (string("notext"));
+	}
+}
+
+
 AVPixelFormat
 PlayerVideo::force (AVPixelFormat force_to)
 {
@@ -37,6 +37,7 @@ extern "C" {
 
 class Image;
 class ImageProxy;
+class Digester;
 class Film;
 class Socket;
 
@@ -76,14 +77,14 @@ public:
 	}
 
 	void prepare (std::function<AVPixelFormat (AVPixelFormat)> pixel_format, VideoRange video_range, Image::Alignment alignment, bool fast, bool proxy_only);
-	std::shared_ptr<Image> image (std::function<AVPixelFormat (AVPixelFormat)> pixel_format, VideoRange video_range, bool fast) const;
+	std::shared_ptr<Image> image (std::function<AVPixelFormat (AVPixelFormat)> pixel_format, VideoRange video_range, bool fast, int slices = 1) const;
 	std::shared_ptr<const Image> raw_image () const;
 
 	static AVPixelFormat force (AVPixelFormat);
 	static AVPixelFormat keep_xyz_or_rgb (AVPixelFormat);
 
-	void add_metadata (xmlpp::Node* node) const;
-	void write_to_socket (std::shared_ptr<Socket> socket) const;
+	void add_metadata (xmlpp::Node* node, bool compress) const;
+	void write_to_socket (std::shared_ptr<Socket> socket, bool compress) const;
 
 	bool reset_metadata (std::shared_ptr<const Film> film, dcp::Size player_video_container_size);
 
@@ -115,6 +116,7 @@ public:
 	}
 
 	bool same (std::shared_ptr<const PlayerVideo> other) const;
+	void add_digest (Digester& digester) const;
 
 	size_t memory_used () const;
 
@@ -127,7 +129,7 @@ public:
 	}
 
 private:
-	void make_image (std::function<AVPixelFormat (AVPixelFormat)> pixel_format, VideoRange video_range, bool fast) const;
+	void make_image (std::function<AVPixelFormat (AVPixelFormat)> pixel_format, VideoRange video_range, bool fast, int slices = 1) const;
 
 	std::shared_ptr<const ImageProxy> _in;
 	Crop _crop;
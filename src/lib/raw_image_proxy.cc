@@ -19,8 +19,10 @@
 */
 
 
-#include "raw_image_proxy.h"
+#include "digester.h"
 #include "image.h"
+#include "raw_image_proxy.h"
+#include "image_compression.h"
 #include <dcp/raw_convert.h>
 #include <dcp/util.h>
 #include <dcp/warnings.h>
@@ -58,8 +60,12 @@ RawImageProxy::RawImageProxy (shared_ptr<cxml::Node> xml, shared_ptr<Socket> soc
 		xml->number_child<int>("Width"), xml->number_child<int>("Height")
 		);
 
-	_image = make_shared<Image>(static_cast<AVPixelFormat>(xml->number_child<int>("PixelFormat")), size, Image::Alignment::PADDED);
-	_image->read_from_socket (socket);
+	_image = read_image_from_socket (
+		static_cast<AVPixelFormat>(xml->number_child<int>("PixelFormat")),
+		size,
+		xml->optional_string_child("Compression").get_value_or("") == "FFV1",
+		socket
+		);
 }
 
 
@@ -72,19 +78,22 @@ RawImageProxy::image (Image::Alignment alignment, optional<dcp::Size>) const
 
 
 void
-RawImageProxy::add_metadata (xmlpp::Node* node) const
+RawImageProxy::add_metadata (xmlpp::Node* node, bool compress) const
 {
 	node->add_child("Type")->add_child_text(N_("Raw"));
 	node->add_child("Width")->add_child_text(raw_convert<string>(_image->size().width));
 	node->add_child("Height")->add_child_text(raw_convert<string>(_image->size().height));
 	node->add_child("PixelFormat")->add_child_text(raw_convert<string>(static_cast<int>(_image->pixel_format())));
+	if (compress && can_compress_image_losslessly(_image->pixel_format())) {
+		node->add_child("Compression")->add_child_text(N_("FFV1"));
+	}
 }
 
 
 void
-RawImageProxy::write_to_socket (shared_ptr<Socket> socket) const
+RawImageProxy::write_to_socket (shared_ptr<Socket> socket, bool compress) const
 {
-	_image->write_to_socket (socket);
+	write_image_to_socket (_image, compress && can_compress_image_losslessly(_image->pixel_format()), socket);
 }
 
 
@@ -100,6 +109,14 @@ RawImageProxy::same (shared_ptr<const ImageProxy> other) const
 }
 
 
+void
+RawImageProxy::add_digest (Digester& digester) const
+{
+	digester.add (string("raw"));
+	_image->add_digest (digester);
+}
+
+
 size_t
 RawImageProxy::memory_used () const
 {
@@ -37,9 +37,10 @@ public:
 		boost::optional<dcp::Size> size = boost::optional<dcp::Size> ()
 		) const override;
 
-	void add_metadata (xmlpp::Node *) const override;
-	void write_to_socket (std::shared_ptr<Socket>) const override;
+	void add_metadata (xmlpp::Node *, bool compress) const override;
+	void write_to_socket (std::shared_ptr<Socket>, bool compress) const override;
 	bool same (std::shared_ptr<const ImageProxy>) const override;
+	void add_digest (Digester& digester) const override;
 	size_t memory_used () const override;
 
 private:
@@ -25,6 +25,7 @@
 #include "cross.h"
 #include "dcpomatic_log.h"
 #include "digester.h"
+#include "file_digest.h"
 #include "film.h"
 #include "font_data.h"
 #include "image.h"
@@ -759,17 +760,16 @@ void
 ReelWriter::calculate_digests (std::function<void (float)> set_progress)
 try
 {
-	if (_picture_asset) {
-		_picture_asset->hash (set_progress);
-	}
-
-	if (_sound_asset) {
-		_sound_asset->hash (set_progress);
-	}
+	auto calculate = [set_progress](shared_ptr<dcp::Asset> asset) {
+		if (asset) {
+			DCPOMATIC_ASSERT (asset->file());
+			asset->set_hash (file_digest(*asset->file(), set_progress));
+		}
+	};
 
-	if (_atmos_asset) {
-		_atmos_asset->hash (set_progress);
-	}
+	calculate (_picture_asset);
+	calculate (_sound_asset);
+	calculate (_atmos_asset);
 } catch (boost::thread_interrupted) {
 	/* set_progress contains an interruption_point, so any of these methods
 	 * may throw thread_interrupted, at which point we just give up.
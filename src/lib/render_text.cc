@@ -35,6 +35,8 @@ LIBDCP_DISABLE_WARNINGS
 LIBDCP_ENABLE_WARNINGS
 #include <pango/pangocairo.h>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
 #include <iostream>
 
 
@@ -48,6 +50,7 @@ using std::min;
 using std::pair;
 using std::shared_ptr;
 using std::string;
+using boost::optional;
 using namespace dcpomatic;
 
 
@@ -55,6 +58,22 @@ static FcConfig* fc_config = nullptr;
 static list<pair<boost::filesystem::path, string>> fc_config_fonts;
 
 
+/** A line of subtitles which has been rendered without any fade */
+struct RenderedLine
+{
+	list<StringText> subtitles;
+	boost::filesystem::path font_file;
+	dcp::Size target;
+	PositionImage image;
+};
+
+/** Number of rendered lines to keep; there are rarely more than a few on screen at once */
+static size_t constexpr rendered_lines_to_keep = 16;
+static boost::mutex rendered_lines_mutex;
+/** Recently-rendered lines, most recently used first */
+static list<RenderedLine> rendered_lines;
+
+
 /** Create a Pango layout using a dummy context which we can use to calculate the size
  *  of the text we will render.  Then we can transfer the layout over to the real context
  *  for the actual render.
@@ -174,21 +193,29 @@ create_surface (shared_ptr<Image> image)
 }
 
 
-static string
-setup_font (StringText const& subtitle, list<shared_ptr<Font>> const& fonts)
+/** @return the font file that should be used to render a subtitle */
+static boost::filesystem::path
+font_file (StringText const& subtitle, list<shared_ptr<Font>> const& fonts)
 {
-	if (!fc_config) {
-		fc_config = FcInitLoadConfig ();
-	}
-
-	auto font_file = default_font_file ();
+	auto file = default_font_file ();
 
 	for (auto i: fonts) {
 		if (i->id() == subtitle.font() && i->file()) {
-			font_file = i->file().get();
+			file = i->file().get();
 		}
 	}
 
+	return file;
+}
+
+
+static string
+setup_font (boost::filesystem::path font_file)
+{
+	if (!fc_config) {
+		fc_config = FcInitLoadConfig ();
+	}
+
 	auto existing = fc_config_fonts.cbegin ();
 	while (existing != fc_config_fonts.end() && existing->first != font_file) {
 		++existing;
@@ -323,11 +350,12 @@ y_position (StringText const& first, int target_height, int layout_height)
 }
 
 
-/** @param subtitles A list of subtitles that are all on the same line,
+/** Render a line of subtitles without any fade.
+ *  @param subtitles A list of subtitles that are all on the same line,
  *  at the same time and with the same fade in/out.
  */
 static PositionImage
-render_line (list<StringText> subtitles, list<shared_ptr<Font>> fonts, dcp::Size target, DCPTime time, int frame_rate)
+render_line (list<StringText> const& subtitles, boost::filesystem::path font_file, dcp::Size target)
 {
 	/* XXX: this method can only handle italic / bold changes mid-line,
 	   nothing else yet.
@@ -336,8 +364,8 @@ render_line (list<StringText> subtitles, list<shared_ptr<Font>> fonts, dcp::Size
 	DCPOMATIC_ASSERT (!subtitles.empty ());
 	auto const& first = subtitles.front ();
 
-	auto const font_name = setup_font (first, fonts);
-	auto const fade_factor = calculate_fade_factor (first, time, frame_rate);
+	auto const font_name = setup_font (font_file);
+	float const fade_factor = 1;
 	auto const markup = marked_up (subtitles, target.height, fade_factor, font_name);
 	auto layout = create_layout ();
 	setup_layout (layout, font_name, markup);
@@ -419,6 +447,60 @@ render_line (list<StringText> subtitles, list<shared_ptr<Font>> fonts, dcp::Size
 }
 
 
+static bool
+same_subtitles (list<StringText> const& a, list<StringText> const& b)
+{
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](StringText const& x, StringText const& y) {
+		return static_cast<dcp::SubtitleString const&>(x) == static_cast<dcp::SubtitleString const&>(y) && x.outline_width == y.outline_width;
+	});
+}
+
+
+/** Render a line of subtitles, or find it in the cache of recently-rendered lines
+ *  if it is there, and then apply any fade.  A line is usually on screen for many
+ *  frames, and only its fade changes from one to the next.
+ *  @param subtitles A list of subtitles that are all on the same line,
+ *  at the same time and with the same fade in/out.
+ */
+static PositionImage
+render_line (list<StringText> subtitles, list<shared_ptr<Font>> fonts, dcp::Size target, DCPTime time, int frame_rate)
+{
+	DCPOMATIC_ASSERT (!subtitles.empty ());
+	auto const file = font_file (subtitles.front(), fonts);
+
+	optional<PositionImage> line;
+
+	{
+		boost::mutex::scoped_lock lm (rendered_lines_mutex);
+		auto i = std::find_if (rendered_lines.begin(), rendered_lines.end(), [&](RenderedLine const& r) {
+			return r.target == target && r.font_file == file && same_subtitles(r.subtitles, subtitles);
+		});
+		if (i != rendered_lines.end()) {
+			line = i->image;
+			rendered_lines.splice (rendered_lines.begin(), rendered_lines, i);
+		}
+	}
+
+	if (!line) {
+		line = render_line (subtitles, file, target);
+		boost::mutex::scoped_lock lm (rendered_lines_mutex);
+		rendered_lines.push_front ({subtitles, file, target, *line});
+		if (rendered_lines.size() > rendered_lines_to_keep) {
+			rendered_lines.pop_back ();
+		}
+	}
+
+	auto const fade_factor = calculate_fade_factor (subtitles.front(), time, frame_rate);
+	if (fade_factor == 1) {
+		return *line;
+	}
+
+	auto faded = make_shared<Image>(*line->image);
+	faded->fade (fade_factor);
+	return PositionImage (faded, line->position);
+}
+
+
 /** @param time Time of the frame that these subtitles are going on.
  *  @param target Size of the container that this subtitle will end up in.
  *  @param frame_rate DCP frame rate.
@@ -0,0 +1,164 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "compose.hpp"
+#include "rgb_to_xyz.h"
+#include <dcp/rgb_xyz.h>
+#include <dcp/transfer_function.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+using std::make_shared;
+using std::max;
+using std::min;
+using std::shared_ptr;
+using std::vector;
+
+
+/** Convert an RGB image to XYZ.  This gives exactly the same results as dcp::rgb_to_xyz,
+ *  but is quicker: the output gamma LUT is scaled to 12 bits once rather than for every
+ *  pixel, and where SSE2 is available the matrix multiplication is done for two pixels
+ *  at a time.
+ *
+ *  @param rgb RGB data; packed RGB48LE (i.e. 16 bits per component, 48 bits per pixel).
+ *  @param size Size of RGB image in pixels.
+ *  @param stride Stride for RGB data in bytes.
+ *  @param conversion Colour conversion to use.
+ *  @param note Handler for any notes about the conversion, or empty.
+ *  @return XYZ image.
+ */
+shared_ptr<dcp::OpenJPEGImage>
+dcpomatic::rgb_to_xyz (uint8_t const* rgb, dcp::Size size, int stride, dcp::ColourConversion const& conversion, dcp::NoteHandler note)
+{
+	auto xyz = make_shared<dcp::OpenJPEGImage>(size);
+
+	auto const* lut_in = conversion.in()->lut(0, 1, 12, false);
+	auto const* lut_out = conversion.out()->lut(0, 1, 16, true);
+
+	/* This is the product of the RGB to XYZ matrix, the Bradford transform and the DCI companding */
+	double fast_matrix[9];
+	dcp::combined_rgb_to_xyz (conversion, fast_matrix);
+
+	/* Output LUT scaled to 12 bits, exactly as it would be for each pixel */
+	vector<int> lut_out_12 (65536);
+	for (int i = 0; i < 65536; ++i) {
+		lut_out_12[i] = lrint (lut_out[i] * 4095);
+	}
+
+	int clamped = 0;
+	int* xyz_x = xyz->data (0);
+	int* xyz_y = xyz->data (1);
+	int* xyz_z = xyz->data (2);
+
+#ifdef __SSE2__
+	__m128d m[9];
+	for (int i = 0; i < 9; ++i) {
+		m[i] = _mm_set1_pd (fast_matrix[i]);
+	}
+	auto const zero = _mm_setzero_pd ();
+	auto const top = _mm_set1_pd (65535);
+#endif
+
+	for (int y = 0; y < size.height; ++y) {
+		auto p = reinterpret_cast<uint16_t const *>(rgb + y * stride);
+		int x = 0;
+
+#ifdef __SSE2__
+		for (; x < (size.width - 1); x += 2) {
+			/* In gamma LUT (converting 16-bit to 12-bit); pixel x in the low half, x + 1 in the high */
+			auto const r = _mm_set_pd (lut_in[p[3] >> 4], lut_in[p[0] >> 4]);
+			auto const g = _mm_set_pd (lut_in[p[4] >> 4], lut_in[p[1] >> 4]);
+			auto const b = _mm_set_pd (lut_in[p[5] >> 4], lut_in[p[2] >> 4]);
+			p += 6;
+
+			/* RGB to XYZ, Bradford transform and DCI companding, with the operations
+			   in the same order as the scalar version so that the results are identical.
+			*/
+			auto dx = _mm_add_pd (_mm_add_pd(_mm_mul_pd(r, m[0]), _mm_mul_pd(g, m[1])), _mm_mul_pd(b, m[2]));
+			auto dy = _mm_add_pd (_mm_add_pd(_mm_mul_pd(r, m[3]), _mm_mul_pd(g, m[4])), _mm_mul_pd(b, m[5]));
+			auto dz = _mm_add_pd (_mm_add_pd(_mm_mul_pd(r, m[6]), _mm_mul_pd(g, m[7])), _mm_mul_pd(b, m[8]));
+
+			/* Clamp */
+			auto const low = _mm_or_pd (_mm_or_pd(_mm_cmplt_pd(dx, zero), _mm_cmplt_pd(dy, zero)), _mm_cmplt_pd(dz, zero));
+			auto const high = _mm_or_pd (_mm_or_pd(_mm_cmpgt_pd(dx, top), _mm_cmpgt_pd(dy, top)), _mm_cmpgt_pd(dz, top));
+			int const out_of_range = _mm_movemask_pd (_mm_or_pd(low, high));
+			clamped += (out_of_range & 1) + ((out_of_range >> 1) & 1);
+
+			dx = _mm_min_pd (_mm_max_pd(dx, zero), top);
+			dy = _mm_min_pd (_mm_max_pd(dy, zero), top);
+			dz = _mm_min_pd (_mm_max_pd(dz, zero), top);
+
+			/* Round to nearest (which is what lrint does in the default rounding mode) and
+			   then out gamma LUT.
+			*/
+			auto const ix = _mm_cvtpd_epi32 (dx);
+			auto const iy = _mm_cvtpd_epi32 (dy);
+			auto const iz = _mm_cvtpd_epi32 (dz);
+			xyz_x[0] = lut_out_12[_mm_cvtsi128_si32(ix)];
+			xyz_x[1] = lut_out_12[_mm_cvtsi128_si32(_mm_srli_si128(ix, 4))];
+			xyz_y[0] = lut_out_12[_mm_cvtsi128_si32(iy)];
+			xyz_y[1] = lut_out_12[_mm_cvtsi128_si32(_mm_srli_si128(iy, 4))];
+			xyz_z[0] = lut_out_12[_mm_cvtsi128_si32(iz)];
+			xyz_z[1] = lut_out_12[_mm_cvtsi128_si32(_mm_srli_si128(iz, 4))];
+			xyz_x += 2;
+			xyz_y += 2;
+			xyz_z += 2;
+		}
+#endif
+
+		for (; x < size.width; ++x) {
+			/* In gamma LUT (converting 16-bit to 12-bit) */
+			double const r = lut_in[*p++ >> 4];
+			double const g = lut_in[*p++ >> 4];
+			double const b = lut_in[*p++ >> 4];
+
+			/* RGB to XYZ, Bradford transform and DCI companding */
+			double dx = r * fast_matrix[0] + g * fast_matrix[1] + b * fast_matrix[2];
+			double dy = r * fast_matrix[3] + g * fast_matrix[4] + b * fast_matrix[5];
+			double dz = r * fast_matrix[6] + g * fast_matrix[7] + b * fast_matrix[8];
+
+			/* Clamp */
+			if (dx < 0 || dy < 0 || dz < 0 || dx > 65535 || dy > 65535 || dz > 65535) {
+				++clamped;
+			}
+
+			dx = min (65535.0, max (0.0, dx));
+			dy = min (65535.0, max (0.0, dy));
+			dz = min (65535.0, max (0.0, dz));
+
+			/* Out gamma LUT */
+			*xyz_x++ = lut_out_12[lrint(dx)];
+			*xyz_y++ = lut_out_12[lrint(dy)];
+			*xyz_z++ = lut_out_12[lrint(dz)];
+		}
+	}
+
+	if (clamped && note) {
+		note (dcp::NoteType::NOTE, String::compose("%1 XYZ value(s) clamped", clamped));
+	}
+
+	return xyz;
+}
@@ -0,0 +1,49 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  src/lib/rgb_to_xyz.h
+ *  @brief Fast conversion of RGB images to XYZ.
+ */
+
+
+#ifndef DCPOMATIC_RGB_TO_XYZ_H
+#define DCPOMATIC_RGB_TO_XYZ_H
+
+
+#include <dcp/colour_conversion.h>
+#include <dcp/openjpeg_image.h>
+#include <dcp/types.h>
+#include <memory>
+#include <stdint.h>
+
+
+namespace dcpomatic {
+
+
+extern std::shared_ptr<dcp::OpenJPEGImage> rgb_to_xyz (
+	uint8_t const* rgb, dcp::Size size, int stride, dcp::ColourConversion const& conversion, dcp::NoteHandler note
+	);
+
+
+}
+
+
+#endif
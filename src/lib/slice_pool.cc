@@ -0,0 +1,133 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "slice_pool.h"
+#include "util.h"
+#include <algorithm>
+
+
+using std::function;
+using std::make_shared;
+using std::shared_ptr;
+
+
+SlicePool::SlicePool ()
+{
+	int const count = static_cast<int>(boost::thread::hardware_concurrency()) - 1;
+	for (int i = 0; i < count; ++i) {
+		_threads.push_back (make_shared<boost::thread>([this]() { thread(); }));
+	}
+}
+
+
+/** Run a job, split into some slices which may be done in parallel, and return
+ *  when they have all finished.  If any slice throws an exception the first
+ *  one to do so will be re-thrown here (after all the slices have finished).
+ *  @param slices Number of slices.
+ *  @param job Function to run each slice; it is passed the index of the slice,
+ *  from 0 to slices - 1.
+ */
+void
+SlicePool::run (int slices, function<void (int)> job)
+{
+	if (slices <= 1 || _threads.empty()) {
+		for (int i = 0; i < slices; ++i) {
+			job (i);
+		}
+		return;
+	}
+
+	auto j = make_shared<Job>(slices, job);
+
+	boost::mutex::scoped_lock lm (_mutex);
+	_jobs.push_back (j);
+	_condition.notify_all ();
+
+	/* Do what we can ourselves, then wait for anything that the pool threads are still working on */
+	while (run_one(j, lm)) {}
+	while (j->done < j->slices) {
+		_condition.wait (lm);
+	}
+
+	if (j->error) {
+		std::rethrow_exception (j->error);
+	}
+}
+
+
+/** Start and run the next slice of a job, if it has any which have not been started.
+ *  @param lm Lock on _mutex; this will be released while the slice runs.
+ *  @return true if a slice was run.
+ */
+bool
+SlicePool::run_one (shared_ptr<Job> job, boost::mutex::scoped_lock& lm)
+{
+	if (job->next == job->slices) {
+		return false;
+	}
+
+	auto const slice = job->next++;
+	if (job->next == job->slices) {
+		_jobs.erase (std::find(_jobs.begin(), _jobs.end(), job));
+	}
+
+	std::exception_ptr error;
+	lm.unlock ();
+	try {
+		job->function (slice);
+	} catch (...) {
+		error = std::current_exception ();
+	}
+	lm.lock ();
+
+	if (error && !job->error) {
+		job->error = error;
+	}
+	++job->done;
+	_condition.notify_all ();
+	return true;
+}
+
+
+void
+SlicePool::thread ()
+{
+	start_of_thread ("SlicePool");
+
+	boost::mutex::scoped_lock lm (_mutex);
+	while (true) {
+		while (_jobs.empty()) {
+			_condition.wait (lm);
+		}
+		run_one (_jobs.front(), lm);
+	}
+}
+
+
+SlicePool*
+SlicePool::instance ()
+{
+	/* As with ImagePool, this may be used from any thread at any time up to the end
+	   of the program, so it is made in a thread-safe way and never destroyed.
+	*/
+	static auto pool = new SlicePool ();
+	return pool;
+}
@@ -0,0 +1,96 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCPOMATIC_SLICE_POOL_H
+#define DCPOMATIC_SLICE_POOL_H
+
+
+/** @file  src/lib/slice_pool.h
+ *  @brief SlicePool class.
+ */
+
+
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+
+
+/** @class SlicePool
+ *  @brief Some threads which can be used to split a single job (such as processing one
+ *  image) into slices which are done in parallel.
+ *
+ *  The thread which calls run() does some of the slices itself, so even if the pool's
+ *  threads are all busy it will not be waiting for nothing.
+ */
+class SlicePool
+{
+public:
+	SlicePool (SlicePool const&) = delete;
+	SlicePool& operator= (SlicePool const&) = delete;
+
+	void run (int slices, std::function<void (int)> job);
+
+	/** @return number of slices that can usefully be run at the same time,
+	 *  including the one done by the caller of run().
+	 */
+	int threads () const {
+		return _threads.size() + 1;
+	}
+
+	static SlicePool* instance ();
+
+private:
+	SlicePool ();
+
+	struct Job
+	{
+		Job (int slices_, std::function<void (int)> function_)
+			: slices (slices_)
+			, function (function_)
+		{}
+
+		int slices;
+		std::function<void (int)> function;
+		/** index of the next slice to start */
+		int next = 0;
+		/** number of slices that have finished */
+		int done = 0;
+		/** first exception thrown by a slice, if any */
+		std::exception_ptr error;
+	};
+
+	void thread ();
+	bool run_one (std::shared_ptr<Job> job, boost::mutex::scoped_lock& lm);
+
+	std::vector<std::shared_ptr<boost::thread>> _threads;
+	/** mutex to protect _jobs and the state in each Job */
+	boost::mutex _mutex;
+	/** condition to wake threads when a job is added, and callers of run() when a slice is finished */
+	boost::condition _condition;
+	/** jobs which have slices that have not yet been started */
+	std::deque<std::shared_ptr<Job>> _jobs;
+};
+
+
+#endif
@@ -0,0 +1,155 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "dcpomatic_assert.h"
+#include "exceptions.h"
+#include "spill_file.h"
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+
+
+using std::make_shared;
+using std::max;
+using std::shared_ptr;
+
+
+/** @param path File to use; it will be created when the first frame is appended,
+ *  and anything already there will be overwritten.
+ */
+SpillFile::SpillFile (boost::filesystem::path path)
+	: _path (path)
+{
+
+}
+
+
+SpillFile::~SpillFile ()
+{
+	if (_file) {
+		_file->close ();
+	}
+	boost::system::error_code ec;
+	boost::filesystem::remove (_path, ec);
+}
+
+
+void
+SpillFile::open ()
+{
+	_file = dcp::File (_path, "w+b");
+	if (!*_file) {
+		_file.reset ();
+		throw OpenFileError (_path, errno, OpenFileError::READ_WRITE);
+	}
+}
+
+
+/** Add a frame to the file, in the first freed gap that it fits, or at the end if there is none.
+ *  @return Where the frame was written, to pass to read().
+ */
+SpillFile::Extent
+SpillFile::append (dcp::Data const& data)
+{
+	if (!_file) {
+		open ();
+	}
+
+	Extent extent;
+	extent.size = data.size();
+
+	auto gap = std::find_if (_free.begin(), _free.end(), [&data](std::pair<int64_t const, int64_t> const& i) {
+		return i.second >= data.size();
+	});
+
+	if (gap != _free.end()) {
+		extent.offset = gap->first;
+		auto const remaining = gap->second - data.size();
+		_free.erase (gap);
+		if (remaining > 0) {
+			_free[extent.offset + data.size()] = remaining;
+		}
+	} else {
+		extent.offset = _length;
+		_length += data.size();
+		_maximum_length = max (_maximum_length, _length);
+	}
+
+	_file->seek (extent.offset, SEEK_SET);
+	_file->checked_write (data.data(), data.size());
+
+	++_waiting;
+	return extent;
+}
+
+
+/** Read back a frame that was written by append().  Each frame must be read exactly once */
+shared_ptr<dcp::ArrayData>
+SpillFile::read (Extent extent)
+{
+	DCPOMATIC_ASSERT (_file);
+	DCPOMATIC_ASSERT (_waiting > 0);
+	DCPOMATIC_ASSERT (extent.offset + extent.size <= _length);
+
+	auto data = make_shared<dcp::ArrayData>(extent.size);
+	_file->seek (extent.offset, SEEK_SET);
+	_file->checked_read (data->data(), extent.size);
+
+	--_waiting;
+	release (extent);
+
+	return data;
+}
+
+
+/** Mark the space used by a frame as free, merging it with any free neighbours */
+void
+SpillFile::release (Extent extent)
+{
+	int64_t offset = extent.offset;
+	int64_t size = extent.size;
+
+	auto next = _free.upper_bound (offset);
+	if (next != _free.begin()) {
+		auto previous = std::prev (next);
+		DCPOMATIC_ASSERT (previous->first + previous->second <= offset);
+		if (previous->first + previous->second == offset) {
+			offset = previous->first;
+			size += previous->second;
+			_free.erase (previous);
+		}
+	}
+
+	if (next != _free.end()) {
+		DCPOMATIC_ASSERT (offset + size <= next->first);
+		if (offset + size == next->first) {
+			size += next->second;
+			_free.erase (next);
+		}
+	}
+
+	if (offset + size == _length) {
+		/* This is the end of the file, so later frames can be appended here */
+		_length = offset;
+	} else {
+		_free[offset] = size;
+	}
+}
@@ -0,0 +1,93 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCPOMATIC_SPILL_FILE_H
+#define DCPOMATIC_SPILL_FILE_H
+
+
+/** @file  src/lib/spill_file.h
+ *  @brief SpillFile class.
+ */
+
+
+#include <dcp/array_data.h>
+#include <dcp/file.h>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+#include <map>
+#include <memory>
+
+
+/** @class SpillFile
+ *  @brief A single scratch file which holds encoded frames that the Writer
+ *  cannot yet write to its assets.
+ *
+ *  Frames are read back (once) by their position.  The space used by a frame that
+ *  has been read is re-used for later frames, and when space at the end of the file
+ *  is freed the end moves back, so the file grows only when no freed gap is big enough
+ *  for a new frame.  The file is deleted when the SpillFile is destroyed.  This class
+ *  is not thread-safe.
+ */
+class SpillFile
+{
+public:
+	explicit SpillFile (boost::filesystem::path path);
+	~SpillFile ();
+
+	SpillFile (SpillFile const&) = delete;
+	SpillFile& operator= (SpillFile const&) = delete;
+
+	/** Position of a frame within the file */
+	struct Extent
+	{
+		int64_t offset = 0;
+		int size = 0;
+	};
+
+	Extent append (dcp::Data const& data);
+	std::shared_ptr<dcp::ArrayData> read (Extent extent);
+
+	/** @return number of frames that have been appended but not yet read */
+	int waiting () const {
+		return _waiting;
+	}
+
+	/** @return largest size that the file has reached, in bytes */
+	int64_t maximum_length () const {
+		return _maximum_length;
+	}
+
+private:
+	void open ();
+	void release (Extent extent);
+
+	boost::filesystem::path _path;
+	boost::optional<dcp::File> _file;
+	/** end of the data that is still waiting to be read */
+	int64_t _length = 0;
+	/** gaps before _length that can be re-used, as offset -> size; adjacent gaps are always merged */
+	std::map<int64_t, int64_t> _free;
+	int64_t _maximum_length = 0;
+	int _waiting = 0;
+};
+
+
+#endif
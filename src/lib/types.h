@@ -47,8 +47,13 @@ namespace xmlpp {
  *
  *  64 - first version used
  *  65 - v2.16.0 - checksums added to communication
+ *  66 - persistent connections with several frames in flight
+ *  67 - servers report how long they took to encode each frame
+ *
+ *  Lossless compression of raw images does not need a new version, as servers which
+ *  can accept compressed images say so when they reply to a broadcast.
  */
-#define SERVER_LINK_VERSION (64+1)
+#define SERVER_LINK_VERSION (64+3)
 
 /** A film of F seconds at f FPS will be Ff frames;
     Consider some delta FPS d, so if we run the same
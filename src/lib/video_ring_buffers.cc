@@ -22,13 +22,11 @@
 #include "video_ring_buffers.h"
 #include "player_video.h"
 #include "compose.hpp"
-#include <list>
-#include <iostream>
+#include "dcpomatic_assert.h"
+#include "exceptions.h"
 
 
-using std::list;
 using std::make_pair;
-using std::cout;
 using std::pair;
 using std::string;
 using std::shared_ptr;
@@ -36,23 +34,40 @@ using boost::optional;
 using namespace dcpomatic;
 
 
+VideoRingBuffers::VideoRingBuffers (int capacity)
+	: _data (capacity)
+	, _read (0)
+	, _write (0)
+{
+	DCPOMATIC_ASSERT (capacity > 0);
+}
+
+
 void
 VideoRingBuffers::put (shared_ptr<PlayerVideo> frame, DCPTime time)
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	_data.push_back (make_pair(frame, time));
+	auto const write = _write.load (std::memory_order_relaxed);
+	if (write - _read.load(std::memory_order_acquire) == capacity()) {
+		throw ProgrammingError (__FILE__, __LINE__, String::compose("Video ring buffers overflowed (%1 frames held)", capacity()));
+	}
+
+	_data[write % capacity()] = make_pair(frame, time);
+	_write.store (write + 1, std::memory_order_release);
 }
 
 
 pair<shared_ptr<PlayerVideo>, DCPTime>
 VideoRingBuffers::get ()
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	if (_data.empty ()) {
+	auto const read = _read.load (std::memory_order_relaxed);
+	if (_write.load(std::memory_order_acquire) == read) {
 		return {};
 	}
-	auto const r = _data.front();
-	_data.pop_front ();
+
+	/* Move the frame out so that the ring does not keep it alive */
+	auto r = std::move (_data[read % capacity()]);
+	_data[read % capacity()] = {};
+	_read.store (read + 1, std::memory_order_release);
 	return r;
 }
 
@@ -60,45 +75,48 @@ VideoRingBuffers::get ()
 Frame
 VideoRingBuffers::size () const
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	return _data.size ();
+	auto const read = _read.load (std::memory_order_acquire);
+	return _write.load(std::memory_order_acquire) - read;
 }
 
 
 bool
 VideoRingBuffers::empty () const
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	return _data.empty ();
+	return size() == 0;
 }
 
 
 void
 VideoRingBuffers::clear ()
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	_data.clear ();
+	auto const write = _write.load (std::memory_order_acquire);
+	for (auto i = _read.load(std::memory_order_relaxed); i < write; ++i) {
+		_data[i % capacity()] = {};
+	}
+	_read.store (write, std::memory_order_release);
 }
 
 
 pair<size_t, string>
 VideoRingBuffers::memory_used () const
 {
-	boost::mutex::scoped_lock lm (_mutex);
+	auto const read = _read.load (std::memory_order_acquire);
+	auto const write = _write.load (std::memory_order_acquire);
 	size_t m = 0;
-	for (auto const& i: _data) {
-		m += i.first->memory_used();
+	for (auto i = read; i < write; ++i) {
+		m += _data[i % capacity()].first->memory_used();
 	}
-	return make_pair(m, String::compose("%1 frames", _data.size()));
+	return make_pair(m, String::compose("%1 frames", write - read));
 }
 
 
 void
 VideoRingBuffers::reset_metadata (shared_ptr<const Film> film, dcp::Size player_video_container_size)
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	for (auto const& i: _data) {
-		i.first->reset_metadata (film, player_video_container_size);
+	auto const read = _read.load (std::memory_order_acquire);
+	auto const write = _write.load (std::memory_order_acquire);
+	for (auto i = read; i < write; ++i) {
+		_data[i % capacity()].first->reset_metadata (film, player_video_container_size);
 	}
 }
-
@@ -22,18 +22,27 @@
 #include "dcpomatic_time.h"
 #include "player_video.h"
 #include "types.h"
-#include <boost/thread/mutex.hpp>
+#include <atomic>
 #include <utility>
+#include <vector>
 
 
 class Film;
 class PlayerVideo;
 
 
+/** @class VideoRingBuffers
+ *  @brief A fixed-size ring of video, written by one thread and read by another.
+ *
+ *  put() must only be called by one thread at a time and get() and clear() by one
+ *  (other) thread at a time; none of them take locks.  size() and empty() can be
+ *  called from any thread.  reset_metadata() and memory_used() look at the frames in
+ *  the ring, so they must not be called at the same time as put(), get() or clear().
+ */
 class VideoRingBuffers
 {
 public:
-	VideoRingBuffers () {}
+	explicit VideoRingBuffers (int capacity);
 
 	VideoRingBuffers (VideoRingBuffers const&) = delete;
 	VideoRingBuffers& operator= (VideoRingBuffers const&) = delete;
@@ -49,7 +58,15 @@ public:
 
 	std::pair<size_t, std::string> memory_used () const;
 
+	/** @return maximum number of frames that can be held */
+	int capacity () const {
+		return _data.size();
+	}
+
 private:
-	mutable boost::mutex _mutex;
-	std::list<std::pair<std::shared_ptr<PlayerVideo>, dcpomatic::DCPTime>> _data;
+	std::vector<std::pair<std::shared_ptr<PlayerVideo>, dcpomatic::DCPTime>> _data;
+	/** Total number of frames ever taken from the ring; only get() and clear() change this */
+	std::atomic<Frame> _read;
+	/** Total number of frames ever put into the ring; only put() changes this */
+	std::atomic<Frame> _write;
 };
@@ -0,0 +1,287 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DCPOMATIC_WORK_STEALING_QUEUE_H
+#define DCPOMATIC_WORK_STEALING_QUEUE_H
+
+
+/** @file  src/lib/work_stealing_queue.h
+ *  @brief WorkStealingQueue class.
+ */
+
+
+#include "dcpomatic_assert.h"
+#include <boost/optional.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <memory>
+#include <vector>
+
+
+/** @class WorkStealingQueue
+ *  @brief A queue of work items shared between some worker threads.
+ *
+ *  Each worker has its own deque, protected by its own mutex, so workers do not contend
+ *  with each other when taking work.  push() hands an item directly to a worker which is
+ *  asleep waiting for work (waking only that worker) or, if they are all busy, to the
+ *  worker with the least to do.  A worker with nothing in its own deque takes work from
+ *  the front of the busiest other deque.
+ *
+ *  set_workers() and take_all() must not be called at the same time as any other method;
+ *  everything else can be called from any thread.
+ */
+template <class T>
+class WorkStealingQueue
+{
+public:
+	WorkStealingQueue ()
+		: _size (0)
+	{
+		set_workers (1);
+	}
+
+	WorkStealingQueue (WorkStealingQueue const&) = delete;
+	WorkStealingQueue& operator= (WorkStealingQueue const&) = delete;
+
+	/** Set the number of workers, keeping any items that are already queued */
+	void set_workers (int workers)
+	{
+		auto items = take_all ();
+
+		_workers.clear ();
+		/* Keep one deque even if there are no workers so that we can still hold items */
+		for (int i = 0; i < std::max(workers, 1); ++i) {
+			_workers.push_back (std::make_shared<Worker>());
+		}
+
+		int n = 0;
+		for (auto& i: items) {
+			auto w = _workers[n++ % _workers.size()];
+			w->items.push_back (std::move(i));
+			++w->count;
+			++_size;
+		}
+	}
+
+	/** Add an item to the back of the queue.
+	 *  @param avoid A worker which should not be given the item, if possible.
+	 */
+	void push (T item, boost::optional<int> avoid = boost::none)
+	{
+		auto w = choose (avoid);
+		boost::mutex::scoped_lock lm (w->mutex);
+		w->items.push_back (std::move(item));
+		++w->count;
+		++_size;
+		w->condition.notify_one ();
+	}
+
+	/** Add an item to the front of the queue, so that it is one of the next to be taken.
+	 *  @param avoid A worker which should not be given the item, if possible.
+	 */
+	void push_front (T item, boost::optional<int> avoid = boost::none)
+	{
+		auto w = choose (avoid);
+		boost::mutex::scoped_lock lm (w->mutex);
+		w->items.push_front (std::move(item));
+		++w->count;
+		++_size;
+		w->condition.notify_one ();
+	}
+
+	/** Take an item for a worker, blocking until one is available.  This is a
+	 *  boost thread interruption point.
+	 */
+	T pop (int worker)
+	{
+		while (true) {
+			auto item = pop (worker, boost::posix_time::hours(1));
+			if (item) {
+				return std::move(*item);
+			}
+		}
+	}
+
+	/** Take an item for a worker, blocking until one is available or until
+	 *  a timeout has passed.  This is a boost thread interruption point.
+	 *  @return Item, or nothing if the timeout passed first.
+	 */
+	boost::optional<T> pop (int worker, boost::posix_time::time_duration timeout)
+	{
+		auto const until = boost::get_system_time() + timeout;
+		auto w = get (worker);
+		while (true) {
+			auto item = try_pop (worker);
+			if (item) {
+				return item;
+			}
+
+			boost::mutex::scoped_lock lm (w->mutex);
+			if (!w->items.empty()) {
+				/* Something arrived after try_pop() looked */
+				continue;
+			}
+
+			auto const now = boost::get_system_time();
+			if (now >= until) {
+				return {};
+			}
+
+			/* Wake up every so often to see if there is anything to steal; push() only
+			   wakes us if it gives us something directly, and it may have given an item
+			   to a worker which will not get to it for a while.
+			*/
+			w->sleeping = true;
+			try {
+				w->condition.timed_wait (lm, std::min(until, now + boost::posix_time::seconds(1)));
+			} catch (...) {
+				w->sleeping = false;
+				throw;
+			}
+			w->sleeping = false;
+		}
+	}
+
+	/** Take an item for a worker without blocking.
+	 *  @return Item from the worker's own deque if there is one, otherwise an
+	 *  item taken from another worker, otherwise nothing.
+	 */
+	boost::optional<T> try_pop (int worker)
+	{
+		auto w = get (worker);
+		{
+			boost::mutex::scoped_lock lm (w->mutex);
+			if (!w->items.empty()) {
+				return take_front (w);
+			}
+		}
+
+		return steal (worker);
+	}
+
+	/** @return total number of items in the queue */
+	int size () const {
+		return _size;
+	}
+
+	/** Remove and return all items */
+	std::list<T> take_all ()
+	{
+		std::list<T> items;
+		for (auto w: _workers) {
+			boost::mutex::scoped_lock lm (w->mutex);
+			for (auto& i: w->items) {
+				items.push_back (std::move(i));
+			}
+			_size -= static_cast<int>(w->items.size());
+			w->items.clear ();
+			w->count = 0;
+		}
+		return items;
+	}
+
+private:
+	struct Worker
+	{
+		boost::mutex mutex;
+		boost::condition condition;
+		std::deque<T> items;
+		/** size of items, so that it can be read without taking the mutex */
+		std::atomic<int> count {0};
+		/** true if this worker is waiting in pop() for something to do */
+		std::atomic<bool> sleeping {false};
+	};
+
+	std::shared_ptr<Worker> get (int worker) const
+	{
+		DCPOMATIC_ASSERT (worker >= 0 && worker < static_cast<int>(_workers.size()));
+		return _workers[worker];
+	}
+
+	/** Caller must hold a lock on w->mutex, and w->items must not be empty */
+	boost::optional<T> take_front (std::shared_ptr<Worker> w)
+	{
+		auto item = std::move(w->items.front());
+		w->items.pop_front ();
+		--w->count;
+		--_size;
+		return boost::optional<T>(std::move(item));
+	}
+
+	/** Take the oldest item from the worker which has the most queued, so that
+	 *  items are still processed roughly in the order that they were pushed.
+	 */
+	boost::optional<T> steal (int thief)
+	{
+		while (_size > 0) {
+			std::shared_ptr<Worker> victim;
+			int most = 0;
+			for (int i = 0; i < static_cast<int>(_workers.size()); ++i) {
+				if (i != thief && _workers[i]->count > most) {
+					victim = _workers[i];
+					most = victim->count;
+				}
+			}
+
+			if (!victim) {
+				return {};
+			}
+
+			boost::mutex::scoped_lock lm (victim->mutex);
+			if (!victim->items.empty()) {
+				return take_front (victim);
+			}
+			/* Someone else got there first; look again */
+		}
+
+		return {};
+	}
+
+	/** @return worker that a new item should be given to */
+	std::shared_ptr<Worker> choose (boost::optional<int> avoid) const
+	{
+		std::shared_ptr<Worker> best;
+		for (int i = 0; i < static_cast<int>(_workers.size()); ++i) {
+			if (avoid && *avoid == i && _workers.size() > 1) {
+				continue;
+			}
+			auto w = _workers[i];
+			if (w->sleeping) {
+				return w;
+			}
+			if (!best || w->count < best->count) {
+				best = w;
+			}
+		}
+		return best;
+	}
+
+	std::vector<std::shared_ptr<Worker>> _workers;
+	/** total number of items in all the workers' deques */
+	std::atomic<int> _size;
+};
+
+
+#endif
@@ -21,6 +21,7 @@
 
 #include "writer.h"
 #include "compose.hpp"
+#include "file_digest.h"
 #include "film.h"
 #include "ratio.h"
 #include "log.h"
@@ -126,6 +127,12 @@ Writer::~Writer ()
 	if (!_text_only) {
 		terminate_thread (false);
 	}
+
+	boost::this_thread::disable_interruption dis;
+	_referenced_digests_thread.interrupt ();
+	try {
+		_referenced_digests_thread.join ();
+	} catch (...) {}
 }
 
 
@@ -188,7 +195,7 @@ Writer::repeat (Frame frame, Eyes eyes)
 {
 	boost::mutex::scoped_lock lock (_state_mutex);
 
-	while (_queue.size() > _maximum_queue_size && have_sequenced_image_at_queue_head()) {
+	while (_queue.size() > _maximum_queue_size && have_sequenced_image()) {
 		/* The queue is too big, and the main writer thread can run and fix it, so
 		   wake it and wait until it has done.
 		*/
@@ -220,7 +227,7 @@ Writer::fake_write (Frame frame, Eyes eyes)
 {
 	boost::mutex::scoped_lock lock (_state_mutex);
 
-	while (_queue.size() > _maximum_queue_size && have_sequenced_image_at_queue_head()) {
+	while (_queue.size() > _maximum_queue_size && have_sequenced_image()) {
 		/* The queue is too big, and the main writer thread can run and fix it, so
 		   wake it and wait until it has done.
 		*/
@@ -333,17 +340,37 @@ Writer::write (shared_ptr<const dcp::AtmosFrame> atmos, DCPTime time, AtmosMetad
 }
 
 
-/** Caller must hold a lock on _state_mutex */
-bool
-Writer::have_sequenced_image_at_queue_head ()
+/** Caller must hold a lock on _state_mutex.
+ *  @return The first item in the queue which is the next thing to write to its reel,
+ *  or _queue.end() if there is none.  Reels are written independently, so frames for a
+ *  later reel can be written while an earlier one is still waiting for something.
+ */
+std::list<QueueItem>::iterator
+Writer::sequenced_image ()
 {
-	if (_queue.empty ()) {
-		return false;
+	_queue.sort ();
+
+	/* The queue is sorted by reel, so only the first item for each reel can be next */
+	optional<size_t> reel;
+	for (auto i = _queue.begin(); i != _queue.end(); ++i) {
+		if (reel && *reel == i->reel) {
+			continue;
+		}
+		reel = i->reel;
+		if (_last_written[i->reel].next(*i)) {
+			return i;
+		}
 	}
 
-	_queue.sort ();
-	auto const & f = _queue.front();
-	return _last_written[f.reel].next(f);
+	return _queue.end();
+}
+
+
+/** Caller must hold a lock on _state_mutex */
+bool
+Writer::have_sequenced_image ()
+{
+	return sequenced_image() != _queue.end();
 }
 
 
@@ -389,7 +416,7 @@ try
 
 		while (true) {
 
-			if (_finish || _queued_full_in_memory > _maximum_frames_in_memory || have_sequenced_image_at_queue_head ()) {
+			if (_finish || _queued_full_in_memory > _maximum_frames_in_memory || have_sequenced_image ()) {
 				/* We've got something to do: go and do it */
 				break;
 			}
@@ -401,13 +428,13 @@ try
 		}
 
 		/* We stop here if we have been asked to finish, and if either the queue
-		   is empty or we do not have a sequenced image at its head (if this is the
+		   is empty or we do not have a sequenced image in it (if this is the
 		   case we will never terminate as no new frames will be sent once
 		   _finish is true).
 		*/
-		if (_finish && (!have_sequenced_image_at_queue_head() || _queue.empty())) {
+		if (_finish && (!have_sequenced_image() || _queue.empty())) {
 			/* (Hopefully temporarily) log anything that was not written */
-			if (!_queue.empty() && !have_sequenced_image_at_queue_head()) {
+			if (!_queue.empty() && !have_sequenced_image()) {
 				LOG_WARNING (N_("Finishing writer with a left-over queue of %1:"), _queue.size());
 				for (auto const& i: _queue) {
 					if (i.type == QueueItem::Type::FULL) {
@@ -421,10 +448,10 @@ try
 		}
 
 		/* Write any frames that we can write; i.e. those that are in sequence. */
-		while (have_sequenced_image_at_queue_head ()) {
-			auto qi = _queue.front ();
+		for (auto i = sequenced_image(); i != _queue.end(); i = sequenced_image()) {
+			auto qi = *i;
 			_last_written[qi.reel].update (qi);
-			_queue.pop_front ();
+			_queue.erase (i);
 			if (qi.type == QueueItem::Type::FULL && qi.encoded) {
 				--_queued_full_in_memory;
 			}
@@ -437,7 +464,8 @@ try
 			case QueueItem::Type::FULL:
 				LOG_DEBUG_ENCODE (N_("Writer FULL-writes %1 (%2)"), qi.frame, (int) qi.eyes);
 				if (!qi.encoded) {
-					qi.encoded.reset (new ArrayData(film()->j2c_path(qi.reel, qi.frame, qi.eyes, false)));
+					DCPOMATIC_ASSERT (_spill && qi.spilled);
+					qi.encoded = _spill->read (*qi.spilled);
 				}
 				reel.write (qi.encoded, qi.frame, qi.eyes);
 				++_full_written;
@@ -483,12 +511,13 @@ try
 
 			LOG_GENERAL ("Writer full; pushes %1 to disk while awaiting %2", i->frame, awaiting);
 
-			i->encoded->write_via_temp (
-				film()->j2c_path(i->reel, i->frame, i->eyes, true),
-				film()->j2c_path(i->reel, i->frame, i->eyes, false)
-				);
+			if (!_spill) {
+				_spill.reset (new SpillFile(film()->spill_path()));
+			}
+			auto const spilled = _spill->append (*i->encoded);
 
 			lock.lock ();
+			i->spilled = spilled;
 			i->encoded.reset ();
 			--_queued_full_in_memory;
 			_full_condition.notify_all ();
@@ -554,21 +583,30 @@ Writer::calculate_digests ()
 	for (auto& i: _reels) {
 		service.post (boost::bind (&ReelWriter::calculate_digests, &i, set_progress));
 	}
-	service.post (boost::bind (&Writer::calculate_referenced_digests, this, set_progress));
 
 	work.reset ();
 
 	try {
 		pool.join_all ();
+		/* Referenced assets started being hashed when write() was given them,
+		 * so this may well have finished already.
+		 */
+		if (_referenced_digests_thread.joinable()) {
+			_referenced_digests_thread.join ();
+		}
 	} catch (boost::thread_interrupted) {
 		/* join_all was interrupted, so we need to interrupt the threads
 		 * in our pool then try again to join them.
 		 */
 		pool.interrupt_all ();
 		pool.join_all ();
+		_referenced_digests_thread.interrupt ();
+		_referenced_digests_thread.join ();
 	}
 
 	service.stop ();
+
+	rethrow ();
 }
 
 
@@ -581,6 +619,11 @@ Writer::finish (boost::filesystem::path output_dcp)
 		terminate_thread (true);
 	}
 
+	if (_spill) {
+		LOG_GENERAL ("Spill file reached %1 bytes", _spill->maximum_length());
+		_spill.reset ();
+	}
+
 	LOG_GENERAL_NC ("Finishing ReelWriters");
 
 	for (auto& i: _reels) {
@@ -914,6 +957,26 @@ void
 Writer::write (ReferencedReelAsset asset)
 {
 	_reel_assets.push_back (asset);
+
+	auto file = dynamic_pointer_cast<dcp::ReelFileAsset>(asset.asset);
+	if (!file || file->hash()) {
+		return;
+	}
+
+	/* Start calculating the hash now so that it happens while we are encoding */
+	boost::mutex::scoped_lock lm (_referenced_digests_mutex);
+	_referenced_digests_pending.push_back (file);
+	if (!_referenced_digests_running) {
+		if (_referenced_digests_thread.joinable()) {
+			/* This has finished whatever it was doing */
+			_referenced_digests_thread.join ();
+		}
+		_referenced_digests_running = true;
+		_referenced_digests_thread = boost::thread (boost::bind(&Writer::calculate_referenced_digests, this));
+#ifdef DCPOMATIC_LINUX
+		pthread_setname_np (_referenced_digests_thread.native_handle(), "writer-digests");
+#endif
+	}
 }
 
 
@@ -951,22 +1014,39 @@ Writer::set_digest_progress (Job* job, float progress)
 }
 
 
-/** Calculate hashes for any referenced MXF assets which do not already have one */
+/** Thread to calculate hashes for referenced MXF assets which did not already have one */
 void
-Writer::calculate_referenced_digests (std::function<void (float)> set_progress)
-try
+Writer::calculate_referenced_digests ()
 {
-	for (auto const& i: _reel_assets) {
-		auto file = dynamic_pointer_cast<dcp::ReelFileAsset>(i.asset);
-		if (file && !file->hash()) {
-			file->asset_ref().asset()->hash (set_progress);
-			file->set_hash (file->asset_ref().asset()->hash());
+	try {
+		while (true) {
+			shared_ptr<dcp::ReelFileAsset> file;
+			{
+				boost::mutex::scoped_lock lm (_referenced_digests_mutex);
+				if (_referenced_digests_pending.empty()) {
+					_referenced_digests_running = false;
+					return;
+				}
+				file = _referenced_digests_pending.front ();
+				_referenced_digests_pending.pop_front ();
+			}
+
+			auto asset = file->asset_ref().asset();
+			DCPOMATIC_ASSERT (asset->file());
+			auto const hash = file_digest (*asset->file(), [](float) {
+				boost::this_thread::interruption_point ();
+			});
+			asset->set_hash (hash);
+			file->set_hash (hash);
 		}
+	} catch (boost::thread_interrupted) {
+		/* We are being destroyed or the job has been cancelled, so just give up */
+	} catch (...) {
+		store_current ();
 	}
-} catch (boost::thread_interrupted) {
-	/* set_progress contains an interruption_point, so any of these methods
-	 * may throw thread_interrupted, at which point we just give up.
-	 */
+
+	boost::mutex::scoped_lock lm (_referenced_digests_mutex);
+	_referenced_digests_running = false;
 }
 
 
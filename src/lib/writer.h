@@ -28,6 +28,7 @@
 #include "types.h"
 #include "player_text.h"
 #include "exception_store.h"
+#include "spill_file.h"
 #include "dcp_text_track.h"
 #include "weak_film.h"
 #include <dcp/atmos_frame.h>
@@ -38,6 +39,7 @@
 
 namespace dcp {
 	class Data;
+	class ReelFileAsset;
 }
 
 namespace dcpomatic {
@@ -67,8 +69,10 @@ public:
 		REPEAT,
 	} type;
 
-	/** encoded data for FULL */
+	/** encoded data for FULL, if it is in memory */
 	std::shared_ptr<const dcp::Data> encoded;
+	/** position of the encoded data for FULL in the Writer's spill file, if it is not in memory */
+	boost::optional<SpillFile::Extent> spilled;
 	/** size of data for FAKE */
 	int size = 0;
 	/** reel index */
@@ -124,11 +128,12 @@ public:
 private:
 	void thread ();
 	void terminate_thread (bool);
-	bool have_sequenced_image_at_queue_head ();
+	std::list<QueueItem>::iterator sequenced_image ();
+	bool have_sequenced_image ();
 	size_t video_reel (int frame) const;
 	void set_digest_progress (Job* job, float progress);
 	void write_cover_sheet (boost::filesystem::path output_dcp);
-	void calculate_referenced_digests (std::function<void (float)> set_progress);
+	void calculate_referenced_digests ();
 	void write_hanging_text (ReelWriter& reel);
 	void calculate_digests ();
 
@@ -192,6 +197,10 @@ private:
 	    due to the limit of frames to be held in memory.
 	*/
 	int _pushed_to_disk = 0;
+	/** file that FULL frames are pushed to, created the first time one is pushed;
+	 *  only used by the writer thread.
+	 */
+	std::unique_ptr<SpillFile> _spill;
 
 	bool _text_only;
 
@@ -200,6 +209,15 @@ private:
 
 	std::list<ReferencedReelAsset> _reel_assets;
 
+	/** mutex for _referenced_digests_pending and _referenced_digests_running */
+	boost::mutex _referenced_digests_mutex;
+	/** referenced assets whose hashes have yet to be calculated */
+	std::list<std::shared_ptr<dcp::ReelFileAsset>> _referenced_digests_pending;
+	/** true if _referenced_digests_thread is working through _referenced_digests_pending */
+	bool _referenced_digests_running = false;
+	/** thread to calculate hashes of referenced assets while we are encoding */
+	boost::thread _referenced_digests_thread;
+
 	std::vector<dcpomatic::FontData> _fonts;
 
 	/** true if any reel has any subtitles */
@@ -235,6 +235,11 @@ FilmViewer::recreate_butler ()
 		_butler->disable_audio ();
 	}
 
+	/* If we have not been told exactly what reduction to use, decode DCPs more coarsely
+	   than the display size would suggest if we can't otherwise keep up.
+	*/
+	_butler->set_adaptive_decode_reduction (!_dcp_decode_reduction);
+
 	_closed_captions_dialog->set_butler (_butler);
 
 	resume ();
@@ -702,6 +707,9 @@ FilmViewer::set_dcp_decode_reduction (optional<int> reduction)
 	if (_player) {
 		_player->set_dcp_decode_reduction (reduction);
 	}
+	if (_butler) {
+		_butler->set_adaptive_decode_reduction (!reduction);
+	}
 }
 
 
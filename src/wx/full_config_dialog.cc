@@ -110,6 +110,11 @@ private:
 		table->Add (_server_encoding_threads, wxGBPosition (r, 1));
 		++r;
 
+		add_label_to_sizer (table, _panel, _("Number of reels to decode at once when making a DCP"), true, wxGBPosition (r, 0));
+		_parallel_reels = new wxSpinCtrl (_panel);
+		table->Add (_parallel_reels, wxGBPosition (r, 1));
+		++r;
+
 		add_label_to_sizer (table, _panel, _("Configuration file"), true, wxGBPosition (r, 0));
 		_config_file = new FilePickerCtrl (_panel, _("Select configuration file"), "*.xml", true, false);
 		table->Add (_config_file, wxGBPosition (r, 1));
@@ -141,6 +146,8 @@ private:
 		_master_encoding_threads->Bind (wxEVT_SPINCTRL, boost::bind (&FullGeneralPage::master_encoding_threads_changed, this));
 		_server_encoding_threads->SetRange (1, 128);
 		_server_encoding_threads->Bind (wxEVT_SPINCTRL, boost::bind (&FullGeneralPage::server_encoding_threads_changed, this));
+		_parallel_reels->SetRange (1, 32);
+		_parallel_reels->Bind (wxEVT_SPINCTRL, boost::bind (&FullGeneralPage::parallel_reels_changed, this));
 		export_cinemas->Bind (wxEVT_BUTTON, boost::bind (&FullGeneralPage::export_cinemas_file, this));
 
 #ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
@@ -155,6 +162,7 @@ private:
 
 		checked_set (_master_encoding_threads, config->master_encoding_threads ());
 		checked_set (_server_encoding_threads, config->server_encoding_threads ());
+		checked_set (_parallel_reels, config->parallel_reels ());
 #ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
 		checked_set (_analyse_ebur128, config->analyse_ebur128 ());
 #endif
@@ -200,6 +208,11 @@ private:
 		Config::instance()->set_server_encoding_threads (_server_encoding_threads->GetValue());
 	}
 
+	void parallel_reels_changed ()
+	{
+		Config::instance()->set_parallel_reels (_parallel_reels->GetValue());
+	}
+
 	void config_file_changed ()
 	{
 		auto config = Config::instance();
@@ -233,6 +246,7 @@ private:
 
 	wxSpinCtrl* _master_encoding_threads;
 	wxSpinCtrl* _server_encoding_threads;
+	wxSpinCtrl* _parallel_reels;
 	FilePickerCtrl* _config_file;
 	FilePickerCtrl* _cinemas_file;
 #ifdef DCPOMATIC_HAVE_EBUR128_PATCHED_FFMPEG
@@ -1502,6 +1516,10 @@ private:
 		table->Add (_only_servers_encode, 1, wxEXPAND | wxALL);
 		table->AddSpacer (0);
 
+		_compress_frames_for_servers = new CheckBox (_panel, _("Compress frames sent to encoding servers"));
+		table->Add (_compress_frames_for_servers, 1, wxEXPAND | wxALL);
+		table->AddSpacer (0);
+
 		{
 			add_label_to_sizer (table, _panel, _("Maximum number of frames to store per thread"), true, 0, wxLEFT | wxRIGHT | wxALIGN_CENTRE_VERTICAL);
 			auto s = new wxBoxSizer (wxHORIZONTAL);
@@ -1510,6 +1528,23 @@ private:
 			table->Add (s, 1);
 		}
 
+		{
+			_use_j2k_cache = new CheckBox (_panel, _("Keep encoded frames for re-use in"));
+			table->Add (_use_j2k_cache, 0, wxALIGN_CENTRE_VERTICAL);
+			auto s = new wxBoxSizer (wxHORIZONTAL);
+#ifdef DCPOMATIC_USE_OWN_PICKER
+			_j2k_cache_directory = new DirPickerCtrl (_panel);
+#else
+			_j2k_cache_directory = new wxDirPickerCtrl (_panel, wxDD_DIR_MUST_EXIST);
+#endif
+			s->Add (_j2k_cache_directory, 1, wxEXPAND);
+			add_label_to_sizer (s, _panel, _("up to"), false, 0, wxLEFT | wxRIGHT | wxALIGN_CENTRE_VERTICAL);
+			_j2k_cache_size = new wxSpinCtrl (_panel);
+			s->Add (_j2k_cache_size);
+			add_label_to_sizer (s, _panel, _("GB"), false, 0, wxLEFT | wxALIGN_CENTRE_VERTICAL);
+			table->Add (s, 1, wxEXPAND);
+		}
+
 		{
 			auto format = create_label (_panel, _("DCP metadata filename format"), true);
 #ifdef DCPOMATIC_OSX
@@ -1599,7 +1634,12 @@ private:
 		_allow_96khz_audio->Bind (wxEVT_CHECKBOX, boost::bind(&AdvancedPage::allow_96khz_audio_changed, this));
 		_show_experimental_audio_processors->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::show_experimental_audio_processors_changed, this));
 		_only_servers_encode->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::only_servers_encode_changed, this));
+		_compress_frames_for_servers->Bind (wxEVT_CHECKBOX, boost::bind(&AdvancedPage::compress_frames_for_servers_changed, this));
 		_frames_in_memory_multiplier->Bind (wxEVT_SPINCTRL, boost::bind(&AdvancedPage::frames_in_memory_multiplier_changed, this));
+		_use_j2k_cache->Bind (wxEVT_CHECKBOX, boost::bind(&AdvancedPage::j2k_cache_directory_changed, this));
+		_j2k_cache_directory->Bind (wxEVT_DIRPICKER_CHANGED, boost::bind(&AdvancedPage::j2k_cache_directory_changed, this));
+		_j2k_cache_size->SetRange (1, 100000);
+		_j2k_cache_size->Bind (wxEVT_SPINCTRL, boost::bind(&AdvancedPage::j2k_cache_size_changed, this));
 		_dcp_metadata_filename_format->Changed.connect (boost::bind (&AdvancedPage::dcp_metadata_filename_format_changed, this));
 		_dcp_asset_filename_format->Changed.connect (boost::bind (&AdvancedPage::dcp_asset_filename_format_changed, this));
 		_log_general->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::log_changed, this));
@@ -1635,6 +1675,7 @@ private:
 		checked_set (_allow_96khz_audio, config->allow_96khz_audio());
 		checked_set (_show_experimental_audio_processors, config->show_experimental_audio_processors ());
 		checked_set (_only_servers_encode, config->only_servers_encode ());
+		checked_set (_compress_frames_for_servers, config->compress_frames_for_servers());
 		checked_set (_log_general, config->log_types() & LogEntry::TYPE_GENERAL);
 		checked_set (_log_warning, config->log_types() & LogEntry::TYPE_WARNING);
 		checked_set (_log_error, config->log_types() & LogEntry::TYPE_ERROR);
@@ -1646,6 +1687,13 @@ private:
 		checked_set (_log_debug_player, config->log_types() & LogEntry::TYPE_DEBUG_PLAYER);
 		checked_set (_log_debug_audio_analysis, config->log_types() & LogEntry::TYPE_DEBUG_AUDIO_ANALYSIS);
 		checked_set (_frames_in_memory_multiplier, config->frames_in_memory_multiplier());
+		checked_set (_use_j2k_cache, static_cast<bool>(config->j2k_cache_directory()));
+		if (config->j2k_cache_directory()) {
+			_j2k_cache_directory->SetPath (std_to_wx(config->j2k_cache_directory()->string()));
+		}
+		checked_set (_j2k_cache_size, config->j2k_cache_size());
+		_j2k_cache_directory->Enable (_use_j2k_cache->GetValue());
+		_j2k_cache_size->Enable (_use_j2k_cache->GetValue());
 #ifdef DCPOMATIC_WINDOWS
 		checked_set (_win32_console, config->win32_console());
 #endif
@@ -1670,6 +1718,23 @@ private:
 		Config::instance()->set_frames_in_memory_multiplier(_frames_in_memory_multiplier->GetValue());
 	}
 
+	void j2k_cache_directory_changed ()
+	{
+		auto const path = wx_to_std (_j2k_cache_directory->GetPath());
+		if (_use_j2k_cache->GetValue() && !path.empty()) {
+			Config::instance()->set_j2k_cache_directory (path);
+		} else {
+			Config::instance()->unset_j2k_cache_directory ();
+		}
+		_j2k_cache_directory->Enable (_use_j2k_cache->GetValue());
+		_j2k_cache_size->Enable (_use_j2k_cache->GetValue());
+	}
+
+	void j2k_cache_size_changed ()
+	{
+		Config::instance()->set_j2k_cache_size (_j2k_cache_size->GetValue());
+	}
+
 	void allow_any_dcp_frame_rate_changed ()
 	{
 		Config::instance()->set_allow_any_dcp_frame_rate(_allow_any_dcp_frame_rate->GetValue());
@@ -1695,6 +1760,11 @@ private:
 		Config::instance()->set_only_servers_encode (_only_servers_encode->GetValue());
 	}
 
+	void compress_frames_for_servers_changed ()
+	{
+		Config::instance()->set_compress_frames_for_servers (_compress_frames_for_servers->GetValue());
+	}
+
 	void dcp_metadata_filename_format_changed ()
 	{
 		Config::instance()->set_dcp_metadata_filename_format(_dcp_metadata_filename_format->get());
@@ -1751,11 +1821,19 @@ private:
 	wxSpinCtrl* _maximum_j2k_bandwidth = nullptr;
 	wxChoice* _video_display_mode = nullptr;
 	wxSpinCtrl* _frames_in_memory_multiplier = nullptr;
+	wxCheckBox* _use_j2k_cache = nullptr;
+#ifdef DCPOMATIC_USE_OWN_PICKER
+	DirPickerCtrl* _j2k_cache_directory = nullptr;
+#else
+	wxDirPickerCtrl* _j2k_cache_directory = nullptr;
+#endif
+	wxSpinCtrl* _j2k_cache_size = nullptr;
 	wxCheckBox* _allow_any_dcp_frame_rate = nullptr;
 	wxCheckBox* _allow_any_container = nullptr;
 	wxCheckBox* _allow_96khz_audio = nullptr;
 	wxCheckBox* _show_experimental_audio_processors = nullptr;
 	wxCheckBox* _only_servers_encode = nullptr;
+	wxCheckBox* _compress_frames_for_servers = nullptr;
 	NameFormatEditor* _dcp_metadata_filename_format = nullptr;
 	NameFormatEditor* _dcp_asset_filename_format = nullptr;
 	wxCheckBox* _log_general = nullptr;
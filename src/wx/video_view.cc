@@ -24,6 +24,7 @@
 #include "film_viewer.h"
 #include "lib/butler.h"
 #include "lib/dcpomatic_log.h"
+#include "lib/slice_pool.h"
 #include <boost/optional.hpp>
 #include <sys/time.h>
 
@@ -153,6 +154,11 @@ VideoView::reset_metadata (shared_ptr<const Film> film, dcp::Size player_video_c
 void
 VideoView::add_dropped ()
 {
+	auto butler = _viewer->butler ();
+	if (butler) {
+		butler->video_dropped ();
+	}
+
 	bool too_many = false;
 
 	{
@@ -174,6 +180,18 @@ VideoView::add_dropped ()
 }
 
 
+/** @return Number of slices to split the work of making an image into.  When we are
+ *  playing, the butler is preparing frames in the background and we should keep out of
+ *  its way; otherwise (e.g. after a seek) we are waiting for this one frame, and we can
+ *  use all our cores on it.
+ */
+int
+VideoView::image_slices () const
+{
+	return _viewer->playing() ? 1 : SlicePool::instance()->threads();
+}
+
+
 wxColour
 VideoView::pad_colour () const
 {
@@ -140,6 +140,7 @@ protected:
 	dcpomatic::DCPTime one_video_frame () const;
 
 	wxColour pad_colour () const;
+	int image_slices () const;
 
 	wxColour outline_content_colour () const {
 		return wxColour(255, 0, 0);
@@ -0,0 +1,220 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  test/alpha_blend_test.cc
+ *  @brief Test the alpha blending kernels, and time Image::alpha_blend.
+ *  @ingroup selfcontained
+ *  @see test/image_test.cc
+ */
+
+
+#include "lib/alpha_blend.h"
+#include "lib/image.h"
+#include "lib/util.h"
+#include <boost/test/unit_test.hpp>
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+#include <cstring>
+#include <vector>
+
+
+using std::make_shared;
+using std::vector;
+using namespace dcpomatic;
+
+
+static void
+random_fill (vector<uint8_t>& data)
+{
+	for (auto& i: data) {
+		i = rand() & 0xff;
+	}
+}
+
+
+/** Make a BGRA or RGBA overlay which is mostly either transparent or opaque, like a subtitle */
+static vector<uint8_t>
+random_overlay (int pixels)
+{
+	vector<uint8_t> overlay (pixels * 4);
+	random_fill (overlay);
+	for (int i = 0; i < pixels; ++i) {
+		switch (rand() % 3) {
+		case 0:
+			overlay[i * 4 + 3] = 0;
+			break;
+		case 1:
+			overlay[i * 4 + 3] = 255;
+			break;
+		}
+	}
+	return overlay;
+}
+
+
+/** Check the kernels against alpha_blend_sample() with every row length up to a
+ *  few times the SIMD width, so that the ends of rows are tested too.
+ */
+BOOST_AUTO_TEST_CASE (alpha_blend_kernels_test)
+{
+	srand (1);
+
+	for (int pixels = 0; pixels < 40; ++pixels) {
+		auto const overlay = random_overlay (pixels);
+
+		for (auto bgra: { false, true }) {
+			int const red = bgra ? 2 : 0;
+			int const blue = bgra ? 0 : 2;
+
+			/* RGB24 */
+			vector<uint8_t> rgb24 (pixels * 3);
+			random_fill (rgb24);
+			auto check = rgb24;
+			alpha_blend_packed_row (rgb24.data(), PackedBlendTarget::RGB24, overlay.data(), bgra, pixels);
+			for (int i = 0; i < pixels; ++i) {
+				auto const o = overlay.data() + i * 4;
+				BOOST_REQUIRE_EQUAL (rgb24[i * 3 + 0], alpha_blend_sample<uint8_t>(check[i * 3 + 0], o[red], o[3]));
+				BOOST_REQUIRE_EQUAL (rgb24[i * 3 + 1], alpha_blend_sample<uint8_t>(check[i * 3 + 1], o[1], o[3]));
+				BOOST_REQUIRE_EQUAL (rgb24[i * 3 + 2], alpha_blend_sample<uint8_t>(check[i * 3 + 2], o[blue], o[3]));
+			}
+
+			/* BGRA */
+			vector<uint8_t> bgra_target (pixels * 4);
+			random_fill (bgra_target);
+			check = bgra_target;
+			alpha_blend_packed_row (bgra_target.data(), PackedBlendTarget::BGRA, overlay.data(), bgra, pixels);
+			for (int i = 0; i < pixels; ++i) {
+				auto const o = overlay.data() + i * 4;
+				BOOST_REQUIRE_EQUAL (bgra_target[i * 4 + 0], alpha_blend_sample<uint8_t>(check[i * 4 + 0], o[blue], o[3]));
+				BOOST_REQUIRE_EQUAL (bgra_target[i * 4 + 1], alpha_blend_sample<uint8_t>(check[i * 4 + 1], o[1], o[3]));
+				BOOST_REQUIRE_EQUAL (bgra_target[i * 4 + 2], alpha_blend_sample<uint8_t>(check[i * 4 + 2], o[red], o[3]));
+				BOOST_REQUIRE_EQUAL (bgra_target[i * 4 + 3], alpha_blend_sample<uint8_t>(check[i * 4 + 3], o[3], o[3]));
+			}
+
+			/* RGB48LE, where only the high bytes are blended */
+			vector<uint8_t> rgb48 (pixels * 6);
+			random_fill (rgb48);
+			check = rgb48;
+			alpha_blend_packed_row (rgb48.data(), PackedBlendTarget::RGB48LE, overlay.data(), bgra, pixels);
+			for (int i = 0; i < pixels; ++i) {
+				auto const o = overlay.data() + i * 4;
+				BOOST_REQUIRE_EQUAL (rgb48[i * 6 + 0], check[i * 6 + 0]);
+				BOOST_REQUIRE_EQUAL (rgb48[i * 6 + 1], alpha_blend_sample<uint8_t>(check[i * 6 + 1], o[red], o[3]));
+				BOOST_REQUIRE_EQUAL (rgb48[i * 6 + 2], check[i * 6 + 2]);
+				BOOST_REQUIRE_EQUAL (rgb48[i * 6 + 3], alpha_blend_sample<uint8_t>(check[i * 6 + 3], o[1], o[3]));
+				BOOST_REQUIRE_EQUAL (rgb48[i * 6 + 4], check[i * 6 + 4]);
+				BOOST_REQUIRE_EQUAL (rgb48[i * 6 + 5], alpha_blend_sample<uint8_t>(check[i * 6 + 5], o[blue], o[3]));
+			}
+		}
+
+		vector<uint16_t> alpha (pixels * 2);
+		alpha_blend_extract_alpha (overlay.data(), pixels, alpha.data());
+		for (int i = 0; i < pixels; ++i) {
+			BOOST_REQUIRE_EQUAL (alpha[i], overlay[i * 4 + 3]);
+		}
+		for (int i = pixels; i < pixels * 2; ++i) {
+			alpha[i] = rand() & 0xff;
+		}
+
+		/* 8-bit planar, and chroma with two pixels per sample */
+		vector<uint8_t> plane8 (pixels);
+		vector<uint8_t> overlay8 (pixels * 2);
+		random_fill (plane8);
+		random_fill (overlay8);
+		auto check8 = plane8;
+		alpha_blend_planar_row (plane8.data(), overlay8.data(), alpha.data(), pixels);
+		for (int i = 0; i < pixels; ++i) {
+			BOOST_REQUIRE_EQUAL (plane8[i], alpha_blend_sample<uint8_t>(check8[i], overlay8[i], alpha[i]));
+		}
+		check8 = plane8;
+		alpha_blend_chroma_row (plane8.data(), overlay8.data(), overlay8.data() + pixels, alpha.data(), pixels);
+		for (int i = 0; i < pixels; ++i) {
+			auto const even = alpha_blend_sample<uint8_t>(check8[i], overlay8[i], alpha[i * 2]);
+			BOOST_REQUIRE_EQUAL (plane8[i], alpha_blend_sample<uint8_t>(even, overlay8[pixels + i], alpha[i * 2 + 1]));
+		}
+
+		/* 16-bit planar, using the whole range */
+		vector<uint16_t> plane16 (pixels);
+		vector<uint16_t> overlay16 (pixels * 2);
+		for (auto& i: plane16) {
+			i = rand() & 0xffff;
+		}
+		for (auto& i: overlay16) {
+			i = rand() & 0xffff;
+		}
+		auto check16 = plane16;
+		alpha_blend_planar_row (plane16.data(), overlay16.data(), alpha.data(), pixels);
+		for (int i = 0; i < pixels; ++i) {
+			BOOST_REQUIRE_EQUAL (plane16[i], alpha_blend_sample<uint16_t>(check16[i], overlay16[i], alpha[i]));
+		}
+		check16 = plane16;
+		alpha_blend_chroma_row (plane16.data(), overlay16.data(), overlay16.data() + pixels, alpha.data(), pixels);
+		for (int i = 0; i < pixels; ++i) {
+			auto const even = alpha_blend_sample<uint16_t>(check16[i], overlay16[i], alpha[i * 2]);
+			BOOST_REQUIRE_EQUAL (plane16[i], alpha_blend_sample<uint16_t>(even, overlay16[pixels + i], alpha[i * 2 + 1]));
+		}
+	}
+}
+
+
+/** Time Image::alpha_blend of two lines of subtitles onto a 4K frame in each of
+ *  the formats that it supports.  This checks nothing; it is here to make it easy
+ *  to see the effect of changes to the blending code, so it is disabled by default.
+ *  Run it with --run_test=alpha_blend_benchmark --log_level=message to see the results.
+ */
+BOOST_AUTO_TEST_CASE (alpha_blend_benchmark, * boost::unit_test::disabled())
+{
+	/* Something like two lines of subtitles: opaque text, anti-aliased edges and plenty of gaps */
+	auto overlay = make_shared<Image>(AV_PIX_FMT_BGRA, dcp::Size(2800, 260), Image::Alignment::PADDED);
+	overlay->make_transparent ();
+	for (int y = 0; y < overlay->size().height; ++y) {
+		if (y % 130 < 20 || y % 130 > 110) {
+			continue;
+		}
+		auto p = overlay->data()[0] + y * overlay->stride()[0];
+		for (int x = 100; x < overlay->size().width - 100; ++x) {
+			if (x % 40 < 30) {
+				p[x * 4 + 0] = p[x * 4 + 1] = p[x * 4 + 2] = 255;
+				p[x * 4 + 3] = (x % 40 == 0 || x % 40 == 29) ? 128 : 255;
+			}
+		}
+	}
+
+	int const N = 20;
+
+	for (auto format: { AV_PIX_FMT_RGB24, AV_PIX_FMT_BGRA, AV_PIX_FMT_RGBA, AV_PIX_FMT_RGB48LE, AV_PIX_FMT_XYZ12LE, AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P10, AV_PIX_FMT_YUV422P10LE }) {
+		auto frame = make_shared<Image>(format, dcp::Size(3996, 2160), Image::Alignment::PADDED);
+		for (int c = 0; c < frame->planes(); ++c) {
+			memset (frame->data()[c], 0, frame->sample_size(c).height * frame->stride()[c]);
+		}
+
+		struct timeval start;
+		gettimeofday (&start, 0);
+		for (int i = 0; i < N; ++i) {
+			frame->alpha_blend (overlay, Position<int>(598, 1800));
+		}
+		struct timeval end;
+		gettimeofday (&end, 0);
+
+		BOOST_TEST_MESSAGE ("alpha_blend onto " << av_get_pix_fmt_name(format) << ": " << ((seconds(end) - seconds(start)) * 1000 / N) << "ms");
+	}
+}
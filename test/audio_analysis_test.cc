@@ -29,17 +29,23 @@
 
 #include "test.h"
 #include "lib/analyse_audio_job.h"
+#include "lib/audio_analyser.h"
 #include "lib/audio_analysis.h"
+#include "lib/audio_analysis_blocks.h"
 #include "lib/audio_content.h"
+#include "lib/config.h"
 #include "lib/content_factory.h"
 #include "lib/dcp_content_type.h"
+#include "lib/exceptions.h"
 #include "lib/ffmpeg_content.h"
 #include "lib/ffmpeg_content.h"
 #include "lib/film.h"
 #include "lib/job_manager.h"
+#include "lib/player.h"
 #include "lib/playlist.h"
 #include "lib/ratio.h"
 #include <boost/test/unit_test.hpp>
+#include <fstream>
 #include <iostream>
 
 
@@ -100,6 +106,56 @@ BOOST_AUTO_TEST_CASE (audio_analysis_serialisation_test)
 }
 
 
+/** Check that points are written and read back exactly, and that an old (XML) or
+ *  truncated analysis gives OldFormatError so that it will be made again.
+ */
+BOOST_AUTO_TEST_CASE (audio_analysis_binary_format_test)
+{
+	int const channels = 16;
+	int const points = 1025;
+
+	AudioAnalysis a (channels);
+	for (int i = 0; i < channels; ++i) {
+		for (int j = 0; j < points; ++j) {
+			AudioPoint p;
+			p[AudioPoint::PEAK] = float(rand()) / RAND_MAX;
+			p[AudioPoint::RMS] = -float(rand()) / RAND_MAX;
+			a.add_point (i, p);
+		}
+	}
+	a.set_samples_per_point (100);
+	a.set_sample_rate (48000);
+	a.set_leqm (82.5);
+	a.set_frames (102400);
+
+	boost::filesystem::path const path = "build/test/audio_analysis_binary_format_test";
+	a.write (path);
+
+	AudioAnalysis b (path);
+	BOOST_REQUIRE_EQUAL (b.channels(), channels);
+	for (int i = 0; i < channels; ++i) {
+		BOOST_REQUIRE_EQUAL (b.points(i), points);
+		for (int j = 0; j < points; ++j) {
+			BOOST_REQUIRE_EQUAL (a.get_point(i, j)[AudioPoint::PEAK], b.get_point(i, j)[AudioPoint::PEAK]);
+			BOOST_REQUIRE_EQUAL (a.get_point(i, j)[AudioPoint::RMS], b.get_point(i, j)[AudioPoint::RMS]);
+		}
+	}
+	BOOST_CHECK_EQUAL (b.samples_per_point(), 100);
+	BOOST_CHECK_EQUAL (b.sample_rate(), 48000);
+	BOOST_CHECK_CLOSE (b.leqm().get_value_or(0), 82.5, 1e-6);
+	BOOST_CHECK_EQUAL (b.frames().get_value_or(0), 102400);
+
+	boost::filesystem::resize_file (path, boost::filesystem::file_size(path) - 4);
+	BOOST_CHECK_THROW (make_shared<AudioAnalysis>(path), OldFormatError);
+
+	{
+		std::ofstream f (path.string().c_str());
+		f << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<AudioAnalysis><Version>3</Version></AudioAnalysis>\n";
+	}
+	BOOST_CHECK_THROW (make_shared<AudioAnalysis>(path), OldFormatError);
+}
+
+
 BOOST_AUTO_TEST_CASE (audio_analysis_test)
 {
 	auto film = new_test_film ("audio_analysis_test");
@@ -219,3 +275,78 @@ BOOST_AUTO_TEST_CASE (analyse_audio_leqm_test)
 	/* The CLI tool of leqm_nrt gives this value for betty_stereo_48k.wav */
 	BOOST_CHECK_CLOSE (analysis.leqm().get_value_or(0), 88.276, 0.001);
 }
+
+
+/** Check that an analysis of several pieces of content made from analyses of each
+ *  one is close to one made in a single pass, and that moving content re-uses the
+ *  analyses that we already have.
+ */
+BOOST_AUTO_TEST_CASE (audio_analysis_blocks_test)
+{
+	Config::instance()->set_analyse_ebur128 (false);
+
+	auto white = content_factory("test/data/white.wav").front();
+	auto sine = content_factory("test/data/sine_440.wav").front();
+	auto film = new_test_film2 ("audio_analysis_blocks_test", { white, sine });
+	sine->set_position (film, white->end(film) + DCPTime::from_seconds(1));
+	BOOST_REQUIRE (can_assemble_audio_analysis(film, film->playlist()));
+
+	auto analyse = [film]() {
+		JobManager::instance()->add (make_shared<AnalyseAudioJob>(film, film->playlist(), true));
+		BOOST_REQUIRE (!wait_for_jobs());
+		return AudioAnalysis (film->audio_analysis_path(film->playlist()));
+	};
+
+	auto assembled = analyse ();
+	auto const sine_block = film->audio_analysis_block_path(sine);
+	BOOST_REQUIRE (boost::filesystem::exists(film->audio_analysis_block_path(white)));
+	BOOST_REQUIRE (boost::filesystem::exists(sine_block));
+
+	AudioAnalyser analyser (film, film->playlist(), true, [](float) {});
+	auto player = make_shared<Player>(film, film->playlist());
+	player->set_ignore_video ();
+	player->set_ignore_text ();
+	player->Audio.connect ([&analyser](shared_ptr<AudioBuffers> audio, DCPTime time, int) {
+		analyser.analyse (audio, time);
+	});
+	while (!player->pass()) {}
+	analyser.finish ();
+	auto reference = analyser.get ();
+
+	BOOST_REQUIRE_EQUAL (assembled.channels(), reference.channels());
+	for (int i = 0; i < reference.channels(); ++i) {
+		BOOST_CHECK_EQUAL (assembled.sample_peak()[i].peak, reference.sample_peak()[i].peak);
+		BOOST_CHECK (assembled.sample_peak()[i].time == reference.sample_peak()[i].time);
+		BOOST_REQUIRE (std::abs(assembled.points(i) - reference.points(i)) <= 1);
+		for (int j = 0; j < std::min(assembled.points(i), reference.points(i)); ++j) {
+			BOOST_CHECK_CLOSE (assembled.get_point(i, j)[AudioPoint::PEAK], reference.get_point(i, j)[AudioPoint::PEAK], 15);
+			BOOST_CHECK_CLOSE (assembled.get_point(i, j)[AudioPoint::RMS], reference.get_point(i, j)[AudioPoint::RMS], 15);
+		}
+	}
+	BOOST_CHECK_CLOSE (assembled.leqm().get_value_or(0), reference.leqm().get_value_or(1), 0.1);
+
+	/* Doctor the sine's block so that we can see that it is used after the sine is moved */
+	AudioAnalysis block (sine_block);
+	vector<AudioAnalysis::PeakTime> peaks (film->audio_channels(), AudioAnalysis::PeakTime(2, DCPTime()));
+	block.set_sample_peak (peaks);
+	block.write (sine_block);
+
+	sine->set_position (film, sine->position() + DCPTime::from_seconds(2));
+	BOOST_REQUIRE (film->audio_analysis_block_path(sine) == sine_block);
+
+	auto moved = analyse ();
+	for (auto i: moved.sample_peak()) {
+		BOOST_CHECK_EQUAL (i.peak, 2);
+		BOOST_CHECK (i.time == sine->position());
+	}
+
+	/* Changing the sine's gain needs a new block, and the old one should be removed */
+	sine->audio->set_gain (-3);
+	BOOST_REQUIRE (film->audio_analysis_block_path(sine) != sine_block);
+	analyse ();
+	BOOST_CHECK (boost::filesystem::exists(film->audio_analysis_block_path(sine)));
+	BOOST_CHECK (boost::filesystem::exists(film->audio_analysis_block_path(white)));
+	BOOST_CHECK (!boost::filesystem::exists(sine_block));
+
+	Config::instance()->set_analyse_ebur128 (true);
+}
@@ -23,11 +23,17 @@
  *  @ingroup selfcontained
  */
 
+#include <algorithm>
 #include <cmath>
 #include <boost/test/unit_test.hpp>
+#include "lib/audio_buffer_pool.h"
 #include "lib/audio_buffers.h"
+#include "lib/audio_kernels.h"
+#include <vector>
 
 using std::pow;
+using std::vector;
+using namespace dcpomatic;
 
 static float tolerance = 1e-3;
 
@@ -344,3 +350,122 @@ BOOST_AUTO_TEST_CASE (audio_buffers_trim_start)
        }
 }
 
+
+
+BOOST_AUTO_TEST_CASE (audio_buffers_alignment_test)
+{
+	for (int frames = 0; frames < 100; ++frames) {
+		AudioBuffers a (6, frames);
+		for (int i = 0; i < 6; ++i) {
+			BOOST_REQUIRE_EQUAL (reinterpret_cast<uintptr_t>(a.data(i)) % AudioBufferPool::alignment, 0U);
+		}
+	}
+}
+
+
+/** Shrinking some buffers and then growing them again should give silence in the new space */
+BOOST_AUTO_TEST_CASE (audio_buffers_shrink_grow_test)
+{
+	AudioBuffers a (3, 400);
+	srand (4);
+	random_fill (a);
+
+	a.set_frames (100);
+	a.set_frames (300);
+
+	srand (4);
+	random_check (a, 0, 100);
+	for (int i = 100; i < 300; ++i) {
+		for (int c = 0; c < 3; ++c) {
+			BOOST_REQUIRE_EQUAL (a.data(c)[i], 0);
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE (audio_buffers_pool_test)
+{
+	auto pool = AudioBufferPool::instance ();
+	pool->clear ();
+
+	auto const hits = pool->hits ();
+	{
+		AudioBuffers a (16, 2000);
+	}
+	BOOST_CHECK (pool->resident() > 0);
+	{
+		/* This should re-use the block from the last one */
+		AudioBuffers b (16, 1999);
+	}
+	BOOST_CHECK_EQUAL (pool->hits(), hits + 1);
+
+	pool->clear ();
+	BOOST_CHECK_EQUAL (pool->resident(), 0U);
+}
+
+
+/** Check the kernels against simple loops, with every length up to a few times the SIMD width */
+BOOST_AUTO_TEST_CASE (audio_kernels_test)
+{
+	srand (9);
+
+	for (int samples = 0; samples < 40; ++samples) {
+		vector<float> target (samples);
+		vector<float> source (samples);
+		for (int i = 0; i < samples; ++i) {
+			target[i] = random_float() * 2 - 1;
+			source[i] = random_float() * 2 - 1;
+		}
+
+		auto check = target;
+		audio_apply_gain (target.data(), 0.3, samples);
+		for (int i = 0; i < samples; ++i) {
+			check[i] *= 0.3f;
+			BOOST_REQUIRE_EQUAL (target[i], check[i]);
+		}
+
+		audio_accumulate (target.data(), source.data(), samples);
+		for (int i = 0; i < samples; ++i) {
+			check[i] += source[i];
+			BOOST_REQUIRE_EQUAL (target[i], check[i]);
+		}
+
+		audio_accumulate (target.data(), source.data(), 0.7, samples);
+		for (int i = 0; i < samples; ++i) {
+			check[i] += source[i] * 0.7f;
+			BOOST_REQUIRE_EQUAL (target[i], check[i]);
+		}
+
+		vector<int16_t> in16 (samples);
+		vector<int32_t> in32 (samples);
+		for (int i = 0; i < samples; ++i) {
+			in16[i] = i == 0 ? INT16_MIN : (i == 1 ? INT16_MAX : rand());
+			in32[i] = i == 0 ? INT32_MIN : (i == 1 ? INT32_MAX : rand() * (i % 2 ? 1 : -1));
+		}
+		vector<float> out (samples);
+		audio_convert (in16.data(), out.data(), samples);
+		for (int i = 0; i < samples; ++i) {
+			BOOST_REQUIRE_EQUAL (out[i], static_cast<float>(in16[i]) / (1 << 15));
+		}
+		audio_convert (in32.data(), out.data(), samples);
+		for (int i = 0; i < samples; ++i) {
+			BOOST_REQUIRE_EQUAL (out[i], static_cast<float>(in32[i]) / 2147483648);
+		}
+
+		if (samples > 2) {
+			source[2] = 0;
+		}
+		float peak;
+		double sum_of_squares;
+		audio_peak_and_power (source.data(), samples, 1e-6, peak, sum_of_squares);
+		float check_peak = 1e-6;
+		double check_sum_of_squares = 0;
+		for (int i = 0; i < samples; ++i) {
+			auto const s = std::max(fabsf(source[i]), 1e-6f);
+			check_peak = std::max(check_peak, s);
+			check_sum_of_squares += static_cast<double>(s) * s;
+		}
+		BOOST_REQUIRE_EQUAL (peak, check_peak);
+		BOOST_REQUIRE_SMALL (sum_of_squares - check_sum_of_squares, 1e-12);
+	}
+}
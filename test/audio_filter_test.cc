@@ -28,10 +28,12 @@
 #include <boost/test/unit_test.hpp>
 #include "lib/audio_filter.h"
 #include "lib/audio_buffers.h"
+#include <vector>
 
 
 using std::make_shared;
 using std::shared_ptr;
+using std::vector;
 
 
 static void
@@ -49,7 +51,7 @@ audio_filter_impulse_test_one (AudioFilter& f, int block_size, int num_blocks)
 		auto out = f.run (in);
 
 		for (int j = 0; j < out->frames(); ++j) {
-			BOOST_CHECK_EQUAL (out->data()[0][j], c + j);
+			BOOST_CHECK_SMALL (out->data()[0][j] - (c + j), 1e-4f);
 		}
 
 		c += block_size;
@@ -64,7 +66,7 @@ BOOST_AUTO_TEST_CASE (audio_filter_impulse_kernel_test)
 {
 	AudioFilter f (0.02);
 
-	f._ir.reserve(f._M + 1);
+	f._ir.resize(f._M + 1);
 	f._ir[0] = 1;
 	for (int i = 1; i <= f._M; ++i) {
 		f._ir[i] = 0;
@@ -77,7 +79,8 @@ BOOST_AUTO_TEST_CASE (audio_filter_impulse_kernel_test)
 
 
 /** Create filters and pass them impulses as input and check that
- *  the filter kernels comes back.
+ *  the filter kernels comes back (to within the rounding errors of
+ *  FFT convolution).
  */
 BOOST_AUTO_TEST_CASE (audio_filter_impulse_input_test)
 {
@@ -90,9 +93,9 @@ BOOST_AUTO_TEST_CASE (audio_filter_impulse_input_test)
 	auto out = lpf.run (in);
 	for (int j = 0; j < out->frames(); ++j) {
 		if (j <= lpf._M) {
-			BOOST_CHECK_EQUAL (out->data(0)[j], lpf._ir[j]);
+			BOOST_CHECK_SMALL (out->data(0)[j] - lpf._ir[j], 1e-6f);
 		} else {
-			BOOST_CHECK_EQUAL (out->data(0)[j], 0);
+			BOOST_CHECK_SMALL (out->data(0)[j], 1e-6f);
 		}
 	}
 
@@ -105,9 +108,55 @@ BOOST_AUTO_TEST_CASE (audio_filter_impulse_input_test)
 	out = hpf.run (in);
 	for (int j = 0; j < out->frames(); ++j) {
 		if (j <= hpf._M) {
-			BOOST_CHECK_EQUAL (out->data(0)[j], hpf._ir[j]);
+			BOOST_CHECK_SMALL (out->data(0)[j] - hpf._ir[j], 1e-6f);
 		} else {
-			BOOST_CHECK_EQUAL (out->data(0)[j], 0);
+			BOOST_CHECK_SMALL (out->data(0)[j], 1e-6f);
+		}
+	}
+}
+
+
+/** Check filters which use FFT convolution, and some which don't, against a direct
+ *  convolution, with a few channels and various block sizes.
+ */
+BOOST_AUTO_TEST_CASE (audio_filter_fft_test)
+{
+	srand (1);
+
+	for (auto bandwidth: { 0.2f, 0.02f, 0.005f }) {
+		BandPassAudioFilter f (bandwidth, 0.1, 0.3);
+		BOOST_CHECK_EQUAL (f._fft_size, 0);
+
+		int const channels = 3;
+		vector<vector<float>> input (channels);
+		vector<vector<float>> output (channels);
+
+		for (auto block: { 1, 17, 300, 4096, 2 }) {
+			auto in = make_shared<AudioBuffers>(channels, block);
+			for (int c = 0; c < channels; ++c) {
+				for (int i = 0; i < block; ++i) {
+					in->data(c)[i] = float(rand()) / RAND_MAX - 0.5;
+					input[c].push_back (in->data(c)[i]);
+				}
+			}
+			auto out = f.run (in);
+			for (int c = 0; c < channels; ++c) {
+				for (int i = 0; i < block; ++i) {
+					output[c].push_back (out->data(c)[i]);
+				}
+			}
+		}
+
+		BOOST_CHECK_EQUAL (f._fft_size > 0, f._M + 1 >= AudioFilter::fft_threshold);
+
+		for (int c = 0; c < channels; ++c) {
+			for (int i = 0; i < static_cast<int>(input[c].size()); ++i) {
+				double s = 0;
+				for (int k = 0; k <= f._M && k <= i; ++k) {
+					s += input[c][i - k] * f._ir[k];
+				}
+				BOOST_REQUIRE_SMALL (output[c][i] - s, 1e-5);
+			}
 		}
 	}
 }
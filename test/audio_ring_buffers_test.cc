@@ -19,6 +19,7 @@
 */
 
 #include "lib/audio_ring_buffers.h"
+#include "lib/exceptions.h"
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 
@@ -192,3 +193,50 @@ BOOST_AUTO_TEST_CASE (audio_ring_buffers_test3)
 	BOOST_CHECK (!rb.get(buffer, 2, 240));
 	BOOST_CHECK_EQUAL (buffer[240 * 2], CANARY);
 }
+
+/** Wrap round the end of a small ring several times, checking data and times */
+BOOST_AUTO_TEST_CASE (audio_ring_buffers_test4)
+{
+	AudioRingBuffers rb (128);
+	BOOST_CHECK_EQUAL (rb.capacity(), 128);
+
+	int put_value = 0;
+	int get_value = 0;
+	Frame position = 0;
+	float buffer[64 * 2];
+
+	for (int i = 0; i < 20; ++i) {
+		shared_ptr<AudioBuffers> data (new AudioBuffers (2, 37));
+		for (int j = 0; j < 37; ++j) {
+			data->data(0)[j] = put_value;
+			data->data(1)[j] = -put_value;
+			++put_value;
+		}
+		rb.put (data, DCPTime::from_frames(position + rb.size(), 48000), 48000);
+
+		int const frames = 30 + i % 8;
+		BOOST_REQUIRE (*rb.get(buffer, 2, frames) == DCPTime::from_frames(position, 48000));
+		for (int j = 0; j < frames; ++j) {
+			BOOST_REQUIRE_EQUAL (buffer[j * 2], get_value);
+			BOOST_REQUIRE_EQUAL (buffer[j * 2 + 1], -get_value);
+			++get_value;
+		}
+		position += frames;
+		BOOST_REQUIRE_EQUAL (rb.size(), put_value - get_value);
+		BOOST_REQUIRE (*rb.peek() == DCPTime::from_frames(position, 48000));
+	}
+
+	/* After a clear() we can start again at a different time */
+	rb.clear ();
+	BOOST_CHECK_EQUAL (rb.size(), 0);
+	BOOST_CHECK (!rb.peek());
+	shared_ptr<AudioBuffers> data (new AudioBuffers (2, 64));
+	data->make_silent ();
+	rb.put (data, DCPTime::from_seconds(5), 48000);
+	BOOST_CHECK (*rb.get(buffer, 2, 10) == DCPTime::from_seconds(5));
+	BOOST_CHECK (*rb.peek() == DCPTime::from_seconds(5) + DCPTime::from_frames(10, 48000));
+
+	/* We can't put more than will fit */
+	shared_ptr<AudioBuffers> big (new AudioBuffers (2, 75));
+	BOOST_CHECK_THROW (rb.put(big, DCPTime::from_seconds(5) + DCPTime::from_frames(64, 48000), 48000), ProgrammingError);
+}
@@ -33,15 +33,18 @@
 #include "lib/dcp_video.h"
 #include "lib/dcpomatic_log.h"
 #include "lib/encode_server.h"
+#include "lib/encode_server_connection.h"
 #include "lib/encode_server_description.h"
 #include "lib/file_log.h"
 #include "lib/image.h"
 #include "lib/j2k_image_proxy.h"
 #include "lib/player_video.h"
 #include "lib/raw_image_proxy.h"
+#include "lib/util.h"
 #include "test.h"
 #include <boost/test/unit_test.hpp>
 #include <boost/thread.hpp>
+#include <set>
 
 
 using std::list;
@@ -213,10 +216,12 @@ BOOST_AUTO_TEST_CASE (client_server_test_yuv)
 
 	/* "localhost" rather than "127.0.0.1" here fails on docker; go figure */
 	EncodeServerDescription description ("127.0.0.1", 2, SERVER_LINK_VERSION);
+	/* The same server, but sending the image and subtitle losslessly compressed */
+	EncodeServerDescription compressed ("127.0.0.1", 2, SERVER_LINK_VERSION, true);
 
 	list<thread*> threads;
 	for (int i = 0; i < 8; ++i) {
-		threads.push_back (new thread(boost::bind(do_remote_encode, frame, description, locally_encoded)));
+		threads.push_back (new thread(boost::bind(do_remote_encode, frame, (i % 2) ? description : compressed, locally_encoded)));
 	}
 
 	for (auto i: threads) {
@@ -325,3 +330,89 @@ BOOST_AUTO_TEST_CASE (client_server_test_j2k)
 	delete server_thread;
 	delete server;
 }
+
+
+/** Send several frames over one connection before collecting any of them */
+BOOST_AUTO_TEST_CASE (client_server_test_pipelined)
+{
+	auto image = make_shared<Image>(AV_PIX_FMT_RGB24, dcp::Size (1998, 1080), Image::Alignment::PADDED);
+	uint8_t* p = image->data()[0];
+
+	for (int y = 0; y < 1080; ++y) {
+		uint8_t* q = p;
+		for (int x = 0; x < 1998; ++x) {
+			*q++ = x % 256;
+			*q++ = y % 256;
+			*q++ = (x + y) % 256;
+		}
+		p += image->stride()[0];
+	}
+
+	LogSwitcher ls (make_shared<FileLog>("build/test/client_server_test_pipelined.log"));
+
+	auto pvf = std::make_shared<PlayerVideo>(
+		make_shared<RawImageProxy>(image),
+		Crop (),
+		optional<double> (),
+		dcp::Size (1998, 1080),
+		dcp::Size (1998, 1080),
+		Eyes::BOTH,
+		Part::WHOLE,
+		ColourConversion(),
+		VideoRange::FULL,
+		weak_ptr<Content>(),
+		optional<Frame>(),
+		false
+		);
+
+	auto locally_encoded = DCPVideo(pvf, 0, 24, 200000000, Resolution::TWO_K).encode_locally();
+
+	auto server = new EncodeServer (true, 2);
+
+	auto server_thread = new thread (boost::bind(&EncodeServer::run, server));
+
+	/* Let the server get itself ready */
+	dcpomatic_sleep_seconds (1);
+
+	/* "localhost" rather than "127.0.0.1" here fails on docker; go figure */
+	EncodeServerDescription description ("127.0.0.1", 2, SERVER_LINK_VERSION);
+
+	{
+		EncodeServerConnection connection (description, 1200);
+		BOOST_CHECK_EQUAL (connection.maximum_window(), 4);
+		BOOST_CHECK (!connection.last_encode_time());
+
+		struct timeval start;
+		gettimeofday (&start, 0);
+
+		for (int i = 0; i < 4; ++i) {
+			connection.send (DCPVideo(pvf, i, 24, 200000000, Resolution::TWO_K));
+		}
+		BOOST_CHECK_EQUAL (connection.in_flight(), 4);
+
+		std::set<int> indices;
+		for (int i = 0; i < 4; ++i) {
+			auto encoded = connection.collect ();
+			indices.insert (encoded.first.index());
+			BOOST_REQUIRE_EQUAL (locally_encoded.size(), encoded.second.size());
+			BOOST_CHECK_EQUAL (memcmp(locally_encoded.data(), encoded.second.data(), locally_encoded.size()), 0);
+		}
+
+		BOOST_CHECK_EQUAL (connection.in_flight(), 0);
+		BOOST_CHECK_EQUAL (indices.size(), 4U);
+		struct timeval end;
+		gettimeofday (&end, 0);
+
+		/* The server's encode time should not include any of the time that our frames spent
+		   waiting, so it must be less than the total time taken to get them all back.
+		*/
+		BOOST_REQUIRE (connection.last_encode_time());
+		BOOST_CHECK (*connection.last_encode_time() > 0);
+		BOOST_CHECK (*connection.last_encode_time() < seconds(end) - seconds(start));
+	}
+
+	server->stop ();
+	server_thread->join ();
+	delete server_thread;
+	delete server;
+}
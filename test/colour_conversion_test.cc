@@ -27,7 +27,11 @@
 
 #include "lib/colour_conversion.h"
 #include "lib/film.h"
+#include "lib/rgb_to_xyz.h"
+#include "lib/rng.h"
 #include <dcp/gamma_transfer_function.h>
+#include <dcp/openjpeg_image.h>
+#include <dcp/rgb_xyz.h>
 #include <libxml++/libxml++.h>
 #include <boost/test/unit_test.hpp>
 #include <iostream>
@@ -121,3 +125,28 @@ BOOST_AUTO_TEST_CASE (colour_conversion_test4)
 		BOOST_CHECK (ColourConversion::from_xml(in, Film::current_state_version).get() == i.conversion);
 	}
 }
+
+
+/** Check that our RGB to XYZ conversion gives the same results as libdcp's */
+BOOST_AUTO_TEST_CASE (colour_conversion_rgb_to_xyz_test)
+{
+	/* Odd width so that we test the end of each line, and some padding on each line */
+	dcp::Size const size (197, 31);
+	int const stride = size.width * 6 + 10;
+	std::vector<uint8_t> rgb (stride * size.height);
+	dcpomatic::RNG rng (42);
+	for (auto& i: rgb) {
+		i = rng.get() & 0xff;
+	}
+
+	for (auto const& i: PresetColourConversion::all()) {
+		int ours_clamped = 0;
+		auto ours = dcpomatic::rgb_to_xyz (rgb.data(), size, stride, i.conversion, [&ours_clamped](dcp::NoteType, std::string) { ++ours_clamped; });
+		int theirs_clamped = 0;
+		auto theirs = dcp::rgb_to_xyz (rgb.data(), size, stride, i.conversion, dcp::NoteHandler([&theirs_clamped](dcp::NoteType, std::string) { ++theirs_clamped; }));
+		BOOST_CHECK_EQUAL (ours_clamped, theirs_clamped);
+		for (int c = 0; c < 3; ++c) {
+			BOOST_CHECK (memcmp(ours->data(c), theirs->data(c), size.width * size.height * sizeof(int)) == 0);
+		}
+	}
+}
@@ -0,0 +1,117 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  test/decode_reduction_controller_test.cc
+ *  @brief Test DecodeReductionController.
+ *  @ingroup selfcontained
+ */
+
+
+#include "lib/decode_reduction_controller.h"
+#include <boost/test/unit_test.hpp>
+
+
+/** Run one second's worth of decodes (at 24fps) through a controller */
+static boost::optional<int>
+period (DecodeReductionController& controller, double& now, double decode, int dropped = 0)
+{
+	for (int i = 0; i < 24; ++i) {
+		controller.add_decode (decode);
+	}
+	for (int i = 0; i < dropped; ++i) {
+		controller.add_dropped ();
+	}
+	now += 1;
+	return controller.update (now, 0.1);
+}
+
+
+BOOST_AUTO_TEST_CASE (decode_reduction_controller_test)
+{
+	DecodeReductionController controller (2);
+	double now = 0;
+	controller.update (now, 0.1);
+
+	/* Keeping up comfortably at full resolution: no change */
+	BOOST_CHECK (!period(controller, now, 0.05));
+	BOOST_CHECK_EQUAL (controller.reduction(), 0);
+
+	/* Dropped frames make us reduce */
+	BOOST_CHECK_EQUAL (period(controller, now, 0.05, 5).get_value_or(-1), 1);
+	/* The next period is ignored as it includes frames from before the change */
+	BOOST_CHECK (!period(controller, now, 0.2));
+	/* Decodes taking longer than the budget make us reduce again */
+	BOOST_CHECK_EQUAL (period(controller, now, 0.2).get_value_or(-1), 2);
+	BOOST_CHECK (!period(controller, now, 0.2));
+	/* ...but not past the maximum */
+	BOOST_CHECK (!period(controller, now, 0.2));
+	BOOST_CHECK_EQUAL (controller.reduction(), 2);
+
+	/* Nothing happening (e.g. we are stopped): no change */
+	now += 1;
+	BOOST_CHECK (!controller.update(now, 0.1));
+
+	/* Plenty of headroom: we go back up, but only after a few periods */
+	BOOST_CHECK (!period(controller, now, 0.01));
+	BOOST_CHECK (!period(controller, now, 0.01));
+	BOOST_CHECK_EQUAL (period(controller, now, 0.01).get_value_or(-1), 1);
+	BOOST_CHECK (!period(controller, now, 0.01));
+
+	/* A drop resets the count of good periods */
+	BOOST_CHECK (!period(controller, now, 0.01));
+	BOOST_CHECK (!period(controller, now, 0.01, 1));
+	BOOST_CHECK (!period(controller, now, 0.01));
+	BOOST_CHECK (!period(controller, now, 0.01));
+	BOOST_CHECK_EQUAL (period(controller, now, 0.01).get_value_or(-1), 0);
+
+	/* Updates within a period do nothing */
+	controller.add_dropped ();
+	controller.add_dropped ();
+	controller.add_dropped ();
+	BOOST_CHECK (!controller.update(now + 0.5, 0.1));
+}
+
+
+BOOST_AUTO_TEST_CASE (decode_reduction_controller_reset_test)
+{
+	DecodeReductionController controller (2);
+	double now = 0;
+	controller.update (now, 0.1);
+
+	BOOST_CHECK_EQUAL (period(controller, now, 0.2).get_value_or(-1), 1);
+	/* Some good periods which would count towards going back up */
+	BOOST_CHECK (!period(controller, now, 0.01));
+	BOOST_CHECK (!period(controller, now, 0.01));
+	/* A drop in the current period which would make us reduce again */
+	controller.add_dropped ();
+	controller.add_dropped ();
+
+	controller.reset ();
+	BOOST_CHECK_EQUAL (controller.reduction(), 0);
+
+	/* The next update starts a new period rather than ending the old one */
+	now += 1;
+	BOOST_CHECK (!controller.update(now, 0.1));
+	/* and there is no settling period or leftover count of good periods */
+	BOOST_CHECK (!period(controller, now, 0.01));
+	BOOST_CHECK_EQUAL (controller.reduction(), 0);
+	BOOST_CHECK_EQUAL (period(controller, now, 0.2).get_value_or(-1), 1);
+}
@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  test/file_digest_test.cc
+ *  @brief Test dcpomatic::file_digest.
+ *  @ingroup selfcontained
+ */
+
+
+#include "lib/file_digest.h"
+#include <dcp/file.h>
+#include <dcp/util.h>
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+
+using std::vector;
+
+
+static boost::filesystem::path
+make_file (boost::filesystem::path path, int size)
+{
+	boost::filesystem::create_directories (path.parent_path());
+	vector<uint8_t> data (size);
+	for (int i = 0; i < size; ++i) {
+		data[i] = (i * 7 + i / 1000) & 0xff;
+	}
+	dcp::File f (path, "wb");
+	BOOST_REQUIRE (f);
+	if (size > 0) {
+		f.checked_write (data.data(), data.size());
+	}
+	return path;
+}
+
+
+/** Check that file_digest gives the same answer as libdcp for files which are
+ *  empty, smaller than one of its blocks, and spread over several blocks.
+ */
+BOOST_AUTO_TEST_CASE (file_digest_test)
+{
+	for (auto size: { 0, 1, 65536, 4 * 1024 * 1024, 19 * 1024 * 1024 + 17 }) {
+		auto file = make_file ("build/test/file_digest_test", size);
+		BOOST_CHECK_EQUAL (dcpomatic::file_digest(file, {}), dcp::make_digest(file, {}));
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE (file_digest_progress_test)
+{
+	auto file = make_file ("build/test/file_digest_progress_test", 19 * 1024 * 1024);
+
+	float last = 0;
+	dcpomatic::file_digest (file, [&last](float progress) {
+		BOOST_CHECK (progress >= last);
+		last = progress;
+	});
+	BOOST_CHECK_CLOSE (last, 1, 0.1);
+
+	/* Stopping part-way through should not leave anything behind */
+	BOOST_CHECK_THROW (
+		dcpomatic::file_digest(file, [](float progress) {
+			if (progress > 0.3) {
+				throw std::runtime_error ("stop");
+			}
+		}),
+		std::runtime_error
+		);
+}
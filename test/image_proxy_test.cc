@@ -23,6 +23,7 @@
 #include "lib/j2k_image_proxy.h"
 #include "test.h"
 #include <boost/test/unit_test.hpp>
+#include <vector>
 
 
 using std::make_shared;
@@ -66,3 +67,34 @@ BOOST_AUTO_TEST_CASE (ffmpeg_image_proxy_same_test)
 	}
 }
 
+
+/** Check pack_row() against a simple loop, at widths which leave some pixels over after
+ *  any SIMD blocks and with the largest 12-bit samples.
+ */
+BOOST_AUTO_TEST_CASE (j2k_image_proxy_pack_row_test)
+{
+	for (int width: { 1, 7, 8, 9, 15, 16, 17, 1998, 2047 }) {
+		std::vector<int> in[3];
+		for (int c = 0; c < 3; ++c) {
+			in[c].resize (width);
+			for (int x = 0; x < width; ++x) {
+				/* Mostly 4095, with some other values to check that samples end up in the right place */
+				in[c][x] = (x % 3 == c) ? 4095 : ((x * 37 + c * 1001) & 0xfff);
+			}
+		}
+
+		for (int shift: { 0, 4 }) {
+			/* Guard values after the end of the row, to check that nothing is written there */
+			std::vector<uint16_t> out (width * 3 + 8, 0xabcd);
+			dcpomatic::pack_row (in[0].data(), in[1].data(), in[2].data(), out.data(), width, shift);
+			for (int x = 0; x < width; ++x) {
+				for (int c = 0; c < 3; ++c) {
+					BOOST_REQUIRE_EQUAL (out[x * 3 + c], static_cast<uint16_t>(in[c][x] << shift));
+				}
+			}
+			for (int i = width * 3; i < width * 3 + 8; ++i) {
+				BOOST_REQUIRE_EQUAL (out[i], 0xabcd);
+			}
+		}
+	}
+}
@@ -28,9 +28,11 @@
 
 #include "lib/compose.hpp"
 #include "lib/image.h"
+#include "lib/image_compression.h"
 #include "lib/image_content.h"
 #include "lib/image_decoder.h"
 #include "lib/image_jpeg.h"
+#include "lib/image_pool.h"
 #include "lib/image_png.h"
 #include "lib/ffmpeg_image_proxy.h"
 #include "test.h"
@@ -41,6 +43,7 @@
 using std::cout;
 using std::list;
 using std::make_shared;
+using std::shared_ptr;
 using std::string;
 
 
@@ -285,6 +288,70 @@ BOOST_AUTO_TEST_CASE (crop_scale_window_test)
 }
 
 
+/** Check that Image::crop_scale_window gives the same result when it is split into slices */
+BOOST_AUTO_TEST_CASE (crop_scale_window_slices_test)
+{
+	/* A source with something different in every pixel */
+	dcp::Size const size (1998, 1080);
+	auto raw = make_shared<Image>(AV_PIX_FMT_RGB24, size, Image::Alignment::PADDED);
+	for (int y = 0; y < size.height; ++y) {
+		auto p = raw->data()[0] + y * raw->stride()[0];
+		for (int x = 0; x < size.width; ++x) {
+			*p++ = x * 255 / size.width;
+			*p++ = y * 255 / size.height;
+			*p++ = (x * 7 + y * 13) & 0xff;
+		}
+	}
+
+	auto scale = [raw](Crop crop, dcp::Size inter_size, AVPixelFormat out_format, int slices) {
+		return raw->crop_scale_window(
+			crop, inter_size, dcp::Size(1998, 1080), dcp::YUVToRGB::REC709, VideoRange::FULL, out_format, VideoRange::FULL, Image::Alignment::PADDED, false, slices
+			);
+	};
+
+	auto compare = [](shared_ptr<const Image> reference, shared_ptr<const Image> sliced, int tolerance, int slices) {
+		for (int c = 0; c < reference->planes(); ++c) {
+			for (int y = 0; y < reference->sample_size(c).height; ++y) {
+				auto p = reference->data()[c] + y * reference->stride()[c];
+				auto q = sliced->data()[c] + y * sliced->stride()[c];
+				for (int x = 0; x < reference->line_size()[c]; ++x) {
+					BOOST_REQUIRE_MESSAGE (std::abs(p[x] - q[x]) <= tolerance, "plane " << c << " at (" << x << "," << y << ") with " << slices << " slices");
+				}
+			}
+		}
+	};
+
+	/* Each output line only depends on one input line when there is no vertical scaling and
+	   no vertical chroma subsampling, so slicing should make no difference at all.
+	*/
+	{
+		Crop const crop (6, 12, 0, 0);
+		auto reference = scale (crop, dcp::Size(1998, 1080), AV_PIX_FMT_RGB24, 1);
+		for (auto slices: { 2, 3, 8 }) {
+			compare (reference, scale(crop, dcp::Size(1998, 1080), AV_PIX_FMT_RGB24, slices), 0, slices);
+		}
+	}
+
+	/* With vertical scaling each slice is scaled on its own, so lines can be very slightly
+	   different; use a smooth source so that we can check that the difference is small.
+	*/
+	for (int y = 0; y < size.height; ++y) {
+		auto p = raw->data()[0] + y * raw->stride()[0];
+		for (int x = 0; x < size.width; ++x) {
+			p[x * 3 + 2] = (x + y) * 255 / (size.width + size.height);
+		}
+	}
+
+	{
+		Crop const crop (0, 0, 12, 6);
+		auto reference = scale (crop, dcp::Size(1998, 836), AV_PIX_FMT_YUV420P, 1);
+		for (auto slices: { 2, 3, 8 }) {
+			compare (reference, scale(crop, dcp::Size(1998, 836), AV_PIX_FMT_YUV420P, slices), 2, slices);
+		}
+	}
+}
+
+
 /** Special cases of Image::crop_scale_window which triggered some valgrind warnings */
 BOOST_AUTO_TEST_CASE (crop_scale_window_test2)
 {
@@ -592,3 +659,106 @@ BOOST_AUTO_TEST_CASE (over_crop_test)
 	write_image (scaled, "build/test/" + filename);
 	check_image ("test/data/" + filename, "build/test/" + filename);
 }
+
+
+/** Check that images which we send to encoding servers come back the same after lossless compression */
+BOOST_AUTO_TEST_CASE (lossless_compression_test)
+{
+	for (auto format: { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV444P16LE, AV_PIX_FMT_BGRA }) {
+		BOOST_REQUIRE (can_compress_image_losslessly(format));
+
+		/* A frame which is compressed in slices, and a subtitle-sized image which is not */
+		for (auto size: { dcp::Size(1998, 1080), dcp::Size(40, 18) }) {
+			auto image = make_shared<Image>(format, size, Image::Alignment::PADDED);
+			for (int i = 0; i < image->planes(); ++i) {
+				uint8_t* p = image->data()[i];
+				for (int y = 0; y < image->sample_size(i).height; ++y) {
+					for (int x = 0; x < image->line_size()[i]; ++x) {
+						p[x] = (x * 7 + y * 3) % 256;
+					}
+					p += image->stride()[i];
+				}
+			}
+
+			auto compressed = compress_image_losslessly (image);
+			if (size.width > 1000) {
+				BOOST_CHECK (compressed.size() < image->sample_size(0).height * image->line_size()[0]);
+			}
+
+			auto decompressed = decompress_image_losslessly (compressed, format, image->size(), Image::Alignment::PADDED);
+			BOOST_CHECK (*image == *decompressed);
+		}
+	}
+
+	BOOST_CHECK (can_decompress_images_losslessly());
+	BOOST_CHECK (!can_compress_image_losslessly(AV_PIX_FMT_XYZ12LE));
+}
+
+
+BOOST_AUTO_TEST_CASE (image_pool_test)
+{
+	auto pool = ImagePool::instance ();
+	pool->clear ();
+	BOOST_CHECK_EQUAL (pool->resident(), 0U);
+
+	uint8_t* data = nullptr;
+	{
+		Image image (AV_PIX_FMT_RGB24, dcp::Size(123, 45), Image::Alignment::PADDED);
+		data = image.data()[0];
+	}
+	BOOST_CHECK (pool->resident() > 0U);
+
+	{
+		/* Different size, so this can't use the buffer that we just finished with */
+		Image image (AV_PIX_FMT_RGB24, dcp::Size(124, 45), Image::Alignment::PADDED);
+		BOOST_CHECK (image.data()[0] != data);
+	}
+
+	auto const hits = pool->hits ();
+	Image image (AV_PIX_FMT_RGB24, dcp::Size(123, 45), Image::Alignment::PADDED);
+	BOOST_CHECK_EQUAL (pool->hits(), hits + 1);
+	BOOST_CHECK (image.data()[0] == data);
+
+	/* Reducing the maximum size frees things */
+	auto const maximum = pool->maximum_resident ();
+	pool->set_maximum_resident (0);
+	BOOST_CHECK_EQUAL (pool->resident(), 0U);
+	pool->set_maximum_resident (maximum);
+}
+
+
+/** Check that crop_scale_window() makes its borders black even if its output image re-uses
+ *  a buffer which already has something in it.
+ */
+BOOST_AUTO_TEST_CASE (crop_scale_window_borders_test)
+{
+	auto in = make_shared<Image>(AV_PIX_FMT_RGB24, dcp::Size(640, 480), Image::Alignment::PADDED);
+	memset (in->data()[0], 0xff, in->stride()[0] * in->size().height);
+
+	for (auto inter: { dcp::Size(800, 400), dcp::Size(600, 600) }) {
+		{
+			/* Leave something which isn't black for the next 800x600 image to find */
+			Image dirty (AV_PIX_FMT_RGB24, dcp::Size(800, 600), Image::Alignment::COMPACT);
+			memset (dirty.data()[0], 0xff, dirty.stride()[0] * dirty.size().height);
+		}
+
+		auto out = in->crop_scale_window(
+			Crop(), inter, dcp::Size(800, 600), dcp::YUVToRGB::REC709, VideoRange::FULL, AV_PIX_FMT_RGB24, VideoRange::FULL, Image::Alignment::COMPACT, false
+			);
+
+		int const left = (800 - inter.width) / 2;
+		int const top = (600 - inter.height) / 2;
+
+		for (int y = 0; y < 600; ++y) {
+			auto p = out->data()[0] + y * out->stride()[0];
+			for (int x = 0; x < 800; ++x) {
+				bool const inside = x >= left && x < (left + inter.width) && y >= top && y < (top + inter.height);
+				if (inside) {
+					BOOST_REQUIRE_MESSAGE (p[x * 3] > 0xf0, "at (" << x << "," << y << ")");
+				} else {
+					BOOST_REQUIRE_MESSAGE (p[x * 3] == 0, "at (" << x << "," << y << ")");
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  test/j2k_cache_test.cc
+ *  @brief Test J2KCache.
+ *  @ingroup selfcontained
+ */
+
+
+#include "lib/j2k_cache.h"
+#include <boost/test/unit_test.hpp>
+#include <ctime>
+
+
+static dcp::ArrayData
+make_data (int size, uint8_t value)
+{
+	dcp::ArrayData data (size);
+	memset (data.data(), value, size);
+	return data;
+}
+
+
+BOOST_AUTO_TEST_CASE (j2k_cache_test1)
+{
+	boost::filesystem::path dir = "build/test/j2k_cache_test1";
+	boost::filesystem::remove_all (dir);
+
+	{
+		J2KCache cache (dir, 3000);
+		BOOST_CHECK (!cache.get("00000000000000000000000000000000"));
+
+		cache.put ("00000000000000000000000000000000", make_data(1000, 0));
+		cache.put ("11111111111111111111111111111111", make_data(1000, 1));
+		cache.put ("22222222222222222222222222222222", make_data(1000, 2));
+		BOOST_CHECK_EQUAL (cache.size(), 3000U);
+
+		auto got = cache.get ("11111111111111111111111111111111");
+		BOOST_REQUIRE (got);
+		BOOST_REQUIRE_EQUAL (got->size(), 1000);
+		BOOST_CHECK_EQUAL (got->data()[0], 1);
+		BOOST_CHECK_EQUAL (got->data()[999], 1);
+
+		/* Use 0 so that 2 is now the least recently used, then add something to push it out */
+		BOOST_CHECK (cache.get("00000000000000000000000000000000"));
+		cache.put ("33333333333333333333333333333333", make_data(1000, 3));
+		BOOST_CHECK_EQUAL (cache.size(), 3000U);
+		BOOST_CHECK (!cache.get("22222222222222222222222222222222"));
+		BOOST_CHECK (cache.get("00000000000000000000000000000000"));
+		BOOST_CHECK (cache.get("11111111111111111111111111111111"));
+		BOOST_CHECK (cache.get("33333333333333333333333333333333"));
+	}
+
+	/* The frames should still be there for a new cache in the same directory, and a
+	   smaller maximum size should make it throw away the least recently used.  Everything
+	   above probably happened within the same second, so give the files distinct times
+	   to say which that is.
+	*/
+	auto const now = time(nullptr);
+	boost::filesystem::last_write_time (dir / "11" / "11111111111111111111111111111111", now - 30);
+	boost::filesystem::last_write_time (dir / "00" / "00000000000000000000000000000000", now - 20);
+	boost::filesystem::last_write_time (dir / "33" / "33333333333333333333333333333333", now - 10);
+
+	J2KCache cache (dir, 2000);
+	BOOST_CHECK_EQUAL (cache.size(), 2000U);
+	BOOST_CHECK (!boost::filesystem::exists(dir / "11" / "11111111111111111111111111111111"));
+	BOOST_CHECK (cache.get("00000000000000000000000000000000"));
+	auto got = cache.get ("33333333333333333333333333333333");
+	BOOST_REQUIRE (got);
+	BOOST_CHECK_EQUAL (got->data()[0], 3);
+}
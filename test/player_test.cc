@@ -43,6 +43,7 @@
 #include "test.h"
 #include <boost/test/unit_test.hpp>
 #include <boost/algorithm/string.hpp>
+#include <cmath>
 #include <iostream>
 
 
@@ -466,3 +467,63 @@ BOOST_AUTO_TEST_CASE (player_silence_at_end_crash)
 	film2->set_video_frame_rate (24);
 	make_and_verify_dcp (film2);
 }
+
+
+/** Check that the audio from a Player is the same when it is ignoring video (so that DCP decoders
+ *  do several frames of audio per pass, FFmpeg decoders discard the streams that are not used,
+ *  and silence is made in bigger pieces) as when it is not.
+ */
+BOOST_AUTO_TEST_CASE (player_audio_only_test)
+{
+	/* A DCP with some audio, to import */
+	auto red = content_factory("test/data/flat_red.png").front();
+	auto sine = content_factory("test/data/sine_440.wav").front();
+	auto dcp_film = new_test_film2 ("player_audio_only_test_dcp", {red, sine});
+	red->video->set_length (24 * 3);
+	make_and_verify_dcp (dcp_film);
+
+	/* The DCP, then a gap, then something with video and audio streams */
+	auto dcp = make_shared<DCPContent>(dcp_film->dir(dcp_film->dcp_name()));
+	auto boon = content_factory(TestPaths::private_data() / "boon_telly.mkv").front();
+	auto film = new_test_film2 ("player_audio_only_test", {dcp, boon});
+	boon->set_position (film, dcp->end(film) + DCPTime::from_seconds(1));
+	auto const end = boon->position() + DCPTime::from_seconds(4);
+
+	auto get = [film, end](bool audio_only, DCPTime start) {
+		auto player = make_shared<Player>(film, Image::Alignment::COMPACT);
+		if (audio_only) {
+			player->set_ignore_video ();
+			player->set_ignore_text ();
+		}
+		if (start != DCPTime()) {
+			player->seek (start, true);
+		}
+
+		auto all = make_shared<AudioBuffers>(film->audio_channels(), 0);
+		auto next = start;
+		player->Audio.connect ([&all, &next](shared_ptr<AudioBuffers> audio, DCPTime time, int frame_rate) {
+			BOOST_REQUIRE (labs(time.get() - next.get()) < 2);
+			all->append (audio);
+			next = time + DCPTime::from_frames(audio->frames(), frame_rate);
+		});
+		while (next < end && !player->pass()) {}
+		return all;
+	};
+
+	auto compare = [film, end](shared_ptr<AudioBuffers> reference, shared_ptr<AudioBuffers> check, DCPTime start) {
+		auto const frames = (end - start).frames_floor(film->audio_frame_rate());
+		BOOST_REQUIRE (reference->frames() >= frames);
+		BOOST_REQUIRE (check->frames() >= frames);
+		for (int c = 0; c < reference->channels(); ++c) {
+			for (int i = 0; i < frames; ++i) {
+				BOOST_REQUIRE_MESSAGE (std::abs(reference->data(c)[i] - check->data(c)[i]) < 1e-6, "channel " << c << " frame " << i);
+			}
+		}
+	};
+
+	compare (get(false, DCPTime()), get(true, DCPTime()), DCPTime());
+
+	/* And after a seek into the FFmpeg content, which seeks using a different stream when video is not wanted */
+	auto const seek = boon->position() + DCPTime::from_seconds(2);
+	compare (get(false, seek), get(true, seek), seek);
+}
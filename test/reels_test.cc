@@ -25,6 +25,7 @@
  */
 
 
+#include "lib/config.h"
 #include "lib/content_factory.h"
 #include "lib/dcp_content.h"
 #include "lib/dcp_content_type.h"
@@ -233,6 +234,40 @@ BOOST_AUTO_TEST_CASE (reels_test4)
 }
 
 
+/** As reels_test4 but with the reels' video decoded in parallel; the DCP should be the same */
+BOOST_AUTO_TEST_CASE (reels_test4_parallel)
+{
+	auto film = new_test_film2 ("reels_test4_parallel");
+	film->set_reel_type (ReelType::BY_VIDEO_CONTENT);
+	film->set_interop (false);
+
+	shared_ptr<ImageContent> content[4];
+	for (int i = 0; i < 4; ++i) {
+		content[i].reset (new ImageContent("test/data/flat_green.png"));
+		film->examine_and_add_content (content[i]);
+		BOOST_REQUIRE (!wait_for_jobs());
+		content[i]->video->set_length (24);
+	}
+
+	auto subs = make_shared<StringTextFileContent>("test/data/subrip3.srt");
+	film->examine_and_add_content (subs);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	ConfigRestorer cr;
+	Config::instance()->set_parallel_reels (3);
+
+	make_and_verify_dcp (
+		film,
+		{
+			dcp::VerificationNote::Code::MISSING_SUBTITLE_LANGUAGE,
+			dcp::VerificationNote::Code::INVALID_SUBTITLE_FIRST_TEXT_TIME,
+			dcp::VerificationNote::Code::INVALID_SUBTITLE_DURATION
+		});
+
+	check_dcp ("test/data/reels_test4", film->dir (film->dcp_name()));
+}
+
+
 BOOST_AUTO_TEST_CASE (reels_test5)
 {
 	auto dcp = make_shared<DCPContent>("test/data/reels_test4");
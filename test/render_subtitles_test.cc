@@ -19,10 +19,11 @@
 */
 
 /** @file  test/render_text_test.cc
- *  @brief Check markup of subtitles for rendering.
+ *  @brief Check markup and rendering of subtitles.
  *  @ingroup feature
  */
 
+#include "lib/image.h"
 #include "lib/render_text.h"
 #include <dcp/subtitle_string.h>
 #include <boost/test/unit_test.hpp>
@@ -110,3 +111,64 @@ BOOST_AUTO_TEST_CASE (render_markup_test6)
 	add (s, "we are bold.", false, true, false);
 	BOOST_CHECK_EQUAL (marked_up(s, 1024, 1, ""), "<span style=\"italic\" size=\"41472\" alpha=\"65535\" color=\"#FFFFFF\">Hello</span><span size=\"41472\" alpha=\"65535\" color=\"#FFFFFF\"> world </span><span weight=\"bold\" size=\"41472\" alpha=\"65535\" color=\"#FFFFFF\">we are bold.</span>");
 }
+
+
+/** Check that render_text() re-uses lines that it has already rendered, and that it
+ *  fades them correctly.
+ */
+BOOST_AUTO_TEST_CASE (render_text_cache_test)
+{
+	std::list<StringText> s;
+	s.push_back (
+		StringText (
+			dcp::SubtitleString (
+				boost::optional<std::string> (),
+				false,
+				false,
+				false,
+				dcp::Colour (255, 255, 255),
+				42,
+				1,
+				dcp::Time (0, 0, 0, 0, 24),
+				dcp::Time (0, 0, 5, 0, 24),
+				0.5,
+				dcp::HAlign::CENTER,
+				0.1,
+				dcp::VAlign::BOTTOM,
+				dcp::Direction::LTR,
+				"Hello world",
+				dcp::Effect::NONE,
+				dcp::Colour (0, 0, 0),
+				dcp::Time (0, 0, 1, 0, 24),
+				dcp::Time (),
+				0
+				),
+			2
+			)
+		);
+
+	auto const size = dcp::Size (1998, 1080);
+	auto const fonts = std::list<std::shared_ptr<dcpomatic::Font>>();
+
+	auto first = render_text (s, fonts, size, dcpomatic::DCPTime::from_seconds(2), 24);
+	auto second = render_text (s, fonts, size, dcpomatic::DCPTime::from_seconds(3), 24);
+	BOOST_REQUIRE_EQUAL (first.size(), 1U);
+	BOOST_REQUIRE_EQUAL (second.size(), 1U);
+	BOOST_CHECK (first.front().image == second.front().image);
+
+	/* Half-way through the fade up */
+	auto half = render_text (s, fonts, size, dcpomatic::DCPTime::from_seconds(0.5), 24);
+	BOOST_REQUIRE_EQUAL (half.size(), 1U);
+	BOOST_CHECK (half.front().position == first.front().position);
+
+	auto full_image = first.front().image;
+	auto half_image = half.front().image;
+	BOOST_REQUIRE (full_image->size() == half_image->size());
+	for (int y = 0; y < full_image->size().height; ++y) {
+		auto p = full_image->data()[0] + y * full_image->stride()[0];
+		auto q = half_image->data()[0] + y * half_image->stride()[0];
+		for (int x = 0; x < full_image->size().width * 4; ++x) {
+			BOOST_REQUIRE (std::abs(q[x] - p[x] / 2) <= 1);
+		}
+	}
+}
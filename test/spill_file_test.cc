@@ -0,0 +1,124 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  test/spill_file_test.cc
+ *  @brief Test SpillFile.
+ *  @ingroup selfcontained
+ */
+
+
+#include "lib/spill_file.h"
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+
+static dcp::ArrayData
+make_data (int size, uint8_t value)
+{
+	dcp::ArrayData data (size);
+	memset (data.data(), value, size);
+	return data;
+}
+
+
+BOOST_AUTO_TEST_CASE (spill_file_test)
+{
+	boost::filesystem::path path = "build/test/spill_file_test";
+	boost::filesystem::create_directories (path.parent_path());
+
+	{
+		SpillFile spill (path);
+
+		auto a = spill.append (make_data(1000, 1));
+		auto b = spill.append (make_data(500, 2));
+		auto c = spill.append (make_data(2000, 3));
+		BOOST_CHECK_EQUAL (spill.waiting(), 3);
+		BOOST_CHECK_EQUAL (b.offset, 1000);
+
+		/* Frames can be read back in any order */
+		auto got = spill.read (b);
+		BOOST_REQUIRE_EQUAL (got->size(), 500);
+		BOOST_CHECK_EQUAL (got->data()[0], 2);
+		BOOST_CHECK_EQUAL (got->data()[499], 2);
+
+		got = spill.read (c);
+		BOOST_REQUIRE_EQUAL (got->size(), 2000);
+		BOOST_CHECK_EQUAL (got->data()[1999], 3);
+
+		got = spill.read (a);
+		BOOST_REQUIRE_EQUAL (got->size(), 1000);
+		BOOST_CHECK_EQUAL (got->data()[0], 1);
+		BOOST_CHECK_EQUAL (spill.waiting(), 0);
+
+		/* Now that everything has been read the file should be re-used from the start */
+		auto d = spill.append (make_data(100, 4));
+		BOOST_CHECK_EQUAL (d.offset, 0);
+		BOOST_CHECK_EQUAL (spill.read(d)->data()[99], 4);
+		BOOST_CHECK_EQUAL (spill.maximum_length(), 3500);
+
+		BOOST_CHECK (boost::filesystem::exists(path));
+	}
+
+	BOOST_CHECK (!boost::filesystem::exists(path));
+}
+
+
+/** Check that space is re-used while some frames are still waiting, as they will be
+ *  for as long as the Writer is stuck behind one missing frame.
+ */
+BOOST_AUTO_TEST_CASE (spill_file_reuse_test)
+{
+	boost::filesystem::path path = "build/test/spill_file_reuse_test";
+	boost::filesystem::create_directories (path.parent_path());
+
+	SpillFile spill (path);
+
+	/* This frame stays waiting throughout */
+	auto stuck = spill.append (make_data(100, 1));
+
+	std::vector<SpillFile::Extent> extents;
+	for (int i = 0; i < 4; ++i) {
+		extents.push_back (spill.append(make_data(1000, 2)));
+	}
+
+	for (int i = 0; i < 1000; ++i) {
+		auto const value = static_cast<uint8_t>(i);
+		auto got = spill.read (extents.front());
+		BOOST_REQUIRE_EQUAL (got->size(), 1000);
+		extents.erase (extents.begin());
+		extents.push_back (spill.append(make_data(1000, value)));
+		BOOST_CHECK_EQUAL (spill.read(extents.back())->data()[999], value);
+		extents.back() = spill.append (make_data(1000, value));
+	}
+
+	BOOST_CHECK_EQUAL (spill.waiting(), 5);
+	BOOST_CHECK_EQUAL (spill.maximum_length(), 100 + 4 * 1000);
+
+	/* Neighbouring gaps should be merged so that a bigger frame fits into them */
+	spill.read (extents[1]);
+	spill.read (extents[2]);
+	auto big = spill.append (make_data(2000, 3));
+	BOOST_CHECK_EQUAL (big.offset, extents[1].offset);
+	BOOST_CHECK_EQUAL (spill.maximum_length(), 100 + 4 * 1000);
+	BOOST_CHECK_EQUAL (spill.read(big)->data()[1999], 3);
+
+	BOOST_CHECK_EQUAL (spill.read(stuck)->data()[0], 1);
+}
@@ -26,6 +26,7 @@
 
 
 #include "lib/audio_buffers.h"
+#include "lib/audio_filter.h"
 #include "lib/dcp_content_type.h"
 #include "lib/ffmpeg_content.h"
 #include "lib/film.h"
@@ -35,10 +36,13 @@
 #include "test.h"
 #include <sndfile.h>
 #include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <vector>
 
 
 using std::make_shared;
 using std::shared_ptr;
+using std::vector;
 #if BOOST_VERSION >= 106100
 using namespace boost::placeholders;
 #endif
@@ -107,3 +111,69 @@ BOOST_AUTO_TEST_CASE (upmixer_a_test)
 	check_wav_file ("test/data/upmixer_a_test/Ls.wav", "build/test/upmixer_a_test/Ls.wav");
 	check_wav_file ("test/data/upmixer_a_test/Rs.wav", "build/test/upmixer_a_test/Rs.wav");
 }
+
+
+/** UpmixerA's filters are long enough to be run by FFT convolution; check its output against
+ *  direct convolution of its input with the impulse responses of those filters.
+ */
+BOOST_AUTO_TEST_CASE (upmixer_a_convolution_test)
+{
+	int const rate = 48000;
+
+	auto impulse_response = [](AudioFilter&& filter) {
+		auto in = make_shared<AudioBuffers>(1, 1024);
+		in->make_silent ();
+		in->data(0)[0] = 1;
+		auto out = filter.run (in);
+		return vector<float>(out->data(0), out->data(0) + out->frames());
+	};
+
+	vector<vector<float>> kernels = {
+		impulse_response (BandPassAudioFilter(0.02, 1900.0 / rate, 4800.0 / rate)),
+		impulse_response (BandPassAudioFilter(0.02, 1900.0 / rate, 4800.0 / rate)),
+		impulse_response (BandPassAudioFilter(0.01, 150.0 / rate, 1900.0 / rate)),
+		impulse_response (LowPassAudioFilter(0.01, 150.0 / rate)),
+		impulse_response (BandPassAudioFilter(0.02, 4800.0 / rate, 20000.0 / rate)),
+		impulse_response (BandPassAudioFilter(0.02, 4800.0 / rate, 20000.0 / rate))
+	};
+
+	UpmixerA upmixer (rate);
+
+	srand (1);
+	vector<vector<float>> input (6);
+	vector<vector<float>> output (6);
+	for (auto frames: { 1, 17, 300, 4096, 2, 8000 }) {
+		auto in = make_shared<AudioBuffers>(2, frames);
+		for (int i = 0; i < frames; ++i) {
+			auto const L = float(rand()) / RAND_MAX - 0.5f;
+			auto const R = float(rand()) / RAND_MAX - 0.5f;
+			in->data(0)[i] = L;
+			in->data(1)[i] = R;
+			/* Inputs to each of the upmixer's filters */
+			for (auto c: { 0, 4 }) {
+				input[c].push_back (L);
+			}
+			for (auto c: { 1, 5 }) {
+				input[c].push_back (R);
+			}
+			for (auto c: { 2, 3 }) {
+				input[c].push_back ((L + R) * pow(10, -6.0 / 20));
+			}
+		}
+
+		auto out = upmixer.run (in, 6);
+		for (int c = 0; c < 6; ++c) {
+			output[c].insert (output[c].end(), out->data(c), out->data(c) + frames);
+		}
+	}
+
+	for (int c = 0; c < 6; ++c) {
+		for (size_t i = 0; i < input[c].size(); ++i) {
+			double s = 0;
+			for (size_t k = 0; k < kernels[c].size() && k <= i; ++k) {
+				s += input[c][i - k] * kernels[c][k];
+			}
+			BOOST_REQUIRE_SMALL (output[c][i] - s, 1e-5);
+		}
+	}
+}
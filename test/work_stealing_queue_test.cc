@@ -0,0 +1,121 @@
+/*
+    Copyright (C) 2021 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/** @file  test/work_stealing_queue_test.cc
+ *  @brief Test WorkStealingQueue.
+ *  @ingroup selfcontained
+ */
+
+
+#include "lib/work_stealing_queue.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <set>
+
+
+using std::set;
+
+
+BOOST_AUTO_TEST_CASE (work_stealing_queue_test1)
+{
+	WorkStealingQueue<int> queue;
+	queue.set_workers (2);
+
+	for (int i = 0; i < 6; ++i) {
+		queue.push (i);
+	}
+	BOOST_CHECK_EQUAL (queue.size(), 6);
+
+	/* Worker 0 should be able to take everything, stealing from worker 1 when it has to */
+	set<int> taken;
+	for (int i = 0; i < 6; ++i) {
+		auto item = queue.try_pop (0);
+		BOOST_REQUIRE (item);
+		taken.insert (*item);
+	}
+
+	BOOST_CHECK_EQUAL (taken.size(), 6U);
+	BOOST_CHECK_EQUAL (queue.size(), 0);
+	BOOST_CHECK (!queue.try_pop(1));
+	BOOST_CHECK (!queue.pop(1, boost::posix_time::milliseconds(50)));
+}
+
+
+BOOST_AUTO_TEST_CASE (work_stealing_queue_test2)
+{
+	WorkStealingQueue<int> queue;
+	queue.set_workers (2);
+
+	queue.push (1);
+	queue.push (2);
+	queue.push_front (0);
+
+	/* Changing the number of workers keeps what was there */
+	queue.set_workers (3);
+	BOOST_CHECK_EQUAL (queue.size(), 3);
+
+	auto all = queue.take_all ();
+	BOOST_CHECK_EQUAL (all.size(), 3U);
+	BOOST_CHECK_EQUAL (queue.size(), 0);
+}
+
+
+BOOST_AUTO_TEST_CASE (work_stealing_queue_test3)
+{
+	WorkStealingQueue<int> queue;
+	queue.set_workers (4);
+
+	int const N = 10000;
+	boost::mutex mutex;
+	set<int> taken;
+
+	boost::thread_group threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.create_thread ([&queue, &mutex, &taken, i]() {
+			try {
+				while (true) {
+					auto item = queue.pop (i);
+					boost::mutex::scoped_lock lm (mutex);
+					taken.insert (item);
+				}
+			} catch (boost::thread_interrupted &) {}
+		});
+	}
+
+	for (int i = 0; i < N; ++i) {
+		queue.push (i);
+	}
+
+	while (true) {
+		{
+			boost::mutex::scoped_lock lm (mutex);
+			if (static_cast<int>(taken.size()) == N) {
+				break;
+			}
+		}
+		boost::this_thread::sleep (boost::posix_time::milliseconds(10));
+	}
+
+	threads.interrupt_all ();
+	threads.join_all ();
+
+	BOOST_CHECK_EQUAL (queue.size(), 0);
+}